@@ -0,0 +1,63 @@
+/* A plugin to try "Run plugins apart?" with. It uses no GTK+, so it can
+ * be run by amcl-pluginhost: it counts the lines and prompts the mud
+ * sends, and says so every 100 lines. Typing "slowdown" has it take two
+ * seconds over the command, as a slow plugin would; loaded into amcl
+ * that stops everything for as long, run apart only the plugin waits,
+ * and what it misses meanwhile is dropped.
+ *
+ * Build it with make, copy apart.plugin to ~/.amcl/plugins/, check "Run
+ * plugins apart?" in the preferences and start amcl again.
+ */
+#define __MODULE__
+#include <gtk/gtk.h>
+#include <glib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../../src/modules_api.h"
+
+static void init_plugin   (PLUGIN_OBJECT *, gint);
+
+PLUGIN_INFO amcl_plugin_info =
+{
+    "Apart Plugin",
+    "Robin Ericsson",
+    "1.0",
+    "Counts lines and prompts, and can be slow. Made to be run apart.",
+    init_plugin,
+};
+
+static gint lines;
+static gint prompts;
+
+void init_plugin(PLUGIN_OBJECT *plugin, gint context)
+{
+  lines = prompts = 0;
+
+  plugin_register_data_outgoing(context, "data_out_function");
+
+  if (plugin_api_version() >= 2)
+    plugin_register_line(context, "line_function");
+}
+
+void data_out_function(PLUGIN_OBJECT *plugin, CONNECTION_DATA *connection, gchar *data, gint context)
+{
+  if (strcmp(data, "slowdown"))
+    return;
+
+  plugin_add_connection_text(connection, "Apart Plugin: taking two seconds.\n", MESSAGE_NORMAL);
+  sleep(2);
+}
+
+gint line_function(PLUGIN_OBJECT *plugin, PLUGIN_LINE *line, gint context)
+{
+  gchar buf[80];
+
+  if (line->prompt)
+    prompts++;
+  else if (++lines % 100 == 0) {
+    g_snprintf(buf, 80, "Apart Plugin: %d lines, %d prompts.\n", lines, prompts);
+    plugin_add_connection_text(line->connection, buf, MESSAGE_NORMAL);
+  }
+
+  return PLUGIN_LINE_PASS;
+}
@@ -20,6 +20,9 @@ void init_plugin(PLUGIN_OBJECT *plugin, gint context)
   //plugin_popup_message ("TEsting testing\n0h0h0h0h");
   plugin_register_menu(context, "Test Plugin", "menu_function");
   plugin_register_data_incoming(context, "data_in_function");
+
+  if (plugin_api_version() >= 2)
+    plugin_register_line(context, "line_function");
 }
 
 void data_in_function(PLUGIN_OBJECT *plugin, CONNECTION_DATA *connection, gchar *data, gint context)
@@ -27,6 +30,14 @@ void data_in_function(PLUGIN_OBJECT *plugin, CONNECTION_DATA *connection, gchar
   g_message("Recieved (%d) bytes.", strlen(data));
 }
 
+gint line_function(PLUGIN_OBJECT *plugin, PLUGIN_LINE *line, gint context)
+{
+  if (line->prompt)
+    g_message("Prompt (%d) characters in (%d) colours.", line->length, line->n_styles);
+
+  return PLUGIN_LINE_PASS;
+}
+
 void menu_function(GtkWidget *widget, gint data)
 {
     GtkWidget *label;
@@ -56,6 +56,14 @@ struct connection_data {
   gint        notebook;
   gboolean    echo;
   GtkWidget  *window;
+  GString    *partial;        /* Read but not ended, for line plugins */
+  gint        partial_wait;
+  gshort      ansi_fg;        /* Colour the mud last set, for them too */
+  gshort      ansi_bg;
+  gboolean    ansi_bold;
+  gint        timer_tick;     /* Its #tick timer, see timer.c          */
+  gchar      *prompt;         /* Last prompt, and what the status bar  */
+  gchar      *prompt_status;  /* made of it, see prompt.c              */
 };
 
 struct alias_data {
@@ -75,6 +83,9 @@ struct system_data {
     bool       KeepText;
     bool       AutoSave;
     bool       Freeze;
+    bool       PluginsApart;
+    gint       PluginBudget;            /* ms a plugin function may take */
+    bool       PluginBudgetDisable;
     gchar     *FontName;
     gchar     *CommDev;
 };
@@ -142,6 +153,10 @@ void load_keys	      ( void				   );
 /* map.c */
 void  window_automap  ( GtkWidget *widget, gpointer data   );
 
+/* map_room.c */
+void  map_room_text   ( gchar *text                        );
+void  map_room_command( gchar *text                        );
+
 /* misc.c */
 void  init_uid        ( void                               );
 
@@ -158,12 +173,29 @@ void  read_from_connection (CONNECTION_DATA *connection,
                             GdkInputCondition condition     );
 void  send_to_connection (GtkWidget *widget, gpointer data  );
 void  connection_send ( CONNECTION_DATA *cd, gchar *message );
+void  action_send_to_connection ( gchar *entry_text, CONNECTION_DATA *);
 
 /* prefs.c */
 void  load_prefs      ( void                               );
 void  window_prefs    ( GtkWidget *widget, gpointer data   );
 int   check_amcl_dir  ( gchar *dirname                     );
 
+/* prompt.c */
+gboolean prompt_match ( gchar *text                         );
+gboolean prompt_have_pattern ( void                         );
+gboolean prompt_show  ( CONNECTION_DATA *, gchar *prompt    );
+void  prompt_switch   ( CONNECTION_DATA *connection         );
+
+/* timer.c */
+gint  timer_add       ( CONNECTION_DATA *, glong ms, gchar *command,
+                        gboolean repeat                    );
+gint  timer_add_func  ( glong ms, GtkFunction func,
+                        gpointer data                      );
+gboolean timer_remove ( gint id                            );
+void  timer_remove_connection ( CONNECTION_DATA *          );
+gchar *timer_command  ( CONNECTION_DATA *, gchar *text,
+                        gchar *separators, gboolean verbose );
+
 /* window.c */
 void  window_alias    ( GtkWidget *widget, gpointer data             );
 void  popup_window    ( const gchar *message                         );
@@ -190,6 +222,8 @@ extern CONNECTION_DATA *connections[15];
 
 extern GtkWidget *main_notebook;
 extern GtkWidget *text_entry;
+extern GtkWidget *prompt_label;
+extern GtkWidget *prompt_statusbar;
 extern GtkWidget *entry_host;
 extern GtkWidget *entry_port;
 extern GtkWidget *menu_plugin_menu;
@@ -44,6 +44,8 @@ CONNECTION_DATA *main_connection;
 CONNECTION_DATA *connections[15];
 GtkWidget *main_notebook;
 GtkWidget *text_entry;
+GtkWidget *prompt_label;
+GtkWidget *prompt_statusbar;
 GtkWidget *entry_host;
 GtkWidget *entry_port;
 GtkWidget *menu_plugin_menu;
@@ -542,6 +544,11 @@ void init_window ()
     v_scrollbar = gtk_vscrollbar_new (GTK_TEXT(main_connection->window)->vadj);
     gtk_box_pack_start (GTK_BOX (box_h_low), v_scrollbar, FALSE, FALSE, 0);
 
+    /* Shown by prompt.c if it is asked to */
+    prompt_label = gtk_label_new ("");
+    gtk_misc_set_alignment (GTK_MISC (prompt_label), 0, 0.5);
+    gtk_box_pack_start (GTK_BOX(box_main), prompt_label, FALSE, TRUE, 0);
+
     text_entry = gtk_entry_new ();
     gtk_signal_connect (GTK_OBJECT (text_entry), "key_press_event",
                         GTK_SIGNAL_FUNC (text_entry_key_press_cb), NULL);
@@ -551,6 +558,9 @@ void init_window ()
     gtk_widget_grab_focus (text_entry);
     gtk_widget_show (text_entry);
 
+    prompt_statusbar = gtk_statusbar_new ();
+    gtk_box_pack_start (GTK_BOX(box_main), prompt_statusbar, FALSE, TRUE, 0);
+
     /* show them */
     gtk_widget_show (v_scrollbar         );
     gtk_widget_show (box_h_low           );
@@ -33,6 +33,8 @@
 #include <signal.h>
 #include <stdio.h>
 
+#include "map.h"
+
 #if 0
 #define USE_DMALLOC
 #include <glib.h>
@@ -84,177 +86,42 @@ static char const rcsid[] =
  * element has a link to the map node that it references.
  * ...
  */
-extern GList *MapList, *AutoMapList;
-
 #define RGB(r, g, b) { ((r)<<24) | ((g)<<16) | ((b)<<8), (r)<<8, (g)<<8, (b)<<8 }
 
 GdkColor red = RGB(255, 0, 0);
 
-typedef struct _AutoMap     AutoMap;
-typedef struct _Map         Map;
-typedef struct _MapNode     MapNode;
-
-typedef GdkPoint            Point;
-typedef struct _Rectangle   Rectangle;
-typedef struct _RectNode    RectNode;
-typedef struct _SPVertex    SPVertex; /* Shortest path vertex */
-
-struct _Map {
-
-    gchar *name;
-
-    /* The extents of the map */
-    gint min_x, min_y, max_x, max_y;
-
-    /* The map contains a linked list of all nodes which aren't interlinked */
-    GList *nodelist;
-
-    /* Hash table of linked lists of all MapNodes in this map */
-    GHashTable *nodes;
-};
-
 char *direction[] = { "N", "NE", "E", "SE", "S", "SW", "W", "NW", "U", "D" };
 char *direction_long[] = { "North", "Northeast", "East", "Southeast", "South", "Southwest", "West", "Northwest", "Up", "Down" };
 
-/* Direction values and button direction codes */
-#define NORTH     0
-#define NORTHEAST 1
-#define EAST      2
-#define SOUTHEAST 3
-#define SOUTH     4
-#define SOUTHWEST 5
-#define WEST      6
-#define NORTHWEST 7
-#define UP        8
-#define DOWN      9
-#define OPPOSITE(x) ( ((x) & ~7) ? (!(x - 8) + 8) : (((x) + 4) & 7) )
 /* Other button codes */
 #define REMOVE   10
 #define LOAD     11
 #define SAVE     12
-
-#define PIX_ZOOM    40
-#define X_INIT_SIZE 200
-#define Y_INIT_SIZE 200
-#define X_PADDING   (X_INIT_SIZE / PIX_ZOOM / 2)
-#define Y_PADDING   (Y_INIT_SIZE / PIX_ZOOM / 2)
-
-/* The join types.
- * LINE has no additional parameters, so needs no additional struct
- * ARC requires that the arc thingy be known. The rest is calculated
- */
-struct _MapNode {
-
-    gint32 x, y;
-    Map *map;
-    int conn; /* The number of node connections (discounting up/down) */
-
-    /* There is a one to one mapping between node connections */
-    struct {
-        MapNode *node; /* The map this node is located on */
-    } connections[10];
-};
-
-struct _Rectangle {
-
-    gint16 x, y;
-    gint16 width, height;
-};
-
-struct _RectNode {
-
-    Rectangle  rectangle;
-    MapNode   *node;
-};
-
-/* This struct contains the window the drawable is being drawn in, the
- * drawable, the backing pixmap, and anything else
- */
-struct _AutoMap {
-
-    GtkWidget *window;
-    GtkWidget *draw_area;
-    GdkPixmap *pixmap;
-
-    /* Horizontal and vertical scrollbars, plus adjustment data */
-    GtkWidget *hsb, *vsb;
-    GtkObject *hsbdata, *vsbdata;
-    gint last_hvalue, last_vvalue;
-    
-    Map *map;         /* The map which is currently being displayed    */
-    gint16 x, y;      /* The center of the map currently displayed     */
-    gfloat zoom;      /* Zoom factor, must be > 0, > 1 means zoom out  */
-    MapNode *player;  /* The map node the player is currently on       */
-    GList *visible;   /* A linked list of RectNode elements            */
-
-    /* Use this to determine what state the program is in when the mouse
-     * cursor is moving
-     */
-    enum { NONE, SELECTMOVE, BOXSELECT } state;
-
-    GList *selected;  /* A list of all selected nodes */
-
-    /* The X and Y positions where the last node was selected */
-    gint16 x_orig, y_orig;
-
-    /* The X and Y offsets of the selected nodes */
-    gint16 x_offset, y_offset;
-
-    /* A box being drawn to handle grouping selected nodes */
-    Rectangle selection_box;
-
-    /* And all nodes which fall within this box */
-    GList *in_selection_box;
-
-    /* Program states */
-    guint shift : 1;
-    guint node_break : 1;
-    guint node_goto : 1;
-    guint print_coord : 1;
-    guint modifying_coords : 1;
-    guint redraw_map : 1;
-};
-
-struct _SPVertex {
-
-    MapNode *node;
-    int label;
-    int working;
-};
-
-struct win_scale {
-
-    gint16 width;         /* Width of the pixmap */
-    gint16 height;        /* Height of the pixmap in question */
-    gint16 mapped_unit;   /* The number of pixels in a unit of the graph */
-    gint16 mapped_x;      /* The leftmost x coord in the graph visible in the pixmap */
-    gint16 mapped_y;      /* The bottom y coord in the graph visible in the pixmap */
-    gint16 mapped_width;  /* The width of the pixmap in units of the graph */
-    gint16 mapped_height; /* The height of the pixmap in units of the graph */
-};
+#define COSTS    13
+#define INFO     14
+#define MERGE    15
 
 GList *AutoMapList = NULL;
 GList *MapList = NULL;
 
-AutoMap *auto_map_new(void);
-Map *map_new(void);
-void redraw_map (AutoMap *automap);
-void draw_map (AutoMap *automap);
 static void draw_nodes (AutoMap *automap, struct win_scale *ws,
-
-MapNode *start, MapNode *parent, GHashTable *hash);
-static void draw_selected(AutoMap *automap, struct win_scale *ws);
-static void undraw_selected(AutoMap *automap, struct win_scale *ws);
+                        MapNode *start, MapNode *parent);
+static void draw_selected(AutoMap *automap, struct win_scale *ws,
+                          Rectangle *areas, gint count);
+static void damage_add(AutoMap *automap, struct win_scale *ws,
+                       gint x1, gint y1, gint x2, gint y2);
+static void damage_node(AutoMap *automap, struct win_scale *ws, MapNode *node,
+                        gboolean links);
+static void damage_selected(AutoMap *automap, struct win_scale *ws);
+static void damage_flush(AutoMap *automap, struct win_scale *ws);
 void move_player(AutoMap *automap, guint type);
 static void scrollbar_adjust(AutoMap *automap);
-static void remove_map(Map *map);
-static void get_nodes(GHashTable *hash, Map *map, int *n);
+static void get_nodes(GHashTable *hash, Map *map);
 static void new_automap_with_node(void);
-static void load_automap_from_file(gchar *filename, AutoMap *automap);
+static gchar *map_autosave_filename(void);
 static void draw_player(AutoMap *automap, struct win_scale *ws, MapNode *node);
-static void draw_dot(AutoMap *automap, struct win_scale *ws, MapNode *node);
-static void blit_nodes(AutoMap *automap, struct win_scale *ws, MapNode *nodelist[]);
 void node_goto(AutoMap *automap, struct win_scale *ws, MapNode *dest);
+void node_kind(AutoMap *automap, guint type);
 
 struct win_scale *map_coords(AutoMap *automap)
 {
@@ -265,7 +132,7 @@ struct win_scale *map_coords(AutoMap *automap)
     ws.width = automap->draw_area->allocation.width;
     ws.height = automap->draw_area->allocation.height;
 
-    ws.mapped_unit = PIX_ZOOM / automap->zoom;
+    ws.mapped_unit = MAX(PIX_ZOOM / automap->zoom, 1);
     ws.mapped_width = ws.width / ws.mapped_unit;
     ws.mapped_height = ws.height / ws.mapped_unit;
 
@@ -276,23 +143,11 @@ struct win_scale *map_coords(AutoMap *automap)
     ws.mapped_x = automap->x - ws.mapped_width / 2;
     ws.mapped_y = automap->y - ws.mapped_height / 2;
 
-    return &ws;
-}
-
-static inline
-gboolean node_visible (MapNode *node, struct win_scale *ws)
-{
-    return (node->x >= ws->mapped_x &&
-            node->x <= ws->mapped_x + ws->mapped_width &&
-            node->y >= ws->mapped_y &&
-            node->y <= ws->mapped_y + ws->mapped_height);
-}
+    ws.origin_x = automap->x * ws.mapped_unit - ws.width / 2;
+    ws.origin_y = -automap->y * ws.mapped_unit - ws.height / 2;
+    ws.drawable = automap->pixmap;
 
-static inline
-gboolean in_rectangle (gint x, gint y, Rectangle *rectangle)
-{
-    return (x >= rectangle->x && x <= rectangle->x + rectangle->width &&
-            y >= rectangle->y && y <= rectangle->y + rectangle->height);
+    return &ws;
 }
 
 guint node_hash(MapNode *a)
@@ -305,24 +160,338 @@ gint node_comp(MapNode *a, MapNode *b)
     return a->x == b->x && a->y == b->y;
 }
 
-static inline
 void node_hash_prepend(GHashTable *hash, MapNode *node)
 {
     GList *list = g_hash_table_lookup(hash, node);
     list = g_list_prepend(list, node);
+
+    /* Inserting over an existing entry keeps the old key, which may be
+     * a node that is about to move or be freed. Always key the list on
+     * its first element instead
+     */
+    g_hash_table_remove(hash, node);
     g_hash_table_insert(hash, node, list);
 }
 
-static inline
 void node_hash_remove(GHashTable *hash, MapNode *node)
 {
     GList *list = g_hash_table_lookup(hash, node);
     list = g_list_remove(list, node);
 
+    g_hash_table_remove(hash, node);
+
     if (list)
         g_hash_table_insert(hash, list->data, list);
+}
+
+MapNode *map_node_new(AutoMap *automap, Map *map, guint32 id, gint32 x, gint32 y)
+{
+    MapNode *node = g_malloc0(sizeof(MapNode));
+
+    if (node == NULL)
+    {
+        g_error("map_node_new: g_malloc0 error: %s\n", strerror(errno));
+        gtk_exit(1);
+    }
+
+    if (id == MAP_NODE_ID_ANY)
+        id = automap->next_id;
+
+    if (id >= automap->next_id)
+        automap->next_id = id + 1;
+
+    node->id = id;
+    node->x = x;
+    node->y = y;
+    node->map = map;
+
+    g_hash_table_insert(automap->ids, GUINT_TO_POINTER(id), node);
+    node_hash_prepend(map->nodes, node);
+    map_lod_add(node);
+
+    return node;
+}
+
+MapNode *map_node_lookup(AutoMap *automap, guint32 id)
+{
+    return g_hash_table_lookup(automap->ids, GUINT_TO_POINTER(id));
+}
+
+void map_node_free(AutoMap *automap, MapNode *node)
+{
+    g_hash_table_remove(automap->ids, GUINT_TO_POINTER(node->id));
+    map_room_index(automap, node, 0);
+    map_info_clear(automap, node);
+    node_hash_remove(node->map->nodes, node);
+    map_lod_remove(node);
+    g_free(node);
+}
+
+/* Grow the map extents to include node
+ */
+void map_extend(Map *map, MapNode *node)
+{
+    if (node->x < map->min_x)
+        map->min_x = node->x;
+    else if (node->x > map->max_x)
+        map->max_x = node->x;
+
+    if (node->y < map->min_y)
+        map->min_y = node->y;
+    else if (node->y > map->max_y)
+        map->max_y = node->y;
+}
+
+/* Shrink the map extents back to the nodes it has left
+ */
+void map_extents_rebuild(Map *map)
+{
+    gboolean first = TRUE;
+    GSList *nodes = NULL, *puck;
+
+    map_nodes_in_area(map, G_MININT, G_MININT, G_MAXINT, G_MAXINT, &nodes);
+
+    for (puck = nodes; puck != NULL; puck = puck->next)
+    {
+        MapNode *node = puck->data;
+
+        if (first)
+        {
+            map->min_x = map->max_x = node->x;
+            map->min_y = map->max_y = node->y;
+            first = FALSE;
+        } else
+            map_extend(map, node);
+    }
+
+    g_slist_free(nodes);
+}
+
+/* Pass the change on to the journal. Every function that changes the
+ * shape of a map must call this once for each change it makes
+ */
+void map_record(AutoMap *automap, MapOp *op)
+{
+    map_route_record(automap, op);
+    map_landmark_record(automap, op);
+
+    /* Which rooms are greyed out may have changed everywhere */
+    if (map_connect_record(automap, op))
+        map_tile_flush(automap);
     else
-        g_hash_table_remove(hash, node);
+        map_tile_record(automap, op);
+
+    map_undo_record(automap, op);
+
+    if (automap->journal)
+        map_journal_append(automap->journal, op);
+}
+
+static void map_record_player(AutoMap *automap, guint32 old)
+{
+    MapOp op;
+
+    memset(&op, 0, sizeof(op));
+    op.type = MAP_OP_PLAYER;
+    op.node = automap->player->id;
+    op.other = old;
+    map_record(automap, &op);
+}
+
+static void map_record_link(AutoMap *automap, MapOpType type,
+                            MapNode *node, guint dir, MapNode *other)
+{
+    MapOp op;
+
+    memset(&op, 0, sizeof(op));
+    op.type = type;
+    op.node = node->id;
+    op.dir = dir;
+    op.other = other->id;
+    map_record(automap, &op);
+}
+
+static void map_record_node(AutoMap *automap, MapOpType type, MapNode *node)
+{
+    MapOp op;
+
+    memset(&op, 0, sizeof(op));
+    op.type = type;
+    op.node = node->id;
+    op.x = node->x;
+    op.y = node->y;
+    op.map = node->map->name;
+    map_record(automap, &op);
+}
+
+static void map_record_map(AutoMap *automap, MapOpType type, Map *map)
+{
+    MapOp op;
+
+    memset(&op, 0, sizeof(op));
+    op.type = type;
+    op.map = map->name;
+    map_record(automap, &op);
+}
+
+/* Make the way dir out of node plain again, from both ends, before it
+ * is unlinked, so that undoing the unlink gets its kind back too
+ */
+static void map_record_plain(AutoMap *automap, MapNode *node, guint dir)
+{
+    MapNode *other = node->connections[dir].node;
+    MapOp op;
+
+    memset(&op, 0, sizeof(op));
+    op.type = MAP_OP_EDGE;
+    op.x = MAP_EDGE_PLAIN;
+
+    if (node->connections[dir].kind != MAP_EDGE_PLAIN)
+    {
+        op.node = node->id;
+        op.dir = dir;
+        map_op_apply(automap, &op);
+        map_record(automap, &op);
+    }
+
+    if (other->connections[OPPOSITE(dir)].kind != MAP_EDGE_PLAIN)
+    {
+        op.node = other->id;
+        op.dir = OPPOSITE(dir);
+        map_op_apply(automap, &op);
+        map_record(automap, &op);
+    }
+}
+
+/* Forget the room text and info of node before it is deleted, again so
+ * that undoing the deletion gets them back
+ */
+static void map_record_forget(AutoMap *automap, MapNode *node)
+{
+    gint field;
+    MapOp op;
+
+    memset(&op, 0, sizeof(op));
+    op.node = node->id;
+
+    if (node->fingerprint)
+    {
+        op.type = MAP_OP_ROOM;
+        op.other = 0;
+        map_op_apply(automap, &op);
+        map_record(automap, &op);
+    }
+
+    for (field = 0; field < MAP_INFO_FIELDS; field++)
+    {
+        if (map_info_get(node, field) == NULL)
+            continue;
+
+        op.type = MAP_OP_INFO;
+        op.x = field;
+        op.text = NULL;
+        op.old_text = g_strdup(map_info_get(node, field));
+        map_op_apply(automap, &op);
+        map_record(automap, &op);
+        g_free(op.old_text);
+    }
+}
+
+/* Put the costs of map back to the defaults before it is deleted
+ */
+static void map_record_costs(AutoMap *automap, Map *map)
+{
+    gint16 old[MAP_EDGE_KINDS];
+    gint kind;
+    MapOp op;
+
+    memcpy(old, map->cost, sizeof(old));
+    map_cost_defaults(map);
+
+    for (kind = 0; kind < MAP_EDGE_KINDS; kind++)
+    {
+        if (old[kind] == map->cost[kind])
+            continue;
+
+        memset(&op, 0, sizeof(op));
+        op.type = MAP_OP_COST;
+        op.map = map->name;
+        op.x = kind;
+        op.y = map->cost[kind];
+        op.old = old[kind];
+        map_record(automap, &op);
+    }
+}
+
+static void nodelist_mark(GHashTable *seen, MapNode *start)
+{
+    GSList *stack = g_slist_prepend(NULL, start);
+    int i;
+
+    g_hash_table_insert(seen, start, start);
+
+    while (stack)
+    {
+        MapNode *node = stack->data;
+        stack = g_slist_remove(stack, node);
+
+        for (i = 0; i < 8; i++)
+        {
+            MapNode *next = node->connections[i].node;
+
+            if (next == NULL || next->map != node->map ||
+                g_hash_table_lookup(seen, next))
+                continue;
+
+            g_hash_table_insert(seen, next, next);
+            stack = g_slist_prepend(stack, next);
+        }
+    }
+}
+
+static void nodelist_add_unseen(MapNode *key, GList *list, void *data[2])
+{
+    Map *map = data[0];
+    GHashTable *seen = data[1];
+
+    for (; list != NULL; list = list->next)
+    {
+        if (g_hash_table_lookup(seen, list->data))
+            continue;
+
+        map->nodelist = g_list_append(map->nodelist, list->data);
+        nodelist_mark(seen, list->data);
+    }
+}
+
+/* Make map->nodelist hold exactly one node of every group of interlinked
+ * nodes again. Used after changes (replaying the journal) which only
+ * keep it approximately right. Existing start nodes are kept where
+ * possible
+ */
+void map_nodelist_rebuild(Map *map)
+{
+    GHashTable *seen = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GList *old = map->nodelist, *puck;
+    void *data[2];
+
+    map->nodelist = NULL;
+
+    for (puck = old; puck != NULL; puck = puck->next)
+    {
+        if (g_hash_table_lookup(seen, puck->data))
+            continue;
+
+        map->nodelist = g_list_append(map->nodelist, puck->data);
+        nodelist_mark(seen, puck->data);
+    }
+
+    data[0] = map;
+    data[1] = seen;
+    g_hash_table_foreach(map->nodes, (GHFunc)nodelist_add_unseen, data);
+
+    g_list_free(old);
+    g_hash_table_destroy(seen);
 }
 
 static gint
@@ -335,16 +504,27 @@ expose_event(GtkWidget *widget, GdkEventExpose *event, AutoMap *automap)
                     event->area.x, event->area.y,
                     event->area.width, event->area.height);
 
-    draw_selected(automap, map_coords(automap));
+    {
+        Rectangle area;
+
+        area.x = event->area.x;
+        area.y = event->area.y;
+        area.width = event->area.width;
+        area.height = event->area.height;
+        draw_selected(automap, map_coords(automap), &area, 1);
+    }
 
     return TRUE; /* Terminate signal */
 }
 
 void remove_selected(AutoMap *automap)
 {
-    undraw_selected(automap, map_coords(automap));
+    struct win_scale *ws = map_coords(automap);
+
+    damage_selected(automap, ws);
     g_list_free(automap->selected);
     automap->selected = NULL;
+    damage_flush(automap, ws);
 }
 
 /* Recurses the map node list, looking for nodes in the map node
@@ -401,6 +581,7 @@ void remove_player_node(AutoMap *automap)
      * tricky ...
      */
     MapNode *curr = automap->player;
+    guint32 curr_id = curr->id;
     GHashTable *hash;
     struct win_scale *ws;
     int i;
@@ -456,6 +637,9 @@ void remove_player_node(AutoMap *automap)
 
         if (this)
         {
+            map_record_plain(automap, curr, i);
+            map_record_link(automap, MAP_OP_UNLINK, curr, i, this);
+
             /* Maintain the node count unless this node goes up or down */
             if (i < 8) this->conn--;
 
@@ -498,8 +682,14 @@ void remove_player_node(AutoMap *automap)
     }
 
     g_hash_table_destroy(hash);
-    node_hash_remove(automap->map->nodes, curr);
-    g_free(curr);
+
+    /* The player is moved before the node goes, so that undoing this
+     * brings the node back before the player is put on it
+     */
+    map_record_player(automap, curr_id);
+    map_record_forget(automap, curr);
+    map_record_node(automap, MAP_OP_NODE_DELETE, curr);
+    map_node_free(automap, curr);
 
     /* If the map the closest node was on, is not the same map as the
      * removed node was on, then destroy the previous map, and set the
@@ -508,17 +698,17 @@ void remove_player_node(AutoMap *automap)
 
     if (automap->map != automap->player->map)
     {
+        map_record_costs(automap, automap->map);
+        map_record_map(automap, MAP_OP_MAP_DELETE, automap->map);
         remove_map(automap->map);
         automap->map = automap->player->map;
     }
 
 
-    /* Recalculate map size by reseting the map size before entering
-     * redraw_map(). Recenter window if the node is offscreen
+    /* Recalculate map size. Recenter window if the node is offscreen
      */
 
-    automap->map->min_x = automap->map->max_x = automap->player->x;
-    automap->map->min_y = automap->map->max_y = automap->player->y;
+    map_extents_rebuild(automap->map);
 
     if ((automap->player->x <= ws->mapped_x) ||
         (automap->player->y <= ws->mapped_y) ||
@@ -533,6 +723,19 @@ void remove_player_node(AutoMap *automap)
     scrollbar_adjust(automap);
 }
 
+/* Zoom in (factor < 1) or out (factor > 1) around the centre of the map
+ */
+static void map_zoom(AutoMap *automap, gfloat factor)
+{
+    gfloat zoom = automap->zoom * factor;
+
+    if (zoom < MAP_ZOOM_MIN || zoom > MAP_ZOOM_MAX)
+        return;
+
+    automap->zoom = zoom;
+    scrollbar_adjust(automap);
+}
+
 static gint
 key_press_event(GtkWidget *widget, GdkEventKey *event, AutoMap *automap)
 {
@@ -557,9 +760,38 @@ key_press_event(GtkWidget *widget, GdkEventKey *event, AutoMap *automap)
     case GDK_g:
         automap->node_goto = TRUE; break;
 
+    case GDK_t:
+        automap->node_kind = TRUE; break;
+
     case GDK_p:
         automap->print_coord = TRUE; break;
 
+    case GDK_z:
+    case GDK_Z:
+    case GDK_y:
+        if (!(event->state & GDK_CONTROL_MASK))
+            return FALSE;
+
+        /* Ctrl-Z undoes, Ctrl-Shift-Z and Ctrl-Y redo */
+        if (event->keyval == GDK_z ? map_undo(automap) : map_redo(automap))
+        {
+            /* Selected nodes may be gone, so they are not undrawn */
+            g_list_free(automap->selected);
+            g_list_free(automap->in_selection_box);
+            automap->selected = automap->in_selection_box = NULL;
+            scrollbar_adjust(automap);
+        }
+        break;
+
+    case GDK_plus:
+    case GDK_equal:
+    case GDK_KP_Add:
+        map_zoom(automap, 0.5);          break;
+
+    case GDK_minus:
+    case GDK_KP_Subtract:
+        map_zoom(automap, 2);            break;
+
         /* Keys to do with movement
          * Hopefully I have gotten them all
          */
@@ -638,7 +870,7 @@ static gint
 button_press_event(GtkWidget *widget, GdkEventButton *event, AutoMap *automap)
 {
 
-    GList *puck;
+    MapNode *node;
 
     gint x = (gint)rint(event->x), y = (gint)rint(event->y);
 
@@ -650,66 +882,61 @@ button_press_event(GtkWidget *widget, GdkEventButton *event, AutoMap *automap)
          */
 
         if (!automap->shift && automap->selected)
-        {
-            undraw_selected(automap, ws);
             remove_selected(automap);
-        }
 
         /* See if the mouse clicked on a node */
-        for (puck = automap->visible; puck != NULL; puck = puck->next)
+        if ((node = map_node_at(automap, ws, x, y)) != NULL)
         {
-            RectNode *rn = puck->data;
-            if (in_rectangle(x, y, &rn->rectangle))
+            /* DEBUG print the coordinate the node is on */
+            if (automap->print_coord)
             {
-                /* DEBUG print the coordinate the node is on */
-                if (automap->print_coord)
-                {
-                    automap->print_coord = FALSE;
-                    
-                    g_print("Mouse is at (%d, %d)\n", rn->node->x, rn->node->y);
-
-                    return TRUE;
-                }
+                automap->print_coord = FALSE;
+                
+                g_print("Mouse is at (%d, %d)\n", node->x, node->y);
 
-                /* If the player wants to go to this node ... */
-                if (automap->node_goto)
-                {
-                    automap->node_goto = FALSE;
-                    node_goto(automap, ws, rn->node);
-                    return TRUE;
-                }
+                return TRUE;
+            }
 
-                /* If the shift button has not been pressed, select this node
-                 * as the player node
-                 */
-                if (!automap->shift)
-                {
-                    MapNode *nodelist[] = { automap->player, NULL };
-                    automap->state = NONE;
+            /* If the player wants to go to this node ... */
+            if (automap->node_goto)
+            {
+                automap->node_goto = FALSE;
+                node_goto(automap, ws, node);
+                return TRUE;
+            }
 
-                    draw_dot(automap, ws, automap->player);
-                    blit_nodes(automap, ws, nodelist);
+            /* If the shift button has not been pressed, select this node
+             * as the player node
+             */
+            if (!automap->shift)
+            {
+                guint32 old_id = automap->player->id;
+                automap->state = NONE;
 
-                    nodelist[0] = automap->player = rn->node;
-                    draw_player(automap, ws, automap->player);
-                    blit_nodes(automap, ws, nodelist);
+                draw_dot(automap, ws, automap->player);
+                damage_node(automap, ws, automap->player, FALSE);
 
-                    return TRUE;
-                }
+                automap->player = node;
+                draw_player(automap, ws, automap->player);
+                damage_node(automap, ws, automap->player, FALSE);
+                damage_flush(automap, ws);
+                map_record_player(automap, old_id);
 
-                /* Select this object, if it's not already in the list */
-                if (!g_list_find(automap->selected, rn->node))
-                    automap->selected = g_list_prepend(automap->selected, rn->node);
+                return TRUE;
+            }
 
-                automap->x_orig = x; automap->y_orig = y;
-                automap->x_offset = automap->y_offset = 0;
+            /* Select this object, if it's not already in the list */
+            if (!g_list_find(automap->selected, node))
+                automap->selected = g_list_prepend(automap->selected, node);
 
-                draw_selected(automap, map_coords(automap));
-                automap->state = SELECTMOVE;
+            automap->x_orig = x; automap->y_orig = y;
+            automap->x_offset = automap->y_offset = 0;
 
-                return TRUE; /* Terminate signal */
+            damage_selected(automap, ws);
+            damage_flush(automap, ws);
+            automap->state = SELECTMOVE;
 
-            }
+            return TRUE; /* Terminate signal */
         }
 
         /* If this area was reached, then the user clicked in a blank area
@@ -727,11 +954,14 @@ button_press_event(GtkWidget *widget, GdkEventButton *event, AutoMap *automap)
     return FALSE; /* Propogate signal */
 }
 
-static void undraw_hollow_rectangle(AutoMap *automap,
-                                    gint x, gint y, gint width, gint height)
+/* The box being drawn to select nodes
+ */
+static void damage_box(AutoMap *automap, struct win_scale *ws)
 {
+    gint x = automap->selection_box.x, y = automap->selection_box.y;
+    gint width = automap->selection_box.width;
+    gint height = automap->selection_box.height;
 
-    /* Redraw the pixmap over the old selection box */
     if (width < 0) {
         x += width;
         width = -width;
@@ -742,25 +972,11 @@ static void undraw_hollow_rectangle(AutoMap *automap,
         height = -height;
     }
 
-    /* Top left to top right */
-    gdk_draw_pixmap(automap->draw_area->window,
-                    automap->draw_area->style->fg_gc[GTK_WIDGET_STATE (automap->draw_area)],
-                    automap->pixmap, x, y, x, y, width + 1, 1);
-
-    /* Bottom left to bottom right */
-    gdk_draw_pixmap(automap->draw_area->window,
-                    automap->draw_area->style->fg_gc[GTK_WIDGET_STATE (automap->draw_area)],
-                    automap->pixmap, x, y + height, x, y + height, width + 1, 1);
-
-    /* Top left to bottom left */
-    gdk_draw_pixmap(automap->draw_area->window,
-                    automap->draw_area->style->fg_gc[GTK_WIDGET_STATE (automap->draw_area)],
-                    automap->pixmap, x, y, x, y, 1, height + 1);
-
-    /* Top right to bottom right */
-    gdk_draw_pixmap(automap->draw_area->window,
-                    automap->draw_area->style->fg_gc[GTK_WIDGET_STATE (automap->draw_area)],
-                    automap->pixmap, x + width, y, x + width, y, 1, height + 1);
+    /* Top, bottom, left and right */
+    damage_add(automap, ws, x, y, x + width + 1, y + 1);
+    damage_add(automap, ws, x, y + height, x + width + 1, y + height + 1);
+    damage_add(automap, ws, x, y, x + 1, y + height + 1);
+    damage_add(automap, ws, x + width, y, x + width + 1, y + height + 1);
 }
 
 static gint
@@ -778,32 +994,61 @@ button_release_event(GtkWidget *widget, GdkEventButton *event, AutoMap *automap)
 
         if (automap->state == SELECTMOVE)
         {
-            for (; puck != NULL; puck = puck->next)
+            /* Where the nodes were and where they go need drawing again,
+             * along with their links
+             */
+            damage_selected(automap, ws);
+
+            if (x_off != 0 || y_off != 0)
+                for (; puck != NULL; puck = puck->next)
+                    damage_node(automap, ws, puck->data, TRUE);
+
+            for (puck = automap->selected; puck != NULL; puck = puck->next)
             {
+                MapOp op;
+
                 node = puck->data;
                 node_hash_remove(automap->map->nodes, node);
+                map_lod_remove(node);
                 node->x += x_off;
                 node->y -= y_off;
                 node_hash_prepend(automap->map->nodes, node);
+                map_lod_add(node);
+
+                if (x_off == 0 && y_off == 0)
+                    continue;
+
+                memset(&op, 0, sizeof(op));
+                op.type = MAP_OP_MOVE;
+                op.node = node->id;
+                op.x = x_off;
+                op.y = -y_off;
+                map_record(automap, &op);
             }
 
             automap->x_offset = automap->y_offset = 0;
             automap->x_orig = (gint16)rint(event->x);
             automap->y_orig = (gint16)rint(event->y);
-            automap->map->min_x = automap->map->max_x = automap->x;
-            automap->map->min_y = automap->map->max_y = automap->y;
+            map_extents_rebuild(automap->map);
 
-            redraw_map(automap);
-        } else {
+            if (x_off != 0 || y_off != 0)
+            {
+                draw_map(automap);
+
+                for (puck = automap->selected; puck != NULL; puck = puck->next)
+                    damage_node(automap, ws, puck->data, TRUE);
+            }
+
+            damage_selected(automap, ws);
+        } else {
             automap->selected = g_list_concat(automap->selected, automap->in_selection_box);
             automap->in_selection_box = NULL;
 
-            undraw_hollow_rectangle(automap, automap->selection_box.x,
-                                    automap->selection_box.y, automap->selection_box.width,
-                                    automap->selection_box.height);
+            damage_box(automap, ws);
+            damage_selected(automap, ws);
         }
 
-        draw_selected(automap, ws);
+        damage_flush(automap, ws);
 
         automap->state = NONE;
     }
@@ -841,8 +1086,7 @@ motion_notify_event(GtkWidget *widget, GdkEventMotion *event, AutoMap *automap)
                 y > automap->y_orig + automap->y_offset + ws->mapped_unit/2 ||
                 y < automap->y_orig + automap->y_offset - ws->mapped_unit/2)
             {
-
-                undraw_selected(automap, ws);
+                damage_selected(automap, ws);
 
                 if (x > automap->x_orig + automap->x_offset + ws->mapped_unit/2)
                     automap->x_offset += ws->mapped_unit;
@@ -854,17 +1098,17 @@ motion_notify_event(GtkWidget *widget, GdkEventMotion *event, AutoMap *automap)
                 else if (y < automap->y_orig + automap->y_offset - ws->mapped_unit/2)
                     automap->y_offset -= ws->mapped_unit;
 
-                draw_selected(automap, ws);
+                damage_selected(automap, ws);
+                damage_flush(automap, ws);
             }
         } else if (automap->state == BOXSELECT) {
             gint rx = automap->selection_box.x;
             gint ry = automap->selection_box.y;
-            gint rwidth = automap->selection_box.width;
-            gint rheight = automap->selection_box.height;
-            GList *puck;
+            gint rwidth, rheight;
+            GSList *nodes = NULL, *puck;
 
-            undraw_selected(automap, ws);
-            undraw_hollow_rectangle(automap, rx, ry, rwidth, rheight);
+            damage_selected(automap, ws);
+            damage_box(automap, ws);
 
             rwidth = automap->selection_box.width = x - rx;
             rheight = automap->selection_box.height = y - ry;
@@ -881,35 +1125,37 @@ motion_notify_event(GtkWidget *widget, GdkEventMotion *event, AutoMap *automap)
                 rheight = -rheight;
             }
 
-            /* Draw the rectangle */
-            gdk_draw_rectangle(automap->draw_area->window,
-                               automap->draw_area->style->black_gc,
-                               FALSE, rx, ry, rwidth, rheight);
             g_list_free(automap->in_selection_box);
 
             automap->in_selection_box = NULL;
 
-            /* And now insert unselected nodes to go in the selected node list */
-            for (puck = automap->visible; puck != NULL; puck = puck->next)
+            /* And now insert unselected nodes to go in the selected node
+             * list. Pixels to graph units, rounding inwards
+             */
+            map_nodes_in_area(automap->map,
+                (rx + ws->origin_x + ws->mapped_unit - 1) / ws->mapped_unit,
+                -((ry + rheight + ws->origin_y) / ws->mapped_unit),
+                (rx + rwidth + ws->origin_x) / ws->mapped_unit,
+                -((ry + ws->origin_y + ws->mapped_unit - 1) / ws->mapped_unit),
+                &nodes);
+
+            for (puck = nodes; puck != NULL; puck = puck->next)
             {
-                RectNode *rn = puck->data;
-                Rectangle rect;
+                /* Select this object, if it's not already in the list */
+                if (!g_list_find(automap->selected, puck->data))
+                    automap->in_selection_box =
+                        g_list_prepend(automap->in_selection_box, puck->data);
+            }
 
-                rect.x = rx; rect.y = ry; rect.width = rwidth; rect.height = rheight;
+            g_slist_free(nodes);
 
-                if (in_rectangle(rn->rectangle.x + rn->rectangle.width / 2,
-                                 rn->rectangle.y + rn->rectangle.height / 2,
-                                 &rect))
-                {
-                    /* Select this object, if it's not already in the list */
-                    if (!g_list_find(automap->selected, rn->node))
-                    {
-                        automap->in_selection_box = g_list_prepend(automap->in_selection_box, rn->node);
-                    }
-                }
-            }
+            damage_selected(automap, ws);
+            damage_flush(automap, ws);
 
-            draw_selected(automap, map_coords(automap));
+            /* Draw the rectangle */
+            gdk_draw_rectangle(automap->draw_area->window,
+                               automap->draw_area->style->black_gc,
+                               FALSE, rx, ry, rwidth, rheight);
         }
     }
 
@@ -1023,6 +1269,9 @@ static inline guint get_direction_type(char *text)
     else if (!strcasecmp(text, "remove")) return REMOVE;
     else if (!strcasecmp(text, "load"  )) return LOAD;
     else if (!strcasecmp(text, "save"  )) return SAVE;
+    else if (!strcasecmp(text, "costs" )) return COSTS;
+    else if (!strcasecmp(text, "room"  )) return INFO;
+    else if (!strcasecmp(text, "merge" )) return MERGE;
          g_error("get_direction_type: unknown direction string: %s\n", text);
 
     gtk_exit(1);
@@ -1084,12 +1333,11 @@ static inline void node_reposition(guint type, guint *x, guint *y)
  *   2) Draw the dot that signifies this is a node
  */
 
-static inline
 void translate (AutoMap *automap, struct win_scale *ws, Point *p)
 {
 
-    p->x = (gint)((p->x - automap->x) * ws->mapped_unit) + ws->width / 2;
-    p->y = ws->height / 2 - (gint)((p->y - automap->y) * ws->mapped_unit);
+    p->x = p->x * ws->mapped_unit - ws->origin_x;
+    p->y = -p->y * ws->mapped_unit - ws->origin_y;
 }
 
 static inline
@@ -1132,7 +1380,6 @@ gboolean adjust (struct win_scale *ws, Rectangle *rect)
     return TRUE;
 }
 
-static
 void draw_line(AutoMap *automap, struct win_scale *ws,
                MapNode *node1, MapNode *node2)
 {
@@ -1168,11 +1415,10 @@ void draw_line(AutoMap *automap, struct win_scale *ws,
         p2.y += nodewidth;
     }
 
-    gdk_draw_line(automap->pixmap,
+    gdk_draw_line(ws->drawable,
                   automap->draw_area->style->black_gc, p1.x, p1.y, p2.x, p2.y);
 }
 
-static
 void draw_dot(AutoMap *automap, struct win_scale *ws, MapNode *node)
 {
 
@@ -1184,14 +1430,16 @@ void draw_dot(AutoMap *automap, struct win_scale *ws, MapNode *node)
     Point p = { node->x, node->y };
     translate(automap, ws, &p);
 
-    /* Clear the area first */
-    gdk_draw_rectangle(automap->pixmap,
-                       automap->draw_area->style->white_gc, TRUE,
+    /* Clear the area first, rooms the player can't get to are greyed */
+    gdk_draw_rectangle(ws->drawable,
+                       map_node_reachable(automap, automap->player, node) ?
+                       automap->draw_area->style->white_gc :
+                       automap->draw_area->style->mid_gc[GTK_STATE_NORMAL], TRUE,
                        p.x - nodewidth, p.y - nodewidth,
                        nodewidth * 2, nodewidth * 2);
 
     /* Outline */
-    gdk_draw_rectangle(automap->pixmap,
+    gdk_draw_rectangle(ws->drawable,
                        automap->draw_area->style->black_gc, FALSE,
                        p.x - nodewidth, p.y - nodewidth,
                        nodewidth * 2, nodewidth * 2);
@@ -1199,17 +1447,17 @@ void draw_dot(AutoMap *automap, struct win_scale *ws, MapNode *node)
     /* Going up ? Draw up arrow */
     if (node->connections[UP].node)
     {
-        gdk_draw_line(automap->pixmap,
+        gdk_draw_line(ws->drawable,
                       automap->draw_area->style->black_gc,
                       p.x + nodewidth/2, p.y - nodewidth/5*4,
                       p.x + nodewidth/2, p.y + nodewidth/5*4);
 
-        gdk_draw_line(automap->pixmap,
+        gdk_draw_line(ws->drawable,
                       automap->draw_area->style->black_gc,
                       p.x + nodewidth/2, p.y - nodewidth/5*4,
                       p.x + nodewidth/5, p.y - nodewidth/5*2);
 
-        gdk_draw_line(automap->pixmap,
+        gdk_draw_line(ws->drawable,
                       automap->draw_area->style->black_gc,
                       p.x + nodewidth/2, p.y - nodewidth/5*4,
                       p.x + nodewidth/5*4, p.y - nodewidth/5*2);
@@ -1218,17 +1466,17 @@ void draw_dot(AutoMap *automap, struct win_scale *ws, MapNode *node)
     /* Going down ? Draw down arrow */
     if (node->connections[DOWN].node)
     {
-        gdk_draw_line(automap->pixmap,
+        gdk_draw_line(ws->drawable,
                       automap->draw_area->style->black_gc,
                       p.x - nodewidth/2, p.y + nodewidth/5*4,
                       p.x - nodewidth/2, p.y - nodewidth/5*4);
 
-        gdk_draw_line(automap->pixmap,
+        gdk_draw_line(ws->drawable,
                       automap->draw_area->style->black_gc,
                       p.x - nodewidth/2, p.y + nodewidth/5*4,
                       p.x - nodewidth/5, p.y + nodewidth/5*2);
 
-        gdk_draw_line(automap->pixmap,
+        gdk_draw_line(ws->drawable,
                       automap->draw_area->style->black_gc,
                       p.x - nodewidth/2, p.y + nodewidth/5*4,
                       p.x - nodewidth/5*4, p.y + nodewidth/5*2);
@@ -1236,7 +1484,7 @@ void draw_dot(AutoMap *automap, struct win_scale *ws, MapNode *node)
 }
 
 static
-void blit_nodes(AutoMap *automap, struct win_scale *ws, MapNode *nodelist[])
+void blank_nodes(AutoMap *automap, struct win_scale *ws, MapNode *nodelist[])
 {
 
     /* nodewidth is the distance from the nodes centre, to the nodes
@@ -1278,74 +1526,52 @@ void blit_nodes(AutoMap *automap, struct win_scale *ws, MapNode *nodelist[])
     rect.width = x_higher - x_lower + 1;
     rect.height = y_higher - y_lower + 1;
 
-    if (adjust(ws, &rect))
-    {
-        gdk_draw_pixmap(automap->draw_area->window,
-                        automap->draw_area->style->fg_gc[GTK_WIDGET_STATE (automap->draw_area)],
-                        automap->pixmap, rect.x, rect.y, rect.x, rect.y, rect.width, rect.height);
+    if (adjust(ws, &rect)) {
+        gdk_draw_rectangle(ws->drawable,
+                           automap->draw_area->style->white_gc, TRUE,
+                           rect.x, rect.y, rect.width, rect.height);
     }
 }
 
-static
-void blank_nodes(AutoMap *automap, struct win_scale *ws, MapNode *nodelist[])
+/* Where the marker of a selected node is drawn
+ */
+static void selected_rect(AutoMap *automap, struct win_scale *ws,
+                          MapNode *node, Rectangle *rect)
 {
+    gint16 radius = 5; /* ceil (sqrt (3*3 + 3*3)) */
+    gint x, y;
 
-    /* nodewidth is the distance from the nodes centre, to the nodes
-     * edge (not its diagonal edge)
-     */
-    gint nodewidth = ws->mapped_unit / 4;
-
-    Point p = { nodelist[0]->x, nodelist[0]->y };
-    Rectangle rect;
-    gint x_lower, y_lower, x_higher, y_higher;
-    int i;
-
-    /* Set up bounds initially */
-    translate(automap, ws, &p);
-
-    x_lower = p.x - nodewidth;
-    x_higher = p.x + nodewidth;
-    y_lower = p.y - nodewidth;
-    y_higher = p.y + nodewidth;
+    x = (gint)((node->x - automap->x) * ws->mapped_unit) + ws->width / 2;
+    x += automap->x_offset;
+    y = ws->height / 2 - (gint)((node->y - automap->y) * ws->mapped_unit);
+    y += automap->y_offset;
 
-    for (i = 1; nodelist[i] != NULL; i++)
+    if (node == automap->player)
     {
-        p.x = nodelist[i]->x; p.y = nodelist[i]->y;
-        translate(automap, ws, &p);
-
-        if (p.x - nodewidth < x_lower)
-            x_lower = p.x - nodewidth;
-        else if (p.x + nodewidth > x_higher)
-            x_higher = p.x + nodewidth;
-
-        if (p.y - nodewidth < y_lower)
-            y_lower = p.y - nodewidth;
-        else if (p.y + nodewidth > y_higher)
-            y_higher = p.y + nodewidth;
+        rect->x = x - radius; rect->y = y - radius;
+        rect->width = rect->height = radius * 2;
+    } else {
+        rect->x = x - 3; rect->y = y - 3;
+        rect->width = rect->height = 6;
     }
+}
 
-    rect.x = x_lower;
-    rect.y = y_lower;
-    rect.width = x_higher - x_lower + 1;
-    rect.height = y_higher - y_lower + 1;
-
-    if (adjust(ws, &rect)) {
-        gdk_draw_rectangle(automap->pixmap,
-                           automap->draw_area->style->white_gc, TRUE,
-                           rect.x, rect.y, rect.width, rect.height);
-    }
+static gboolean rect_meets(Rectangle *a, Rectangle *b)
+{
+    return a->x < b->x + b->width && b->x < a->x + a->width &&
+           a->y < b->y + b->height && b->y < a->y + a->height;
 }
 
+/* Draw the markers of the selected nodes straight onto the window, only
+ * those meeting one of the count areas, or all if areas is NULL
+ */
 static
-void draw_selected(AutoMap *automap, struct win_scale *ws)
+void draw_selected(AutoMap *automap, struct win_scale *ws,
+                   Rectangle *areas, gint count)
 {
-    gint16 radius = 5; /* ceil (sqrt (3*3 + 3*3)) */
     GList *list_start, *puck;
-    MapNode *node;
-    gint x, y;
-    GdkGC *gc = gdk_gc_new(automap->draw_area->window);
-
-    gdk_gc_set_foreground(gc, &red);
+    Rectangle rect;
+    gint i;
 
     if (automap->selected)
         list_start = puck = automap->selected;
@@ -1354,21 +1580,32 @@ void draw_selected(AutoMap *automap, struct win_scale *ws)
     else
         return;
 
+    if (automap->select_gc == NULL)
+    {
+        automap->select_gc = gdk_gc_new(automap->draw_area->window);
+        gdk_gc_set_foreground(automap->select_gc, &red);
+    }
+
     for (;;)
     {
-        node = (MapNode *)puck->data;
-        x = (gint)((node->x - automap->x) * ws->mapped_unit) + ws->width / 2;
-        x += automap->x_offset;
-        y = ws->height / 2 - (gint)((node->y - automap->y) * ws->mapped_unit);
-        y += automap->y_offset;
+        MapNode *node = (MapNode *)puck->data;
+
+        selected_rect(automap, ws, node, &rect);
+
+        for (i = 0; areas && i < count; i++)
+            if (rect_meets(&rect, &areas[i]))
+                break;
 
-        if (node == automap->player)
+        if (areas == NULL || i < count)
         {
-            gdk_draw_arc(automap->draw_area->window, gc, TRUE,
-                         x - radius, y - radius, radius * 2, radius * 2, 0, 360*64);
-        } else {
-            gdk_draw_rectangle(automap->draw_area->window, gc, TRUE,
-                               x - 3, y - 3, 6, 6);
+            if (node == automap->player)
+                gdk_draw_arc(automap->draw_area->window, automap->select_gc,
+                             TRUE, rect.x, rect.y, rect.width, rect.height,
+                             0, 360*64);
+            else
+                gdk_draw_rectangle(automap->draw_area->window,
+                                   automap->select_gc, TRUE,
+                                   rect.x, rect.y, rect.width, rect.height);
         }
 
         puck = puck->next;
@@ -1381,62 +1618,167 @@ void draw_selected(AutoMap *automap, struct win_scale *ws)
                 break;
         }
     }
+}
 
-    gdk_gc_destroy(gc);
+/*
+ * Damage
+ *
+ * Parts of the window that no longer show what is in the backing
+ * pixmap. While the pixmap is drawn on, or selected nodes are dragged
+ * about, the parts changed are gathered as a few rectangles, and then
+ * copied to the window together by damage_flush(), along with the
+ * markers of the selected nodes in them. Rectangles close together are
+ * merged when that copies less than MAP_DAMAGE_SLACK pixels more than
+ * keeping them apart, so dragging a block of rooms copies a few strips
+ * instead of a rectangle per room.
+ */
+
+static gint rect_area(Rectangle *rect)
+{
+    return rect->width * rect->height;
 }
 
-static
-void undraw_selected(AutoMap *automap, struct win_scale *ws)
+static void rect_union(Rectangle *a, Rectangle *b, Rectangle *out)
 {
-    gint16 radius = 5; /* ceil (sqrt (3*3 + 3*3)) */
-    GList *list_start, *puck;
-    MapNode *node;
-    Point p;
-    Rectangle rect;
+    gint x1 = MIN(a->x, b->x), y1 = MIN(a->y, b->y);
+    gint x2 = MAX(a->x + a->width, b->x + b->width);
+    gint y2 = MAX(a->y + a->height, b->y + b->height);
 
-    if (automap->selected)
-        list_start = puck = automap->selected;
-    else if (automap->in_selection_box)
-        list_start = puck = automap->in_selection_box;
-    else
+    out->x = x1;
+    out->y = y1;
+    out->width = x2 - x1;
+    out->height = y2 - y1;
+}
+
+/* Window pixels x1, y1 up to but not including x2, y2 need copying
+ */
+static void damage_add(AutoMap *automap, struct win_scale *ws,
+                       gint x1, gint y1, gint x2, gint y2)
+{
+    Rectangle rect, both;
+    gint i, best, waste, least;
+
+    /* Only what is in the window, the rest may not even fit a Rectangle */
+    x1 = MAX(x1, 0);
+    y1 = MAX(y1, 0);
+    x2 = MIN(x2, ws->width);
+    y2 = MIN(y2, ws->height);
+
+    if (x1 >= x2 || y1 >= y2)
         return;
 
+    rect.x = x1;
+    rect.y = y1;
+    rect.width = x2 - x1;
+    rect.height = y2 - y1;
+
+    /* Merge it with what it wastes the least copying on, for as long as
+     * that is cheap enough or there's no room to keep it apart
+     */
     for (;;)
     {
-        node = (MapNode *)puck->data;
-        p.x = node->x; p.y = node->y;
-        translate(automap, ws, &p);
-        p.x += automap->x_offset;
-        p.y += automap->y_offset;
+        best = -1;
+        least = 0;
 
-        if (node == automap->player)
+        for (i = 0; i < automap->damage_count; i++)
         {
-            rect.x = p.x - radius; rect.y = p.y - radius;
-            rect.width = rect.height = radius * 2;
-        } else {
-            rect.x = p.x - 3; rect.y = p.y - 3;
-            rect.width = rect.height = 6;
-        }
+            rect_union(&automap->damage[i], &rect, &both);
+            waste = rect_area(&both) - rect_area(&automap->damage[i]) - rect_area(&rect);
 
-        if (adjust(ws, &rect))
-        {
-            gdk_draw_pixmap(automap->draw_area->window,
-                            automap->draw_area->style->fg_gc[GTK_WIDGET_STATE (automap->draw_area)],
-                            automap->pixmap, rect.x, rect.y, rect.x, rect.y, rect.width, rect.height);
+            if (best < 0 || waste < least)
+            {
+                best = i;
+                least = waste;
+            }
         }
 
-        puck = puck->next;
+        if (best < 0 ||
+            (least > MAP_DAMAGE_SLACK && automap->damage_count < MAP_DAMAGE_RECTS))
+            break;
 
-        if (puck == NULL)
+        rect_union(&automap->damage[best], &rect, &rect);
+        automap->damage[best] = automap->damage[--automap->damage_count];
+    }
+
+    automap->damage[automap->damage_count++] = rect;
+}
+
+/* The node as drawn by draw_dot() and draw_player(), and with links the
+ * lines to its neighbours too
+ */
+static void damage_node(AutoMap *automap, struct win_scale *ws, MapNode *node,
+                        gboolean links)
+{
+    gint half = MAX(ws->mapped_unit / 4, 5) + 1;
+    gint x = node->x * ws->mapped_unit - ws->origin_x;
+    gint y = -node->y * ws->mapped_unit - ws->origin_y;
+    gint i;
+
+    damage_add(automap, ws, x - half, y - half, x + half + 1, y + half + 1);
+
+    for (i = 0; links && i < 8; i++)
+    {
+        MapNode *next = node->connections[i].node;
+        gint nx, ny;
+
+        if (next == NULL)
+            continue;
+
+        nx = next->x * ws->mapped_unit - ws->origin_x;
+        ny = -next->y * ws->mapped_unit - ws->origin_y;
+
+        damage_add(automap, ws, MIN(x, nx) - 1, MIN(y, ny) - 1,
+                   MAX(x, nx) + 2, MAX(y, ny) + 2);
+    }
+}
+
+/* The markers of the selected nodes where they are drawn now
+ */
+static void damage_selected(AutoMap *automap, struct win_scale *ws)
+{
+    GList *puck;
+    Rectangle rect;
+    gint i;
+
+    for (i = 0; i < 2; i++)
+    {
+        for (puck = i ? automap->in_selection_box : automap->selected;
+             puck != NULL; puck = puck->next)
         {
-            if (list_start == automap->selected && automap->in_selection_box)
-                list_start = puck = automap->in_selection_box;
-            else
-                break;
+            selected_rect(automap, ws, puck->data, &rect);
+            damage_add(automap, ws, rect.x, rect.y,
+                       rect.x + rect.width, rect.y + rect.height);
         }
     }
 }
 
+/* Copy the damage to the window, and put back the markers of selected
+ * nodes in it
+ */
+static void damage_flush(AutoMap *automap, struct win_scale *ws)
+{
+    gint i;
+
+    if (automap->draw_area->window == NULL)
+    {
+        automap->damage_count = 0;
+        return;
+    }
+
+    for (i = 0; i < automap->damage_count; i++)
+    {
+        Rectangle *rect = &automap->damage[i];
+
+        gdk_draw_pixmap(automap->draw_area->window,
+                        automap->draw_area->style->fg_gc[GTK_WIDGET_STATE (automap->draw_area)],
+                        automap->pixmap, rect->x, rect->y, rect->x, rect->y,
+                        rect->width, rect->height);
+    }
+
+    draw_selected(automap, ws, automap->damage, automap->damage_count);
+    automap->damage_count = 0;
+}
+
 static
 void draw_player(AutoMap *automap, struct win_scale *ws, MapNode *node)
 {
@@ -1451,7 +1793,7 @@ void draw_player(AutoMap *automap, struct win_scale *ws, MapNode *node)
 
     if (adjust(ws, &rect))
     {
-        gdk_draw_arc(automap->pixmap,
+        gdk_draw_arc(ws->drawable,
                      automap->draw_area->style->black_gc, TRUE,
                      rect.x, rect.y, rect.width, rect.height, 0, 360*64);
     }
@@ -1471,7 +1813,7 @@ void clear_block(AutoMap *automap, struct win_scale *ws, gint x, gint y)
 
     if (adjust(ws, &rect))
     {
-        gdk_draw_rectangle(automap->pixmap,
+        gdk_draw_rectangle(ws->drawable,
                            automap->draw_area->style->white_gc,
                            TRUE, rect.x , rect.y, rect.width, rect.height);
     }
@@ -1479,118 +1821,31 @@ void clear_block(AutoMap *automap, struct win_scale *ws, gint x, gint y)
 
 static
 void draw_nodes (AutoMap *automap, struct win_scale *ws,
-                 MapNode *start, MapNode *parent, GHashTable *hash)
+                 MapNode *start, MapNode *parent)
 {
     int i;
     MapNode *next;
 
-    if (hash)
+    if (parent)
     {
-        GSList *unvisited = NULL, *puck;
-        guint8 *count = g_hash_table_lookup(hash, start);
-        guint8 *next_count;
-
-        if (start->x < automap->map->min_x)
-            automap->map->min_x = start->x;
-        else if (start->x > automap->map->max_x)
-            automap->map->max_x = start->x;
-
-        if (start->y < automap->map->min_y)
-            automap->map->min_y = start->y;
-        else if (start->y < automap->map->min_y)
-            automap->map->max_y = start->y;
-
         for (i = 0; i < 8; i++)
         {
             next = start->connections[i].node;
 
-            if (!next) continue;
-            next_count = g_hash_table_lookup(hash, next);
-
-            if (!next_count)
-            {
-                next_count = g_malloc0(sizeof(guint8));
-                g_hash_table_insert(hash, next, next_count);
-                unvisited = g_slist_prepend(unvisited, next);
-            } else if (*next_count == next->conn)
-                continue;
-
-            (*count)++;
-            (*next_count)++;
-
-#if DEBUG
-            if (start->x <= next->x)
-                g_print("Drawing from (%3d, %3d) to (%3d, %3d)\n",
-                        start->x, start->y, next->x, next->y);
-            else
-                g_print("Drawing from (%3d, %3d) to (%3d, %3d)\n",
-                        next->x, next->y, start->x, start->y);
-#endif
-            draw_line(automap, ws, next, start);
-        }
-
-        for (puck = unvisited; puck != NULL; puck = puck->next)
-            draw_nodes(automap, ws, (MapNode *)puck->data, start, hash);
-        
-        g_slist_free(unvisited);
-    } else {
-        if (parent)
-        {
-            for (i = 0; i < 8; i++)
-            {
-                next = start->connections[i].node;
-
             if (next && next != parent)
                 draw_line(automap, ws, next, start);
-            }
-        } else {
-
-            /* Clear this entire pixel block */
-            clear_block(automap, ws, start->x, start->y);
-
-            for (i = 0; i < 8; i++)
-            {
-                next = start->connections[i].node;
-
-                if (next)
-                    draw_line(automap, ws, next, start);
-            }
         }
-    }
-
-    /* Now insert the node into the visible nodes list (for selecting items)
-     */
-    if (node_visible (start, ws))
-    {
-        GList *puck = automap->visible;
+    } else {
 
-        for (; puck != NULL; puck = puck->next)
-        {
-            if ( ((RectNode *)puck->data)->node == start )
-                break;
-        }
+        /* Clear this entire pixel block */
+        clear_block(automap, ws, start->x, start->y);
 
-        if (puck == NULL)
+        for (i = 0; i < 8; i++)
         {
-            /* Not in the list */
-            RectNode *rn = g_malloc0(sizeof(RectNode));
-
-            if (rn == NULL)
-            {
-                g_error("draw_nodes: g_malloc0 error: %s\n", strerror(errno));
-                gtk_exit(1);
-            }
-
-            rn->rectangle.x = (start->x - automap->x) * ws->mapped_unit +
-                ws->width / 2 - 3;
-
-            rn->rectangle.y = ws->height / 2 - (gint)((start->y - automap->y) *
-                                                      ws->mapped_unit) - 3;
-
-            rn->rectangle.width = rn->rectangle.height = 6;
-            rn->node = start;
+            next = start->connections[i].node;
 
-            automap->visible = g_list_prepend(automap->visible, rn);
+            if (next)
+                draw_line(automap, ws, next, start);
         }
     }
 
@@ -1603,21 +1858,6 @@ void draw_nodes (AutoMap *automap, struct win_scale *ws,
  */
 void redraw_map(AutoMap *automap)
 {
-    GList *puck;
-
-    /* Clear the pixmap ... */
-    gdk_draw_rectangle(automap->pixmap,
-                       automap->draw_area->style->white_gc, TRUE, 0, 0,
-                       automap->draw_area->allocation.width,
-                       automap->draw_area->allocation.height);
-
-    /* Remove the visible elements list */
-    for (puck = automap->visible; puck != NULL; puck = puck->next)
-        free(puck->data);
-
-    g_list_free(automap->visible);
-    automap->visible = NULL;
-
     /* Draw the map */
     draw_map(automap);
 
@@ -1629,142 +1869,159 @@ void redraw_map(AutoMap *automap)
                     automap->draw_area->allocation.height
                    );
 
-    draw_selected(automap, map_coords(automap));
-}
-
-gboolean free_node_count (MapNode *key, guint8 *count, gpointer user_data)
-{
-    free(count);
-    return TRUE;
+    /* All of it is up to date now */
+    automap->damage_count = 0;
+    draw_selected(automap, map_coords(automap), NULL, 0);
 }
 
 void draw_map (AutoMap *automap)
 {
     struct win_scale *ws = map_coords(automap);
-    GList *puck;
-
-    /* Iterate over all the nodes in automap->map, and recursively draw
-     * all those nodes which are on the screen
-      */
-
-    for (puck = automap->map->nodelist; puck != NULL; puck = puck->next)
-    {
-        GHashTable *hash = g_hash_table_new((GHashFunc)node_hash, (GCompareFunc)node_comp );
-        MapNode *start = puck->data;
-        guint8 *count = g_malloc0(sizeof(guint8));
 
-        if (!count)
-        {
-            g_error("draw_map: g_malloc0 error: %s\n", strerror(errno));
-            gtk_exit(1);
-        }
-
-        g_hash_table_insert(hash, start, count);
-        draw_nodes(automap, ws, start, NULL, hash);
-        g_hash_table_foreach_remove(hash, (GHRFunc)free_node_count, NULL);
-        g_hash_table_destroy(hash);
-    }
+    /* The map itself is put together from pieces drawn earlier, only
+     * the ones changed since are drawn again
+     */
+    map_tile_compose(automap, ws);
 
     /* Draw the player */
     if (automap->player)
         draw_player(automap, ws, automap->player);
 }
 
-static void get_node(GHashTable *hash, MapNode *node, gint *n)
+/* Collect every node reachable from the nodes of map, following up and
+ * down links into other maps, into hash
+ */
+static void get_nodes(GHashTable *hash, Map *map)
 {
-    gint *num = g_malloc(sizeof(gint));
+    GSList *stack = NULL;
+    GList *puck;
     gint i;
 
-    if (!num)
+    for (puck = map->nodelist; puck != NULL; puck = puck->next)
     {
-        g_error("get_node: g_malloc error: %s\n", strerror(errno));
-        gtk_exit(1);
-    }
+        if (g_hash_table_lookup(hash, puck->data))
+            continue;
 
-    *num = (*n)++;
-    g_hash_table_insert(hash, node, num);
+        g_hash_table_insert(hash, puck->data, puck->data);
+        stack = g_slist_prepend(stack, puck->data);
+    }
 
-    for (i = 0; i < 8; i++)
+    while (stack)
     {
-        MapNode *next = node->connections[i].node;
+        MapNode *node = stack->data;
+        stack = g_slist_remove(stack, node);
 
-        if (next && !g_hash_table_lookup(hash, next))
-            get_node(hash, next, n);
-    }
+        for (i = 0; i < 10; i++)
+        {
+            MapNode *next = node->connections[i].node;
 
-    for (i = 8; i < 10; i++)
-    {
-        MapNode *next = node->connections[i].node;
+            if (!next || g_hash_table_lookup(hash, next))
+                continue;
 
-        if (next && !g_hash_table_lookup(hash, next))
-            get_nodes(hash, next->map, n);
+            if (i < 8)
+            {
+                g_hash_table_insert(hash, next, next);
+                stack = g_slist_prepend(stack, next);
+            } else {
+                get_nodes(hash, next->map);
+            }
+        }
     }
 }
 
-static void get_nodes(GHashTable *hash, Map *map, int *n)
-{
-    GList *puck;
-
-    for (puck = map->nodelist; puck != NULL; puck = puck->next)
-    {
-        MapNode *node = puck->data;
+/* What map_write() writes, copied as it is at one time, so that it can
+ * be written out later, or in another thread, however the maps change
+ * meanwhile. Copying is far less work than writing: rooms are copied
+ * as they are, and their info is held rather than copied, see
+ * map_info_hold()
+ */
+typedef struct {
+
+    guint32     id;
+    gint32      x, y;
+    gchar      *map;        /* One of the snapshot's names             */
+    guint32     next[10];
+    guint16     linked;     /* Bit i is set if next[i] is a room       */
+    guint8      kind[10];
+    guint32     fingerprint;
+    MapRoomInfo info;
+    gint        block;      /* Of the description, see map_info_hold() */
+} SnapshotNode;
+
+struct _MapSnapshot {
+
+    GString      *head;     /* The automap, map and costs lines        */
+    GHashTable   *names;    /* Map -> its name, copied                 */
+    SnapshotNode *nodes;
+    guint         count;
+};
 
-        if (g_hash_table_lookup(hash, node))
-            continue;
+struct snapshot_take {
 
-        get_node(hash, node, n);
-    }
-}
+    MapSnapshot *snapshot;
+    GHashTable  *written;   /* Description -> its number               */
+};
 
-void write_node(MapNode *node, guint *num, void *data[2])
+static void snapshot_node(MapNode *node, MapNode *value,
+                          struct snapshot_take *take)
 {
-    FILE *file = data[0];
-    GHashTable *hash = data[1];
+    MapSnapshot *snapshot = take->snapshot;
+    SnapshotNode *copy = &snapshot->nodes[snapshot->count++];
     int i;
 
-    fprintf(file, "%d (%d, %d) %s ", *num, node->x, node->y, node->map->name);
+    copy->id = node->id;
+    copy->x = node->x;
+    copy->y = node->y;
+    copy->fingerprint = node->fingerprint;
+
+    if ((copy->map = g_hash_table_lookup(snapshot->names, node->map)) == NULL)
+    {
+        copy->map = g_strdup(node->map->name);
+        g_hash_table_insert(snapshot->names, node->map, copy->map);
+    }
+
+    copy->linked = 0;
 
     for (i = 0; i < 10; i++)
     {
         MapNode *next = node->connections[i].node;
 
-        fprintf(file, "%s %d ", direction[i],
-                next ? *(gint *)g_hash_table_lookup(hash, next) : -1 );
-    }
+        if (next)
+        {
+            copy->next[i] = next->id;
+            copy->linked |= 1 << i;
+        }
 
-    fputs("\n", file);
-}
+        copy->kind[i] = node->connections[i].kind;
+    }
 
-gboolean remove_node(MapNode *node, guint *num, void *data)
-{
-    g_free(num);
-    return TRUE;
+    copy->block = map_info_hold(&copy->info, node, take->written);
 }
 
-static void save_maps(gchar *filename, AutoMap *automap)
+/* Copy what map_write() writes about the maps reachable from
+ * automap->map. seq is the number of the last journal record the
+ * snapshot contains
+ */
+MapSnapshot *map_snapshot_take(AutoMap *automap, guint32 seq)
 {
+    MapSnapshot *snapshot = g_new0(MapSnapshot, 1);
+    struct snapshot_take take;
     GHashTable *hash;
+    GString *out;
     GList *puck;
     Map *map;
-    FILE *file;
-    int n = 0;
-    void *data[2];
-
-    file = fopen(filename, "w");
-
-    if (file == NULL)
-    {
-        g_warning("save_maps: Can't open %s for writing: %s\n",
-                  filename, strerror(errno));
-        return;
-    }
 
     hash = g_hash_table_new(g_direct_hash, g_direct_equal);
-    get_nodes(hash, automap->map, &n);
+    get_nodes(hash, automap->map);
 
-    fprintf(file, "automap map %s player %d zoom %.2f, center (%d, %d)\n",
-            automap->map->name, *(gint *)g_hash_table_lookup(hash, automap->player),
-            automap->zoom, automap->x, automap->y);
+    out = snapshot->head = g_string_new(NULL);
+    snapshot->names = g_hash_table_new(g_direct_hash, g_direct_equal);
+    snapshot->nodes = g_new(SnapshotNode, g_hash_table_size(hash));
+
+    g_string_sprintfa(out, "automap map %s player %d zoom %.2f, center (%d, %d) journal %u\n",
+                      automap->map->name,
+                      automap->player ? (gint)automap->player->id : -1,
+                      automap->zoom, automap->x, automap->y, seq);
 
     /* For all maps known, if elements in the map's nodelist are
      * in the hash, then all nodes in that map are saved. We
@@ -1778,26 +2035,159 @@ static void save_maps(gchar *filename, AutoMap *automap)
 
         map = puck->data;
 
-        if (!g_hash_table_lookup(hash, map->nodelist->data))
+        if (!map->nodelist || !g_hash_table_lookup(hash, map->nodelist->data))
             continue;
 
-        fprintf(file, "map %s min_x %d min_y %d max_x %d max_y %d nodelist ", map->name,
-                map->min_x, map->min_y, map->max_x, map->max_y);
+        g_string_sprintfa(out, "map %s min_x %d min_y %d max_x %d max_y %d nodelist ",
+                          map->name, map->min_x, map->min_y, map->max_x, map->max_y);
 
         for (inner = map->nodelist; inner != NULL; inner = inner->next)
-            fprintf(file, "%d ", *(gint *)g_hash_table_lookup(hash, inner->data));
+            g_string_sprintfa(out, "%u ", ((MapNode *)inner->data)->id);
+
+        g_string_append(out, "\n");
+
+        if (!map_cost_is_default(map))
+        {
+            gint kind;
+
+            g_string_sprintfa(out, "costs %s ", map->name);
 
-        fputs("\n", file);
+            for (kind = 0; kind < MAP_EDGE_KINDS; kind++)
+                g_string_sprintfa(out, "%d ", map->cost[kind]);
+
+            g_string_append(out, "\n");
+        }
     }
 
-    data[0] = file;
-    data[1] = hash;
+    take.snapshot = snapshot;
+    take.written = g_hash_table_new(g_direct_hash, g_direct_equal);
 
-    g_hash_table_foreach(hash, (GHFunc)write_node, (gpointer)data);
-    g_hash_table_foreach_remove(hash, (GHRFunc)remove_node, NULL);
+    g_hash_table_foreach(hash, (GHFunc)snapshot_node, &take);
+    g_hash_table_destroy(take.written);
     g_hash_table_destroy(hash);
 
-    fclose(file);
+    return snapshot;
+}
+
+/* Write snapshot to out, in the same format load_automap_from_file()
+ * reads. Touches nothing but the two, so it can be done in another
+ * thread, as long as out was made in this one
+ */
+void map_snapshot_write(GString *out, MapSnapshot *snapshot)
+{
+    SnapshotNode *node;
+    int i;
+
+    g_string_append(out, snapshot->head->str);
+
+    for (node = snapshot->nodes; node < snapshot->nodes + snapshot->count; node++)
+    {
+        g_string_sprintfa(out, "%u (%d, %d) %s ", node->id, node->x, node->y,
+                          node->map);
+
+        for (i = 0; i < 10; i++)
+        {
+            if (node->linked & (1 << i))
+                g_string_sprintfa(out, "%s %u ", direction[i], node->next[i]);
+            else
+                g_string_sprintfa(out, "%s -1 ", direction[i]);
+        }
+
+        /* Only rooms with other than plain ways out need these */
+        for (i = 0; i < 10; i++)
+            if (node->kind[i] != MAP_EDGE_PLAIN)
+                break;
+
+        if (i < 10)
+        {
+            g_string_append(out, "kinds ");
+
+            for (i = 0; i < 10; i++)
+                g_string_sprintfa(out, "%d ", node->kind[i]);
+        }
+
+        /* Rooms seen from the mud, see map_room.c */
+        if (node->fingerprint)
+            g_string_sprintfa(out, "room %u ", node->fingerprint);
+
+        g_string_append(out, "\n");
+        map_info_write(out, &node->info, node->block);
+    }
+}
+
+static gboolean snapshot_name_free(Map *map, gchar *name, gpointer data)
+{
+    g_free(name);
+
+    return TRUE;
+}
+
+void map_snapshot_free(MapSnapshot *snapshot)
+{
+    guint i;
+
+    for (i = 0; i < snapshot->count; i++)
+        map_info_let_go(&snapshot->nodes[i].info);
+
+    g_hash_table_foreach_remove(snapshot->names, (GHRFunc)snapshot_name_free, NULL);
+    g_hash_table_destroy(snapshot->names);
+    g_string_free(snapshot->head, TRUE);
+    g_free(snapshot->nodes);
+    g_free(snapshot);
+}
+
+/* Write the maps reachable from automap->map to out, in the same
+ * format load_automap_from_file() reads. seq is the number of the last
+ * journal record written
+ */
+void map_write(GString *out, AutoMap *automap, guint32 seq)
+{
+    MapSnapshot *snapshot = map_snapshot_take(automap, seq);
+
+    map_snapshot_write(out, snapshot);
+    map_snapshot_free(snapshot);
+}
+
+/* Saving to the file the maps came from (or were last saved to) just
+ * folds the journal in. Saving anywhere else moves the journal along
+ * with it, so later changes are recorded against the new file
+ */
+void save_maps(gchar *filename, AutoMap *automap)
+{
+    if (automap->journal == NULL || automap->filename == NULL ||
+        strcmp(filename, automap->filename) != 0)
+    {
+        gchar *journalname = g_strconcat(filename, ".journal", NULL);
+
+        gchar *autosave = map_autosave_filename();
+
+        if (automap->journal)
+            map_journal_close(automap->journal);
+
+        unlink(journalname);
+        g_free(journalname);
+
+        /* Once saved somewhere else, the autosave is no longer needed */
+        if (autosave && automap->filename &&
+            !strcmp(autosave, automap->filename))
+        {
+            journalname = g_strconcat(autosave, ".journal", NULL);
+            unlink(autosave);
+            unlink(journalname);
+            g_free(journalname);
+        }
+
+        g_free(autosave);
+
+        g_free(automap->filename);
+        automap->filename = g_strdup(filename);
+        automap->journal = map_journal_open(automap, filename, 0);
+
+        if (automap->journal == NULL)
+            return;
+    }
+
+    map_journal_compact(automap->journal);
 }
 
 gboolean free_nodes(MapNode *key, GList *value, GList **maps)
@@ -1826,6 +2216,7 @@ gboolean free_nodes(MapNode *key, GList *value, GList **maps)
             }
         }
 
+        map_info_clear(NULL, node);
         g_free(node);
     }
 
@@ -1848,16 +2239,34 @@ void free_maps(AutoMap *automap)
         g_hash_table_foreach_remove(map->nodes, (GHRFunc)free_nodes, &list);
         g_hash_table_destroy(map->nodes);
         g_list_free(map->nodelist);
+        map_lod_free(map);
         g_free(map->name);
         g_free(map);
     }
 
+    if (automap->journal)
+        map_journal_close(automap->journal);
+
+    automap->journal = NULL;
+    g_free(automap->filename);
+    automap->filename = NULL;
+
+    g_hash_table_destroy(automap->ids);
+    automap->ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    automap->next_id = 0;
+    map_connect_invalidate(automap);
+    map_route_flush(automap);
+    map_landmark_free(automap);
+    map_room_free(automap);
+    map_info_forget(automap);
+    map_info_free(automap);
+    map_undo_free(automap);
+
     automap->player = NULL;
     automap->map = NULL;
     automap->x = automap->y = 0;
-    g_list_free(automap->visible);
+    map_tile_flush(automap);
 
-    automap->visible = NULL;
     g_list_free(automap->selected);
     automap->selected = NULL;
     automap->state = NONE;
@@ -1873,7 +2282,7 @@ void file_sel_ok_cb(GtkWidget *widget, void *ptr[])
 
     struct stat filestat;
 
-    if (type == LOAD)
+    if (type == LOAD || type == MERGE)
     {
         if (stat(filename, &filestat) != 0)
         {
@@ -1904,11 +2313,11 @@ void file_sel_ok_cb(GtkWidget *widget, void *ptr[])
          * read/written to ...
          */
 
-        FILE *file = fopen(filename, type == LOAD ? "r" : "w");
+        FILE *file = fopen(filename, type == SAVE ? "a" : "r");
 
         if (file == NULL)
         {
-            char *action = type == LOAD ? "reading" : "writing";
+            char *action = type == SAVE ? "writing" : "reading";
             g_warning("Can't open file %s for %s: %s\n",
                       filename, action, strerror(errno));
             return;
@@ -1921,6 +2330,16 @@ void file_sel_ok_cb(GtkWidget *widget, void *ptr[])
     {
         free_maps(automap);
         load_automap_from_file(filename, automap);
+    } else if (type == MERGE) {
+        GString *report = map_merge_file(automap, filename, TRUE);
+
+        if (report)
+        {
+            map_merge_window(automap, report);
+            g_string_free(report, TRUE);
+            scrollbar_adjust(automap);
+            redraw_map(automap);
+        }
     } else {
         save_maps(filename, automap);
     }
@@ -1963,7 +2382,16 @@ static void button_cb(GtkWidget *widget, AutoMap *automap)
         remove_player_node(automap);
         break;
 
+    case COSTS:
+        map_cost_window(automap);
+        break;
+
+    case INFO:
+        map_info_window(automap);
+        break;
+
     case LOAD:
+    case MERGE:
     case SAVE:
 
         ptr = g_malloc(sizeof(void *[3]));
@@ -1972,246 +2400,99 @@ static void button_cb(GtkWidget *widget, AutoMap *automap)
         {
             g_error("button_cb: g_malloc error: %s\n", strerror(errno));
             return;
-        }
-
-        find = gtk_file_selection_new(type == LOAD ? "Load map" : "Save map");
-
-        ptr[0] = (void *)type;
-        ptr[1] = automap;
-        ptr[2] = find;
-
-        home = g_get_home_dir();
-
-        if (home == NULL)
-        {
-            strcpy(dir, "default.map");
-        } else {
-            strcpy(dir, home);
-            strcat(dir, "/.amcl/");
-
-            if (!stat(dir, &dirstat) && S_ISDIR(dirstat.st_mode)) {
-                strcat(dir, "default.map");
-            } else {
-                strcpy(dir, "default.map");
-            }
-        }
-
-        gtk_file_selection_set_filename(GTK_FILE_SELECTION(find), dir);
-        gtk_file_selection_hide_fileop_buttons(GTK_FILE_SELECTION (find));
-        
-        gtk_signal_connect(GTK_OBJECT (GTK_FILE_SELECTION (find)->ok_button),
-                           "clicked", GTK_SIGNAL_FUNC(file_sel_ok_cb), ptr);
-        gtk_signal_connect(GTK_OBJECT (GTK_FILE_SELECTION (find)->cancel_button),
-                           "clicked", GTK_SIGNAL_FUNC(file_sel_cancel_cb), ptr);
-        gtk_signal_connect(GTK_OBJECT (find), "delete_event",
-                           GTK_SIGNAL_FUNC(file_sel_delete_event), ptr);
-
-        gtk_widget_show(find);
-        break;
-
-    default:
-        move_player(automap, type);
-    }
-
-    return;
-}
-
-static
-gint can_reach_node(MapNode *current, MapNode *dest,
-                    GHashTable *hash)
-{
-    int i;
-
-    if (g_hash_table_lookup(hash, current))
-        return FALSE;
-
-    g_hash_table_insert(hash, current, current);
-
-    for (i = 0; i <= 9; i++)
-    {
-        MapNode *next = current->connections[i].node;
-
-        if (next == NULL) continue;
-
-        if (next == dest) return TRUE;
-
-        if (can_reach_node(next, dest, hash)) return TRUE;
-    }
-
-    return FALSE;
-}
-
-gint sp_compare(SPVertex *insert, SPVertex *listnode)
-{
-    return insert->working - listnode->working;
-}
-
-void fill_node_path (SPVertex *cvertex, MapNode *dest,
-                     GHashTable *hash, GList **list)
-{
-    gint i;
-    MapNode *next;
-    SPVertex *vertex;
-
-    /* Step 1:
-     *
-     * Look at all connections, add them to the list
-     * Cut some corners because the weighting is guaranteed
-     * (for now) to be one
-     */
+        }
 
-    for (i = 0; i < 10; i++)
-    {
-        next = cvertex->node->connections[i].node;
+        find = gtk_file_selection_new(type == LOAD  ? "Load map"  :
+                                      type == MERGE ? "Merge map" : "Save map");
 
-        if (!next) continue;
+        ptr[0] = (void *)type;
+        ptr[1] = automap;
+        ptr[2] = find;
 
-        vertex = g_hash_table_lookup(hash, next);
+        home = g_get_home_dir();
 
-        if (vertex == NULL)
+        if (home == NULL)
         {
-            vertex = g_malloc(sizeof(SPVertex));
+            strcpy(dir, "default.map");
+        } else {
+            strcpy(dir, home);
+            strcat(dir, "/.amcl/");
 
-            if (vertex == NULL)
-            {
-                g_error("fill_node_path: g_malloc error: %s\n", strerror(errno));
-                gtk_exit(1);
+            if (!stat(dir, &dirstat) && S_ISDIR(dirstat.st_mode)) {
+                strcat(dir, "default.map");
+            } else {
+                strcpy(dir, "default.map");
             }
+        }
 
-            vertex->node = next;
-            vertex->label = -1;
-            vertex->working = cvertex->label + 1;
-
-            g_hash_table_insert(hash, next, vertex);
-            *list = g_list_insert_sorted(*list, vertex, (GCompareFunc)sp_compare);
+        gtk_file_selection_set_filename(GTK_FILE_SELECTION(find), dir);
+        gtk_file_selection_hide_fileop_buttons(GTK_FILE_SELECTION (find));
+        
+        gtk_signal_connect(GTK_OBJECT (GTK_FILE_SELECTION (find)->ok_button),
+                           "clicked", GTK_SIGNAL_FUNC(file_sel_ok_cb), ptr);
+        gtk_signal_connect(GTK_OBJECT (GTK_FILE_SELECTION (find)->cancel_button),
+                           "clicked", GTK_SIGNAL_FUNC(file_sel_cancel_cb), ptr);
+        gtk_signal_connect(GTK_OBJECT (find), "delete_event",
+                           GTK_SIGNAL_FUNC(file_sel_delete_event), ptr);
 
-        } else if (vertex->label == -1) {
+        gtk_widget_show(find);
+        break;
 
-            if (vertex->working > cvertex->working + 1)
-            {
-                vertex->working = cvertex->working + 1;
-                *list = g_list_remove(*list, vertex);
-                *list = g_list_insert_sorted(*list, vertex, (GCompareFunc)sp_compare);
-            }
-        }
+    default:
+        move_player(automap, type);
     }
-}
 
-gboolean free_vertexes (MapNode *key, SPVertex *vertex, gpointer user_data)
-{
-    g_free(vertex);
-    return TRUE;
+    return;
 }
 
 void node_goto(AutoMap *automap, struct win_scale *ws, MapNode *dest)
 {
-    GHashTable *hash;
-    GList *list = NULL, *puck;
-    guint16 order[10] = { 0, 2, 4, 6, 1, 3, 5, 7, 9, 10 };
-    SPVertex *vertex = g_malloc0(sizeof(SPVertex));
-
-    if (vertex == NULL)
-    {
-        g_error("node_goto: g_malloc0 error: %s\n", strerror(errno));
-        gtk_exit(1);
-    }
-
-    if (dest == automap->player) return;
+    GList *route, *puck;
 
     /* What makes this function interesting is that we must be able
-     * to traverse up and down nodes too
-     */
-    hash = g_hash_table_new( (GHashFunc)g_direct_hash, (GCompareFunc)g_direct_equal);
-
-    if (!can_reach_node(automap->player, dest, hash))
-        return;
-
-    g_hash_table_destroy(hash);
-
-    /* Use Dijkstra's shortest path algorithm, with the weighting between
-     * nodes set at a constant of 1
-     */
-
-    hash = g_hash_table_new( (GHashFunc)g_direct_hash, (GCompareFunc)g_direct_equal);
-
-    vertex->node = automap->player;
-
-    g_hash_table_insert(hash, automap->player, vertex);
-    list = g_list_prepend(NULL, vertex);
-
-    do {
-        vertex = (SPVertex *)list->data;
-        list = g_list_remove_link(list, list);
-        vertex->label = vertex->working;
-
-        if (vertex->node != dest)
-            fill_node_path(vertex, dest, hash, &list);
-    } while (list);
-
-    /* Now start from the destination node, and work our way back to the start
-     * node
+     * to traverse up and down nodes too, see map_route.c
      */
+    route = map_route(automap, automap->player, dest);
 
-    vertex = g_hash_table_lookup(hash, dest);
-
-    for (;;)
+    /* And do something with this list */
+    for (puck = route; puck != NULL; puck = puck->next)
     {
-        gint i;
-        MapNode *node;
-        SPVertex *next;
-
-        for (i = 0; i < 10; i++)
-        {
-            node = vertex->node->connections[order[i]].node;
-
-            if (!node) continue;
-
-            next = g_hash_table_lookup(hash, node);
-
-            if (next == NULL)
-            {
-                /* This can happen and is normal
-                 * g_print("Hmm, next vertex is null");
-                 * while (1);
-                 */
-                continue;
-            }
+        g_print(puck->next == NULL ? "%s\n" : "%s, ",
+                direction_long[GPOINTER_TO_INT(puck->data)]);
+    }
 
-            if (vertex->label - next->label == 1)
-            {
-                vertex = next;
-                break;
-#if 0
-            } else {
-                g_print("From (%d, %d): %d tried (%d, %d): %d\n",
-                        vertex->node->x, vertex->node->y, vertex->label,
-                        next->node->x, next->node->y, next->label);
-#endif
-            }
-        }
+    g_list_free(route);
+}
 
-        if (i == 10)
-        {
-            g_print("Currently at (%d, %d)\n", vertex->node->x, vertex->node->y);
-            g_print("Hmm, no connections led to node\n");
-            while(1);
-        }
+/* Make the way in direction type the next kind of way, both ways
+ */
+void node_kind(AutoMap *automap, guint type)
+{
+    MapNode *this = automap->player;
+    MapNode *next = automap->player->connections[type].node;
+    guint kind = (this->connections[type].kind + 1) % MAP_EDGE_KINDS;
+    MapOp op;
 
-        list = g_list_prepend(list, direction_long[OPPOSITE(order[i])]);
-        if (vertex->node == automap->player) break;
+    if (!next)
+    {
+        g_warning("node_kind: no node existed in that direction\n");
+        return;
     }
 
-    /* And now free the hash table and all vertexes with in */
-    g_hash_table_foreach_remove(hash, (GHRFunc)free_vertexes, NULL);
-    g_hash_table_destroy(hash);
+    memset(&op, 0, sizeof(op));
+    op.type = MAP_OP_EDGE;
+    op.node = this->id;
+    op.dir = type;
+    op.x = kind;
+    map_op_apply(automap, &op);
+    map_record(automap, &op);
 
-    /* And do something with this list */
-    for (puck = list; puck != NULL; puck = puck->next)
-    {
-        g_print(puck->next == NULL ? "%s\n" : "%s, ", (gchar *)puck->data);
-    }
+    op.node = next->id;
+    op.dir = OPPOSITE(type);
+    map_op_apply(automap, &op);
+    map_record(automap, &op);
 
-    g_list_free(list);
+    g_print("%s is now %s\n", direction_long[type], map_edge_names[kind]);
 }
 
 void node_break(AutoMap *automap, guint type)
@@ -2223,7 +2504,7 @@ void node_break(AutoMap *automap, guint type)
     struct win_scale *ws = map_coords(automap);
     GHashTable *hash, *thishash;
 
-    if (!this)
+    if (!next)
     {
         g_warning("node_break: no node existed in that direction\n");
         return;
@@ -2248,13 +2529,23 @@ void node_break(AutoMap *automap, guint type)
 
     automap->player = next;
 
+    map_record_plain(automap, this, type);
+    map_record_link(automap, MAP_OP_UNLINK, this, type, next);
+    map_record_player(automap, this->id);
+
+    /* With the link that is going */
+    damage_node(automap, ws, this, TRUE);
+
     blank_nodes(automap, ws, nodelist);
     memset(&this->connections[type], 0, sizeof(*this->connections));
     memset(&next->connections[OPPOSITE(type)], 0, sizeof(*next->connections));
-    draw_nodes(automap, ws, this, NULL, NULL);
-    draw_nodes(automap, ws, next, NULL, NULL);
+    this->conn--;
+    next->conn--;
+    draw_nodes(automap, ws, this, NULL);
+    draw_nodes(automap, ws, next, NULL);
     draw_player(automap, ws, next);
-    blit_nodes(automap, ws, nodelist);
+    damage_node(automap, ws, next, TRUE);
+    damage_flush(automap, ws);
 
     /* If removing this link means one section of the map will be unreachable
      * from the other section of the map, then add the unreachable
@@ -2283,7 +2574,6 @@ void move_player(AutoMap *automap, guint type)
 {
     MapNode *this = automap->player;
     MapNode *next = automap->player->connections[type].node;
-    struct win_scale *ws = map_coords(automap);
     guint opposite = OPPOSITE(type);
     gboolean redraw = FALSE;
 
@@ -2297,6 +2587,14 @@ void move_player(AutoMap *automap, guint type)
         return;
     }
 
+    if (automap->node_kind)
+    {
+        automap->node_kind = FALSE;
+        node_kind(automap, type);
+
+        return;
+    }
+
     /* Check if this is following a path */
     if (next)
     {
@@ -2305,51 +2603,36 @@ void move_player(AutoMap *automap, guint type)
          * be redrawn
          */
 
-        /* If the node is on a different map, recenter the map */
         automap->map    = next->map;
         automap->player = next;
-
-        if (automap->map != this->map)
-        {
-            automap->x = next->x;
-            automap->y = next->y;
-
-            redraw = TRUE;
-        }
+        map_record_player(automap, this->id);
     } else {
         /* See if there are any nodes on this path */
         if (type == UP || type == DOWN)
         {
             /* Create a new map */
             automap->map = map_new();
-            next = g_malloc0(sizeof(MapNode));
-
-            if (next == NULL)
-            {
-                g_error("main: g_malloc0 error: %s\n", strerror(errno));
-                gtk_exit(1);
-            }
+            next = map_node_new(automap, automap->map, MAP_NODE_ID_ANY, 0, 0);
 
-            /* Add this unreferenced initial node to the map and hash */
+            /* Add this unreferenced initial node to the map */
             automap->map->nodelist = g_list_append(automap->map->nodelist, next);
-            node_hash_prepend(automap->map->nodes, next);
+
+            map_record_map(automap, MAP_OP_MAP_NEW, automap->map);
+            map_record_node(automap, MAP_OP_NODE_NEW, next);
+            map_record_link(automap, MAP_OP_LINK, this, type, next);
 
             /* Link the two nodes up */
-            next->map = automap->map;
             next->connections[opposite].node = automap->player;
             automap->player->connections[type].node = next;
             automap->player = next;
+            map_record_player(automap, this->id);
 
             /* Reset the scrollbar stuff, fixed up selected data
-             * redraw_map takes care of freeing automap->visible
              */
             automap->last_hvalue = 0;
             automap->last_vvalue = 0;
             remove_selected(automap);
 
-            /* Recalculate the common window info calculated */
-            ws = map_coords(automap);
-
             redraw = TRUE;
         } else {
             GList *list;
@@ -2398,22 +2681,21 @@ void move_player(AutoMap *automap, guint type)
 
                 }
             } else {
-                next = g_malloc0(sizeof(MapNode));
-
-                next->x = node.x;
-                next->y = node.y;
-
-                node_hash_prepend(automap->map->nodes, next);
+                next = map_node_new(automap, automap->map, MAP_NODE_ID_ANY,
+                                    node.x, node.y);
+                map_record_node(automap, MAP_OP_NODE_NEW, next);
             }
 
+            map_record_link(automap, MAP_OP_LINK, this, type, next);
+
             next->conn++;
             automap->player->conn++;
 
             next->connections[opposite].node = automap->player;
             automap->player->connections[type].node = next;
 
-            next->map = automap->map;
             automap->player = next;
+            map_record_player(automap, this->id);
         }
     }
 
@@ -2422,15 +2704,43 @@ void move_player(AutoMap *automap, guint type)
      * mud
      */
 
+    map_player_moved(automap, this, redraw);
+}
+
+/* Show node in the middle of the window, selected
+ */
+void map_center(AutoMap *automap, MapNode *node)
+{
+    remove_selected(automap);
+
+    if (automap->map != node->map)
+    {
+        automap->map = node->map;
+        automap->last_hvalue = 0;
+        automap->last_vvalue = 0;
+    }
+
+    automap->selected = g_list_append(NULL, node);
+    automap->x = node->x;
+    automap->y = node->y;
+
+    scrollbar_adjust(automap);
+}
+
+/* Show the player having gone from this to automap->player, recentering
+ * the view if they've left it. redraw forces the whole map to be redrawn
+ */
+void map_player_moved(AutoMap *automap, MapNode *this, gboolean redraw)
+{
+    MapNode *next = automap->player;
+    struct win_scale *ws = map_coords(automap);
+
     /* Check the boundaries to see if they have been extended */
-    if (next->x <= automap->map->min_x)
-        automap->map->min_x = next->x;
-    else if (next->x >= automap->map->max_x)
-        automap->map->max_x = next->x;
-    if (next->y <= automap->map->min_y)
-        automap->map->min_y = next->y;
-    else if (next->y >= automap->map->max_y)
-        automap->map->max_y = next->y;
+    map_extend(automap->map, next);
+
+    /* If the node is on a different map, recenter the map */
+    if (next->map != this->map)
+        redraw = TRUE;
 
     /* If the node is not on the screen, then centre the view, redraw the screen
      * and fix up the scrollbars
@@ -2443,18 +2753,21 @@ void move_player(AutoMap *automap, guint type)
         automap->y = next->y;
 
         scrollbar_adjust(automap);
+    } else if (ws->mapped_unit < MAP_LOD_UNIT) {
+
+        /* Rooms are only shaded cells this far out, see map_lod.c */
+        redraw_map(automap);
     } else {
 
-        /* Pass the old co-ordinates along with the automap details to the drawing
-         * routine
+        /* Only the two rooms and the links between them and their
+         * neighbours are drawn again
          */
-        MapNode *nodelist[] = { this, next, NULL };
-
-        draw_nodes(automap, ws, this, NULL, NULL);
-        draw_nodes(automap, ws, next, this, NULL);
+        draw_nodes(automap, ws, this, NULL);
+        draw_nodes(automap, ws, next, this);
         draw_player(automap, ws, next);
-        blit_nodes(automap, ws, nodelist);
-        draw_selected(automap, ws);
+        damage_node(automap, ws, this, TRUE);
+        damage_node(automap, ws, next, TRUE);
+        damage_flush(automap, ws);
     }
 }
 
@@ -2522,7 +2835,7 @@ AutoMap *auto_map_new(void)
     AutoMap *automap = g_malloc0(sizeof(AutoMap));
     GtkWidget *hbox, *updownvbox, *loadsavevbox, *vbox, *sep;
     GtkWidget *n, *ne, *e, *se, *s, *sw, *w, *nw, *up, *down;
-    GtkWidget *load, *save, *remove;
+    GtkWidget *load, *merge, *save, *remove, *costs, *info, *find;
     GtkWidget *table, *table_draw;
 
     if (automap == NULL)
@@ -2531,6 +2844,8 @@ AutoMap *auto_map_new(void)
         gtk_exit(1);
     }
 
+    automap->ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+
     /* Create main window */
     automap->window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
 
@@ -2640,8 +2955,13 @@ AutoMap *auto_map_new(void)
 
     /* Some buttons */
     load = gtk_button_new_with_label("Load");
+    merge = gtk_button_new_with_label("Merge");
     save = gtk_button_new_with_label("Save");
     remove = gtk_button_new_with_label("Remove");
+    costs = gtk_button_new_with_label("Costs");
+    info = gtk_button_new_with_label("Room");
+    find = map_info_find_box(automap);
+    gtk_widget_set_usize(find, 60, -1);
 
     /* Create button directions */
     n  = gtk_button_new_with_label("N" );
@@ -2670,6 +2990,7 @@ AutoMap *auto_map_new(void)
 
     loadsavevbox = gtk_vbox_new(FALSE, 0);
     gtk_box_pack_start(GTK_BOX(loadsavevbox), load, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(loadsavevbox), merge, FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(loadsavevbox), save, FALSE, FALSE, 0);
 
     updownvbox = gtk_vbox_new(FALSE, 0);
@@ -2679,13 +3000,19 @@ AutoMap *auto_map_new(void)
     vbox = gtk_vbox_new(FALSE, 5);
     gtk_box_pack_start(GTK_BOX(vbox), loadsavevbox, TRUE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(vbox), remove, TRUE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), costs, TRUE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), info, TRUE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), find, TRUE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(vbox), sep, TRUE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(vbox), updownvbox, TRUE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(vbox), table, TRUE, FALSE, 0);
 
     gtk_signal_connect(GTK_OBJECT(load), "clicked", GTK_SIGNAL_FUNC(button_cb), automap);
+    gtk_signal_connect(GTK_OBJECT(merge), "clicked", GTK_SIGNAL_FUNC(button_cb), automap);
     gtk_signal_connect(GTK_OBJECT(save), "clicked", GTK_SIGNAL_FUNC(button_cb), automap);
     gtk_signal_connect(GTK_OBJECT(remove), "clicked", GTK_SIGNAL_FUNC(button_cb), automap);
+    gtk_signal_connect(GTK_OBJECT(costs), "clicked", GTK_SIGNAL_FUNC(button_cb), automap);
+    gtk_signal_connect(GTK_OBJECT(info), "clicked", GTK_SIGNAL_FUNC(button_cb), automap);
 
     gtk_signal_connect(GTK_OBJECT(n)   , "clicked", GTK_SIGNAL_FUNC(button_cb), automap);
     gtk_signal_connect(GTK_OBJECT(ne)  , "clicked", GTK_SIGNAL_FUNC(button_cb), automap);
@@ -2699,8 +3026,12 @@ AutoMap *auto_map_new(void)
     gtk_signal_connect(GTK_OBJECT(down), "clicked", GTK_SIGNAL_FUNC(button_cb), automap);
 
     gtk_widget_show(load);
+    gtk_widget_show(merge);
     gtk_widget_show(save);
     gtk_widget_show(remove);
+    gtk_widget_show(costs);
+    gtk_widget_show(info);
+    gtk_widget_show(find);
 
     gtk_widget_show(n);
     gtk_widget_show(ne);
@@ -2731,13 +3062,12 @@ AutoMap *auto_map_new(void)
     return automap;
 }
 
-Map *map_new(void)
+Map *map_new_with_name(gchar *name)
 {
     Map *map;
-    char name[10];
 
     /* Create our map */
-    map = g_malloc0(sizeof(MapNode));
+    map = g_malloc0(sizeof(Map));
 
     if (map == NULL)
     {
@@ -2745,7 +3075,6 @@ Map *map_new(void)
         gtk_exit(1);
     }
 
-    g_snprintf(name, 10, "AMCL Mapper - map%d", g_list_length(MapList));
     map->name = g_strdup(name);
 
     if (map->name == NULL)
@@ -2755,6 +3084,7 @@ Map *map_new(void)
     }
 
     MapList = g_list_prepend(MapList, map);
+    map_cost_defaults(map);
 
     /* Create the global hash table */
     map->nodes = g_hash_table_new((GHashFunc)node_hash, (GCompareFunc)node_comp);
@@ -2762,12 +3092,40 @@ Map *map_new(void)
     return map;
 }
 
-static void remove_map(Map *map)
+/* Map names end up in the map file and the journal as a single word,
+ * and must be unique for the journal to find the map again
+ */
+Map *map_new(void)
+{
+    gchar name[32];
+    guint n = g_list_length(MapList);
+
+    do
+        g_snprintf(name, 32, "map%u", n++);
+    while (map_find(name));
+
+    return map_new_with_name(name);
+}
+
+Map *map_find(gchar *name)
+{
+    GList *puck;
+
+    for (puck = MapList; puck != NULL; puck = puck->next)
+        if (!strcmp(((Map *)puck->data)->name, name))
+            return puck->data;
+
+    return NULL;
+}
+
+void remove_map(Map *map)
 {
     if (map->nodelist) g_list_free(map->nodelist);
 
     g_hash_table_destroy(map->nodes);
+    map_lod_free(map);
     MapList = g_list_remove(MapList, map);
+    g_free(map->name);
     g_free(map);
 }
 
@@ -2776,11 +3134,62 @@ void window_automap (GtkWidget *button, gpointer data)
     new_automap_with_node ();
 }
 
+/* Maps which haven't been saved anywhere yet are journaled to this file,
+ * so that they can be recovered after a crash
+ */
+static gchar *map_autosave_filename(void)
+{
+    gchar *home = g_get_home_dir();
+    struct stat dirstat;
+    gchar dir[256];
+
+    if (home == NULL)
+        return NULL;
+
+    g_snprintf(dir, 256, "%s/.amcl", home);
+
+    if (stat(dir, &dirstat) || !S_ISDIR(dirstat.st_mode))
+        return NULL;
+
+    return g_strconcat(dir, "/autosave.map", NULL);
+}
+
+static gboolean map_autosave_in_use(gchar *filename)
+{
+    GList *puck;
+
+    for (puck = AutoMapList; puck != NULL; puck = puck->next)
+    {
+        AutoMap *automap = puck->data;
+
+        if (automap->filename && !strcmp(automap->filename, filename))
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
 static void new_automap_with_node(void)
 {
     AutoMap *automap;
     Map *map;
     MapNode *node;
+    gchar *autosave = map_autosave_filename();
+    struct stat filestat;
+
+    if (autosave && map_autosave_in_use(autosave))
+    {
+        g_free(autosave);
+        autosave = NULL;
+    }
+
+    /* Pick up where the last session left off */
+    if (autosave && stat(autosave, &filestat) == 0 && filestat.st_size > 0)
+    {
+        load_automap_from_file(autosave, NULL);
+        g_free(autosave);
+        return;
+    }
 
     /* Create our automaplist ... */
     automap = auto_map_new();
@@ -2792,66 +3201,42 @@ static void new_automap_with_node(void)
     map = map_new();
 
     /* Create our first node and draw it */
-    node = g_malloc0(sizeof(MapNode));
-
-    if (node == NULL)
-    {
-        g_error("main: g_malloc0 error: %s\n", strerror(errno));
-        gtk_exit(1);
-    }
+    node = map_node_new(automap, map, MAP_NODE_ID_ANY, 0, 0);
 
-    /* Add this unreferenced initial node to the map and hash */
+    /* Add this unreferenced initial node to the map */
     map->nodelist = g_list_append(map->nodelist, node);
-    node_hash_prepend(map->nodes, node);
 
     /* Finalise the automap details before configure events occur */
-    automap->map = node->map = map;
+    automap->map = map;
     automap->player = node;
 
-    /* Display the main window in the main() routine (ensures the
-     * first node is drawn
-     */
-    gtk_widget_show(automap->window);
-}
-
-static gchar *get_token(gchar *text, gchar *token)
-{
-    while (isspace(*text) || *text == ',') text++;
-    if (*text == 0)
-        return NULL;
-
-    for (; !isspace(*text) && *text != ',' && *text != 0; text++) {
-        if (*text == '(' || *text == ')')
-            continue;
-        *token++ = *text;
-    }
-
-    *token = 0;
-
-    return text;
-}
+    if (autosave)
+    {
+        gchar *journalname = g_strconcat(autosave, ".journal", NULL);
 
-gboolean is_numeric(gchar *token)
-{
-    for (; *token != 0; token++) {
-        gchar c = *token;
+        /* A journal without a map file to go with it can't be replayed */
+        unlink(journalname);
+        g_free(journalname);
 
-        if (!isdigit(c) && c != '.' && c != '-')
+        automap->filename = autosave;
+        automap->journal = map_journal_open(automap, autosave, 0);
 
-            return FALSE;
+        if (automap->journal)
+            map_journal_compact(automap->journal);
     }
 
-    return TRUE;
+    /* Display the main window in the main() routine (ensures the
+     * first node is drawn
+     */
+    gtk_widget_show(automap->window);
 }
 
-static void load_automap_from_file(gchar *filename, AutoMap *automap)
+void load_automap_from_file(gchar *filename, AutoMap *automap)
 {
     FILE *file;
-    gchar buf[256], token[256], *bptr, *mapname;
-    GPtrArray *arr = g_ptr_array_new();
-    GList *maps = NULL, *puck;
-    gint i, o, explicit_redraw = (automap != NULL);
-    Map *map = NULL;
+    GList *maps;
+    gint explicit_redraw = (automap != NULL);
+    guint32 seq;
 
     file = fopen(filename, "r");
 
@@ -2863,152 +3248,27 @@ static void load_automap_from_file(gchar *filename, AutoMap *automap)
     }
 
     /* Create our automaplist ... */
-    if (!automap) automap = auto_map_new();
-    AutoMapList = g_list_append(AutoMapList, automap);
-
-    /* Get details from the file to fill in to our automap */
-    bptr = fgets(buf, BUFSIZ, file);
-    bptr = get_token(bptr, token);
-    bptr = get_token(bptr, token);
-    bptr = get_token(bptr, token);
-    mapname = g_strdup(token);
-    bptr = get_token(bptr, token);
-    bptr = get_token(bptr, token);
-    automap->player = (MapNode *)atol(token);
-    bptr = get_token(bptr, token);
-    bptr = get_token(bptr, token);
-    automap->zoom = atof(token);
-    bptr = get_token(bptr, token);
-    bptr = get_token(bptr, token);
-    automap->x = atol(token);
-    bptr = get_token(bptr, token);
-    automap->y = atol(token);
-
-    /* Pass 1, part 1:
-     *
-     * Get all map names and details, insert them into MapList. Store then node
-     * numbers and in a later pass replace the node numbers with the nodes they
-     * reference
-     */
-    for (;;) {
-        bptr = fgets(buf, BUFSIZ, file);
-        bptr = get_token(bptr, token);
-
-        if (is_numeric(token))
-            break;
-
-        bptr = get_token(bptr, token);
-        map = g_malloc0(sizeof(Map));
-
-        if (mapname && !strcmp(mapname, token))
-        {
-            g_free(mapname);
-            mapname = NULL;
-            automap->map = map;
-        }
-
-        map->nodes = g_hash_table_new((GHashFunc)node_hash, (GCompareFunc)node_comp);
-        map->name = g_strdup(token);
-
-        bptr = get_token(bptr, token);
-        bptr = get_token(bptr, token);
-        map->min_x = atol(token);
-        bptr = get_token(bptr, token);
-        bptr = get_token(bptr, token);
-        map->max_x = atol(token);
-        bptr = get_token(bptr, token);
-        bptr = get_token(bptr, token);
-        map->min_y = atol(token);
-        bptr = get_token(bptr, token);
-        bptr = get_token(bptr, token);
-        map->max_y = atol(token);
-        bptr = get_token(bptr, token);
-
-        while ((bptr = get_token(bptr, token)) != NULL)
-            map->nodelist = g_list_prepend(map->nodelist, (gpointer)atol(token));
-        
-        MapList = g_list_prepend(MapList, map);
-        maps = g_list_prepend(maps, map);
+    if (!automap)
+    {
+        automap = auto_map_new();
+        AutoMapList = g_list_append(AutoMapList, automap);
     }
 
-    bptr = buf;
-
-    /* Pass 1, part 2:
-     *
-     * Get all node details, insert them into their respective MapLists
-     */
-    do {
-        MapNode *node;
-        gint num;
-
-        node = g_malloc0(sizeof(MapNode));
-        bptr = get_token(bptr, token);
-        num = atol(token);
-        bptr = get_token(bptr, token);
-        node->x = atol(token);
-
-        bptr = get_token(bptr, token);
-        node->y = atol(token);
-
-        bptr = get_token(bptr, token);
-
-        for (puck = MapList; puck != NULL; puck = puck->next)
-        {
-            map = puck->data;
-
-            if (!strcmp(token, map->name))
-                break;
-        }
-
-        node_hash_prepend(map->nodes, node);
-        node->map = map;
-
-        if (num >= arr->len)
-            g_ptr_array_set_size(arr, num + 1);
-
-        g_ptr_array_index(arr, num) = node;
-
-        for (num = 0; num < 10; num++)
-        {
-            bptr = get_token(bptr, token);
-            bptr = get_token(bptr, token);
-            node->connections[num].node = (MapNode *)(atol(token) + 1);
-        }
-    } while ((bptr = fgets(buf, BUFSIZ, file)) != NULL);
-
+    maps = map_read(file, automap, &seq);
     fclose(file);
 
-    /* Pass 2, part 1:
-     *
-     * Go through all maps, substituting the node numbers for the actual nodes
-     */
-    for (puck = maps; puck != NULL; puck = puck->next)
-    {
-        GList *inner;
-        map = puck->data;
-
-        for (inner = map->nodelist; inner != NULL; inner = inner->next)
-            inner->data = g_ptr_array_index(arr, (gint)inner->data);
-    }
+    /* In the same order as if each had been prepended when read */
+    MapList = g_list_concat(maps, MapList);
 
-    /* Pass 2, part 2:
-     *
-     * Go through all map nodes, substituting the node numbers for the
-     * actual nodes
+    /* Bring the maps up to date with changes made since they were last
+     * written, and record new ones from here on
      */
-    for (i = 0; i < arr->len; i++)
-    {
-        MapNode *node = g_ptr_array_index(arr, i);
-
-        for (o = 0; o < 10; o++)
-            if (node->connections[o].node != NULL)
-                node->connections[o].node =
-                    g_ptr_array_index(arr, (gint)node->connections[o].node - 1);
-    }
-
-    automap->player = g_ptr_array_index(arr, (gint)automap->player);
-    g_ptr_array_free(arr, TRUE);
-    g_list_free(maps);
+    automap->filename = g_strdup(filename);
+    automap->journal = map_journal_open(automap, filename, seq);
+    map_connect_invalidate(automap);
+    map_route_flush(automap);
+    map_landmark_load(automap);
+    map_tile_flush(automap);
 
     if (explicit_redraw)
     {
@@ -0,0 +1,492 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * map.c is written by Paul Cameron <thrase@progsoc.uts.edu.au> with
+ * modifications by Robin Ericsson to make it work with AMCL.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __MAP_H__
+#define __MAP_H__
+
+#include <stdio.h>
+
+/*
+ * Typedefs
+ */
+typedef struct _AutoMap     AutoMap;
+typedef struct _Map         Map;
+typedef struct _MapNode     MapNode;
+typedef struct _MapOp       MapOp;
+typedef struct _MapJournal  MapJournal;
+typedef struct _MapTile     MapTile;
+typedef struct _MapCluster  MapCluster;
+typedef struct _MapPortal   MapPortal;
+typedef struct _MapLandmarks   MapLandmarks;
+typedef struct _MapLandmarkJob MapLandmarkJob;
+typedef struct _MapRoomInfo    MapRoomInfo;
+typedef struct _MapUndo        MapUndo;
+typedef struct _MapSnapshot    MapSnapshot;
+
+typedef GdkPoint            Point;
+typedef struct _Rectangle   Rectangle;
+
+/* Direction values and button direction codes */
+#define NORTH     0
+#define NORTHEAST 1
+#define EAST      2
+#define SOUTHEAST 3
+#define SOUTH     4
+#define SOUTHWEST 5
+#define WEST      6
+#define NORTHWEST 7
+#define UP        8
+#define DOWN      9
+#define OPPOSITE(x) ( ((x) & ~7) ? (!(x - 8) + 8) : (((x) + 4) & 7) )
+
+/* Let map_node_new() pick the node number */
+#define MAP_NODE_ID_ANY ((guint32) -1)
+
+#define PIX_ZOOM    40
+#define X_INIT_SIZE 200
+#define Y_INIT_SIZE 200
+#define X_PADDING   (X_INIT_SIZE / PIX_ZOOM / 2)
+#define Y_PADDING   (Y_INIT_SIZE / PIX_ZOOM / 2)
+
+/* Zoom limits, and below how many pixels per graph unit the map is
+ * drawn as shaded cells of at least MAP_LOD_CELL pixels, see map_lod.c
+ */
+#define MAP_ZOOM_MIN   0.25
+#define MAP_ZOOM_MAX   PIX_ZOOM
+#define MAP_LOD_UNIT   8
+#define MAP_LOD_CELL   4
+#define MAP_LOD_LEVELS 6
+
+/* What kind of way a link is, each map says what each kind costs to
+ * take (see map_cost.c)
+ */
+typedef enum {
+    MAP_EDGE_PLAIN,
+    MAP_EDGE_ROAD,
+    MAP_EDGE_ROUGH,
+    MAP_EDGE_WATER,
+    MAP_EDGE_DOOR,
+    MAP_EDGE_LOCKED,
+    MAP_EDGE_DANGER,
+    MAP_EDGE_KINDS
+} MapEdgeKind;
+
+/* What can be known about a room, see map_info.c */
+typedef enum {
+    MAP_INFO_NAME,
+    MAP_INFO_DESCRIPTION,
+    MAP_INFO_NOTES,
+    MAP_INFO_TAGS,
+    MAP_INFO_FIELDS
+} MapInfoField;
+
+#define MAP_INFO_MAX 4000
+
+/* Rectangles of the window kept apart when drawing it again, and how
+ * many pixels more merging two may copy, see damage_add() in map.c
+ */
+#define MAP_DAMAGE_RECTS 32
+#define MAP_DAMAGE_SLACK 1024
+
+/* How many changes can be undone, see map_undo.c */
+#define MAP_UNDO_STEPS 4096
+
+/*
+ * Structures
+ */
+struct _Map {
+
+    gchar *name;
+
+    /* The extents of the map */
+    gint min_x, min_y, max_x, max_y;
+
+    /* The map contains a linked list of all nodes which aren't interlinked */
+    GList *nodelist;
+
+    /* Hash table of linked lists of all MapNodes in this map */
+    GHashTable *nodes;
+
+    /* The furthest apart (in x or y) two linked nodes are */
+    gint span;
+
+    /* What taking a link of each MapEdgeKind costs, 0 means never */
+    gint16 cost[MAP_EDGE_KINDS];
+
+    /* Rooms per cell of 2^level units, built when first drawn that far
+     * zoomed out
+     */
+    GHashTable *density[MAP_LOD_LEVELS];
+};
+
+/* The join types.
+ * LINE has no additional parameters, so needs no additional struct
+ * ARC requires that the arc thingy be known. The rest is calculated
+ */
+struct _MapNode {
+
+    gint32 x, y;
+    Map *map;
+    int conn; /* The number of node connections (discounting up/down) */
+
+    /* Number of this node in the map file and the journal. Unique
+     * within the AutoMap the node belongs to
+     */
+    guint32 id;
+
+    /* Hash of the room text last seen here, 0 if never, see map_room.c */
+    guint32 fingerprint;
+
+    /* Name, description and so on, NULL if nothing is known */
+    MapRoomInfo *info;
+
+    /* Which nodes can reach which, see map_connect.c */
+    MapNode *set;
+    guint8   set_rank;
+
+    /* There is a one to one mapping between node connections */
+    struct {
+        MapNode *node; /* The map this node is located on */
+        guint8   kind; /* MapEdgeKind of the way out of this node */
+    } connections[10];
+};
+
+struct _MapRoomInfo {
+
+    gchar *field[MAP_INFO_FIELDS];  /* Shared with other rooms, don't free */
+};
+
+struct _Rectangle {
+
+    gint16 x, y;
+    gint16 width, height;
+};
+
+/* This struct contains the window the drawable is being drawn in, the
+ * drawable, the backing pixmap, and anything else
+ */
+struct _AutoMap {
+
+    GtkWidget *window;
+    GtkWidget *draw_area;
+    GdkPixmap *pixmap;
+
+    /* Horizontal and vertical scrollbars, plus adjustment data */
+    GtkWidget *hsb, *vsb;
+    GtkObject *hsbdata, *vsbdata;
+    gint last_hvalue, last_vvalue;
+
+    Map *map;         /* The map which is currently being displayed    */
+    gint16 x, y;      /* The center of the map currently displayed     */
+    gfloat zoom;      /* Zoom factor, must be > 0, > 1 means zoom out  */
+    MapNode *player;  /* The map node the player is currently on       */
+
+    /* Rendered pieces of the maps, see map_tile.c */
+    GHashTable *tiles;
+    guint       tile_stamp;
+
+    /* Use this to determine what state the program is in when the mouse
+     * cursor is moving
+     */
+    enum { NONE, SELECTMOVE, BOXSELECT } state;
+
+    GList *selected;  /* A list of all selected nodes */
+
+    /* The X and Y positions where the last node was selected */
+    gint16 x_orig, y_orig;
+
+    /* The X and Y offsets of the selected nodes */
+    gint16 x_offset, y_offset;
+
+    /* A box being drawn to handle grouping selected nodes */
+    Rectangle selection_box;
+
+    /* And all nodes which fall within this box */
+    GList *in_selection_box;
+
+    /* Parts of the window to copy from the pixmap again, and what
+     * selected nodes are marked with
+     */
+    Rectangle damage[MAP_DAMAGE_RECTS];
+    gint      damage_count;
+    GdkGC    *select_gc;
+
+    /* The file the maps are saved to, and the journal that records
+     * every change made since it was last written
+     */
+    gchar      *filename;
+    MapJournal *journal;
+
+    /* Node number -> MapNode, and the next free node number */
+    GHashTable *ids;
+    guint32     next_id;
+
+    /* The portal graph used to find routes, see map_route.c */
+    GHashTable *clusters;
+    GHashTable *portals;
+    GSList     *clusters_dirty;
+
+    /* Room fingerprint -> GList of MapNodes, see map_room.c */
+    GHashTable *rooms;
+
+    /* Word -> GList of MapNodes with it in their info, and the rooms
+     * the find box last found, see map_info.c
+     */
+    GHashTable *words;
+    GList      *found, *found_next;
+    gchar      *found_text;
+
+    /* Changes that can be undone and redone, see map_undo.c */
+    MapUndo    *undo;
+
+    /* Precomputed costs to and from a few rooms, see map_landmark.c */
+    MapLandmarks   *landmarks;
+    MapLandmarkJob *landmark_job;
+    guint           landmark_stamp;
+
+    /* Program states */
+    guint shift : 1;
+    guint node_break : 1;
+    guint node_goto : 1;
+    guint node_kind : 1;
+    guint print_coord : 1;
+    guint modifying_coords : 1;
+    guint redraw_map : 1;
+    guint connect_dirty : 1;
+};
+
+struct win_scale {
+
+    gint16 width;         /* Width of the pixmap */
+    gint16 height;        /* Height of the pixmap in question */
+    gint16 mapped_unit;   /* The number of pixels in a unit of the graph */
+    gint16 mapped_x;      /* The leftmost x coord in the graph visible in the pixmap */
+    gint16 mapped_y;      /* The bottom y coord in the graph visible in the pixmap */
+    gint16 mapped_width;  /* The width of the pixmap in units of the graph */
+    gint16 mapped_height; /* The height of the pixmap in units of the graph */
+    gint32 origin_x;      /* Pixel position of the top left corner of the */
+    gint32 origin_y;      /* pixmap, with graph (0, 0) at pixel (0, 0)    */
+    GdkDrawable *drawable;/* What to draw into */
+};
+
+/* A square of the map rendered at one zoom level
+ */
+#define MAP_TILE_SIZE 256
+
+struct _MapTile {
+
+    Map       *map;
+    gint16     unit;      /* win_scale mapped_unit it was drawn at  */
+    gint32     tx, ty;    /* Covers pixels tx * MAP_TILE_SIZE on    */
+    GdkPixmap *pixmap;
+    guint      stamp;     /* When it was last used                  */
+};
+
+/* A square of a map, for route finding
+ */
+#define MAP_CLUSTER_SIZE 16
+
+struct _MapCluster {
+
+    Map       *map;
+    gint32     cx, cy;    /* Covers units cx * MAP_CLUSTER_SIZE on  */
+    GSList    *portals;   /* MapPortals, rooms with a way out       */
+    gboolean   dirty;
+};
+
+/* A single change made to the map. Operations are written to the
+ * journal as one line of text each, and carry enough information to
+ * be applied again when the journal is replayed.
+ */
+typedef enum {
+    MAP_OP_MAP_NEW,     /* A  map                      */
+    MAP_OP_MAP_DELETE,  /* R  map                      */
+    MAP_OP_NODE_NEW,    /* N  node map x y             */
+    MAP_OP_NODE_DELETE, /* X  node map x y             */
+    MAP_OP_LINK,        /* L  node dir other           */
+    MAP_OP_UNLINK,      /* B  node dir other           */
+    MAP_OP_MOVE,        /* M  node dx dy               */
+    MAP_OP_PLAYER,      /* P  node other               */
+    MAP_OP_EDGE,        /* E  node dir kind            */
+    MAP_OP_COST,        /* C  map kind cost            */
+    MAP_OP_ROOM,        /* F  node fingerprint         */
+    MAP_OP_INFO         /* I  node field text          */
+} MapOpType;
+
+struct _MapOp {
+
+    guint8   type;
+    guint8   dir;
+    guint32  node;
+    guint32  other;
+    gint32   x, y;
+    gchar   *map;     /* Map name, used by MAP_, NODE_ and COST ops */
+    gchar   *text;    /* Used by INFO ops, the rest of the line      */
+
+    /* What EDGE, COST, ROOM and INFO ops replace, for undoing them. Not
+     * written to the journal. map_op_apply() fills in old
+     */
+    gint32   old;
+    gchar   *old_text;
+};
+
+/*
+ * Functions
+ */
+
+/* map.c */
+AutoMap *auto_map_new        (void                                      );
+void     free_maps           (AutoMap *automap                          );
+GList   *map_read            (FILE *file, AutoMap *automap, guint32 *seq);
+void     load_automap_from_file(gchar *filename, AutoMap *automap       );
+void     save_maps           (gchar *filename, AutoMap *automap         );
+MapNode *map_node_new        (AutoMap *automap, Map *map, guint32 id,
+                              gint32 x, gint32 y                        );
+MapNode *map_node_lookup     (AutoMap *automap, guint32 id              );
+void     map_node_free       (AutoMap *automap, MapNode *node           );
+Map     *map_new             (void                                      );
+Map     *map_new_with_name   (gchar *name                               );
+Map     *map_find            (gchar *name                               );
+void     remove_map          (Map *map                                  );
+void     map_extend          (Map *map, MapNode *node                   );
+void     map_extents_rebuild (Map *map                                  );
+void     map_nodelist_rebuild(Map *map                                  );
+void     map_record          (AutoMap *automap, MapOp *op               );
+void     map_write           (GString *out, AutoMap *automap, guint32 seq);
+MapSnapshot *map_snapshot_take (AutoMap *automap, guint32 seq           );
+void     map_snapshot_write  (GString *out, MapSnapshot *snapshot       );
+void     map_snapshot_free   (MapSnapshot *snapshot                     );
+void     map_player_moved    (AutoMap *automap, MapNode *from,
+                              gboolean redraw                           );
+void     map_center          (AutoMap *automap, MapNode *node           );
+void     node_hash_prepend   (GHashTable *hash, MapNode *node           );
+void     node_hash_remove    (GHashTable *hash, MapNode *node           );
+guint    node_hash           (MapNode *a                                );
+gint     node_comp           (MapNode *a, MapNode *b                    );
+void     redraw_map          (AutoMap *automap                          );
+void     draw_map            (AutoMap *automap                          );
+struct win_scale *map_coords (AutoMap *automap                          );
+void     translate           (AutoMap *automap, struct win_scale *ws,
+                              Point *p                                  );
+void     draw_line           (AutoMap *automap, struct win_scale *ws,
+                              MapNode *node1, MapNode *node2            );
+void     draw_dot            (AutoMap *automap, struct win_scale *ws,
+                              MapNode *node                             );
+
+/* map_connect.c */
+gboolean map_connect_record    (AutoMap *automap, MapOp *op              );
+void     map_connect_invalidate(AutoMap *automap                         );
+MapNode *map_node_component    (AutoMap *automap, MapNode *node          );
+gboolean map_node_reachable    (AutoMap *automap, MapNode *a, MapNode *b );
+
+/* map_tile.c */
+void     map_tile_compose   (AutoMap *automap, struct win_scale *ws     );
+void     map_tile_record    (AutoMap *automap, MapOp *op                );
+void     map_tile_invalidate(AutoMap *automap, Map *map, gint x1, gint y1,
+                             gint x2, gint y2                           );
+void     map_tile_flush     (AutoMap *automap                           );
+void     map_nodes_in_area  (Map *map, gint x1, gint y1, gint x2, gint y2,
+                             GSList **nodes                             );
+MapNode *map_node_at        (AutoMap *automap, struct win_scale *ws,
+                             gint x, gint y                             );
+
+/* map_lod.c */
+void     map_lod_add   (MapNode *node                                   );
+void     map_lod_remove(MapNode *node                                   );
+void     map_lod_free  (Map *map                                        );
+void     map_lod_render(AutoMap *automap, struct win_scale *ws, Map *map);
+
+/* map_cost.c */
+void     map_cost_defaults  (Map *map                                  );
+gboolean map_cost_is_default(Map *map                                  );
+gint     map_edge_cost      (MapNode *node, gint dir                   );
+void     map_cost_window    (AutoMap *automap                          );
+
+/* map_route.c */
+GList   *map_route       (AutoMap *automap, MapNode *from, MapNode *to   );
+void     map_route_record(AutoMap *automap, MapOp *op                    );
+void     map_route_flush (AutoMap *automap                               );
+
+/* map_landmark.c */
+MapLandmarks *map_landmarks        (AutoMap *automap                     );
+gint          map_landmark_estimate(MapLandmarks *lm, MapNode *a,
+                                    MapNode *b                           );
+void          map_landmark_record  (AutoMap *automap, MapOp *op          );
+void          map_landmark_load    (AutoMap *automap                     );
+void          map_landmark_free    (AutoMap *automap                     );
+
+/* map_room.c */
+void     map_room_index  (AutoMap *automap, MapNode *node,
+                          guint32 fingerprint                          );
+GList   *map_room_lookup (AutoMap *automap, guint32 fingerprint        );
+void     map_room_free   (AutoMap *automap                             );
+void     map_room_text   (gchar *text                                  );
+void     map_room_command(gchar *text                                  );
+
+/* map_info.c */
+gchar     *map_info_get     (MapNode *node, gint field                  );
+void       map_info_set     (AutoMap *automap, MapNode *node, gint field,
+                             gchar *text                                );
+void       map_info_clear   (AutoMap *automap, MapNode *node            );
+void       map_info_free    (AutoMap *automap                           );
+gint       map_info_hold    (MapRoomInfo *info, MapNode *node,
+                             GHashTable *written                        );
+void       map_info_let_go  (MapRoomInfo *info                          );
+void       map_info_write   (GString *out, MapRoomInfo *info, gint block);
+gboolean   map_info_read    (AutoMap *automap, MapNode *node, gchar *line,
+                             GPtrArray *blocks                          );
+GList     *map_info_search  (AutoMap *automap, gchar *text              );
+void       map_info_forget  (AutoMap *automap                           );
+GtkWidget *map_info_find_box(AutoMap *automap                           );
+void       map_info_window  (AutoMap *automap                           );
+
+/* map_merge.c */
+GString *map_merge_file  (AutoMap *automap, gchar *filename,
+                          gboolean apply                                 );
+void     map_merge_window(AutoMap *automap, GString *report              );
+
+/* map_undo.c */
+void     map_undo_record(AutoMap *automap, MapOp *op                     );
+gboolean map_undo       (AutoMap *automap                                );
+gboolean map_redo       (AutoMap *automap                                );
+void     map_undo_free  (AutoMap *automap                                );
+
+/* map_journal.c */
+MapJournal *map_journal_open    (AutoMap *automap, gchar *filename,
+                                 guint32 seq                            );
+void        map_journal_close   (MapJournal *journal                    );
+void        map_journal_append  (MapJournal *journal, MapOp *op         );
+void        map_journal_compact (MapJournal *journal                    );
+gchar      *map_journal_filename(MapJournal *journal                    );
+guint32     map_journal_seq     (MapJournal *journal                    );
+gboolean    map_op_parse        (gchar *line, MapOp *op, guint32 *seq   );
+void        map_op_format       (GString *out, MapOp *op, guint32 seq   );
+gboolean    map_op_apply        (AutoMap *automap, MapOp *op            );
+
+/*
+ * Variables
+ */
+extern GList *MapList, *AutoMapList;
+extern char  *direction[];
+extern char  *direction_long[];
+extern char  *map_edge_names[];
+
+#endif /* __MAP_H__ */
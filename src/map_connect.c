@@ -0,0 +1,164 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+#ifndef WITHOUT_MAPPER
+
+#include <gtk/gtk.h>
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* Which nodes can be reached from which, kept as a disjoint set forest
+ * over all nodes of an AutoMap (links are always both ways, and up and
+ * down links join maps together).
+ *
+ * New nodes and links just join sets. Sets can't be split again, so
+ * removing a link or node marks the whole thing out of date, and it is
+ * built again from scratch the next time someone asks.
+ */
+
+static MapNode *set_find(MapNode *node)
+{
+    /* Path halving, a NULL set means the node is its own root */
+    while (node->set && node->set != node)
+    {
+        if (node->set->set)
+            node->set = node->set->set;
+
+        node = node->set;
+    }
+
+    return node;
+}
+
+/* Returns whether two sets of more than one node each were joined. A
+ * root of rank 0 has nothing below it
+ */
+static gboolean set_union(MapNode *a, MapNode *b)
+{
+    gboolean joined;
+
+    a = set_find(a);
+    b = set_find(b);
+
+    if (a == b)
+        return FALSE;
+
+    joined = a->set_rank && b->set_rank;
+
+    if (a->set_rank < b->set_rank)
+    {
+        a->set = b;
+    } else {
+        b->set = a;
+
+        if (a->set_rank == b->set_rank)
+            a->set_rank++;
+    }
+
+    return joined;
+}
+
+static void set_reset(gpointer id, MapNode *node, gpointer data)
+{
+    node->set = NULL;
+    node->set_rank = 0;
+}
+
+static void set_join_links(gpointer id, MapNode *node, gpointer data)
+{
+    gint i;
+
+    for (i = 0; i < 10; i++)
+        if (node->connections[i].node)
+            set_union(node, node->connections[i].node);
+}
+
+static void map_connect_rebuild(AutoMap *automap)
+{
+    g_hash_table_foreach(automap->ids, (GHFunc)set_reset, NULL);
+    g_hash_table_foreach(automap->ids, (GHFunc)set_join_links, NULL);
+
+    automap->connect_dirty = FALSE;
+}
+
+/* Keep the sets up to date with a change about to be made to the map.
+ * Returns TRUE if the change may join or split groups of nodes, rather
+ * than just add a node to one
+ */
+gboolean map_connect_record(AutoMap *automap, MapOp *op)
+{
+    MapNode *node, *other;
+
+    switch (op->type)
+    {
+    case MAP_OP_LINK:
+        if (automap->connect_dirty)
+            return TRUE;
+
+        node = map_node_lookup(automap, op->node);
+        other = map_node_lookup(automap, op->other);
+
+        if (node && other)
+            return set_union(node, other);
+
+        automap->connect_dirty = TRUE;
+        return TRUE;
+
+    case MAP_OP_UNLINK:
+    case MAP_OP_NODE_DELETE:
+    case MAP_OP_MAP_DELETE:
+        automap->connect_dirty = TRUE;
+        return TRUE;
+
+    default:
+        /* New nodes start out in a set of their own */
+        return FALSE;
+    }
+}
+
+/* Call after changing the links of automap without recording it, like
+ * loading or replaying the journal
+ */
+void map_connect_invalidate(AutoMap *automap)
+{
+    automap->connect_dirty = TRUE;
+}
+
+MapNode *map_node_component(AutoMap *automap, MapNode *node)
+{
+    if (automap->connect_dirty)
+        map_connect_rebuild(automap);
+
+    return set_find(node);
+}
+
+/* Whether there is any path at all between a and b
+ */
+gboolean map_node_reachable(AutoMap *automap, MapNode *a, MapNode *b)
+{
+    if (a == NULL || b == NULL || a == b)
+        return TRUE;
+
+    return map_node_component(automap, a) == map_node_component(automap, b);
+}
+
+#endif /* WITHOUT_MAPPER */
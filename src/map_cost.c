@@ -0,0 +1,185 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+#ifndef WITHOUT_MAPPER
+
+#include <string.h>
+#include <gtk/gtk.h>
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* Every way out of a room has a kind (see MapEdgeKind), and every map
+ * has its own idea of what each kind costs to take. Costs are in tenths
+ * of an ordinary move, a cost of 0 means the route finder never uses
+ * that kind of way.
+ */
+
+char *map_edge_names[] = { "plain", "road", "rough", "water", "door",
+                           "locked", "danger" };
+
+static gint16 default_cost[MAP_EDGE_KINDS] = { 10, 5, 20, 40, 15, 0, 200 };
+
+struct cost_window {
+
+    AutoMap   *automap;
+    gchar     *map;
+    GtkWidget *window;
+    GtkWidget *spin[MAP_EDGE_KINDS];
+};
+
+void map_cost_defaults(Map *map)
+{
+    memcpy(map->cost, default_cost, sizeof(default_cost));
+}
+
+gboolean map_cost_is_default(Map *map)
+{
+    return !memcmp(map->cost, default_cost, sizeof(default_cost));
+}
+
+/* What it costs to take the link dir out of node, or -1 if it mustn't
+ * be taken at all
+ */
+gint map_edge_cost(MapNode *node, gint dir)
+{
+    gint cost = node->map->cost[node->connections[dir].kind];
+
+    return cost > 0 ? cost : -1;
+}
+
+static void cost_window_destroy(GtkWidget *widget, struct cost_window *cw)
+{
+    g_free(cw->map);
+    g_free(cw);
+}
+
+static void cost_window_ok(GtkWidget *widget, struct cost_window *cw)
+{
+    Map *map = map_find(cw->map);
+    gint kind;
+
+    /* The map may have gone away while the window was open */
+    if (map == NULL)
+    {
+        gtk_widget_destroy(cw->window);
+        return;
+    }
+
+    for (kind = 0; kind < MAP_EDGE_KINDS; kind++)
+    {
+        gint cost = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(cw->spin[kind]));
+        MapOp op;
+
+        if (cost == map->cost[kind])
+            continue;
+
+        memset(&op, 0, sizeof(op));
+        op.type = MAP_OP_COST;
+        op.map = map->name;
+        op.x = kind;
+        op.y = cost;
+        op.old = map->cost[kind];
+        map->cost[kind] = cost;
+        map_record(cw->automap, &op);
+    }
+
+    gtk_widget_destroy(cw->window);
+}
+
+/* Edit what the kinds of links on the map currently shown cost
+ */
+void map_cost_window(AutoMap *automap)
+{
+    struct cost_window *cw;
+    GtkWidget *vbox, *hbox, *table, *label, *separator;
+    GtkWidget *button_ok, *button_close;
+    gchar title[128];
+    gint kind;
+
+    if (automap->map == NULL)
+        return;
+
+    cw = g_malloc0(sizeof(struct cost_window));
+    cw->automap = automap;
+    cw->map = g_strdup(automap->map->name);
+
+    cw->window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    g_snprintf(title, 128, "Route costs: %s", automap->map->name);
+    gtk_window_set_title(GTK_WINDOW(cw->window), title);
+    gtk_signal_connect(GTK_OBJECT(cw->window), "destroy",
+                       GTK_SIGNAL_FUNC(cost_window_destroy), cw);
+
+    /* The window can't outlive the map window it edits */
+    gtk_signal_connect_object_while_alive(GTK_OBJECT(automap->window), "destroy",
+                                          GTK_SIGNAL_FUNC(gtk_widget_destroy),
+                                          GTK_OBJECT(cw->window));
+
+    vbox = gtk_vbox_new(FALSE, 5);
+    gtk_container_border_width(GTK_CONTAINER(vbox), 5);
+    gtk_container_add(GTK_CONTAINER(cw->window), vbox);
+    gtk_widget_show(vbox);
+
+    table = gtk_table_new(MAP_EDGE_KINDS, 2, FALSE);
+    gtk_box_pack_start(GTK_BOX(vbox), table, TRUE, TRUE, 0);
+    gtk_widget_show(table);
+
+    for (kind = 0; kind < MAP_EDGE_KINDS; kind++)
+    {
+        GtkObject *adj = gtk_adjustment_new(automap->map->cost[kind],
+                                            0, 10000, 1, 10, 0);
+
+        label = gtk_label_new(map_edge_names[kind]);
+        gtk_misc_set_alignment(GTK_MISC(label), 0, 0.5);
+        gtk_table_attach(GTK_TABLE(table), label, 0, 1, kind, kind + 1,
+                         GTK_FILL, 0, 5, 2);
+        gtk_widget_show(label);
+
+        cw->spin[kind] = gtk_spin_button_new(GTK_ADJUSTMENT(adj), 1, 0);
+        gtk_table_attach(GTK_TABLE(table), cw->spin[kind], 1, 2, kind, kind + 1,
+                         GTK_EXPAND | GTK_FILL, 0, 5, 2);
+        gtk_widget_show(cw->spin[kind]);
+    }
+
+    separator = gtk_hseparator_new();
+    gtk_box_pack_start(GTK_BOX(vbox), separator, FALSE, TRUE, 5);
+    gtk_widget_show(separator);
+
+    hbox = gtk_hbox_new(FALSE, 0);
+    gtk_container_add(GTK_CONTAINER(vbox), hbox);
+    gtk_widget_show(hbox);
+
+    button_ok    = gtk_button_new_with_label("   ok   ");
+    button_close = gtk_button_new_with_label("  close  ");
+    gtk_signal_connect(GTK_OBJECT(button_ok), "clicked",
+                       GTK_SIGNAL_FUNC(cost_window_ok), cw);
+    gtk_signal_connect_object(GTK_OBJECT(button_close), "clicked",
+                              GTK_SIGNAL_FUNC(gtk_widget_destroy),
+                              GTK_OBJECT(cw->window));
+    gtk_box_pack_start(GTK_BOX(hbox), button_ok, TRUE, TRUE, 5);
+    gtk_box_pack_start(GTK_BOX(hbox), button_close, TRUE, TRUE, 5);
+    gtk_widget_show(button_ok);
+    gtk_widget_show(button_close);
+
+    gtk_widget_show(cw->window);
+}
+
+#endif /* WITHOUT_MAPPER */
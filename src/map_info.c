@@ -0,0 +1,703 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+#ifndef WITHOUT_MAPPER
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <gtk/gtk.h>
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* What is known about a room besides where it is: its name, the
+ * description the mud gives, notes, and tags (words separated by
+ * spaces). Most rooms have none of these, so they're kept apart from
+ * the MapNode and only allocated when needed.
+ *
+ * Muds reuse the same descriptions and tags for whole areas, so every
+ * string is kept once, shared by all the rooms with it, with a count
+ * of how many use it.
+ *
+ * To find rooms quickly, each AutoMap has an index of every word in
+ * any room's info to the rooms it is in. A search for some text finds
+ * the rooms having, for each word of the text, some word containing it.
+ */
+
+static gchar *info_names[MAP_INFO_FIELDS] = {
+    "name", "desc", "notes", "tags"
+};
+
+/* String -> number of uses */
+static GHashTable *strings;
+
+static gchar *info_intern(gchar *text)
+{
+    gpointer key, count;
+
+    if (text == NULL || *text == '\0')
+        return NULL;
+
+    if (strings == NULL)
+        strings = g_hash_table_new(g_str_hash, g_str_equal);
+
+    if (g_hash_table_lookup_extended(strings, text, &key, &count))
+    {
+        g_hash_table_insert(strings, key,
+                            GUINT_TO_POINTER(GPOINTER_TO_UINT(count) + 1));
+        return key;
+    }
+
+    key = g_strdup(text);
+    g_hash_table_insert(strings, key, GUINT_TO_POINTER(1));
+
+    return key;
+}
+
+static void info_release(gchar *text)
+{
+    guint count;
+
+    if (text == NULL)
+        return;
+
+    count = GPOINTER_TO_UINT(g_hash_table_lookup(strings, text)) - 1;
+
+    if (count)
+    {
+        g_hash_table_insert(strings, text, GUINT_TO_POINTER(count));
+    } else {
+        g_hash_table_remove(strings, text);
+        g_free(text);
+    }
+}
+
+/* Call func for every word in text, lowercased
+ */
+static void info_words(gchar *text, void (*func)(gchar *word, gpointer data),
+                       gpointer data)
+{
+    gchar word[64];
+
+    if (text == NULL)
+        return;
+
+    while (*text)
+    {
+        gint len = 0;
+
+        while (*text && !isalnum((guchar)*text))
+            text++;
+
+        while (isalnum((guchar)*text))
+        {
+            if (len < 63)
+                word[len++] = tolower((guchar)*text);
+
+            text++;
+        }
+
+        word[len] = '\0';
+
+        if (len)
+            func(word, data);
+    }
+}
+
+static void word_collect(gchar *word, GHashTable *seen)
+{
+    if (!g_hash_table_lookup(seen, word))
+        g_hash_table_insert(seen, g_strdup(word), seen);
+}
+
+/* All the different words in the info of node
+ */
+static GHashTable *info_node_words(MapNode *node)
+{
+    GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+    gint i;
+
+    for (i = 0; i < MAP_INFO_FIELDS; i++)
+        info_words(node->info->field[i], (gpointer)word_collect, seen);
+
+    return seen;
+}
+
+static void word_add(gchar *word, gpointer value, gpointer data[2])
+{
+    AutoMap *automap = data[0];
+    gpointer key, list;
+
+    if (g_hash_table_lookup_extended(automap->words, word, &key, &list))
+    {
+        g_hash_table_insert(automap->words, key, g_list_prepend(list, data[1]));
+        g_free(word);
+    } else
+        g_hash_table_insert(automap->words, word, g_list_prepend(NULL, data[1]));
+}
+
+static void word_remove(gchar *word, gpointer value, gpointer data[2])
+{
+    AutoMap *automap = data[0];
+    gpointer key, list;
+
+    if (g_hash_table_lookup_extended(automap->words, word, &key, &list))
+    {
+        list = g_list_remove(list, data[1]);
+
+        if (list)
+        {
+            g_hash_table_insert(automap->words, key, list);
+        } else {
+            g_hash_table_remove(automap->words, key);
+            g_free(key);
+        }
+    }
+
+    g_free(word);
+}
+
+static void info_index(AutoMap *automap, MapNode *node, gboolean add)
+{
+    GHashTable *seen;
+    gpointer data[2];
+
+    if (node->info == NULL)
+        return;
+
+    if (automap->words == NULL)
+        automap->words = g_hash_table_new(g_str_hash, g_str_equal);
+
+    data[0] = automap;
+    data[1] = node;
+
+    seen = info_node_words(node);
+    g_hash_table_foreach(seen, (GHFunc)(add ? word_add : word_remove), data);
+    g_hash_table_destroy(seen);
+}
+
+gchar *map_info_get(MapNode *node, gint field)
+{
+    return node->info ? node->info->field[field] : NULL;
+}
+
+/* Set what is known about node, NULL or "" to forget it
+ */
+void map_info_set(AutoMap *automap, MapNode *node, gint field, gchar *text)
+{
+    gchar *old;
+    gint i;
+
+    if (text && strlen(text) > MAP_INFO_MAX)
+    {
+        gchar *cut = g_strndup(text, MAP_INFO_MAX);
+
+        map_info_set(automap, node, field, cut);
+        g_free(cut);
+        return;
+    }
+
+    if (node->info == NULL)
+    {
+        if (text == NULL || *text == '\0')
+            return;
+
+        node->info = g_malloc0(sizeof(MapRoomInfo));
+    }
+
+    info_index(automap, node, FALSE);
+
+    old = node->info->field[field];
+    node->info->field[field] = info_intern(text);
+    info_release(old);
+
+    for (i = 0; i < MAP_INFO_FIELDS; i++)
+        if (node->info->field[i])
+            break;
+
+    if (i == MAP_INFO_FIELDS)
+    {
+        g_free(node->info);
+        node->info = NULL;
+    }
+
+    info_index(automap, node, TRUE);
+}
+
+/* Forget everything known about node. automap may be NULL when the
+ * whole index is about to go with map_info_free()
+ */
+void map_info_clear(AutoMap *automap, MapNode *node)
+{
+    gint i;
+
+    if (node->info == NULL)
+        return;
+
+    if (automap)
+    {
+        info_index(automap, node, FALSE);
+
+        if (g_list_find(automap->found, node))
+            map_info_forget(automap);
+    }
+
+    for (i = 0; i < MAP_INFO_FIELDS; i++)
+        info_release(node->info->field[i]);
+
+    g_free(node->info);
+    node->info = NULL;
+}
+
+static gboolean word_free(gchar *word, GList *list, gpointer data)
+{
+    g_free(word);
+    g_list_free(list);
+
+    return TRUE;
+}
+
+void map_info_free(AutoMap *automap)
+{
+    if (automap->words == NULL)
+        return;
+
+    g_hash_table_foreach_remove(automap->words, (GHRFunc)word_free, NULL);
+    g_hash_table_destroy(automap->words);
+    automap->words = NULL;
+}
+
+/* Hold on to the info of node in info, so it can be written later
+ * however node changes meanwhile; the strings are shared, so it is
+ * only counted as one more use of them. Descriptions are written once,
+ * numbered, and referred to by number after that: returns the number
+ * of node's, numbered in written, negative if it has been already
+ */
+gint map_info_hold(MapRoomInfo *info, MapNode *node, GHashTable *written)
+{
+    gchar *text;
+    gint block, i;
+
+    memset(info, 0, sizeof(MapRoomInfo));
+
+    if (node->info == NULL)
+        return 0;
+
+    for (i = 0; i < MAP_INFO_FIELDS; i++)
+        info->field[i] = info_intern(node->info->field[i]);
+
+    if ((text = info->field[MAP_INFO_DESCRIPTION]) == NULL)
+        return 0;
+
+    if ((block = GPOINTER_TO_INT(g_hash_table_lookup(written, text))) != 0)
+        return -block;
+
+    block = g_hash_table_size(written) + 1;
+    g_hash_table_insert(written, text, GINT_TO_POINTER(block));
+
+    return block;
+}
+
+void map_info_let_go(MapRoomInfo *info)
+{
+    gint i;
+
+    for (i = 0; i < MAP_INFO_FIELDS; i++)
+        info_release(info->field[i]);
+}
+
+/* Write info held by map_info_hold() as lines following its room's
+ * line in the map file, block being what that returned. Touches
+ * nothing else, so it can be done in another thread
+ */
+void map_info_write(GString *out, MapRoomInfo *info, gint block)
+{
+    gint i;
+
+    for (i = 0; i < MAP_INFO_FIELDS; i++)
+    {
+        gchar *text = info->field[i];
+
+        if (text == NULL)
+            continue;
+
+        if (i != MAP_INFO_DESCRIPTION)
+            g_string_sprintfa(out, "  %s %s\n", info_names[i], text);
+        else if (block < 0)
+            g_string_sprintfa(out, "  %s %d\n", info_names[i], -block);
+        else
+            g_string_sprintfa(out, "  %s %d %s\n", info_names[i], block, text);
+    }
+}
+
+/* Read a line written by map_info_write(). blocks holds the
+ * descriptions read so far. Returns FALSE if line isn't one
+ */
+gboolean map_info_read(AutoMap *automap, MapNode *node, gchar *line,
+                       GPtrArray *blocks)
+{
+    gchar *text, *end;
+    gint i, len;
+
+    while (*line == ' ')
+        line++;
+
+    for (i = 0; i < MAP_INFO_FIELDS; i++)
+    {
+        len = strlen(info_names[i]);
+
+        if (!strncmp(line, info_names[i], len) &&
+            (line[len] == ' ' || line[len] == '\n' || line[len] == '\0'))
+            break;
+    }
+
+    if (i == MAP_INFO_FIELDS)
+        return FALSE;
+
+    text = line + len;
+
+    while (*text == ' ')
+        text++;
+
+    if ((end = strchr(text, '\n')) != NULL)
+        *end = '\0';
+
+    if (node == NULL)
+        return TRUE;
+
+    if (i == MAP_INFO_DESCRIPTION)
+    {
+        guint block = strtoul(text, &text, 10);
+
+        while (*text == ' ')
+            text++;
+
+        if (block == 0)
+            return TRUE;
+
+        if (*text)
+        {
+            if (block >= blocks->len)
+                g_ptr_array_set_size(blocks, block + 1);
+
+            g_free(g_ptr_array_index(blocks, block));
+            g_ptr_array_index(blocks, block) = g_strdup(text);
+        } else if (block < blocks->len)
+            text = g_ptr_array_index(blocks, block);
+        else
+            return TRUE;
+    }
+
+    map_info_set(automap, node, i, text);
+
+    return TRUE;
+}
+
+/*
+ * Searching
+ */
+struct info_search {
+
+    gchar      *part;     /* Word of the text searched for       */
+    GHashTable *found;    /* Rooms with a word containing it     */
+};
+
+static void search_word(gchar *word, GList *list, struct info_search *search)
+{
+    if (strstr(word, search->part) == NULL)
+        return;
+
+    for (; list != NULL; list = list->next)
+        g_hash_table_insert(search->found, list->data, list->data);
+}
+
+static void search_part(gchar *part, GSList **parts)
+{
+    *parts = g_slist_prepend(*parts, g_strdup(part));
+}
+
+static gboolean search_missing(MapNode *node, gpointer value, GHashTable *found)
+{
+    return g_hash_table_lookup(found, node) == NULL;
+}
+
+static void search_list(MapNode *node, gpointer value, GList **result)
+{
+    *result = g_list_prepend(*result, node);
+}
+
+static AutoMap *sort_automap;
+
+/* Rooms on the map shown first, then closest to the middle of it
+ */
+static gint search_compare(MapNode *a, MapNode *b)
+{
+    AutoMap *automap = sort_automap;
+    gint da, db;
+
+    if ((a->map == automap->map) != (b->map == automap->map))
+        return a->map == automap->map ? -1 : 1;
+
+    da = ABS(a->x - automap->x) + ABS(a->y - automap->y);
+    db = ABS(b->x - automap->x) + ABS(b->y - automap->y);
+
+    return da - db;
+}
+
+/* The rooms with all the words of text in their info, or parts of
+ * them. Free the list when done with it
+ */
+GList *map_info_search(AutoMap *automap, gchar *text)
+{
+    GSList *parts = NULL, *puck;
+    GHashTable *matches = NULL;
+    GList *result = NULL;
+
+    if (automap->words == NULL)
+        return NULL;
+
+    info_words(text, (gpointer)search_part, &parts);
+
+    for (puck = parts; puck != NULL; puck = puck->next)
+    {
+        struct info_search search;
+
+        search.part = puck->data;
+        search.found = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+        /* Every word it is part of, itself among them */
+        g_hash_table_foreach(automap->words, (GHFunc)search_word, &search);
+
+        if (matches == NULL)
+        {
+            matches = search.found;
+        } else {
+            g_hash_table_foreach_remove(matches, (GHRFunc)search_missing,
+                                        search.found);
+            g_hash_table_destroy(search.found);
+        }
+
+        g_free(puck->data);
+    }
+
+    g_slist_free(parts);
+
+    if (matches == NULL)
+        return NULL;
+
+    g_hash_table_foreach(matches, (GHFunc)search_list, &result);
+    g_hash_table_destroy(matches);
+
+    sort_automap = automap;
+    return g_list_sort(result, (GCompareFunc)search_compare);
+}
+
+/*
+ * The find box
+ */
+static void find_activate(GtkWidget *entry, AutoMap *automap)
+{
+    gchar *text = gtk_entry_get_text(GTK_ENTRY(entry));
+    MapNode *node;
+
+    /* Pressing enter again moves on to the next room found */
+    if (automap->found_text && !strcmp(text, automap->found_text) &&
+        automap->found_next)
+    {
+        node = automap->found_next->data;
+        automap->found_next = automap->found_next->next;
+
+        if (automap->found_next == NULL)
+            automap->found_next = automap->found;
+
+        map_center(automap, node);
+        return;
+    }
+
+    map_info_forget(automap);
+
+    if ((automap->found = map_info_search(automap, text)) == NULL)
+    {
+        gdk_beep();
+        return;
+    }
+
+    automap->found_text = g_strdup(text);
+    automap->found_next = automap->found->next ? automap->found->next
+                                               : automap->found;
+    map_center(automap, automap->found->data);
+}
+
+/* Forget the rooms last found, they may not be there any more
+ */
+void map_info_forget(AutoMap *automap)
+{
+    g_list_free(automap->found);
+    g_free(automap->found_text);
+    automap->found = automap->found_next = NULL;
+    automap->found_text = NULL;
+}
+
+GtkWidget *map_info_find_box(AutoMap *automap)
+{
+    GtkWidget *entry = gtk_entry_new();
+
+    gtk_signal_connect(GTK_OBJECT(entry), "activate",
+                       GTK_SIGNAL_FUNC(find_activate), automap);
+
+    return entry;
+}
+
+/*
+ * Changing the info of a room
+ */
+struct info_window {
+
+    AutoMap   *automap;
+    guint32    node;
+    GtkWidget *window;
+    GtkWidget *entry[MAP_INFO_FIELDS];
+};
+
+static void info_window_destroy(GtkWidget *widget, struct info_window *iw)
+{
+    g_free(iw);
+}
+
+static void info_window_ok(GtkWidget *widget, struct info_window *iw)
+{
+    MapNode *node = map_node_lookup(iw->automap, iw->node);
+    gint field;
+
+    /* The room may have gone away while the window was open */
+    if (node == NULL)
+    {
+        gtk_widget_destroy(iw->window);
+        return;
+    }
+
+    for (field = 0; field < MAP_INFO_FIELDS; field++)
+    {
+        gchar *text = gtk_entry_get_text(GTK_ENTRY(iw->entry[field]));
+        gchar *old = map_info_get(node, field);
+        MapOp op;
+
+        if (!strcmp(text, old ? old : ""))
+            continue;
+
+        memset(&op, 0, sizeof(op));
+        op.type = MAP_OP_INFO;
+        op.node = node->id;
+        op.x = field;
+        op.text = text;
+        op.old_text = g_strdup(old);
+
+        if (map_op_apply(iw->automap, &op))
+            map_record(iw->automap, &op);
+
+        g_free(op.old_text);
+    }
+
+    map_info_forget(iw->automap);
+    gtk_widget_destroy(iw->window);
+}
+
+/* Change what is known about the room the player is in
+ */
+void map_info_window(AutoMap *automap)
+{
+    static gchar *labels[MAP_INFO_FIELDS] = {
+        "Name", "Description", "Notes", "Tags"
+    };
+    struct info_window *iw;
+    GtkWidget *vbox, *hbox, *table, *label, *separator;
+    GtkWidget *button_ok, *button_close;
+    gint field;
+
+    if (automap->player == NULL)
+        return;
+
+    iw = g_malloc0(sizeof(struct info_window));
+    iw->automap = automap;
+    iw->node = automap->player->id;
+
+    iw->window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(iw->window), "Room");
+    gtk_signal_connect(GTK_OBJECT(iw->window), "destroy",
+                       GTK_SIGNAL_FUNC(info_window_destroy), iw);
+
+    /* The window can't outlive the map window it edits */
+    gtk_signal_connect_object_while_alive(GTK_OBJECT(automap->window), "destroy",
+                                          GTK_SIGNAL_FUNC(gtk_widget_destroy),
+                                          GTK_OBJECT(iw->window));
+
+    vbox = gtk_vbox_new(FALSE, 5);
+    gtk_container_border_width(GTK_CONTAINER(vbox), 5);
+    gtk_container_add(GTK_CONTAINER(iw->window), vbox);
+    gtk_widget_show(vbox);
+
+    table = gtk_table_new(MAP_INFO_FIELDS, 2, FALSE);
+    gtk_box_pack_start(GTK_BOX(vbox), table, TRUE, TRUE, 0);
+    gtk_widget_show(table);
+
+    for (field = 0; field < MAP_INFO_FIELDS; field++)
+    {
+        gchar *text = map_info_get(automap->player, field);
+
+        label = gtk_label_new(labels[field]);
+        gtk_misc_set_alignment(GTK_MISC(label), 0, 0.5);
+        gtk_table_attach(GTK_TABLE(table), label, 0, 1, field, field + 1,
+                         GTK_FILL, 0, 5, 2);
+        gtk_widget_show(label);
+
+        iw->entry[field] = gtk_entry_new_with_max_length(MAP_INFO_MAX);
+        gtk_entry_set_text(GTK_ENTRY(iw->entry[field]), text ? text : "");
+        gtk_widget_set_usize(iw->entry[field], 300, -1);
+        gtk_table_attach(GTK_TABLE(table), iw->entry[field], 1, 2, field, field + 1,
+                         GTK_EXPAND | GTK_FILL, 0, 5, 2);
+        gtk_widget_show(iw->entry[field]);
+    }
+
+    separator = gtk_hseparator_new();
+    gtk_box_pack_start(GTK_BOX(vbox), separator, FALSE, TRUE, 5);
+    gtk_widget_show(separator);
+
+    hbox = gtk_hbox_new(FALSE, 0);
+    gtk_container_add(GTK_CONTAINER(vbox), hbox);
+    gtk_widget_show(hbox);
+
+    button_ok    = gtk_button_new_with_label("   ok   ");
+    button_close = gtk_button_new_with_label("  close  ");
+    gtk_signal_connect(GTK_OBJECT(button_ok), "clicked",
+                       GTK_SIGNAL_FUNC(info_window_ok), iw);
+    gtk_signal_connect_object(GTK_OBJECT(button_close), "clicked",
+                              GTK_SIGNAL_FUNC(gtk_widget_destroy),
+                              GTK_OBJECT(iw->window));
+    gtk_box_pack_start(GTK_BOX(hbox), button_ok, TRUE, TRUE, 5);
+    gtk_box_pack_start(GTK_BOX(hbox), button_close, TRUE, TRUE, 5);
+    gtk_widget_show(button_ok);
+    gtk_widget_show(button_close);
+
+    gtk_widget_show(iw->window);
+}
+
+#endif /* WITHOUT_MAPPER */
@@ -0,0 +1,790 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+#ifndef WITHOUT_MAPPER
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* Every change made to a map is appended to <mapfile>.journal as it
+ * happens, so nothing is lost if AMCL dies. Every now and then the
+ * whole map is copied, written out again from the copy (in a separate
+ * thread when we have them) and the records it now contains are
+ * dropped from the journal.
+ *
+ * Each record is a single line, starting with its sequence number. The
+ * map file remembers the sequence number of the last record it
+ * contains, and only records after that one are replayed on load.
+ */
+
+#define MAP_JOURNAL_INTERVAL    60000 /* Check for changes every minute   */
+#define MAP_JOURNAL_MAX_PENDING 2000  /* Don't wait that long beyond this */
+
+struct _MapJournal {
+
+    AutoMap *automap;
+    gchar   *filename;     /* The map file                            */
+    gchar   *journalname;  /* And the journal that goes with it       */
+    FILE    *file;
+
+    guint32  seq;          /* Sequence number of the last record      */
+    guint    pending;      /* Records not yet in the map file         */
+    gint     timeout;
+    gint     idle;
+
+    /* Background compaction */
+    guint    compacting : 1;
+    guint    again : 1;
+    guint32  compact_seq;  /* Last record contained in snapshot       */
+    long     compact_offset; /* Where the journal was at that point   */
+    MapSnapshot *snapshot;
+    GString *text;         /* What the snapshot is written as         */
+    gint     result;       /* 0, or errno from writing the snapshot   */
+
+#ifdef HAVE_LIBPTHREAD
+    pthread_t thread;
+    int       pipe[2];
+    gint      input;
+#endif
+};
+
+static gchar op_codes[] = "ARNXLBMPECFI";
+
+static void map_journal_finish(MapJournal *journal);
+
+/*
+ * Record encoding
+ */
+void map_op_format(GString *out, MapOp *op, guint32 seq)
+{
+    gchar code = op_codes[op->type];
+
+    switch (op->type)
+    {
+    case MAP_OP_MAP_NEW:
+    case MAP_OP_MAP_DELETE:
+        g_string_sprintfa(out, "%u %c %s\n", seq, code, op->map);
+        break;
+
+    case MAP_OP_NODE_NEW:
+    case MAP_OP_NODE_DELETE:
+        g_string_sprintfa(out, "%u %c %u %s %d %d\n", seq, code, op->node,
+                          op->map, op->x, op->y);
+        break;
+
+    case MAP_OP_LINK:
+    case MAP_OP_UNLINK:
+        g_string_sprintfa(out, "%u %c %u %u %u\n", seq, code, op->node,
+                          op->dir, op->other);
+        break;
+
+    case MAP_OP_MOVE:
+        g_string_sprintfa(out, "%u %c %u %d %d\n", seq, code, op->node,
+                          op->x, op->y);
+        break;
+
+    case MAP_OP_PLAYER:
+        g_string_sprintfa(out, "%u %c %u %u\n", seq, code, op->node,
+                          op->other);
+        break;
+
+    case MAP_OP_EDGE:
+        g_string_sprintfa(out, "%u %c %u %u %d\n", seq, code, op->node,
+                          op->dir, op->x);
+        break;
+
+    case MAP_OP_COST:
+        g_string_sprintfa(out, "%u %c %s %d %d\n", seq, code, op->map,
+                          op->x, op->y);
+        break;
+
+    case MAP_OP_ROOM:
+        g_string_sprintfa(out, "%u %c %u %u\n", seq, code, op->node,
+                          op->other);
+        break;
+
+    case MAP_OP_INFO:
+        g_string_sprintfa(out, "%u %c %u %d %s\n", seq, code, op->node,
+                          op->x, op->text ? op->text : "");
+        break;
+    }
+}
+
+/* Cut the next word out of text, returning it. *text is left pointing
+ * to what follows
+ */
+static gchar *op_word(gchar **text)
+{
+    gchar *word = *text, *end;
+
+    while (*word == ' ')
+        word++;
+
+    for (end = word; *end && *end != ' ' && *end != '\n'; end++)
+        ;
+
+    if (end == word)
+        return NULL;
+
+    *text = *end ? end + 1 : end;
+    *end = 0;
+
+    return word;
+}
+
+/* Parse a record written by map_op_format(). Map names and text in op
+ * point into line, which is modified
+ */
+gboolean map_op_parse(gchar *line, MapOp *op, guint32 *seq)
+{
+    gchar code, *c;
+    unsigned int node, dir, other;
+    int n = 0, x, y;
+
+    memset(op, 0, sizeof(MapOp));
+
+    if (sscanf(line, "%u %c %n", seq, &code, &n) < 2 || n == 0)
+        return FALSE;
+
+    if ((c = strchr(op_codes, code)) == NULL || code == 0)
+        return FALSE;
+
+    op->type = c - op_codes;
+    line += n;
+
+    switch (op->type)
+    {
+    case MAP_OP_MAP_NEW:
+    case MAP_OP_MAP_DELETE:
+        return (op->map = op_word(&line)) != NULL;
+
+    case MAP_OP_NODE_NEW:
+    case MAP_OP_NODE_DELETE:
+        if (sscanf(line, "%u %n", &node, &n) < 1)
+            return FALSE;
+
+        line += n;
+
+        if ((op->map = op_word(&line)) == NULL ||
+            sscanf(line, "%d %d", &x, &y) != 2)
+            return FALSE;
+
+        op->node = node;
+        op->x = x;
+        op->y = y;
+        return TRUE;
+
+    case MAP_OP_LINK:
+    case MAP_OP_UNLINK:
+        if (sscanf(line, "%u %u %u", &node, &dir, &other) != 3 || dir > DOWN)
+            return FALSE;
+
+        op->node = node;
+        op->dir = dir;
+        op->other = other;
+        return TRUE;
+
+    case MAP_OP_MOVE:
+        if (sscanf(line, "%u %d %d", &node, &x, &y) != 3)
+            return FALSE;
+
+        op->node = node;
+        op->x = x;
+        op->y = y;
+        return TRUE;
+
+    case MAP_OP_PLAYER:
+        if (sscanf(line, "%u %u", &node, &other) != 2)
+            return FALSE;
+
+        op->node = node;
+        op->other = other;
+        return TRUE;
+
+    case MAP_OP_EDGE:
+        if (sscanf(line, "%u %u %d", &node, &dir, &x) != 3 || dir > DOWN ||
+            x < 0 || x >= MAP_EDGE_KINDS)
+            return FALSE;
+
+        op->node = node;
+        op->dir = dir;
+        op->x = x;
+        return TRUE;
+
+    case MAP_OP_COST:
+        if ((op->map = op_word(&line)) == NULL ||
+            sscanf(line, "%d %d", &x, &y) != 2 || x < 0 || x >= MAP_EDGE_KINDS)
+            return FALSE;
+
+        op->x = x;
+        op->y = y;
+        return TRUE;
+
+    case MAP_OP_ROOM:
+        if (sscanf(line, "%u %u", &node, &other) != 2)
+            return FALSE;
+
+        op->node = node;
+        op->other = other;
+        return TRUE;
+
+    case MAP_OP_INFO:
+        if (sscanf(line, "%u %d%n", &node, &x, &n) != 2 ||
+            x < 0 || x >= MAP_INFO_FIELDS)
+            return FALSE;
+
+        op->node = node;
+        op->x = x;
+        op->text = line + n + (line[n] == ' ');
+        op->text[strcspn(op->text, "\n")] = '\0';
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* Make the change described by op. Map nodelists may be left holding
+ * more than one node of an interlinked group afterwards, use
+ * map_nodelist_rebuild() to tidy them up
+ */
+gboolean map_op_apply(AutoMap *automap, MapOp *op)
+{
+    MapNode *node = NULL, *other = NULL;
+    Map *map = NULL;
+    gint i;
+
+    switch (op->type)
+    {
+    case MAP_OP_MAP_NEW:
+        if (!map_find(op->map))
+            map_new_with_name(op->map);
+        return TRUE;
+
+    case MAP_OP_MAP_DELETE:
+        if ((map = map_find(op->map)) == NULL)
+            return FALSE;
+
+        if (automap->map == map)
+            automap->map = NULL;
+
+        remove_map(map);
+        return TRUE;
+
+    case MAP_OP_NODE_NEW:
+        if ((map = map_find(op->map)) == NULL ||
+            map_node_lookup(automap, op->node))
+            return FALSE;
+
+        node = map_node_new(automap, map, op->node, op->x, op->y);
+        map->nodelist = g_list_prepend(map->nodelist, node);
+        map_extend(map, node);
+        return TRUE;
+
+    case MAP_OP_NODE_DELETE:
+        if ((node = map_node_lookup(automap, op->node)) == NULL)
+            return FALSE;
+
+        for (i = 0; i < 10; i++)
+        {
+            if ((other = node->connections[i].node) == NULL)
+                continue;
+
+            other->connections[OPPOSITE(i)].node = NULL;
+            other->connections[OPPOSITE(i)].kind = MAP_EDGE_PLAIN;
+
+            if (i < 8)
+                other->conn--;
+
+            if (!g_list_find(other->map->nodelist, other))
+                other->map->nodelist = g_list_prepend(other->map->nodelist, other);
+        }
+
+        node->map->nodelist = g_list_remove(node->map->nodelist, node);
+
+        if (automap->player == node)
+            automap->player = NULL;
+
+        map_node_free(automap, node);
+        return TRUE;
+
+    case MAP_OP_LINK:
+        if ((node = map_node_lookup(automap, op->node)) == NULL ||
+            (other = map_node_lookup(automap, op->other)) == NULL ||
+            node->connections[op->dir].node ||
+            other->connections[OPPOSITE(op->dir)].node)
+            return FALSE;
+
+        node->connections[op->dir].node = other;
+        other->connections[OPPOSITE(op->dir)].node = node;
+
+        if (op->dir < 8)
+        {
+            node->conn++;
+            other->conn++;
+        }
+        return TRUE;
+
+    case MAP_OP_UNLINK:
+        if ((node = map_node_lookup(automap, op->node)) == NULL ||
+            (other = map_node_lookup(automap, op->other)) == NULL ||
+            node->connections[op->dir].node != other)
+            return FALSE;
+
+        memset(&node->connections[op->dir], 0, sizeof(*node->connections));
+        memset(&other->connections[OPPOSITE(op->dir)], 0, sizeof(*other->connections));
+
+        if (op->dir < 8)
+        {
+            node->conn--;
+            other->conn--;
+        }
+
+        if (!g_list_find(node->map->nodelist, node))
+            node->map->nodelist = g_list_prepend(node->map->nodelist, node);
+
+        if (!g_list_find(other->map->nodelist, other))
+            other->map->nodelist = g_list_prepend(other->map->nodelist, other);
+        return TRUE;
+
+    case MAP_OP_MOVE:
+        if ((node = map_node_lookup(automap, op->node)) == NULL)
+            return FALSE;
+
+        node_hash_remove(node->map->nodes, node);
+        map_lod_remove(node);
+        node->x += op->x;
+        node->y += op->y;
+        node_hash_prepend(node->map->nodes, node);
+        map_lod_add(node);
+        map_extend(node->map, node);
+        return TRUE;
+
+    case MAP_OP_PLAYER:
+        if ((node = map_node_lookup(automap, op->node)) == NULL)
+            return FALSE;
+
+        automap->player = node;
+        automap->map = node->map;
+        return TRUE;
+
+    case MAP_OP_EDGE:
+        if ((node = map_node_lookup(automap, op->node)) == NULL)
+            return FALSE;
+
+        op->old = node->connections[op->dir].kind;
+        node->connections[op->dir].kind = op->x;
+        return TRUE;
+
+    case MAP_OP_COST:
+        if ((map = map_find(op->map)) == NULL)
+            return FALSE;
+
+        op->old = map->cost[op->x];
+        map->cost[op->x] = op->y;
+        return TRUE;
+
+    case MAP_OP_ROOM:
+        if ((node = map_node_lookup(automap, op->node)) == NULL)
+            return FALSE;
+
+        op->old = node->fingerprint;
+        map_room_index(automap, node, op->other);
+        return TRUE;
+
+    case MAP_OP_INFO:
+        if ((node = map_node_lookup(automap, op->node)) == NULL)
+            return FALSE;
+
+        map_info_set(automap, node, op->x, op->text);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/*
+ * The journal
+ */
+static void map_journal_replay(MapJournal *journal)
+{
+    AutoMap *automap = journal->automap;
+    FILE *file = fopen(journal->journalname, "r");
+    gchar buf[MAP_INFO_MAX + 64];
+    guint replayed = 0, line = 0;
+    long offset = 0;
+    GList *puck;
+    MapOp op;
+    guint32 seq;
+
+    if (file == NULL)
+        return;
+
+    while (fgets(buf, sizeof(buf), file) != NULL)
+    {
+        line++;
+
+        /* A record without a newline was cut short when we went down.
+         * Drop it (and anything after it) from the journal
+         */
+        if (strchr(buf, '\n') == NULL || !map_op_parse(buf, &op, &seq))
+        {
+            g_warning("map_journal_replay: %s: dropping damaged record on line %u\n",
+                      journal->journalname, line);
+            fclose(file);
+            truncate(journal->journalname, offset);
+            file = NULL;
+            break;
+        }
+
+        offset = ftell(file);
+
+        /* Already part of the map file */
+        if (seq <= journal->seq)
+            continue;
+
+        if (!map_op_apply(automap, &op))
+            g_warning("map_journal_replay: %s: record %u doesn't apply, skipped\n",
+                      journal->journalname, seq);
+
+        journal->seq = seq;
+        replayed++;
+    }
+
+    if (file)
+        fclose(file);
+
+    if (replayed == 0)
+        return;
+
+    for (puck = MapList; puck != NULL; puck = puck->next)
+        map_nodelist_rebuild(puck->data);
+
+    if (automap->player)
+        automap->map = automap->player->map;
+
+    journal->pending = replayed;
+}
+
+static gint map_journal_timeout(MapJournal *journal)
+{
+    if (journal->pending && !journal->compacting)
+        map_journal_compact(journal);
+
+    return TRUE;
+}
+
+static gint map_journal_idle(MapJournal *journal)
+{
+    journal->idle = 0;
+    map_journal_compact(journal);
+
+    return FALSE;
+}
+
+/* Open the journal belonging to filename, replaying the records in it
+ * after seq (the last one the map file contains) into automap
+ */
+MapJournal *map_journal_open(AutoMap *automap, gchar *filename, guint32 seq)
+{
+    MapJournal *journal = g_malloc0(sizeof(MapJournal));
+
+    if (journal == NULL)
+    {
+        g_error("map_journal_open: g_malloc0 error: %s\n", strerror(errno));
+        gtk_exit(1);
+    }
+
+    journal->automap = automap;
+    journal->filename = g_strdup(filename);
+    journal->journalname = g_strconcat(filename, ".journal", NULL);
+    journal->seq = seq;
+
+    map_journal_replay(journal);
+
+    journal->file = fopen(journal->journalname, "a");
+
+    if (journal->file == NULL)
+    {
+        g_warning("map_journal_open: Can't open %s for writing: %s\n",
+                  journal->journalname, strerror(errno));
+        g_free(journal->journalname);
+        g_free(journal->filename);
+        g_free(journal);
+        return NULL;
+    }
+
+    journal->timeout = gtk_timeout_add(MAP_JOURNAL_INTERVAL,
+                                       (GtkFunction)map_journal_timeout, journal);
+
+    return journal;
+}
+
+void map_journal_close(MapJournal *journal)
+{
+#ifdef HAVE_LIBPTHREAD
+    /* Let a snapshot being written finish first, it is renamed over
+     * the map file which may be opened again straight away
+     */
+    if (journal->compacting)
+    {
+        pthread_join(journal->thread, NULL);
+        gdk_input_remove(journal->input);
+        close(journal->pipe[0]);
+        close(journal->pipe[1]);
+        journal->again = FALSE;
+        map_journal_finish(journal);
+    }
+#endif
+
+    gtk_timeout_remove(journal->timeout);
+
+    if (journal->idle)
+        gtk_idle_remove(journal->idle);
+
+    if (journal->file)
+        fclose(journal->file);
+
+    g_free(journal->journalname);
+    g_free(journal->filename);
+    g_free(journal);
+}
+
+void map_journal_append(MapJournal *journal, MapOp *op)
+{
+    GString *line;
+
+    if (journal->file == NULL)
+        return;
+
+    line = g_string_new(NULL);
+    map_op_format(line, op, ++journal->seq);
+
+    /* Written straight through, it is only any use if it gets there */
+    if (fputs(line->str, journal->file) == EOF || fflush(journal->file) != 0)
+        g_warning("map_journal_append: Can't write to %s: %s\n",
+                  journal->journalname, strerror(errno));
+
+    g_string_free(line, TRUE);
+
+    if (++journal->pending >= MAP_JOURNAL_MAX_PENDING &&
+        !journal->idle && !journal->compacting)
+        journal->idle = gtk_idle_add((GtkFunction)map_journal_idle, journal);
+}
+
+gchar *map_journal_filename(MapJournal *journal)
+{
+    return journal->filename;
+}
+
+/* Sequence number of the last record, which the map as it is now goes
+ * with
+ */
+guint32 map_journal_seq(MapJournal *journal)
+{
+    return journal->seq;
+}
+
+/* Runs in the worker thread, so must not touch anything but the
+ * snapshot, its text, the filename and the result
+ */
+static void *map_journal_write(MapJournal *journal)
+{
+    gchar *tmpname = g_strconcat(journal->filename, ".tmp", NULL);
+    FILE *file;
+
+    map_snapshot_write(journal->text, journal->snapshot);
+
+    file = fopen(tmpname, "w");
+    journal->result = 0;
+
+    if (file == NULL ||
+        fwrite(journal->text->str, 1, journal->text->len, file)
+            != journal->text->len ||
+        fflush(file) != 0 || fsync(fileno(file)) != 0)
+        journal->result = errno ? errno : EIO;
+
+    if (file && fclose(file) != 0 && !journal->result)
+        journal->result = errno;
+
+    if (!journal->result && rename(tmpname, journal->filename) != 0)
+        journal->result = errno;
+
+    if (journal->result)
+        unlink(tmpname);
+
+    g_free(tmpname);
+
+#ifdef HAVE_LIBPTHREAD
+    write(journal->pipe[1], "", 1);
+#endif
+
+    return NULL;
+}
+
+/* Drop the records the map file now contains from the journal, by
+ * copying the ones added while it was being written to a new journal
+ */
+static void map_journal_truncate(MapJournal *journal)
+{
+    gchar *tmpname = g_strconcat(journal->journalname, ".tmp", NULL);
+    FILE *in, *out;
+    gchar buf[4096];
+    size_t n;
+
+    fclose(journal->file);
+    journal->file = NULL;
+
+    in = fopen(journal->journalname, "r");
+    out = fopen(tmpname, "w");
+
+    if (in && out && fseek(in, journal->compact_offset, SEEK_SET) == 0)
+    {
+        while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+            fwrite(buf, 1, n, out);
+
+        if (fflush(out) == 0 && !ferror(in))
+            rename(tmpname, journal->journalname);
+    }
+
+    if (in) fclose(in);
+    if (out) fclose(out);
+
+    unlink(tmpname);
+    g_free(tmpname);
+
+    journal->file = fopen(journal->journalname, "a");
+
+    if (journal->file == NULL)
+        g_warning("map_journal_truncate: Can't open %s for writing: %s\n",
+                  journal->journalname, strerror(errno));
+}
+
+static void map_journal_finish(MapJournal *journal)
+{
+    map_snapshot_free(journal->snapshot);
+    g_string_free(journal->text, TRUE);
+    journal->snapshot = NULL;
+    journal->text = NULL;
+    journal->compacting = FALSE;
+
+    if (journal->result)
+    {
+        g_warning("map_journal_compact: Can't write %s: %s\n",
+                  journal->filename, strerror(journal->result));
+        journal->pending += 1;
+        return;
+    }
+
+    map_journal_truncate(journal);
+
+    if (journal->again)
+    {
+        journal->again = FALSE;
+        map_journal_compact(journal);
+    }
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void map_journal_written(MapJournal *journal, gint source,
+                                GdkInputCondition condition)
+{
+    gchar c;
+
+    read(journal->pipe[0], &c, 1);
+    pthread_join(journal->thread, NULL);
+
+    gdk_input_remove(journal->input);
+    close(journal->pipe[0]);
+    close(journal->pipe[1]);
+
+    map_journal_finish(journal);
+}
+#endif
+
+/* Write the whole map out again and empty the journal. The snapshot is
+ * taken here; writing it as text, and that to disk, happens in the
+ * background
+ */
+void map_journal_compact(MapJournal *journal)
+{
+    AutoMap *automap = journal->automap;
+
+    if (journal->compacting)
+    {
+        journal->again = TRUE;
+        return;
+    }
+
+    if (automap->map == NULL || journal->file == NULL)
+        return;
+
+    /* GLib isn't told about threads, so the thread can only add to a
+     * string made here
+     */
+    journal->snapshot = map_snapshot_take(automap, journal->seq);
+    journal->text = g_string_new(NULL);
+
+    fflush(journal->file);
+    journal->compact_seq = journal->seq;
+    journal->compact_offset = ftell(journal->file);
+    journal->pending = 0;
+    journal->compacting = TRUE;
+
+#ifdef HAVE_LIBPTHREAD
+    if (pipe(journal->pipe) == 0)
+    {
+        if (pthread_create(&journal->thread, NULL,
+                           (void *(*)(void *))map_journal_write, journal) == 0)
+        {
+            journal->input = gdk_input_add(journal->pipe[0], GDK_INPUT_READ,
+                                           (GdkInputFunction)map_journal_written,
+                                           journal);
+            return;
+        }
+
+        close(journal->pipe[0]);
+        close(journal->pipe[1]);
+    }
+
+    /* No thread, do it here instead. Make the write to the pipe fail
+     * quietly
+     */
+    journal->pipe[1] = -1;
+#endif
+
+    map_journal_write(journal);
+    map_journal_finish(journal);
+}
+
+#endif /* WITHOUT_MAPPER */
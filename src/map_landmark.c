@@ -0,0 +1,549 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+#ifndef WITHOUT_MAPPER
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* Landmarks, to tell the route finder which way to look.
+ *
+ * For a few rooms spread out over the map (the landmarks), what it
+ * costs to get from them to every other room and back is worked out in
+ * advance. The cost from room a to room b is then at least
+ * cost(L, b) - cost(L, a) and cost(a, L) - cost(b, L) for every landmark
+ * L, which is never too much, so map_route() can search towards the end
+ * instead of in all directions.
+ *
+ * Working out the tables means searching the whole map twice for every
+ * landmark, so it is done in a separate thread (when we have them) on a
+ * copy of the links, and only for maps big enough to need it. The
+ * tables are written to <mapfile>.landmarks along with the journal
+ * sequence number they go with, and read back if that still matches
+ * when the map is loaded.
+ *
+ * Removing links or making them dearer leaves the tables still never
+ * too much, if less useful. New or cheaper links make them useless
+ * until worked out again, which happens the next time a route is
+ * asked for.
+ */
+
+#define MAP_LANDMARKS          8
+#define MAP_LANDMARK_MIN_NODES 4000  /* Fewer rooms than this don't need it */
+#define MAP_LANDMARK_FAR       G_MAXINT
+
+struct _MapLandmarks {
+
+    guint    stamp;      /* automap->landmark_stamp they were made for */
+    gint     count;
+    guint32  ids[MAP_LANDMARKS];
+    guint32  size;       /* Node numbers covered                       */
+    gint    *from;       /* size * count, [id * count + landmark]      */
+    gint    *to;
+};
+
+/* A copy of the links, for the worker thread
+ */
+struct _MapLandmarkJob {
+
+    AutoMap      *automap;   /* NULL once the maps it was made for are gone */
+    guint         stamp;
+    guint32       seq;
+    gchar        *filename;
+    guint32       start;
+    guint32       size;
+    guint32      *next;      /* size * 10, node number each link leads to */
+    gint         *cost;      /* size * 10, what taking it costs, or -1    */
+    MapLandmarks *result;
+
+#ifdef HAVE_LIBPTHREAD
+    pthread_t     thread;
+    int           pipe[2];
+    gint          input;
+#endif
+};
+
+#define NO_NODE ((guint32) -1)
+
+static void landmarks_free(MapLandmarks *lm)
+{
+    if (lm == NULL)
+        return;
+
+    g_free(lm->from);
+    g_free(lm->to);
+    g_free(lm);
+}
+
+static void job_free(MapLandmarkJob *job)
+{
+    landmarks_free(job->result);
+    g_free(job->filename);
+    g_free(job->next);
+    g_free(job->cost);
+    g_free(job);
+}
+
+/*
+ * The worker thread. Mustn't touch anything but the job
+ */
+
+static void heap_sift(guint32 *heap, guint32 *pos, gint *dist, guint32 n, guint32 i)
+{
+    /* Up */
+    while (i > 0 && dist[heap[(i - 1) / 2]] > dist[heap[i]])
+    {
+        guint32 p = (i - 1) / 2, t = heap[p];
+
+        heap[p] = heap[i]; pos[heap[p]] = p;
+        heap[i] = t;       pos[t] = i;
+        i = p;
+    }
+
+    /* Down */
+    for (;;)
+    {
+        guint32 least = i, c, t;
+
+        for (c = 2 * i + 1; c <= 2 * i + 2 && c < n; c++)
+            if (dist[heap[c]] < dist[heap[least]])
+                least = c;
+
+        if (least == i)
+            break;
+
+        t = heap[least];
+        heap[least] = heap[i]; pos[heap[least]] = least;
+        heap[i] = t;           pos[t] = i;
+        i = least;
+    }
+}
+
+/* Costs from source to every node (or to source from every node, if
+ * reverse) into dist, MAP_LANDMARK_FAR where there's no way
+ */
+static void job_search(MapLandmarkJob *job, guint32 source, gboolean reverse,
+                       gint *dist, guint32 *heap, guint32 *pos)
+{
+    guint32 n = 0, i;
+
+    for (i = 0; i < job->size; i++)
+    {
+        dist[i] = MAP_LANDMARK_FAR;
+        pos[i] = NO_NODE;
+    }
+
+    dist[source] = 0;
+    heap[n] = source; pos[source] = n++;
+
+    while (n > 0)
+    {
+        guint32 node = heap[0];
+        gint d;
+
+        heap[0] = heap[--n]; pos[heap[0]] = 0;
+        heap_sift(heap, pos, dist, n, 0);
+
+        for (i = 0; i < 10; i++)
+        {
+            guint32 next = job->next[node * 10 + i];
+            gint cost;
+
+            if (next == NO_NODE)
+                continue;
+
+            /* Links always go both ways */
+            cost = reverse ? job->cost[next * 10 + OPPOSITE(i)]
+                           : job->cost[node * 10 + i];
+
+            if (cost < 0 || (d = dist[node] + cost) >= dist[next])
+                continue;
+
+            dist[next] = d;
+
+            if (pos[next] == NO_NODE)
+            {
+                heap[n] = next; pos[next] = n++;
+            }
+
+            heap_sift(heap, pos, dist, n, pos[next]);
+        }
+    }
+}
+
+static void job_write(MapLandmarkJob *job)
+{
+    MapLandmarks *lm = job->result;
+    gchar *name = g_strconcat(job->filename, ".landmarks", NULL);
+    gchar *tmpname = g_strconcat(name, ".tmp", NULL);
+    size_t cells = (size_t)lm->size * lm->count;
+    FILE *file = fopen(tmpname, "w");
+    gint ok;
+
+    if (file == NULL)
+    {
+        g_free(tmpname);
+        g_free(name);
+        return;
+    }
+
+    ok = fprintf(file, "landmarks journal %u count %d nodes %u\n",
+                 job->seq, lm->count, lm->size) > 0 &&
+        fwrite(lm->ids, sizeof(guint32), lm->count, file) == lm->count &&
+        fwrite(lm->from, sizeof(gint), cells, file) == cells &&
+        fwrite(lm->to, sizeof(gint), cells, file) == cells;
+
+    if (fclose(file) == 0 && ok)
+        rename(tmpname, name);
+    else
+        unlink(tmpname);
+
+    g_free(tmpname);
+    g_free(name);
+}
+
+static void *job_run(MapLandmarkJob *job)
+{
+    MapLandmarks *lm = g_malloc0(sizeof(MapLandmarks));
+    guint32 *heap = g_new(guint32, job->size), *pos = g_new(guint32, job->size);
+    gint *dist = g_new(gint, job->size), *nearest = g_new(gint, job->size);
+    guint32 i, landmark = job->start;
+    gint l;
+
+    lm->stamp = job->stamp;
+    lm->size = job->size;
+    lm->from = g_new(gint, (size_t)job->size * MAP_LANDMARKS);
+    lm->to = g_new(gint, (size_t)job->size * MAP_LANDMARKS);
+
+    /* Start with the room furthest from where the player is */
+    job_search(job, job->start, FALSE, dist, heap, pos);
+
+    for (i = 0; i < job->size; i++)
+    {
+        if (dist[i] != MAP_LANDMARK_FAR && dist[i] > dist[landmark])
+            landmark = i;
+
+        nearest[i] = MAP_LANDMARK_FAR;
+    }
+
+    for (l = 0; l < MAP_LANDMARKS; l++)
+    {
+        lm->ids[l] = landmark;
+        lm->count = l + 1;
+
+        job_search(job, landmark, TRUE, dist, heap, pos);
+
+        for (i = 0; i < job->size; i++)
+            lm->to[i * MAP_LANDMARKS + l] = dist[i];
+
+        job_search(job, landmark, FALSE, dist, heap, pos);
+
+        for (i = 0; i < job->size; i++)
+        {
+            lm->from[i * MAP_LANDMARKS + l] = dist[i];
+
+            if (dist[i] < nearest[i])
+                nearest[i] = dist[i];
+        }
+
+        /* And the next one is the room furthest from all of them */
+        for (i = 0; i < job->size; i++)
+            if (nearest[i] != MAP_LANDMARK_FAR && nearest[i] > nearest[landmark])
+                landmark = i;
+
+        if (nearest[landmark] == 0)
+            break;
+    }
+
+    /* Pack the tables down if there weren't enough rooms */
+    if (lm->count < MAP_LANDMARKS)
+    {
+        for (i = 0; i < job->size; i++)
+            for (l = 0; l < lm->count; l++)
+            {
+                lm->from[i * lm->count + l] = lm->from[i * MAP_LANDMARKS + l];
+                lm->to[i * lm->count + l] = lm->to[i * MAP_LANDMARKS + l];
+            }
+    }
+
+    g_free(heap);
+    g_free(pos);
+    g_free(dist);
+    g_free(nearest);
+
+    job->result = lm;
+
+    if (job->filename)
+        job_write(job);
+
+#ifdef HAVE_LIBPTHREAD
+    write(job->pipe[1], "", 1);
+#endif
+
+    return NULL;
+}
+
+/*
+ * The main thread
+ */
+
+static void job_finish(MapLandmarkJob *job)
+{
+    AutoMap *automap = job->automap;
+
+    if (automap)
+    {
+        automap->landmark_job = NULL;
+
+        /* Anything changed while working means starting over, later */
+        if (job->stamp == automap->landmark_stamp)
+        {
+            landmarks_free(automap->landmarks);
+            automap->landmarks = job->result;
+            job->result = NULL;
+        }
+    }
+
+    job_free(job);
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void job_done(MapLandmarkJob *job, gint source,
+                     GdkInputCondition condition)
+{
+    gchar c;
+
+    read(job->pipe[0], &c, 1);
+    pthread_join(job->thread, NULL);
+
+    gdk_input_remove(job->input);
+    close(job->pipe[0]);
+    close(job->pipe[1]);
+
+    job_finish(job);
+}
+#endif
+
+static void job_copy(gpointer id, MapNode *node, MapLandmarkJob *job)
+{
+    gint i;
+
+    for (i = 0; i < 10; i++)
+    {
+        MapNode *next = node->connections[i].node;
+
+        job->next[node->id * 10 + i] = next ? next->id : NO_NODE;
+        job->cost[node->id * 10 + i] = next ? map_edge_cost(node, i) : -1;
+    }
+}
+
+static void job_start(AutoMap *automap)
+{
+    MapLandmarkJob *job = g_malloc0(sizeof(MapLandmarkJob));
+    guint32 i;
+
+    job->automap = automap;
+    job->stamp = automap->landmark_stamp;
+    job->size = automap->next_id;
+    job->start = automap->player->id;
+    job->next = g_new(guint32, (size_t)job->size * 10);
+    job->cost = g_new(gint, (size_t)job->size * 10);
+
+    if (automap->journal)
+    {
+        job->filename = g_strdup(map_journal_filename(automap->journal));
+        job->seq = map_journal_seq(automap->journal);
+    }
+
+    /* Node numbers needn't be contiguous */
+    for (i = 0; i < job->size * 10; i++)
+        job->next[i] = NO_NODE;
+
+    g_hash_table_foreach(automap->ids, (GHFunc)job_copy, job);
+
+    automap->landmark_job = job;
+
+#ifdef HAVE_LIBPTHREAD
+    if (pipe(job->pipe) == 0)
+    {
+        if (pthread_create(&job->thread, NULL, (void *(*)(void *))job_run, job) == 0)
+        {
+            job->input = gdk_input_add(job->pipe[0], GDK_INPUT_READ,
+                                       (GdkInputFunction)job_done, job);
+            return;
+        }
+
+        close(job->pipe[0]);
+        close(job->pipe[1]);
+    }
+
+    job->pipe[1] = -1;
+#endif
+
+    job_run(job);
+    job_finish(job);
+}
+
+/* The landmark tables to use for a route, or NULL if there are none
+ * that are any good at the moment. Starts working them out if need be
+ */
+MapLandmarks *map_landmarks(AutoMap *automap)
+{
+    MapLandmarks *lm = automap->landmarks;
+
+    if (lm && lm->stamp == automap->landmark_stamp)
+        return lm;
+
+    if (automap->landmark_job == NULL && automap->player &&
+        g_hash_table_size(automap->ids) >= MAP_LANDMARK_MIN_NODES)
+        job_start(automap);
+
+    /* Without threads, that may have done it already */
+    lm = automap->landmarks;
+
+    return lm && lm->stamp == automap->landmark_stamp ? lm : NULL;
+}
+
+/* The least it can cost to get from a to b
+ */
+gint map_landmark_estimate(MapLandmarks *lm, MapNode *a, MapNode *b)
+{
+    gint *fa, *fb, *ta, *tb;
+    gint l, best = 0;
+
+    if (a->id >= lm->size || b->id >= lm->size)
+        return 0;
+
+    fa = lm->from + a->id * lm->count; fb = lm->from + b->id * lm->count;
+    ta = lm->to + a->id * lm->count;   tb = lm->to + b->id * lm->count;
+
+    for (l = 0; l < lm->count; l++)
+    {
+        if (fa[l] != MAP_LANDMARK_FAR && fb[l] != MAP_LANDMARK_FAR &&
+            fb[l] - fa[l] > best)
+            best = fb[l] - fa[l];
+
+        if (ta[l] != MAP_LANDMARK_FAR && tb[l] != MAP_LANDMARK_FAR &&
+            ta[l] - tb[l] > best)
+            best = ta[l] - tb[l];
+    }
+
+    return best;
+}
+
+/* Note a change about to be made to the map
+ */
+void map_landmark_record(AutoMap *automap, MapOp *op)
+{
+    switch (op->type)
+    {
+    case MAP_OP_LINK:
+    case MAP_OP_EDGE:
+    case MAP_OP_COST:
+        /* May be cheaper than the tables think */
+        automap->landmark_stamp++;
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Read the tables saved with the map, if they still go with it. Call
+ * once the journal has been replayed
+ */
+void map_landmark_load(AutoMap *automap)
+{
+    MapLandmarks *lm;
+    gchar *name;
+    FILE *file;
+    guint32 seq, size;
+    gint count;
+    size_t cells;
+
+    if (automap->journal == NULL)
+        return;
+
+    name = g_strconcat(map_journal_filename(automap->journal), ".landmarks", NULL);
+    file = fopen(name, "r");
+    g_free(name);
+
+    if (file == NULL)
+        return;
+
+    if (fscanf(file, "landmarks journal %u count %d nodes %u", &seq, &count, &size) != 3 ||
+        fgetc(file) != '\n' || seq != map_journal_seq(automap->journal) ||
+        count < 1 || count > MAP_LANDMARKS || size != automap->next_id)
+    {
+        fclose(file);
+        return;
+    }
+
+    cells = (size_t)size * count;
+
+    lm = g_malloc0(sizeof(MapLandmarks));
+    lm->stamp = automap->landmark_stamp;
+    lm->count = count;
+    lm->size = size;
+    lm->from = g_new(gint, cells);
+    lm->to = g_new(gint, cells);
+
+    if (fread(lm->ids, sizeof(guint32), count, file) != count ||
+        fread(lm->from, sizeof(gint), cells, file) != cells ||
+        fread(lm->to, sizeof(gint), cells, file) != cells)
+    {
+        landmarks_free(lm);
+        fclose(file);
+        return;
+    }
+
+    fclose(file);
+
+    landmarks_free(automap->landmarks);
+    automap->landmarks = lm;
+}
+
+/* Forget the tables, for when the maps go away. A job still running is
+ * left to finish on its own
+ */
+void map_landmark_free(AutoMap *automap)
+{
+    landmarks_free(automap->landmarks);
+    automap->landmarks = NULL;
+    automap->landmark_stamp++;
+
+    if (automap->landmark_job)
+        automap->landmark_job->automap = NULL;
+
+    automap->landmark_job = NULL;
+}
+
+#endif /* WITHOUT_MAPPER */
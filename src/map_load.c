@@ -0,0 +1,743 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+#ifndef WITHOUT_MAPPER
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* Reading map files, as map_write() writes them.
+ *
+ * The file is read whole. The header and the map lines are read in
+ * order, then the room lines, which are nearly all of a big file, are
+ * cut into pieces at room lines and each piece is read by a thread of
+ * its own into an array of LoadRooms, which point at nothing but the
+ * file's text. The rooms are then made, given what is known about them
+ * and linked up in file order, by the thread that called map_read().
+ *
+ * Files are edited by hand and merged by other programs, so what doesn't
+ * add up is reported and left out rather than trusted: links to rooms
+ * that aren't in the file, links that only go one way, rooms given
+ * twice or on maps that aren't in the file, and lines that can't be read.
+ */
+
+/* Files smaller than this aren't worth the threads */
+#define LOAD_PIECE_MIN    (256 * 1024)
+#define LOAD_THREADS_MAX  16
+
+/* Problems listed by g_warning(), the rest are only counted */
+#define LOAD_PROBLEMS_SHOWN 20
+
+typedef struct {
+    guint32  id;
+    gint32   x, y;
+    gchar   *map;                       /* Into the file's text */
+    gint32   links[10];                 /* Room numbers, -1 for none */
+    guint8   kinds[10];
+    guint32  fingerprint;
+    gchar   *info;                      /* First line about the room */
+    guint    line;                      /* In its piece, from 0 */
+} LoadRoom;
+
+typedef struct {
+    guint    line;                      /* In its piece, until counted */
+    gchar   *text;
+} LoadProblem;
+
+typedef struct {
+    gchar       *start, *end;           /* The lines of the piece */
+    guint        first;                 /* Line number of start */
+    guint        lines;
+    LoadRoom    *rooms;                 /* The thread's own arena */
+    guint        count, size;
+    LoadProblem *problems;              /* Made into a list once read, */
+    guint        n_problems, n_size;    /* as GSLists aren't thread safe */
+#ifdef HAVE_LIBPTHREAD
+    pthread_t    thread;
+    gboolean     started;
+#endif
+} LoadPiece;
+
+typedef struct {
+    GSList      *problems;              /* Reversed */
+} Load;
+
+/* The next word of *text, which is moved past it. Words end at white
+ * space or a comma and brackets are left out of them, so "(10, 4)" is
+ * the words 10 and 4. The text is changed in place
+ */
+static gchar *load_word(gchar **text)
+{
+    gchar *r = *text, *w, *word;
+
+    while (isspace((guchar)*r) || *r == ',')
+        r++;
+
+    if (*r == '\0')
+    {
+        *text = r;
+        return NULL;
+    }
+
+    for (word = w = r; *r != '\0' && !isspace((guchar)*r) && *r != ','; r++)
+        if (*r != '(' && *r != ')')
+            *w++ = *r;
+
+    if (*r != '\0')
+        r++;
+
+    *w = '\0';
+    *text = r;
+
+    return word;
+}
+
+/* Whether word is a whole number, and what */
+static gboolean load_number(gchar *word, glong *value)
+{
+    gchar *end;
+
+    if (word == NULL)
+        return FALSE;
+
+    *value = strtol(word, &end, 10);
+
+    return end != word && *end == '\0';
+}
+
+static void load_problem(GSList **problems, guint line, gchar *format, ...)
+{
+    LoadProblem *p = g_new(LoadProblem, 1);
+    va_list args;
+
+    va_start(args, format);
+    p->line = line;
+    p->text = g_strdup_vprintf(format, args);
+    va_end(args);
+
+    *problems = g_slist_prepend(*problems, p);
+}
+
+/* One room line: number (x, y) map, then the ten ways out as a name and
+ * a room number, -1 for none, then maybe their kinds and the room's
+ * fingerprint
+ */
+static gboolean load_room(LoadRoom *room, gchar *text)
+{
+    gchar *word;
+    glong value;
+    gint i;
+
+    memset(room, 0, sizeof(*room));
+
+    if (!load_number(load_word(&text), &value) || value < 0)
+        return FALSE;
+
+    room->id = value;
+
+    if (!load_number(load_word(&text), &value))
+        return FALSE;
+
+    room->x = value;
+
+    if (!load_number(load_word(&text), &value))
+        return FALSE;
+
+    room->y = value;
+
+    if ((room->map = load_word(&text)) == NULL)
+        return FALSE;
+
+    for (i = 0; i < 10; i++)
+    {
+        if (load_word(&text) == NULL ||
+            !load_number(load_word(&text), &value))
+            return FALSE;
+
+        room->links[i] = value < 0 ? -1 : value;
+    }
+
+    /* Rooms with only plain ways out don't have kinds, and rooms not
+     * seen from the mud don't have a fingerprint
+     */
+    while ((word = load_word(&text)) != NULL)
+    {
+        if (!strcmp(word, "kinds"))
+        {
+            for (i = 0; i < 10 && load_number(load_word(&text), &value); i++)
+                room->kinds[i] = CLAMP(value, 0, MAP_EDGE_KINDS - 1);
+        } else if (!strcmp(word, "room") &&
+                   (word = load_word(&text)) != NULL) {
+            room->fingerprint = strtoul(word, NULL, 10);
+        }
+    }
+
+    return TRUE;
+}
+
+/* Read the room lines of a piece into its arena. This runs in a thread
+ * of its own, so touches nothing but the piece
+ */
+static void *load_piece(LoadPiece *piece)
+{
+    gchar *line, *next;
+    LoadRoom *room = NULL;
+
+    for (line = piece->start; line < piece->end; line = next, piece->lines++)
+    {
+        if ((next = memchr(line, '\n', piece->end - line)) != NULL)
+            *next++ = '\0';
+        else
+            next = piece->end;
+
+        /* What is known about the room read last, read later */
+        if (*line == ' ')
+        {
+            if (room != NULL && room->info == NULL)
+                room->info = line;
+
+            continue;
+        }
+
+        if (*line == '\0' || *line == '\r')
+            continue;
+
+        if (piece->count == piece->size)
+        {
+            piece->size = MAX(piece->size * 2, 1024);
+            piece->rooms = g_realloc(piece->rooms, piece->size * sizeof(LoadRoom));
+        }
+
+        room = &piece->rooms[piece->count];
+
+        if (!load_room(room, line))
+        {
+            if (piece->n_problems == piece->n_size)
+            {
+                piece->n_size = MAX(piece->n_size * 2, 16);
+                piece->problems = g_realloc(piece->problems,
+                                            piece->n_size * sizeof(LoadProblem));
+            }
+
+            piece->problems[piece->n_problems].line = piece->lines;
+            piece->problems[piece->n_problems].text = "room can't be read";
+            piece->n_problems++;
+            room = NULL;
+            continue;
+        }
+
+        room->line = piece->lines;
+        piece->count++;
+    }
+
+    return NULL;
+}
+
+/* Cut the room lines from start to end into up to pieces pieces, each
+ * beginning with a room line
+ */
+static LoadPiece *load_cut(gchar *start, gchar *end, gint *pieces)
+{
+    LoadPiece *piece = g_new0(LoadPiece, MAX(*pieces, 1));
+    gchar *at = start, *cut;
+    gint i, n = 0;
+
+    for (i = 0; i < *pieces && at < end; i++)
+    {
+        cut = start + (end - start) / *pieces * (i + 1);
+
+        if (i == *pieces - 1 || cut <= at)
+            cut = end;
+
+        /* Forward to the start of a room line */
+        while (cut < end && (cut = memchr(cut, '\n', end - cut)) != NULL)
+        {
+            if (++cut < end && *cut != ' ')
+                break;
+        }
+
+        if (cut == NULL)
+            cut = end;
+
+        piece[n].start = at;
+        piece[n].end = cut;
+        at = cut;
+        n++;
+    }
+
+    *pieces = n;
+
+    return piece;
+}
+
+static void load_pieces(LoadPiece *piece, gint pieces)
+{
+    gint i;
+
+    if (pieces == 0)
+        return;
+
+#ifdef HAVE_LIBPTHREAD
+    /* The first piece is read here, while the threads read the rest */
+    for (i = 1; i < pieces; i++)
+        piece[i].started =
+            pthread_create(&piece[i].thread, NULL,
+                           (void *(*)(void *))load_piece, &piece[i]) == 0;
+
+    load_piece(&piece[0]);
+
+    for (i = 1; i < pieces; i++)
+    {
+        if (piece[i].started)
+            pthread_join(piece[i].thread, NULL);
+        else
+            load_piece(&piece[i]);
+    }
+#else
+    for (i = 0; i < pieces; i++)
+        load_piece(&piece[i]);
+#endif
+}
+
+static gint load_threads(guint size)
+{
+    gint threads = 1;
+
+#ifdef HAVE_LIBPTHREAD
+#ifdef _SC_NPROCESSORS_ONLN
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    threads = CLAMP(threads, 1, LOAD_THREADS_MAX);
+    threads = MIN(threads, size / LOAD_PIECE_MIN + 1);
+#endif
+
+    return threads;
+}
+
+static gint load_problem_comp(LoadProblem *a, LoadProblem *b)
+{
+    return a->line < b->line ? -1 : a->line > b->line;
+}
+
+static void load_report(Load *load, gchar *what)
+{
+    GSList *list;
+    guint shown = 0, count = 0;
+
+    load->problems = g_slist_sort(load->problems, (GCompareFunc)load_problem_comp);
+
+    for (list = load->problems; list != NULL; list = list->next)
+    {
+        LoadProblem *p = list->data;
+
+        if (shown < LOAD_PROBLEMS_SHOWN)
+        {
+            if (p->line)
+                g_warning("map_read: %s: line %u: %s\n", what, p->line, p->text);
+            else
+                g_warning("map_read: %s: %s\n", what, p->text);
+
+            shown++;
+        }
+
+        count++;
+        g_free(p->text);
+        g_free(p);
+    }
+
+    if (count > shown)
+        g_warning("map_read: %s: %u more problems\n", what, count - shown);
+
+    g_slist_free(load->problems);
+    load->problems = NULL;
+}
+
+/* The next line from *text, which is moved past it, or NULL at end.
+ * The line is changed in place
+ */
+static gchar *load_line(gchar **text, gchar *end, guint *line)
+{
+    gchar *start = *text, *next;
+
+    if (start >= end)
+        return NULL;
+
+    if ((next = memchr(start, '\n', end - start)) == NULL)
+        next = end;
+
+    *next = '\0';
+    *text = next < end ? next + 1 : end;
+    (*line)++;
+
+    return start;
+}
+
+/* Link the rooms read, now that they all exist, checking every link
+ * goes to a room and comes back
+ */
+static void load_link(Load *load, AutoMap *automap, LoadPiece *piece,
+                      gint pieces, MapNode **made)
+{
+    MapNode *node, *other;
+    LoadRoom *room;
+    gint i, p, dir, back;
+    guint r;
+
+    for (p = 0, i = 0; p < pieces; p++)
+    {
+        for (r = 0; r < piece[p].count; r++, i++)
+        {
+            room = &piece[p].rooms[r];
+
+            if ((node = made[i]) == NULL)
+                continue;
+
+            for (dir = 0; dir < 10; dir++)
+            {
+                if (room->links[dir] < 0)
+                    continue;
+
+                if ((other = map_node_lookup(automap, room->links[dir])) == NULL)
+                {
+                    load_problem(&load->problems, piece[p].first + room->line,
+                                 "room %u leads to room %d, which isn't there",
+                                 room->id, room->links[dir]);
+                    continue;
+                }
+
+                node->connections[dir].node = other;
+                node->connections[dir].kind = room->kinds[dir];
+            }
+        }
+    }
+
+    for (p = 0, i = 0; p < pieces; p++)
+    {
+        for (r = 0; r < piece[p].count; r++, i++)
+        {
+            room = &piece[p].rooms[r];
+
+            if ((node = made[i]) == NULL)
+                continue;
+
+            for (dir = 0; dir < 10; dir++)
+            {
+                if ((other = node->connections[dir].node) == NULL)
+                    continue;
+
+                back = OPPOSITE(dir);
+
+                if (other->connections[back].node == node)
+                    continue;
+
+                /* Made to go both ways if the way back is free */
+                if (other->connections[back].node == NULL)
+                {
+                    other->connections[back].node = node;
+                    other->connections[back].kind = node->connections[dir].kind;
+                    load_problem(&load->problems, piece[p].first + room->line,
+                                 "room %u leads to room %u, which doesn't "
+                                 "lead back, it does now",
+                                 node->id, other->id);
+                } else {
+                    load_problem(&load->problems, piece[p].first + room->line,
+                                 "room %u leads to room %u, which leads back "
+                                 "to room %u, the way is left out",
+                                 node->id, other->id,
+                                 other->connections[back].node->id);
+                    memset(&node->connections[dir], 0, sizeof(*node->connections));
+                }
+            }
+        }
+    }
+}
+
+/* Read the maps in file into automap: its nodes, player, zoom and
+ * position. The maps are returned but not added to MapList, and seq is
+ * set to the last journal record the file includes
+ */
+GList *map_read(FILE *file, AutoMap *automap, guint32 *seq)
+{
+    GPtrArray *blocks = g_ptr_array_new();
+    GHashTable *names = g_hash_table_new(g_str_hash, g_str_equal);
+    MapNode **made, *node;
+    LoadPiece *piece;
+    Load load;
+    GList *maps = NULL, *puck;
+    Map *map = NULL;
+    gchar *all = NULL, *text, *end, *line, *word, *mapname = NULL, *info;
+    glong player = -1, value;
+    guint lineno = 0, total, r, at;
+    guint len = 0, size = 0;
+    gint pieces, i, p;
+
+    *seq = 0;
+    memset(&load, 0, sizeof(load));
+
+    do {
+        if (len + BUFSIZ + 1 > size)
+        {
+            size = MAX(size * 2, BUFSIZ * 4);
+            all = g_realloc(all, size);
+        }
+
+        len += (r = fread(all + len, 1, BUFSIZ, file));
+    } while (r > 0);
+
+    all[len] = '\0';
+    text = all;
+    end = all + len;
+
+    /* Get details from the file to fill in to our automap: automap map
+     * NAME player N zoom Z, center (X, Y) journal SEQ
+     */
+    if ((line = load_line(&text, end, &lineno)) == NULL ||
+        (word = load_word(&line)) == NULL || strcmp(word, "automap"))
+    {
+        load_problem(&load.problems, 0, "not a map file");
+        load_report(&load, "no maps read");
+        g_free(all);
+        g_hash_table_destroy(names);
+        g_ptr_array_free(blocks, TRUE);
+        automap->player = NULL;
+        return NULL;
+    }
+
+    while ((word = load_word(&line)) != NULL)
+    {
+        if (!strcmp(word, "map"))
+            mapname = load_word(&line);
+        else if (!strcmp(word, "player") && load_number(load_word(&line), &value))
+            player = value;
+        else if (!strcmp(word, "zoom") && (word = load_word(&line)) != NULL)
+            automap->zoom = atof(word);
+        else if (!strcmp(word, "center") && load_number(load_word(&line), &value))
+        {
+            automap->x = value;
+
+            if (load_number(load_word(&line), &value))
+                automap->y = value;
+        }
+        /* Files written before the journal existed don't have this */
+        else if (!strcmp(word, "journal") && (word = load_word(&line)) != NULL)
+            *seq = strtoul(word, NULL, 10);
+    }
+
+    /* The maps, each with its extents and the rooms to draw it from, and
+     * what links cost on it if not the defaults
+     */
+    for (;;)
+    {
+        /* Up to the first room */
+        if (isdigit((guchar)*text) || *text == '-')
+            break;
+
+        if ((line = load_line(&text, end, &lineno)) == NULL)
+            break;
+
+        if ((word = load_word(&line)) == NULL)
+            continue;
+
+        if (!strcmp(word, "costs"))
+        {
+            if ((word = load_word(&line)) != NULL && map && !strcmp(map->name, word))
+                for (i = 0; i < MAP_EDGE_KINDS &&
+                         load_number(load_word(&line), &value); i++)
+                    map->cost[i] = value;
+
+            continue;
+        }
+
+        if (strcmp(word, "map") || (word = load_word(&line)) == NULL)
+        {
+            load_problem(&load.problems, lineno, "map can't be read");
+            continue;
+        }
+
+        if (g_hash_table_lookup(names, word))
+        {
+            load_problem(&load.problems, lineno, "map %s is given twice", word);
+            continue;
+        }
+
+        map = g_malloc0(sizeof(Map));
+        map_cost_defaults(map);
+        map->nodes = g_hash_table_new((GHashFunc)node_hash, (GCompareFunc)node_comp);
+        map->name = g_strdup(word);
+        g_hash_table_insert(names, map->name, map);
+
+        if (mapname && !strcmp(mapname, map->name))
+            automap->map = map;
+
+        load_word(&line);
+        load_number(load_word(&line), &value);
+        map->min_x = value;
+        load_word(&line);
+        load_number(load_word(&line), &value);
+        map->min_y = value;
+        load_word(&line);
+        load_number(load_word(&line), &value);
+        map->max_x = value;
+        load_word(&line);
+        load_number(load_word(&line), &value);
+        map->max_y = value;
+        load_word(&line);
+
+        while (load_number(load_word(&line), &value))
+            map->nodelist = g_list_prepend(map->nodelist, (gpointer)value);
+
+        maps = g_list_prepend(maps, map);
+    }
+
+    /* The rooms, read in pieces at once */
+    pieces = load_threads(end - text);
+    piece = load_cut(text, end, &pieces);
+    load_pieces(piece, pieces);
+
+    for (p = 0, total = 0; p < pieces; p++)
+    {
+        guint i;
+
+        piece[p].first = lineno + 1;
+        lineno += piece[p].lines;
+        total += piece[p].count;
+
+        for (i = 0; i < piece[p].n_problems; i++)
+            load_problem(&load.problems, piece[p].first + piece[p].problems[i].line,
+                         "%s", piece[p].problems[i].text);
+
+        g_free(piece[p].problems);
+    }
+
+    /* Made in file order, and told what is known about them in file
+     * order, as descriptions shared between rooms are written once
+     */
+    made = g_new0(MapNode *, MAX(total, 1));
+
+    for (p = 0, i = 0; p < pieces; p++)
+    {
+        for (r = 0; r < piece[p].count; r++, i++)
+        {
+            LoadRoom *room = &piece[p].rooms[r];
+
+            at = piece[p].first + room->line;
+
+            if ((map = g_hash_table_lookup(names, room->map)) == NULL)
+            {
+                load_problem(&load.problems, at, "room %u is on map %s, "
+                             "which isn't there", room->id, room->map);
+                continue;
+            }
+
+            if (map_node_lookup(automap, room->id) != NULL)
+            {
+                load_problem(&load.problems, at, "room %u is given twice",
+                             room->id);
+                continue;
+            }
+
+            node = made[i] = map_node_new(automap, map, room->id, room->x, room->y);
+
+            if (room->fingerprint)
+                map_room_index(automap, node, room->fingerprint);
+
+            for (info = room->info; info != NULL && info < piece[p].end &&
+                     *info == ' '; info += strlen(info) + 1)
+            {
+                at++;
+
+                if (!map_info_read(automap, node, info, blocks))
+                    load_problem(&load.problems, at, "what is known about "
+                                 "room %u can't be read", room->id);
+            }
+        }
+    }
+
+    for (i = 0; i < blocks->len; i++)
+        g_free(g_ptr_array_index(blocks, i));
+
+    g_ptr_array_free(blocks, TRUE);
+
+    load_link(&load, automap, piece, pieces, made);
+
+    /* The rooms each map is drawn from */
+    for (puck = maps; puck != NULL; puck = puck->next)
+    {
+        GList *inner, *next;
+        gboolean lost = FALSE;
+
+        map = puck->data;
+
+        for (inner = map->nodelist; inner != NULL; inner = next)
+        {
+            next = inner->next;
+            node = map_node_lookup(automap, (guint32)(glong)inner->data);
+
+            if (node == NULL || node->map != map)
+            {
+                map->nodelist = g_list_remove_link(map->nodelist, inner);
+                g_list_free_1(inner);
+                lost = TRUE;
+            } else {
+                inner->data = node;
+            }
+        }
+
+        if (lost)
+        {
+            load_problem(&load.problems, 0, "map %s was to be drawn from rooms "
+                         "that aren't on it", map->name);
+            map_nodelist_rebuild(map);
+        }
+    }
+
+    automap->player = player >= 0 ? map_node_lookup(automap, player) : NULL;
+
+    if (mapname && automap->map == NULL)
+        load_problem(&load.problems, 1, "map %s isn't there", mapname);
+
+    if (load.problems)
+        load_report(&load, "problems in map file");
+
+    for (p = 0; p < pieces; p++)
+        g_free(piece[p].rooms);
+
+    g_free(piece);
+    g_free(made);
+    g_hash_table_destroy(names);
+    g_free(all);
+
+    return maps;
+}
+
+#endif /* WITHOUT_MAPPER */
@@ -0,0 +1,184 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+#ifndef WITHOUT_MAPPER
+
+#include <gtk/gtk.h>
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* Zoomed out far enough, rooms are only a few pixels apart and drawing
+ * every dot and line just makes a black smudge (slowly). Instead the
+ * map is divided into square cells of 2^level graph units, and each
+ * cell is shaded by how many rooms are in it.
+ *
+ * The number of rooms per cell is counted once per level when first
+ * needed, and kept up to date as rooms are added, moved and removed.
+ * Level 0 cells are single coordinates, the node hash is used for those.
+ */
+
+static inline gint floor_div(gint a, gint b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static inline gpointer cell_key(gint cx, gint cy)
+{
+    return GUINT_TO_POINTER(((guint)cx & 0xffff) << 16 | ((guint)cy & 0xffff));
+}
+
+static void density_change(Map *map, gint x, gint y, gint delta)
+{
+    gint level;
+
+    for (level = 1; level < MAP_LOD_LEVELS; level++)
+    {
+        GHashTable *density = map->density[level];
+        gpointer key;
+        guint count;
+
+        if (density == NULL)
+            continue;
+
+        key = cell_key(floor_div(x, 1 << level), floor_div(y, 1 << level));
+        count = GPOINTER_TO_UINT(g_hash_table_lookup(density, key)) + delta;
+
+        if (count)
+            g_hash_table_insert(density, key, GUINT_TO_POINTER(count));
+        else
+            g_hash_table_remove(density, key);
+    }
+}
+
+void map_lod_add(MapNode *node)
+{
+    density_change(node->map, node->x, node->y, 1);
+}
+
+void map_lod_remove(MapNode *node)
+{
+    density_change(node->map, node->x, node->y, -1);
+}
+
+void map_lod_free(Map *map)
+{
+    gint level;
+
+    for (level = 0; level < MAP_LOD_LEVELS; level++)
+    {
+        if (map->density[level])
+            g_hash_table_destroy(map->density[level]);
+
+        map->density[level] = NULL;
+    }
+}
+
+static void density_count(MapNode *key, GList *list, gpointer data[2])
+{
+    GHashTable *density = data[0];
+    gint size = 1 << GPOINTER_TO_INT(data[1]);
+    gpointer cell = cell_key(floor_div(key->x, size), floor_div(key->y, size));
+    guint count = GPOINTER_TO_UINT(g_hash_table_lookup(density, cell));
+
+    g_hash_table_insert(density, cell,
+                        GUINT_TO_POINTER(count + g_list_length(list)));
+}
+
+static GHashTable *density_table(Map *map, gint level)
+{
+    gpointer data[2];
+
+    if (map->density[level])
+        return map->density[level];
+
+    map->density[level] = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    data[0] = map->density[level];
+    data[1] = GINT_TO_POINTER(level);
+    g_hash_table_foreach(map->nodes, (GHFunc)density_count, data);
+
+    return map->density[level];
+}
+
+/* Draw map into ws->drawable as shaded cells
+ */
+void map_lod_render(AutoMap *automap, struct win_scale *ws, Map *map)
+{
+    GtkStyle *style = automap->draw_area->style;
+    gint unit = ws->mapped_unit, level = 0, size, pixels;
+    gint cx, cy, cx1, cy1, cx2, cy2;
+    GHashTable *density = NULL;
+
+    /* The smallest cells still MAP_LOD_CELL pixels across */
+    while ((unit << level) < MAP_LOD_CELL && level < MAP_LOD_LEVELS - 1)
+        level++;
+
+    size = 1 << level;
+    pixels = size * unit;
+
+    if (level)
+        density = density_table(map, level);
+
+    cx1 = floor_div(floor_div(ws->origin_x, unit) - 1, size);
+    cx2 = floor_div(floor_div(ws->origin_x + ws->width, unit) + 1, size);
+    cy1 = floor_div(-floor_div(ws->origin_y + ws->height, unit) - 1, size);
+    cy2 = floor_div(-floor_div(ws->origin_y, unit) + 1, size);
+
+    for (cx = cx1; cx <= cx2; cx++)
+    {
+        for (cy = cy1; cy <= cy2; cy++)
+        {
+            guint count;
+            GdkGC *gc;
+
+            if (density)
+            {
+                count = GPOINTER_TO_UINT(g_hash_table_lookup(density, cell_key(cx, cy)));
+            } else {
+                MapNode key;
+
+                key.x = cx;
+                key.y = cy;
+                count = g_hash_table_lookup(map->nodes, &key) ? size : 0;
+            }
+
+            if (count == 0)
+                continue;
+
+            /* Darker the fuller the cell is */
+            if (count * 4 < size * size)
+                gc = style->mid_gc[GTK_STATE_NORMAL];
+            else if (count * 2 < size * size)
+                gc = style->dark_gc[GTK_STATE_NORMAL];
+            else
+                gc = style->black_gc;
+
+            gdk_draw_rectangle(ws->drawable, gc, TRUE,
+                               cx * pixels - unit / 2 - ws->origin_x,
+                               -(cy * size + size - 1) * unit - unit / 2 - ws->origin_y,
+                               pixels > 2 ? pixels - 1 : pixels,
+                               pixels > 2 ? pixels - 1 : pixels);
+        }
+    }
+}
+
+#endif /* WITHOUT_MAPPER */
@@ -0,0 +1,767 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+#ifndef WITHOUT_MAPPER
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <gtk/gtk.h>
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* Merging the maps in a file into an automap, to put together what two
+ * people (or two clients) mapped of the same mud.
+ *
+ * Each map in the file is lined up with one of ours by the rooms seen
+ * from the mud that both have exactly once: every such pair votes for
+ * a map and an offset, and the most votes win. A map with no rooms in
+ * common goes on our map of the same name, if any, or is added as a
+ * new map.
+ *
+ * Rooms are then paired by fingerprint, or failing that by where they
+ * are, and everything of theirs that ours doesn't have is added:
+ * rooms, links, kinds of link and room info. Where the two disagree,
+ * ours is kept and the difference reported. Every lookup is through a
+ * hash table, so merging takes about as long as reading the file.
+ *
+ * Changes are made as MapOps, so they are journaled and undone
+ * together like any other change.
+ */
+
+/* Conflicts listed in the report, the rest are only counted */
+#define MERGE_CONFLICTS_SHOWN 200
+
+static gchar *merge_fields[MAP_INFO_FIELDS] = {
+    "name", "description", "notes", "tags"
+};
+
+typedef struct {
+
+    Map  *map;
+    gint  dx, dy;
+    guint votes;
+} MergeVote;
+
+typedef struct {
+
+    AutoMap    *ours, *theirs;
+    gboolean    apply;
+
+    GHashTable *pairs;     /* Their MapNode -> ours                     */
+    GHashTable *taken;     /* Our MapNodes paired with one of theirs    */
+    GHashTable *skipped;   /* Their MapNodes left out over a conflict   */
+    GPtrArray  *nodes;     /* All their MapNodes, in the order merged   */
+    GSList     *touched;   /* Our maps that were changed                */
+    GSList     *created;   /* And those made for maps of theirs         */
+
+    GString    *report, *conflicts;
+    guint       matched, added, links, kinds, info, conflict_count;
+} Merge;
+
+static guint vote_hash(MergeVote *v)
+{
+    return GPOINTER_TO_UINT(v->map) ^ (guint)(v->dx << 16 | (v->dy & 0xffff));
+}
+
+static gint vote_comp(MergeVote *a, MergeVote *b)
+{
+    return a->map == b->map && a->dx == b->dx && a->dy == b->dy;
+}
+
+static void merge_conflict(Merge *m, gchar *format, ...)
+{
+    va_list args;
+    gchar *text;
+
+    m->conflict_count++;
+
+    if (m->conflict_count > MERGE_CONFLICTS_SHOWN)
+        return;
+
+    va_start(args, format);
+    text = g_strdup_vprintf(format, args);
+    va_end(args);
+
+    g_string_sprintfa(m->conflicts, "  %s\n", text);
+    g_free(text);
+}
+
+/* Make the change, and keep it for the journal and undoing. What the
+ * route, tile and reachability indexes make of the changes is worked
+ * out once the merge is done, see merge_finish()
+ */
+static gboolean merge_apply(Merge *m, MapOp *op)
+{
+    if (!map_op_apply(m->ours, op))
+        return FALSE;
+
+    map_undo_record(m->ours, op);
+
+    if (m->ours->journal)
+        map_journal_append(m->ours->journal, op);
+
+    return TRUE;
+}
+
+static void merge_touch(Merge *m, Map *map)
+{
+    if (!g_slist_find(m->touched, map))
+        m->touched = g_slist_prepend(m->touched, map);
+}
+
+static void merge_collect(MapNode *key, GList *list, GSList **nodes)
+{
+    for (; list != NULL; list = list->next)
+        *nodes = g_slist_prepend(*nodes, list->data);
+}
+
+/* The only room with fingerprint, or NULL
+ */
+static MapNode *merge_unique(AutoMap *automap, guint32 fingerprint)
+{
+    GList *list;
+
+    if (fingerprint == 0)
+        return NULL;
+
+    list = map_room_lookup(automap, fingerprint);
+
+    return (list && list->next == NULL) ? list->data : NULL;
+}
+
+/* Which of our maps theirs lines up with, and how far it is moved.
+ * NULL if it doesn't line up with any
+ */
+static Map *merge_align(Merge *m, GSList *nodes, gint *dx, gint *dy)
+{
+    GHashTable *votes = g_hash_table_new((GHashFunc)vote_hash,
+                                         (GCompareFunc)vote_comp);
+    GSList *puck, *all = NULL;
+    MergeVote *best = NULL;
+    Map *map = NULL;
+
+    for (puck = nodes; puck != NULL; puck = puck->next)
+    {
+        MapNode *node = puck->data, *ours;
+        MergeVote key, *vote;
+
+        if (merge_unique(m->theirs, node->fingerprint) != node ||
+            (ours = merge_unique(m->ours, node->fingerprint)) == NULL)
+            continue;
+
+        key.map = ours->map;
+        key.dx = ours->x - node->x;
+        key.dy = ours->y - node->y;
+
+        if ((vote = g_hash_table_lookup(votes, &key)) == NULL)
+        {
+            vote = g_memdup(&key, sizeof(key));
+            vote->votes = 0;
+            g_hash_table_insert(votes, vote, vote);
+            all = g_slist_prepend(all, vote);
+        }
+
+        if (++vote->votes > (best ? best->votes : 0))
+            best = vote;
+    }
+
+    if (best)
+    {
+        map = best->map;
+        *dx = best->dx;
+        *dy = best->dy;
+    }
+
+    for (puck = all; puck != NULL; puck = puck->next)
+        g_free(puck->data);
+
+    g_slist_free(all);
+    g_hash_table_destroy(votes);
+
+    return map;
+}
+
+static void merge_pair(Merge *m, MapNode *theirs, MapNode *ours)
+{
+    g_hash_table_insert(m->pairs, theirs, ours);
+    g_hash_table_insert(m->taken, ours, theirs);
+    m->matched++;
+}
+
+/* Add to ours what is known about theirs that ours doesn't know
+ */
+static void merge_info(Merge *m, MapNode *theirs, MapNode *ours)
+{
+    gint field;
+    MapOp op;
+
+    if (theirs->fingerprint && ours->fingerprint == 0 &&
+        map_room_lookup(m->ours, theirs->fingerprint) == NULL)
+    {
+        memset(&op, 0, sizeof(op));
+        op.type = MAP_OP_ROOM;
+        op.node = ours->id;
+        op.other = theirs->fingerprint;
+
+        if (m->apply)
+            merge_apply(m, &op);
+    }
+
+    for (field = 0; field < MAP_INFO_FIELDS; field++)
+    {
+        gchar *text = map_info_get(theirs, field);
+        gchar *known = map_info_get(ours, field);
+
+        if (text == NULL)
+            continue;
+
+        if (known != NULL)
+        {
+            if (strcmp(text, known))
+                merge_conflict(m, "room %u at (%d, %d) on %s: %s differs",
+                               ours->id, ours->x, ours->y, ours->map->name,
+                               merge_fields[field]);
+            continue;
+        }
+
+        memset(&op, 0, sizeof(op));
+        op.type = MAP_OP_INFO;
+        op.node = ours->id;
+        op.x = field;
+        op.text = text;
+        m->info++;
+
+        if (m->apply)
+            merge_apply(m, &op);
+    }
+}
+
+static MapNode *merge_room_new(Merge *m, Map *map, MapNode *theirs,
+                               gint dx, gint dy)
+{
+    MapNode *node;
+    gint field;
+    MapOp op;
+
+    m->added++;
+
+    if (!m->apply)
+        return NULL;
+
+    memset(&op, 0, sizeof(op));
+    op.type = MAP_OP_NODE_NEW;
+    op.node = m->ours->next_id;
+    op.map = map->name;
+    op.x = theirs->x + dx;
+    op.y = theirs->y + dy;
+
+    if (!merge_apply(m, &op))
+        return NULL;
+
+    node = map_node_lookup(m->ours, op.node);
+    g_hash_table_insert(m->pairs, theirs, node);
+    g_hash_table_insert(m->taken, node, theirs);
+
+    if (theirs->fingerprint)
+    {
+        memset(&op, 0, sizeof(op));
+        op.type = MAP_OP_ROOM;
+        op.node = node->id;
+        op.other = theirs->fingerprint;
+        merge_apply(m, &op);
+    }
+
+    for (field = 0; field < MAP_INFO_FIELDS; field++)
+    {
+        if (map_info_get(theirs, field) == NULL)
+            continue;
+
+        memset(&op, 0, sizeof(op));
+        op.type = MAP_OP_INFO;
+        op.node = node->id;
+        op.x = field;
+        op.text = map_info_get(theirs, field);
+        merge_apply(m, &op);
+    }
+
+    return node;
+}
+
+/* Make a map for theirs to go on
+ */
+static Map *merge_map_new(Merge *m, Map *theirs)
+{
+    Map *map;
+    MapOp op;
+
+    map = map_find(theirs->name) ? map_new() : map_new_with_name(theirs->name);
+    m->created = g_slist_prepend(m->created, map);
+
+    memset(&op, 0, sizeof(op));
+    op.type = MAP_OP_MAP_NEW;
+    op.map = map->name;
+    map_undo_record(m->ours, &op);
+
+    if (m->ours->journal)
+        map_journal_append(m->ours->journal, &op);
+
+    return map;
+}
+
+static void merge_map(Merge *m, Map *theirs)
+{
+    GSList *nodes = NULL, *puck;
+    Map *map;
+    gint dx = 0, dy = 0, kind;
+    guint matched = m->matched, added = m->added;
+
+    g_hash_table_foreach(theirs->nodes, (GHFunc)merge_collect, &nodes);
+
+    if ((map = merge_align(m, nodes, &dx, &dy)) != NULL)
+    {
+        g_string_sprintfa(m->report, "%s: lined up with %s, moved (%d, %d)\n",
+                          theirs->name, map->name, dx, dy);
+    } else if ((map = map_find(theirs->name)) != NULL) {
+        g_string_sprintfa(m->report, "%s: no rooms in common, put on %s\n",
+                          theirs->name, map->name);
+    } else if (m->apply) {
+        map = merge_map_new(m, theirs);
+        g_string_sprintfa(m->report, "%s: added as %s\n",
+                          theirs->name, map->name);
+    } else {
+        g_string_sprintfa(m->report, "%s: would be added\n", theirs->name);
+    }
+
+    if (map)
+        merge_touch(m, map);
+
+    /* Costs are taken if ours were never changed from the defaults */
+    if (map && !map_cost_is_default(theirs))
+    {
+        gboolean ours = map_cost_is_default(map);
+
+        for (kind = 0; kind < MAP_EDGE_KINDS; kind++)
+        {
+            MapOp op;
+
+            if (map->cost[kind] == theirs->cost[kind])
+                continue;
+
+            if (!ours)
+            {
+                merge_conflict(m, "%s: %s costs %d here, %d in the file",
+                               map->name, map_edge_names[kind],
+                               map->cost[kind], theirs->cost[kind]);
+                continue;
+            }
+
+            memset(&op, 0, sizeof(op));
+            op.type = MAP_OP_COST;
+            op.map = map->name;
+            op.x = kind;
+            op.y = theirs->cost[kind];
+
+            if (m->apply)
+                merge_apply(m, &op);
+        }
+
+        if (ours)
+            g_string_sprintfa(m->report, "  costs taken from the file\n");
+    }
+
+    for (puck = nodes; puck != NULL; puck = puck->next)
+    {
+        MapNode *node = puck->data, *ours, key;
+        GList *there, *list;
+
+        g_ptr_array_add(m->nodes, node);
+
+        if (map == NULL)
+        {
+            m->added++;
+            continue;
+        }
+
+        /* The same room seen from the mud, wherever it is */
+        if ((ours = merge_unique(m->ours, node->fingerprint)) != NULL &&
+            merge_unique(m->theirs, node->fingerprint) == node &&
+            !g_hash_table_lookup(m->taken, ours))
+        {
+            if (ours->map != map || ours->x != node->x + dx || ours->y != node->y + dy)
+                merge_conflict(m, "room %u is at (%d, %d) on %s here, "
+                               "(%d, %d) on %s in the file",
+                               ours->id, ours->x, ours->y, ours->map->name,
+                               node->x, node->y, theirs->name);
+
+            merge_pair(m, node, ours);
+            merge_info(m, node, ours);
+            continue;
+        }
+
+        /* Or the room where it should be */
+        key.x = node->x + dx;
+        key.y = node->y + dy;
+        ours = NULL;
+        there = g_hash_table_lookup(map->nodes, &key);
+
+        for (list = there; list != NULL && ours == NULL; list = list->next)
+            if (!g_hash_table_lookup(m->taken, list->data))
+                ours = list->data;
+
+        if (ours == NULL && there != NULL)
+        {
+            merge_conflict(m, "(%d, %d) on %s is already another room",
+                           key.x, key.y, map->name);
+            g_hash_table_insert(m->skipped, node, node);
+            continue;
+        }
+
+        if (ours == NULL)
+        {
+            merge_room_new(m, map, node, dx, dy);
+            continue;
+        }
+
+        if (ours->fingerprint && node->fingerprint &&
+            ours->fingerprint != node->fingerprint)
+        {
+            merge_conflict(m, "room %u at (%d, %d) on %s is a different room "
+                           "in the file", ours->id, ours->x, ours->y, map->name);
+            g_hash_table_insert(m->skipped, node, node);
+            continue;
+        }
+
+        merge_pair(m, node, ours);
+        merge_info(m, node, ours);
+    }
+
+    g_string_sprintfa(m->report, "  %u rooms matched, %u new\n",
+                      m->matched - matched, m->added - added);
+
+    g_slist_free(nodes);
+}
+
+static gboolean merge_edge(Merge *m, MapNode *node, gint dir, gint kind)
+{
+    MapOp op;
+
+    if (node == NULL || node->connections[dir].kind == kind)
+        return FALSE;
+
+    memset(&op, 0, sizeof(op));
+    op.type = MAP_OP_EDGE;
+    op.node = node->id;
+    op.dir = dir;
+    op.x = kind;
+
+    return merge_apply(m, &op);
+}
+
+/* Add the link leaving theirs dir, unless ours has a different one
+ */
+static void merge_link(Merge *m, MapNode *node, gint dir)
+{
+    MapNode *next = node->connections[dir].node, *a, *b;
+    gint kind = node->connections[dir].kind;
+    gint back = next->connections[OPPOSITE(dir)].kind;
+    MapOp op;
+
+    if (g_hash_table_lookup(m->skipped, next))
+        return;
+
+    a = g_hash_table_lookup(m->pairs, node);
+    b = g_hash_table_lookup(m->pairs, next);
+
+    /* Rooms not added, when only looking */
+    if (a == NULL || b == NULL)
+    {
+        if (!m->apply)
+            m->links++;
+        return;
+    }
+
+    if (a->connections[dir].node == b)
+    {
+        /* Kinds set on one side only are taken, different ones kept */
+        if (kind != MAP_EDGE_PLAIN && a->connections[dir].kind == MAP_EDGE_PLAIN)
+            m->kinds += !m->apply || merge_edge(m, a, dir, kind);
+        else if (kind != a->connections[dir].kind)
+            merge_conflict(m, "room %u: %s is %s here, %s in the file", a->id,
+                           direction_long[dir],
+                           map_edge_names[a->connections[dir].kind],
+                           map_edge_names[kind]);
+
+        if (back != MAP_EDGE_PLAIN &&
+            b->connections[OPPOSITE(dir)].kind == MAP_EDGE_PLAIN)
+            m->kinds += !m->apply || merge_edge(m, b, OPPOSITE(dir), back);
+        return;
+    }
+
+    if (a->connections[dir].node || b->connections[OPPOSITE(dir)].node)
+    {
+        merge_conflict(m, "room %u: %s leads elsewhere here", a->id,
+                       direction_long[dir]);
+        return;
+    }
+
+    m->links++;
+
+    if (!m->apply)
+        return;
+
+    memset(&op, 0, sizeof(op));
+    op.type = MAP_OP_LINK;
+    op.node = a->id;
+    op.dir = dir;
+    op.other = b->id;
+
+    if (!merge_apply(m, &op))
+        return;
+
+    if (kind != MAP_EDGE_PLAIN)
+        merge_edge(m, a, dir, kind);
+
+    if (back != MAP_EDGE_PLAIN)
+        merge_edge(m, b, OPPOSITE(dir), back);
+
+    merge_touch(m, b->map);
+}
+
+/* Bring everything that keeps track of the maps up to date at once,
+ * rather than after every change
+ */
+static void merge_finish(Merge *m)
+{
+    GSList *puck;
+
+    for (puck = m->touched; puck != NULL; puck = puck->next)
+    {
+        map_nodelist_rebuild(puck->data);
+        map_extents_rebuild(puck->data);
+    }
+
+    /* Merging into an empty automap */
+    if (m->ours->map == NULL && m->touched)
+        m->ours->map = g_slist_last(m->touched)->data;
+
+    map_connect_invalidate(m->ours);
+    map_route_flush(m->ours);
+    m->ours->landmark_stamp++;
+    map_tile_flush(m->ours);
+
+    /* Only maps with a way to them are saved, see get_nodes() */
+    for (puck = m->created; puck != NULL; puck = puck->next)
+    {
+        Map *map = puck->data;
+
+        if (map == m->ours->map || map->nodelist == NULL ||
+            m->ours->map->nodelist == NULL)
+            continue;
+
+        if (!map_node_reachable(m->ours, map->nodelist->data,
+                                m->ours->map->nodelist->data))
+            g_string_sprintfa(m->report, "%s isn't linked to %s, and won't be "
+                              "saved until it is\n", map->name,
+                              m->ours->map->name);
+    }
+}
+
+/* Free maps read into the scratch automap by map_merge_file()
+ */
+static gboolean merge_free_nodes(MapNode *key, GList *list, gpointer data)
+{
+    GList *puck;
+
+    for (puck = list; puck != NULL; puck = puck->next)
+    {
+        map_info_clear(NULL, puck->data);
+        g_free(puck->data);
+    }
+
+    g_list_free(list);
+
+    return TRUE;
+}
+
+static void merge_free(AutoMap *automap, GList *maps)
+{
+    GList *puck;
+
+    for (puck = maps; puck != NULL; puck = puck->next)
+    {
+        Map *map = puck->data;
+
+        g_hash_table_foreach_remove(map->nodes, (GHRFunc)merge_free_nodes, NULL);
+        g_hash_table_destroy(map->nodes);
+        g_list_free(map->nodelist);
+        map_lod_free(map);
+        g_free(map->name);
+        g_free(map);
+    }
+
+    g_list_free(maps);
+    g_hash_table_destroy(automap->ids);
+    map_room_free(automap);
+    map_info_free(automap);
+    g_free(automap);
+}
+
+/* Merge the maps in filename into automap, or with apply FALSE only say
+ * what merging would do. Returns the report, NULL if the file couldn't
+ * be read. Journals next to filename are not read, so changes made
+ * there since it was last saved are left out
+ */
+GString *map_merge_file(AutoMap *automap, gchar *filename, gboolean apply)
+{
+    AutoMap *theirs;
+    GList *maps, *puck;
+    FILE *file;
+    guint32 seq;
+    Merge m;
+    gint i, dir;
+
+    if ((file = fopen(filename, "r")) == NULL)
+    {
+        g_warning("map_merge_file: Could not open %s for reading: %s\n",
+                  filename, g_strerror(errno));
+        return NULL;
+    }
+
+    theirs = g_malloc0(sizeof(AutoMap));
+    theirs->ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    maps = map_read(file, theirs, &seq);
+    fclose(file);
+
+    memset(&m, 0, sizeof(m));
+    m.ours = automap;
+    m.theirs = theirs;
+    m.apply = apply;
+    m.pairs = g_hash_table_new(g_direct_hash, g_direct_equal);
+    m.taken = g_hash_table_new(g_direct_hash, g_direct_equal);
+    m.skipped = g_hash_table_new(g_direct_hash, g_direct_equal);
+    m.nodes = g_ptr_array_new();
+    m.report = g_string_new("");
+    m.conflicts = g_string_new("");
+
+    g_string_sprintfa(m.report, "Merging %s%s\n", filename,
+                      apply ? "" : " (only looking, nothing is changed)");
+
+    /* Oldest map first, as they were written */
+    for (puck = g_list_last(maps); puck != NULL; puck = puck->prev)
+        merge_map(&m, puck->data);
+
+    /* Each link once, from the end with the lower number */
+    for (i = 0; i < m.nodes->len; i++)
+    {
+        MapNode *node = g_ptr_array_index(m.nodes, i);
+
+        if (g_hash_table_lookup(m.skipped, node))
+            continue;
+
+        for (dir = 0; dir < 10; dir++)
+        {
+            MapNode *next = node->connections[dir].node;
+
+            if (next && (node->id < next->id ||
+                         (next == node && dir <= OPPOSITE(dir))))
+                merge_link(&m, node, dir);
+        }
+    }
+
+    if (apply)
+        merge_finish(&m);
+
+    g_string_sprintfa(m.report, "%u rooms matched, %u new, %u links and "
+                      "%u kinds of link new, %u room details new, "
+                      "%u conflicts\n", m.matched, m.added, m.links, m.kinds,
+                      m.info, m.conflict_count);
+
+    if (m.conflict_count)
+    {
+        g_string_append(m.report, "Kept as they were here:\n");
+        g_string_append(m.report, m.conflicts->str);
+
+        if (m.conflict_count > MERGE_CONFLICTS_SHOWN)
+            g_string_sprintfa(m.report, "  and %u more\n",
+                              m.conflict_count - MERGE_CONFLICTS_SHOWN);
+    }
+
+    g_hash_table_destroy(m.pairs);
+    g_hash_table_destroy(m.taken);
+    g_hash_table_destroy(m.skipped);
+    g_ptr_array_free(m.nodes, TRUE);
+    g_slist_free(m.touched);
+    g_slist_free(m.created);
+    g_string_free(m.conflicts, TRUE);
+    merge_free(theirs, maps);
+
+    return m.report;
+}
+
+/* Show what merging did
+ */
+void map_merge_window(AutoMap *automap, GString *report)
+{
+    GtkWidget *window, *vbox, *hbox, *text, *vscrollbar, *button_close;
+
+    window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(window), "Merged maps");
+    gtk_widget_set_usize(window, 480, 320);
+
+    gtk_signal_connect_object_while_alive(GTK_OBJECT(automap->window), "destroy",
+                                          GTK_SIGNAL_FUNC(gtk_widget_destroy),
+                                          GTK_OBJECT(window));
+
+    vbox = gtk_vbox_new(FALSE, 5);
+    gtk_container_border_width(GTK_CONTAINER(vbox), 5);
+    gtk_container_add(GTK_CONTAINER(window), vbox);
+    gtk_widget_show(vbox);
+
+    hbox = gtk_hbox_new(FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(vbox), hbox, TRUE, TRUE, 0);
+    gtk_widget_show(hbox);
+
+    text = gtk_text_new(NULL, NULL);
+    gtk_text_set_editable(GTK_TEXT(text), FALSE);
+    gtk_text_set_word_wrap(GTK_TEXT(text), TRUE);
+    gtk_box_pack_start(GTK_BOX(hbox), text, TRUE, TRUE, 0);
+    gtk_widget_show(text);
+
+    vscrollbar = gtk_vscrollbar_new(GTK_TEXT(text)->vadj);
+    gtk_box_pack_start(GTK_BOX(hbox), vscrollbar, FALSE, FALSE, 0);
+    gtk_widget_show(vscrollbar);
+
+    gtk_text_insert(GTK_TEXT(text), NULL, NULL, NULL, report->str, report->len);
+
+    button_close = gtk_button_new_with_label("  close  ");
+    gtk_signal_connect_object(GTK_OBJECT(button_close), "clicked",
+                              GTK_SIGNAL_FUNC(gtk_widget_destroy),
+                              GTK_OBJECT(window));
+    gtk_box_pack_start(GTK_BOX(vbox), button_close, FALSE, FALSE, 0);
+    gtk_widget_show(button_close);
+
+    gtk_widget_show(window);
+}
+
+#endif /* WITHOUT_MAPPER */
@@ -0,0 +1,742 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+#ifndef WITHOUT_MAPPER
+
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <regex.h>
+#include <gtk/gtk.h>
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* Mapping by hand means pressing a direction button for every step
+ * taken. Instead, the text coming from the mud is watched for rooms:
+ * a title line, some description, then an exits line. Each room seen
+ * gets a fingerprint, a hash of its title, exits and description, and
+ * the player is moved on the map the way the last direction typed
+ * went. If a room with that fingerprint is already on the map where
+ * the move could have led, the two are linked up rather than a new
+ * room being made, so walking round a loop closes it.
+ *
+ * What the lines look like differs from mud to mud, so the patterns
+ * are read from ~/.amcl/rooms, one per line as
+ *
+ *   prompt|title|exits|ignore|fail  <extended regular expression>
+ *
+ * prompt is cut off the start of lines, title and exits find the two
+ * ends of a room, description lines matching ignore (the weather, say)
+ * are left out of the fingerprint and fail is what the mud says when a
+ * move can't be made.
+ */
+
+enum {
+    ROOM_PROMPT,
+    ROOM_TITLE,
+    ROOM_EXITS,
+    ROOM_IGNORE,
+    ROOM_FAIL,
+    ROOM_PATTERNS
+};
+
+static gchar *pattern_names[ROOM_PATTERNS] = {
+    "prompt", "title", "exits", "ignore", "fail"
+};
+
+static gchar *pattern_defaults[ROOM_PATTERNS] = {
+    "^(<[^>]*>|>) *",
+    "^[A-Z][^.!?]{0,50}[^.!?:, ]$",
+    "^ *[[(]?(Obvious )?[Ee]xits?:? *([^])]*)",
+    NULL,
+    "^(Alas, )?[Yy]ou can(no|')t go that way"
+};
+
+/* Directions typed but not yet seen to happen, and the most
+ * description lines a room may have
+ */
+#define ROOM_PENDING   16
+#define ROOM_MAX_LINES 40
+
+/* Where each compass direction leads on the map */
+static const gint dx[] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+static const gint dy[] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+
+static struct {
+
+    gboolean  loaded;
+    regex_t   pattern[ROOM_PATTERNS];
+    gboolean  have[ROOM_PATTERNS];
+
+    GString  *partial;      /* Text after the last newline received   */
+    GString  *title;
+    GString  *description;  /* Words of the description, one space apart */
+    gboolean  in_room;      /* Seen a title, waiting for the exits    */
+    gint      lines;
+
+    guint8    pending[ROOM_PENDING];
+    gint      pending_first, pending_count;
+} room;
+
+static void room_pattern_set(gint which, gchar *text)
+{
+    gint error;
+
+    if (room.have[which])
+        regfree(&room.pattern[which]);
+
+    room.have[which] = FALSE;
+
+    if (text == NULL || *text == '\0')
+        return;
+
+    if ((error = regcomp(&room.pattern[which], text, REG_EXTENDED)) != 0)
+    {
+        gchar message[128];
+
+        regerror(error, &room.pattern[which], message, 128);
+        g_warning("room_pattern_set: bad %s pattern \"%s\": %s\n",
+                  pattern_names[which], text, message);
+        return;
+    }
+
+    room.have[which] = TRUE;
+}
+
+static void room_load_patterns(void)
+{
+    FILE *fp;
+    gchar filename[256], line[512];
+    gint i;
+
+    room.loaded = TRUE;
+    room.partial = g_string_new("");
+    room.title = g_string_new("");
+    room.description = g_string_new("");
+
+    for (i = 0; i < ROOM_PATTERNS; i++)
+        room_pattern_set(i, pattern_defaults[i]);
+
+    g_snprintf(filename, 256, "%s/.amcl/rooms", g_get_home_dir());
+
+    if ((fp = fopen(filename, "r")) == NULL)
+        return;
+
+    while (fgets(line, 512, fp) != NULL)
+    {
+        gchar *text = line;
+        gint len = strlen(line);
+
+        while (len && isspace((guchar)line[len - 1]))
+            line[--len] = '\0';
+
+        while (*text && !isspace((guchar)*text))
+            text++;
+
+        if (*text)
+            *text++ = '\0';
+
+        while (isspace((guchar)*text))
+            text++;
+
+        for (i = 0; i < ROOM_PATTERNS; i++)
+            if (!g_strcasecmp(line, pattern_names[i]))
+                room_pattern_set(i, text);
+    }
+
+    fclose(fp);
+}
+
+static gboolean room_match(gint which, gchar *line, regmatch_t *match, gint n)
+{
+    return room.have[which] &&
+        !regexec(&room.pattern[which], line, n, match, 0);
+}
+
+static void room_reset(void)
+{
+    room.in_room = FALSE;
+    room.lines = 0;
+    g_string_truncate(room.title, 0);
+    g_string_truncate(room.description, 0);
+}
+
+/* Remember that dir was typed, forgetting the oldest if too many are
+ * waiting
+ */
+static void room_pending_push(gint dir)
+{
+    if (room.pending_count == ROOM_PENDING)
+    {
+        room.pending_first = (room.pending_first + 1) % ROOM_PENDING;
+        room.pending_count--;
+    }
+
+    room.pending[(room.pending_first + room.pending_count) % ROOM_PENDING] = dir;
+    room.pending_count++;
+}
+
+static gint room_pending_pop(void)
+{
+    gint dir;
+
+    if (room.pending_count == 0)
+        return -1;
+
+    dir = room.pending[room.pending_first];
+    room.pending_first = (room.pending_first + 1) % ROOM_PENDING;
+    room.pending_count--;
+
+    return dir;
+}
+
+/* Which direction word is the short or long name of, or -1
+ */
+static gint room_direction(gchar *word)
+{
+    gint i;
+
+    for (i = 0; i < 10; i++)
+        if (!g_strcasecmp(word, direction[i]) ||
+            !g_strcasecmp(word, direction_long[i]))
+            return i;
+
+    return -1;
+}
+
+/* Which directions the exits line lists, as a bit mask
+ */
+static guint room_exits(gchar *text)
+{
+    gchar word[32];
+    guint exits = 0;
+    gint dir;
+
+    while (*text)
+    {
+        gint len = 0;
+
+        while (*text && !isalpha((guchar)*text))
+            text++;
+
+        while (isalpha((guchar)*text))
+        {
+            if (len < 31)
+                word[len++] = *text;
+
+            text++;
+        }
+
+        word[len] = '\0';
+
+        if (len && (dir = room_direction(word)) >= 0)
+            exits |= 1 << dir;
+    }
+
+    return exits;
+}
+
+static guint32 room_hash(guint32 hash, gchar *text, gint len)
+{
+    while (len--)
+    {
+        hash ^= (guchar)*text++;
+        hash *= 16777619;
+    }
+
+    return hash;
+}
+
+static guint32 room_fingerprint(guint exits)
+{
+    guint32 hash = 2166136261U;
+    gchar mask[2];
+
+    mask[0] = exits & 0xff;
+    mask[1] = exits >> 8;
+
+    hash = room_hash(hash, room.title->str, room.title->len + 1);
+    hash = room_hash(hash, mask, 2);
+    hash = room_hash(hash, room.description->str, room.description->len);
+
+    /* 0 is kept for rooms that haven't been seen */
+    return hash ? hash : 1;
+}
+
+/* Add the words of line to the description, whitespace and all made
+ * into single spaces
+ */
+static void room_describe(gchar *line)
+{
+    while (*line)
+    {
+        gchar *start;
+
+        while (isspace((guchar)*line))
+            line++;
+
+        if (*line == '\0')
+            break;
+
+        for (start = line; *line && !isspace((guchar)*line); line++)
+            ;
+
+        if (room.description->len)
+            g_string_append_c(room.description, ' ');
+
+        g_string_sprintfa(room.description, "%.*s", (gint)(line - start), start);
+    }
+}
+
+/*
+ * Keeping the map up
+ */
+static void room_index_add(AutoMap *automap, MapNode *node)
+{
+    gpointer key = GUINT_TO_POINTER(node->fingerprint);
+    GList *list = g_hash_table_lookup(automap->rooms, key);
+
+    g_hash_table_insert(automap->rooms, key, g_list_prepend(list, node));
+}
+
+static void room_index_remove(AutoMap *automap, MapNode *node)
+{
+    gpointer key = GUINT_TO_POINTER(node->fingerprint);
+    GList *list = g_hash_table_lookup(automap->rooms, key);
+
+    list = g_list_remove(list, node);
+
+    if (list)
+        g_hash_table_insert(automap->rooms, key, list);
+    else
+        g_hash_table_remove(automap->rooms, key);
+}
+
+/* Give node the fingerprint, 0 to make it a room not yet seen
+ */
+void map_room_index(AutoMap *automap, MapNode *node, guint32 fingerprint)
+{
+    if (automap->rooms == NULL)
+        automap->rooms = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    if (node->fingerprint)
+        room_index_remove(automap, node);
+
+    node->fingerprint = fingerprint;
+
+    if (fingerprint)
+        room_index_add(automap, node);
+}
+
+GList *map_room_lookup(AutoMap *automap, guint32 fingerprint)
+{
+    if (automap->rooms == NULL)
+        return NULL;
+
+    return g_hash_table_lookup(automap->rooms, GUINT_TO_POINTER(fingerprint));
+}
+
+static gboolean room_list_free(gpointer key, GList *list, gpointer data)
+{
+    g_list_free(list);
+
+    return TRUE;
+}
+
+void map_room_free(AutoMap *automap)
+{
+    if (automap->rooms == NULL)
+        return;
+
+    g_hash_table_foreach_remove(automap->rooms, (GHRFunc)room_list_free, NULL);
+    g_hash_table_destroy(automap->rooms);
+    automap->rooms = NULL;
+}
+
+static void room_apply(AutoMap *automap, MapOp *op)
+{
+    if (map_op_apply(automap, op))
+        map_record(automap, op);
+}
+
+static void room_info(AutoMap *automap, MapNode *node, gint field, gchar *text)
+{
+    MapOp op;
+
+    if (*text == '\0' || map_info_get(node, field))
+        return;
+
+    memset(&op, 0, sizeof(op));
+    op.type = MAP_OP_INFO;
+    op.node = node->id;
+    op.x = field;
+    op.text = text;
+    room_apply(automap, &op);
+}
+
+/* Mark node as the room just seen, and name it after it
+ */
+static void room_tag(AutoMap *automap, MapNode *node, guint32 fingerprint)
+{
+    MapOp op;
+
+    memset(&op, 0, sizeof(op));
+    op.type = MAP_OP_ROOM;
+    op.node = node->id;
+    op.other = fingerprint;
+    room_apply(automap, &op);
+
+    room_info(automap, node, MAP_INFO_NAME, room.title->str);
+    room_info(automap, node, MAP_INFO_DESCRIPTION, room.description->str);
+}
+
+static void room_link(AutoMap *automap, MapNode *node, gint dir, MapNode *other)
+{
+    MapOp op;
+
+    memset(&op, 0, sizeof(op));
+    op.type = MAP_OP_LINK;
+    op.node = node->id;
+    op.dir = dir;
+    op.other = other->id;
+    room_apply(automap, &op);
+
+    /* The two may have been on separate trails until now */
+    map_nodelist_rebuild(node->map);
+
+    if (other->map != node->map)
+        map_nodelist_rebuild(other->map);
+}
+
+static MapNode *room_node_new(AutoMap *automap, Map *map, gint32 x, gint32 y)
+{
+    MapOp op;
+
+    memset(&op, 0, sizeof(op));
+    op.type = MAP_OP_NODE_NEW;
+    op.node = automap->next_id;
+    op.map = map->name;
+    op.x = x;
+    op.y = y;
+    room_apply(automap, &op);
+
+    return map_node_lookup(automap, op.node);
+}
+
+/* Put the player on node, and show it
+ */
+static void room_jump(AutoMap *automap, MapNode *node)
+{
+    MapNode *old = automap->player;
+    MapOp op;
+
+    if (node == old)
+        return;
+
+    memset(&op, 0, sizeof(op));
+    op.type = MAP_OP_PLAYER;
+    op.node = node->id;
+    op.other = old->id;
+    room_apply(automap, &op);
+
+    map_player_moved(automap, old, FALSE);
+}
+
+/* A room already mapped that going dir from here could have led to:
+ * the one where the map says it should be, or failing that the only
+ * one of its kind on the map
+ */
+static MapNode *room_known(AutoMap *automap, MapNode *here, gint dir,
+                           guint32 fingerprint)
+{
+    MapNode *found = NULL;
+    gint candidates = 0;
+    GList *puck;
+
+    for (puck = map_room_lookup(automap, fingerprint); puck != NULL; puck = puck->next)
+    {
+        MapNode *node = puck->data;
+
+        if (node == here || node->connections[OPPOSITE(dir)].node)
+            continue;
+
+        /* Up and down lead off the map */
+        if (dir >= UP)
+        {
+            found = node;
+            candidates++;
+            continue;
+        }
+
+        if (node->map != here->map)
+            continue;
+
+        if (node->x == here->x + dx[dir] && node->y == here->y + dy[dir])
+            return node;
+
+        found = node;
+        candidates++;
+    }
+
+    return candidates == 1 ? found : NULL;
+}
+
+/* Make the room going dir from here leads to
+ */
+static MapNode *room_new(AutoMap *automap, MapNode *here, gint dir)
+{
+    MapNode key, *next;
+    GList *list;
+    Map *map;
+
+    if (dir >= UP)
+    {
+        MapOp op;
+
+        /* Every trip up or down is to a new map, as move_player() does */
+        map = map_new();
+
+        memset(&op, 0, sizeof(op));
+        op.type = MAP_OP_MAP_NEW;
+        op.map = map->name;
+        room_apply(automap, &op);
+
+        return room_node_new(automap, map, 0, 0);
+    }
+
+    key.x = here->x + dx[dir];
+    key.y = here->y + dy[dir];
+
+    /* Join up with a room there that hasn't been seen yet */
+    list = g_hash_table_lookup(here->map->nodes, &key);
+
+    if (list)
+    {
+        next = list->data;
+
+        if (!next->fingerprint && !next->connections[OPPOSITE(dir)].node)
+            return next;
+    }
+
+    /* Otherwise a different room is in the way, sit the new one on it */
+    return room_node_new(automap, here->map, key.x, key.y);
+}
+
+/* The player is in a room with the fingerprint, having gone dir to
+ * get there (-1 if not known)
+ */
+static void room_arrive(AutoMap *automap, guint32 fingerprint, gint dir)
+{
+    MapNode *here = automap->player, *next;
+    GList *list = map_room_lookup(automap, fingerprint);
+
+    if (dir < 0)
+    {
+        /* Looked around, or got moved without asking. Only sure where
+         * to when there is just one room like it
+         */
+        if (here->fingerprint == fingerprint)
+            return;
+
+        if (list && list->next == NULL)
+            room_jump(automap, list->data);
+        else if (!here->fingerprint)
+            room_tag(automap, here, fingerprint);
+
+        return;
+    }
+
+    next = here->connections[dir].node;
+
+    /* Not where the map says this way leads */
+    if (next && next->fingerprint && next->fingerprint != fingerprint)
+    {
+        if (list && list->next == NULL)
+            room_jump(automap, list->data);
+
+        return;
+    }
+
+    if (next == NULL)
+    {
+        if ((next = room_known(automap, here, dir, fingerprint)) == NULL)
+            next = room_new(automap, here, dir);
+
+        room_link(automap, here, dir, next);
+    }
+
+    if (!next->fingerprint)
+        room_tag(automap, next, fingerprint);
+
+    room_jump(automap, next);
+}
+
+static void room_found(gchar *exits)
+{
+    guint32 fingerprint = room_fingerprint(room_exits(exits));
+    gint dir = room_pending_pop();
+    GList *puck;
+
+    for (puck = AutoMapList; puck != NULL; puck = puck->next)
+    {
+        AutoMap *automap = puck->data;
+
+        if (automap->player)
+            room_arrive(automap, fingerprint, dir);
+    }
+}
+
+/* Strip colour and other escape sequences from line
+ */
+static void room_plain(gchar *line)
+{
+    gchar *out = line;
+
+    while (*line)
+    {
+        if (*line == '\033')
+        {
+            line++;
+
+            if (*line == '[')
+                for (line++; *line && (*line < 0x40 || *line > 0x7e); line++)
+                    ;
+
+            if (*line)
+                line++;
+
+            continue;
+        }
+
+        if ((guchar)*line >= ' ' || *line == '\t')
+            *out++ = *line;
+
+        line++;
+    }
+
+    *out = '\0';
+}
+
+static void room_line(gchar *line)
+{
+    regmatch_t match[10];
+    gint i;
+
+    room_plain(line);
+
+    /* A prompt means whatever went before was not a room */
+    if (room_match(ROOM_PROMPT, line, match, 1) && match[0].rm_eo > 0)
+    {
+        line += match[0].rm_eo;
+        room_reset();
+    }
+
+    if (room_match(ROOM_FAIL, line, NULL, 0))
+    {
+        room_pending_pop();
+        room_reset();
+        return;
+    }
+
+    if (room.in_room && room_match(ROOM_EXITS, line, match, 10))
+    {
+        /* The exits are in the last part of the pattern that matched */
+        for (i = 9; i > 0 && match[i].rm_so < 0; i--)
+            ;
+
+        line[match[i].rm_eo] = '\0';
+        room_found(line + match[i].rm_so);
+        room_reset();
+        return;
+    }
+
+    /* The first line like a title since the last prompt or room. Wrapped
+     * description lines can look like titles too, so no later one
+     */
+    if (!room.in_room)
+    {
+        if (room_match(ROOM_TITLE, line, NULL, 0))
+        {
+            room.in_room = TRUE;
+            g_string_assign(room.title, line);
+        }
+
+        return;
+    }
+
+    if (room_match(ROOM_IGNORE, line, NULL, 0))
+        return;
+
+    if (++room.lines > ROOM_MAX_LINES)
+        room_reset();
+    else
+        room_describe(line);
+}
+
+/* Text received from the mud, not necessarily whole lines
+ */
+void map_room_text(gchar *text)
+{
+    gchar *end;
+
+    if (AutoMapList == NULL)
+        return;
+
+    if (!room.loaded)
+        room_load_patterns();
+
+    while ((end = strchr(text, '\n')) != NULL)
+    {
+        g_string_sprintfa(room.partial, "%.*s", (gint)(end - text), text);
+        room_line(room.partial->str);
+        g_string_truncate(room.partial, 0);
+        text = end + 1;
+    }
+
+    g_string_append(room.partial, text);
+}
+
+/* Commands sent to the mud, one or more lines of them. Directions are
+ * remembered until the rooms they lead to arrive
+ */
+void map_room_command(gchar *text)
+{
+    gchar **lines, **puck;
+
+    if (AutoMapList == NULL)
+        return;
+
+    lines = g_strsplit(text, "\n", 0);
+
+    for (puck = lines; *puck != NULL; puck++)
+    {
+        gint dir = room_direction(g_strstrip(*puck));
+
+        if (dir >= 0)
+            room_pending_push(dir);
+    }
+
+    g_strfreev(lines);
+}
+
+#endif /* WITHOUT_MAPPER */
@@ -0,0 +1,676 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+#ifndef WITHOUT_MAPPER
+
+#include <gtk/gtk.h>
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* Finding the way between two rooms without searching every room in
+ * between.
+ *
+ * Each map is cut into clusters of MAP_CLUSTER_SIZE by MAP_CLUSTER_SIZE
+ * units. A room with a link leaving its cluster (to the next cluster
+ * over, or up or down to another map) is a portal. For every cluster
+ * the shortest way between each pair of its portals, staying inside the
+ * cluster, is worked out once and kept. Any route is then a walk from
+ * portal to portal, so the search only looks at the portals, plus the
+ * rooms in the clusters the route starts and ends in. Afterwards each
+ * portal to portal hop is filled in with the rooms along it.
+ *
+ * Changes only mark the clusters they touch, which are worked out again
+ * the next time a route is asked for.
+ */
+
+typedef struct _RouteVertex RouteVertex;
+typedef struct _RouteSearch RouteSearch;
+typedef struct _RouteEdge   RouteEdge;
+
+struct _MapPortal {
+
+    MapNode    *node;
+    MapCluster *cluster;
+    GSList     *edges;    /* RouteEdges to the other portals of cluster */
+};
+
+struct _RouteEdge {
+
+    MapPortal *to;
+    gint       cost;
+};
+
+struct _RouteVertex {
+
+    MapNode *node;
+    MapNode *prev;       /* Where the best way here so far came from     */
+    gint     cost;
+    gint     estimate;   /* Least the rest of the way can cost           */
+    gint8    dir;        /* Link taken from prev, -1 for a portal hop    */
+    gint     heap;       /* Position in the heap, -1 once it is settled  */
+};
+
+struct _RouteSearch {
+
+    GHashTable   *vertices; /* MapNode -> RouteVertex */
+    GPtrArray    *heap;
+    MapLandmarks *landmarks; /* To estimate the way to target with */
+    MapNode      *target;
+};
+
+static inline gint floor_div(gint a, gint b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static guint cluster_hash(MapCluster *cluster)
+{
+    return GPOINTER_TO_UINT(cluster->map) ^ (cluster->cx * 7919) ^
+        (cluster->cy << 12);
+}
+
+static gint cluster_equal(MapCluster *a, MapCluster *b)
+{
+    return a->map == b->map && a->cx == b->cx && a->cy == b->cy;
+}
+
+static void cluster_key(MapCluster *key, Map *map, gint x, gint y)
+{
+    key->map = map;
+    key->cx = floor_div(x, MAP_CLUSTER_SIZE);
+    key->cy = floor_div(y, MAP_CLUSTER_SIZE);
+}
+
+static inline gboolean in_cluster(MapCluster *cluster, MapNode *node)
+{
+    return node->map == cluster->map &&
+        floor_div(node->x, MAP_CLUSTER_SIZE) == cluster->cx &&
+        floor_div(node->y, MAP_CLUSTER_SIZE) == cluster->cy;
+}
+
+/*
+ * Dijkstra's algorithm, on a binary heap of RouteVertexes. Or A* with
+ * landmarks, see map_landmark.c
+ */
+
+#define KEY(heap, i) (((RouteVertex *)g_ptr_array_index(heap, i))->cost + \
+                      ((RouteVertex *)g_ptr_array_index(heap, i))->estimate)
+
+static void heap_swap(GPtrArray *heap, gint a, gint b)
+{
+    RouteVertex *va = g_ptr_array_index(heap, a);
+    RouteVertex *vb = g_ptr_array_index(heap, b);
+
+    g_ptr_array_index(heap, a) = vb; vb->heap = a;
+    g_ptr_array_index(heap, b) = va; va->heap = b;
+}
+
+static void heap_up(GPtrArray *heap, gint i)
+{
+    while (i > 0)
+    {
+        gint parent = (i - 1) / 2;
+
+        if (KEY(heap, parent) <= KEY(heap, i))
+            break;
+
+        heap_swap(heap, i, parent);
+        i = parent;
+    }
+}
+
+static void heap_down(GPtrArray *heap, gint i)
+{
+    gint len = heap->len;
+
+    for (;;)
+    {
+        gint least = i, child;
+
+        for (child = 2 * i + 1; child <= 2 * i + 2 && child < len; child++)
+            if (KEY(heap, child) < KEY(heap, least))
+                least = child;
+
+        if (least == i)
+            break;
+
+        heap_swap(heap, i, least);
+        i = least;
+    }
+}
+
+static void search_init(RouteSearch *search)
+{
+    search->vertices = g_hash_table_new(g_direct_hash, g_direct_equal);
+    search->heap = g_ptr_array_new();
+    search->landmarks = NULL;
+    search->target = NULL;
+}
+
+static gboolean vertex_free(MapNode *key, RouteVertex *vertex, gpointer data)
+{
+    g_free(vertex);
+    return TRUE;
+}
+
+static void search_free(RouteSearch *search)
+{
+    g_hash_table_foreach_remove(search->vertices, (GHRFunc)vertex_free, NULL);
+    g_hash_table_destroy(search->vertices);
+    g_ptr_array_free(search->heap, TRUE);
+}
+
+/* Found a way to node costing cost, coming from prev
+ */
+static void search_relax(RouteSearch *search, MapNode *node, gint cost,
+                         MapNode *prev, gint dir)
+{
+    RouteVertex *vertex = g_hash_table_lookup(search->vertices, node);
+
+    if (vertex == NULL)
+    {
+        vertex = g_new(RouteVertex, 1);
+        vertex->node = node;
+        vertex->estimate = search->landmarks ?
+            map_landmark_estimate(search->landmarks, node, search->target) : 0;
+        vertex->heap = search->heap->len;
+        g_ptr_array_add(search->heap, vertex);
+        g_hash_table_insert(search->vertices, node, vertex);
+    } else if (vertex->heap < 0 || vertex->cost <= cost) {
+        return;
+    }
+
+    vertex->cost = cost;
+    vertex->prev = prev;
+    vertex->dir = dir;
+    heap_up(search->heap, vertex->heap);
+}
+
+static RouteVertex *search_pop(RouteSearch *search)
+{
+    GPtrArray *heap = search->heap;
+    RouteVertex *vertex;
+
+    if (heap->len == 0)
+        return NULL;
+
+    vertex = g_ptr_array_index(heap, 0);
+    heap_swap(heap, 0, heap->len - 1);
+    g_ptr_array_remove_index(heap, heap->len - 1);
+    heap_down(heap, 0);
+
+    vertex->heap = -1;
+    return vertex;
+}
+
+/* Search outwards from start without leaving cluster, stopping early
+ * once target (if any) is reached. A reverse search finds what it costs
+ * to get to start instead of from it
+ */
+static void search_cluster(RouteSearch *search, MapCluster *cluster,
+                           MapNode *start, MapNode *target, gboolean reverse)
+{
+    RouteVertex *vertex;
+    gint i, cost;
+
+    search_init(search);
+    search_relax(search, start, 0, NULL, -1);
+
+    while ((vertex = search_pop(search)) != NULL && vertex->node != target)
+    {
+        MapNode *node = vertex->node;
+
+        for (i = 0; i < 10; i++)
+        {
+            MapNode *next = node->connections[i].node;
+
+            if (next == NULL || !in_cluster(cluster, next))
+                continue;
+
+            cost = reverse ? map_edge_cost(next, OPPOSITE(i))
+                           : map_edge_cost(node, i);
+
+            if (cost >= 0)
+                search_relax(search, next, vertex->cost + cost, node, i);
+        }
+    }
+}
+
+/*
+ * The portal graph
+ */
+
+static gboolean portal_leaves(MapCluster *cluster, MapNode *node)
+{
+    gint i;
+
+    for (i = 0; i < 10; i++)
+        if (node->connections[i].node &&
+            !in_cluster(cluster, node->connections[i].node))
+            return TRUE;
+
+    return FALSE;
+}
+
+static void portal_free(AutoMap *automap, MapPortal *portal)
+{
+    GSList *puck;
+
+    for (puck = portal->edges; puck != NULL; puck = puck->next)
+        g_free(puck->data);
+
+    g_slist_free(portal->edges);
+
+    /* A room deleted since may have left its place to a new portal */
+    if (g_hash_table_lookup(automap->portals, portal->node) == portal)
+        g_hash_table_remove(automap->portals, portal->node);
+
+    g_free(portal);
+}
+
+static void cluster_clear(AutoMap *automap, MapCluster *cluster)
+{
+    GSList *puck;
+
+    for (puck = cluster->portals; puck != NULL; puck = puck->next)
+        portal_free(automap, puck->data);
+
+    g_slist_free(cluster->portals);
+    cluster->portals = NULL;
+}
+
+/* Find the portals of cluster, and the ways between them
+ */
+static void cluster_build(AutoMap *automap, MapCluster *cluster)
+{
+    GSList *nodes = NULL, *puck, *other;
+    gint x = cluster->cx * MAP_CLUSTER_SIZE, y = cluster->cy * MAP_CLUSTER_SIZE;
+
+    cluster_clear(automap, cluster);
+    cluster->dirty = FALSE;
+
+    map_nodes_in_area(cluster->map, x, y, x + MAP_CLUSTER_SIZE - 1,
+                      y + MAP_CLUSTER_SIZE - 1, &nodes);
+
+    for (puck = nodes; puck != NULL; puck = puck->next)
+    {
+        MapPortal *portal;
+
+        if (!portal_leaves(cluster, puck->data))
+            continue;
+
+        portal = g_new0(MapPortal, 1);
+        portal->node = puck->data;
+        portal->cluster = cluster;
+
+        cluster->portals = g_slist_prepend(cluster->portals, portal);
+        g_hash_table_insert(automap->portals, portal->node, portal);
+    }
+
+    g_slist_free(nodes);
+
+    for (puck = cluster->portals; puck != NULL; puck = puck->next)
+    {
+        MapPortal *portal = puck->data;
+        RouteSearch search;
+
+        search_cluster(&search, cluster, portal->node, NULL, FALSE);
+
+        for (other = cluster->portals; other != NULL; other = other->next)
+        {
+            MapPortal *to = other->data;
+            RouteVertex *vertex;
+            RouteEdge *edge;
+
+            if (to == portal ||
+                (vertex = g_hash_table_lookup(search.vertices, to->node)) == NULL)
+                continue;
+
+            edge = g_new(RouteEdge, 1);
+            edge->to = to;
+            edge->cost = vertex->cost;
+            portal->edges = g_slist_prepend(portal->edges, edge);
+        }
+
+        search_free(&search);
+    }
+}
+
+static MapCluster *cluster_lookup(AutoMap *automap, Map *map, gint x, gint y)
+{
+    MapCluster key, *cluster;
+
+    cluster_key(&key, map, x, y);
+
+    if ((cluster = g_hash_table_lookup(automap->clusters, &key)) == NULL)
+    {
+        cluster = g_new0(MapCluster, 1);
+        cluster_key(cluster, map, x, y);
+        g_hash_table_insert(automap->clusters, cluster, cluster);
+    }
+
+    return cluster;
+}
+
+static void cluster_touch(AutoMap *automap, Map *map, gint x, gint y)
+{
+    MapCluster *cluster;
+
+    if (automap->clusters == NULL)
+        return;
+
+    cluster = cluster_lookup(automap, map, x, y);
+
+    if (!cluster->dirty)
+    {
+        cluster->dirty = TRUE;
+        automap->clusters_dirty = g_slist_prepend(automap->clusters_dirty, cluster);
+    }
+}
+
+static void node_touch(AutoMap *automap, MapNode *node)
+{
+    if (node)
+        cluster_touch(automap, node->map, node->x, node->y);
+}
+
+struct route_touch {
+
+    AutoMap *automap;
+    Map     *map;
+};
+
+static void cluster_touch_map(MapCluster *key, MapCluster *cluster,
+                              struct route_touch *touch)
+{
+    if (cluster->map == touch->map && !cluster->dirty)
+    {
+        cluster->dirty = TRUE;
+        touch->automap->clusters_dirty =
+            g_slist_prepend(touch->automap->clusters_dirty, cluster);
+    }
+}
+
+static void portal_find(gpointer id, MapNode *node, AutoMap *automap)
+{
+    MapCluster key;
+
+    cluster_key(&key, node->map, node->x, node->y);
+
+    if (portal_leaves(&key, node))
+        cluster_touch(automap, node->map, node->x, node->y);
+}
+
+/* Bring the portal graph up to date
+ */
+static void route_update(AutoMap *automap)
+{
+    GSList *puck;
+
+    if (automap->clusters == NULL)
+    {
+        automap->clusters = g_hash_table_new((GHashFunc)cluster_hash,
+                                             (GCompareFunc)cluster_equal);
+        automap->portals = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+        /* Only clusters with a way out matter */
+        g_hash_table_foreach(automap->ids, (GHFunc)portal_find, automap);
+    }
+
+    for (puck = automap->clusters_dirty; puck != NULL; puck = puck->next)
+        cluster_build(automap, puck->data);
+
+    g_slist_free(automap->clusters_dirty);
+    automap->clusters_dirty = NULL;
+}
+
+static gboolean cluster_free(MapCluster *key, MapCluster *cluster,
+                             AutoMap *automap)
+{
+    cluster_clear(automap, cluster);
+    g_free(cluster);
+
+    return TRUE;
+}
+
+/* Throw the portal graph away, it is built again when next needed
+ */
+void map_route_flush(AutoMap *automap)
+{
+    if (automap->clusters == NULL)
+        return;
+
+    g_hash_table_foreach_remove(automap->clusters, (GHRFunc)cluster_free, automap);
+    g_hash_table_destroy(automap->clusters);
+    g_hash_table_destroy(automap->portals);
+    g_slist_free(automap->clusters_dirty);
+
+    automap->clusters = NULL;
+    automap->portals = NULL;
+    automap->clusters_dirty = NULL;
+}
+
+/* Mark the clusters a change is about to touch
+ */
+void map_route_record(AutoMap *automap, MapOp *op)
+{
+    struct route_touch touch;
+    MapNode *node;
+    Map *map;
+    gint i;
+
+    if (automap->clusters == NULL)
+        return;
+
+    switch (op->type)
+    {
+    case MAP_OP_LINK:
+    case MAP_OP_UNLINK:
+        node_touch(automap, map_node_lookup(automap, op->node));
+        node_touch(automap, map_node_lookup(automap, op->other));
+        break;
+
+    case MAP_OP_EDGE:
+        if ((node = map_node_lookup(automap, op->node)) == NULL)
+            break;
+
+        node_touch(automap, node);
+        node_touch(automap, node->connections[op->dir].node);
+        break;
+
+    case MAP_OP_MOVE:
+        if ((node = map_node_lookup(automap, op->node)) == NULL)
+            break;
+
+        /* The node has already moved, its neighbours may have become
+         * (or stopped being) portals
+         */
+        cluster_touch(automap, node->map, node->x - op->x, node->y - op->y);
+        node_touch(automap, node);
+
+        for (i = 0; i < 10; i++)
+            node_touch(automap, node->connections[i].node);
+        break;
+
+    case MAP_OP_NODE_DELETE:
+        /* Its links were taken away first, each marking the clusters
+         * at both ends, so only its own is left
+         */
+        if ((map = map_find(op->map)) != NULL)
+            cluster_touch(automap, map, op->x, op->y);
+        break;
+
+    case MAP_OP_COST:
+        /* Any way across the map may cost something else now */
+        if ((map = map_find(op->map)) == NULL)
+            break;
+
+        touch.automap = automap;
+        touch.map = map;
+        g_hash_table_foreach(automap->clusters, (GHFunc)cluster_touch_map, &touch);
+        break;
+
+    case MAP_OP_MAP_DELETE:
+        /* Its clusters are kept by the Map, which is going */
+        map_route_flush(automap);
+        break;
+
+    default:
+        /* New rooms aren't linked to anything yet */
+        break;
+    }
+}
+
+/* Turn the path found to vertex into directions, prepended to route
+ */
+static GList *route_refine(RouteSearch *search, RouteVertex *vertex,
+                           AutoMap *automap, GList *route)
+{
+    while (vertex->prev)
+    {
+        if (vertex->dir >= 0)
+        {
+            route = g_list_prepend(route, GINT_TO_POINTER((gint)vertex->dir));
+        } else {
+            /* A hop between two rooms of the same cluster */
+            MapCluster key;
+            RouteSearch hop;
+            RouteVertex *step;
+
+            cluster_key(&key, vertex->prev->map, vertex->prev->x, vertex->prev->y);
+            search_cluster(&hop, &key, vertex->prev, vertex->node, FALSE);
+
+            step = g_hash_table_lookup(hop.vertices, vertex->node);
+            route = route_refine(&hop, step, automap, route);
+
+            search_free(&hop);
+        }
+
+        vertex = g_hash_table_lookup(search->vertices, vertex->prev);
+    }
+
+    return route;
+}
+
+/* The directions to take to get from one room to another, as a list of
+ * GINT_TO_POINTER direction numbers. NULL if there's no way there (or
+ * from is to)
+ */
+GList *map_route(AutoMap *automap, MapNode *from, MapNode *to)
+{
+    MapCluster start_key, goal_key, *start, *goal;
+    RouteSearch local, search;
+    GHashTable *to_goal;
+    RouteVertex *vertex;
+    GList *route = NULL;
+    GSList *puck;
+
+    if (from == to || !map_node_reachable(automap, from, to))
+        return NULL;
+
+    route_update(automap);
+
+    cluster_key(&start_key, from->map, from->x, from->y);
+    cluster_key(&goal_key, to->map, to->x, to->y);
+
+    start = g_hash_table_lookup(automap->clusters, &start_key);
+    goal = g_hash_table_lookup(automap->clusters, &goal_key);
+
+    search_init(&search);
+    search.landmarks = map_landmarks(automap);
+    search.target = to;
+    search_relax(&search, from, 0, NULL, -1);
+
+    /* From the start to the portals of its cluster, or straight to the
+     * end if it is close by
+     */
+    search_cluster(&local, &start_key, from, NULL, FALSE);
+
+    for (puck = start ? start->portals : NULL; puck != NULL; puck = puck->next)
+    {
+        MapPortal *portal = puck->data;
+
+        if ((vertex = g_hash_table_lookup(local.vertices, portal->node)) != NULL)
+            search_relax(&search, portal->node, vertex->cost, from, -1);
+    }
+
+    if ((vertex = g_hash_table_lookup(local.vertices, to)) != NULL)
+        search_relax(&search, to, vertex->cost, from, -1);
+
+    search_free(&local);
+
+    /* And from the portals of the end's cluster to the end */
+    to_goal = g_hash_table_new(g_direct_hash, g_direct_equal);
+    search_cluster(&local, &goal_key, to, NULL, TRUE);
+
+    for (puck = goal ? goal->portals : NULL; puck != NULL; puck = puck->next)
+    {
+        MapPortal *portal = puck->data;
+
+        if ((vertex = g_hash_table_lookup(local.vertices, portal->node)) != NULL)
+            g_hash_table_insert(to_goal, portal->node,
+                                GINT_TO_POINTER(vertex->cost + 1));
+    }
+
+    search_free(&local);
+
+    while ((vertex = search_pop(&search)) != NULL && vertex->node != to)
+    {
+        MapNode *node = vertex->node;
+        MapPortal *portal = g_hash_table_lookup(automap->portals, node);
+        gint i, cost;
+
+        if (portal == NULL)
+            continue;
+
+        for (puck = portal->edges; puck != NULL; puck = puck->next)
+        {
+            RouteEdge *edge = puck->data;
+
+            search_relax(&search, edge->to->node, vertex->cost + edge->cost,
+                         node, -1);
+        }
+
+        for (i = 0; i < 10; i++)
+        {
+            MapNode *next = node->connections[i].node;
+
+            if (next && !in_cluster(portal->cluster, next) &&
+                (cost = map_edge_cost(node, i)) >= 0)
+                search_relax(&search, next, vertex->cost + cost, node, i);
+        }
+
+        /* Stored off by one, so that 0 isn't mistaken for NULL */
+        if ((cost = GPOINTER_TO_INT(g_hash_table_lookup(to_goal, node))) != 0)
+            search_relax(&search, to, vertex->cost + cost - 1, node, -1);
+    }
+
+    if (vertex)
+        route = route_refine(&search, vertex, automap, NULL);
+
+    g_hash_table_destroy(to_goal);
+    search_free(&search);
+
+    return route;
+}
+
+#endif /* WITHOUT_MAPPER */
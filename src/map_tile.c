@@ -0,0 +1,453 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+#ifndef WITHOUT_MAPPER
+
+#include <stdlib.h>
+#include <gtk/gtk.h>
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* The maps are drawn in squares of MAP_TILE_SIZE pixels, which are kept
+ * around and copied into the window's pixmap when it is redrawn. Pixel
+ * (0, 0) of the first tile is graph coordinate (0, 0) at every zoom
+ * level, so a tile can be used wherever the window happens to be
+ * scrolled to.
+ *
+ * Changes to the map throw away only the tiles they touch. A change to
+ * which rooms the player can reach (see map_connect.c) throws away
+ * everything, as rooms all over may have to be greyed out.
+ */
+
+#define MAP_TILE_CACHE 64  /* Tiles kept, 8MB at 16bpp. A full screen is 20 */
+
+struct tile_area {
+
+    gint x1, y1, x2, y2;
+    GSList **nodes;
+};
+
+struct tile_damage {
+
+    Map *map;
+    gint x1, y1, x2, y2;
+};
+
+static inline gint floor_div(gint a, gint b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static guint tile_hash(MapTile *tile)
+{
+    return GPOINTER_TO_UINT(tile->map) ^ (tile->unit << 24) ^
+        (tile->tx * 7919) ^ (tile->ty << 12);
+}
+
+static gint tile_equal(MapTile *a, MapTile *b)
+{
+    return a->map == b->map && a->unit == b->unit &&
+        a->tx == b->tx && a->ty == b->ty;
+}
+
+static gboolean tile_free(MapTile *key, MapTile *tile, gpointer data)
+{
+    gdk_pixmap_unref(tile->pixmap);
+    g_free(tile);
+
+    return TRUE;
+}
+
+static void area_add(MapNode *key, GList *list, struct tile_area *area)
+{
+    if (key->x < area->x1 || key->x > area->x2 ||
+        key->y < area->y1 || key->y > area->y2)
+        return;
+
+    for (; list != NULL; list = list->next)
+        *area->nodes = g_slist_prepend(*area->nodes, list->data);
+}
+
+/* Add all nodes of map from (x1, y1) to (x2, y2) inclusive to nodes.
+ * Looks up each coordinate when that's less work than going through
+ * the whole map
+ */
+void map_nodes_in_area(Map *map, gint x1, gint y1, gint x2, gint y2,
+                       GSList **nodes)
+{
+    gdouble area = ((gdouble)x2 - x1 + 1) * ((gdouble)y2 - y1 + 1);
+    MapNode key;
+    GList *list;
+
+    if (x1 > x2 || y1 > y2)
+        return;
+
+    if (area > g_hash_table_size(map->nodes))
+    {
+        struct tile_area data;
+
+        data.x1 = x1; data.y1 = y1;
+        data.x2 = x2; data.y2 = y2;
+        data.nodes = nodes;
+        g_hash_table_foreach(map->nodes, (GHFunc)area_add, &data);
+
+        return;
+    }
+
+    for (key.x = x1; key.x <= x2; key.x++)
+        for (key.y = y1; key.y <= y2; key.y++)
+            for (list = g_hash_table_lookup(map->nodes, &key); list; list = list->next)
+                *nodes = g_slist_prepend(*nodes, list->data);
+}
+
+static void tile_render(AutoMap *automap, struct win_scale *screen, MapTile *tile)
+{
+    struct win_scale ws = *screen;
+    gint unit = ws.mapped_unit;
+    gint pad = (tile->map->span + 1) * unit;
+    GSList *nodes = NULL, *puck;
+    gint i;
+
+    ws.width = ws.height = MAP_TILE_SIZE;
+    ws.origin_x = tile->tx * MAP_TILE_SIZE;
+    ws.origin_y = tile->ty * MAP_TILE_SIZE;
+    ws.mapped_width = ws.mapped_height = MAP_TILE_SIZE / unit;
+    ws.mapped_x = floor_div(ws.origin_x, unit);
+    ws.mapped_y = -floor_div(ws.origin_y + MAP_TILE_SIZE, unit);
+    ws.drawable = tile->pixmap;
+
+    gdk_draw_rectangle(tile->pixmap, automap->draw_area->style->white_gc, TRUE,
+                       0, 0, MAP_TILE_SIZE, MAP_TILE_SIZE);
+
+    if (unit < MAP_LOD_UNIT)
+    {
+        map_lod_render(automap, &ws, tile->map);
+        return;
+    }
+
+    /* Anything linked to something in the tile is at most the map's
+     * span away from it
+     */
+    map_nodes_in_area(tile->map,
+                      floor_div(ws.origin_x - pad, unit),
+                      -floor_div(ws.origin_y + MAP_TILE_SIZE + pad, unit),
+                      floor_div(ws.origin_x + MAP_TILE_SIZE + pad, unit),
+                      -floor_div(ws.origin_y - pad, unit),
+                      &nodes);
+
+    /* Lines first, both ends are in the list so draw each once */
+    for (puck = nodes; puck != NULL; puck = puck->next)
+    {
+        MapNode *node = puck->data;
+
+        for (i = 0; i < 8; i++)
+        {
+            MapNode *next = node->connections[i].node;
+
+            if (next && next < node && next->map == node->map)
+                draw_line(automap, &ws, node, next);
+        }
+    }
+
+    for (puck = nodes; puck != NULL; puck = puck->next)
+        draw_dot(automap, &ws, puck->data);
+
+    g_slist_free(nodes);
+}
+
+static void tile_collect(MapTile *key, MapTile *tile, GPtrArray *tiles)
+{
+    g_ptr_array_add(tiles, tile);
+}
+
+static int tile_compare_stamp(const void *a, const void *b)
+{
+    const MapTile *ta = *(MapTile **)a, *tb = *(MapTile **)b;
+
+    return ta->stamp < tb->stamp ? -1 : ta->stamp > tb->stamp;
+}
+
+/* Throw away the tiles used longest ago, but none used just now
+ */
+static void tile_trim(AutoMap *automap)
+{
+    GPtrArray *tiles;
+    gint excess = g_hash_table_size(automap->tiles) - MAP_TILE_CACHE;
+    guint i;
+
+    if (excess <= 0)
+        return;
+
+    tiles = g_ptr_array_new();
+    g_hash_table_foreach(automap->tiles, (GHFunc)tile_collect, tiles);
+    qsort(tiles->pdata, tiles->len, sizeof(gpointer), tile_compare_stamp);
+
+    for (i = 0; i < tiles->len && excess > 0; i++, excess--)
+    {
+        MapTile *tile = g_ptr_array_index(tiles, i);
+
+        if (tile->stamp == automap->tile_stamp)
+            break;
+
+        g_hash_table_remove(automap->tiles, tile);
+        tile_free(tile, tile, NULL);
+    }
+
+    g_ptr_array_free(tiles, TRUE);
+}
+
+/* Fill ws->drawable with automap->map as seen through ws
+ */
+void map_tile_compose(AutoMap *automap, struct win_scale *ws)
+{
+    gint tx, ty, tx1, ty1, tx2, ty2;
+    MapTile key;
+
+    if (automap->tiles == NULL)
+        automap->tiles = g_hash_table_new((GHashFunc)tile_hash,
+                                          (GCompareFunc)tile_equal);
+
+    automap->tile_stamp++;
+
+    tx1 = floor_div(ws->origin_x, MAP_TILE_SIZE);
+    ty1 = floor_div(ws->origin_y, MAP_TILE_SIZE);
+    tx2 = floor_div(ws->origin_x + ws->width - 1, MAP_TILE_SIZE);
+    ty2 = floor_div(ws->origin_y + ws->height - 1, MAP_TILE_SIZE);
+
+    key.map = automap->map;
+    key.unit = ws->mapped_unit;
+
+    for (ty = ty1; ty <= ty2; ty++)
+    {
+        for (tx = tx1; tx <= tx2; tx++)
+        {
+            MapTile *tile;
+
+            key.tx = tx;
+            key.ty = ty;
+
+            if ((tile = g_hash_table_lookup(automap->tiles, &key)) == NULL)
+            {
+                tile = g_malloc0(sizeof(MapTile));
+                *tile = key;
+                tile->pixmap = gdk_pixmap_new(automap->draw_area->window,
+                                              MAP_TILE_SIZE, MAP_TILE_SIZE, -1);
+                tile_render(automap, ws, tile);
+                g_hash_table_insert(automap->tiles, tile, tile);
+            }
+
+            tile->stamp = automap->tile_stamp;
+
+            gdk_draw_pixmap(ws->drawable,
+                            automap->draw_area->style->fg_gc[GTK_WIDGET_STATE (automap->draw_area)],
+                            tile->pixmap, 0, 0,
+                            tx * MAP_TILE_SIZE - ws->origin_x,
+                            ty * MAP_TILE_SIZE - ws->origin_y,
+                            MAP_TILE_SIZE, MAP_TILE_SIZE);
+        }
+    }
+
+    tile_trim(automap);
+}
+
+static gboolean tile_damaged(MapTile *key, MapTile *tile, struct tile_damage *damage)
+{
+    gint unit = tile->unit;
+    gint x = tile->tx * MAP_TILE_SIZE, y = tile->ty * MAP_TILE_SIZE;
+
+    if (tile->map != damage->map ||
+        damage->x2 * unit + unit < x ||
+        damage->x1 * unit - unit >= x + MAP_TILE_SIZE ||
+        -damage->y1 * unit + unit < y ||
+        -damage->y2 * unit - unit >= y + MAP_TILE_SIZE)
+        return FALSE;
+
+    return tile_free(key, tile, NULL);
+}
+
+/* Throw away all tiles of map showing any of (x1, y1) to (x2, y2),
+ * including the lines and dots drawn around them
+ */
+void map_tile_invalidate(AutoMap *automap, Map *map, gint x1, gint y1,
+                         gint x2, gint y2)
+{
+    struct tile_damage damage;
+
+    if (automap->tiles == NULL)
+        return;
+
+    damage.map = map;
+    damage.x1 = MIN(x1, x2); damage.y1 = MIN(y1, y2);
+    damage.x2 = MAX(x1, x2); damage.y2 = MAX(y1, y2);
+
+    g_hash_table_foreach_remove(automap->tiles, (GHRFunc)tile_damaged, &damage);
+}
+
+static void span_update(MapNode *node)
+{
+    gint i;
+
+    for (i = 0; i < 8; i++)
+    {
+        MapNode *next = node->connections[i].node;
+
+        if (next == NULL || next->map != node->map)
+            continue;
+
+        node->map->span = MAX(node->map->span, ABS(next->x - node->x));
+        node->map->span = MAX(node->map->span, ABS(next->y - node->y));
+    }
+}
+
+static void span_node(gpointer id, MapNode *node, gpointer data)
+{
+    span_update(node);
+}
+
+/* Throw away every tile, and work out how far apart linked nodes are
+ * from scratch
+ */
+void map_tile_flush(AutoMap *automap)
+{
+    GList *puck;
+
+    if (automap->tiles)
+        g_hash_table_foreach_remove(automap->tiles, (GHRFunc)tile_free, NULL);
+
+    for (puck = MapList; puck != NULL; puck = puck->next)
+        ((Map *)puck->data)->span = 0;
+
+    g_hash_table_foreach(automap->ids, (GHFunc)span_node, NULL);
+}
+
+/* Throw away the tiles a change to the map touches. The change may be
+ * recorded just before or just after it is made
+ */
+void map_tile_record(AutoMap *automap, MapOp *op)
+{
+    MapNode *node, *other;
+    Map *map;
+    gint i, x1, y1, x2, y2;
+
+    switch (op->type)
+    {
+    case MAP_OP_NODE_NEW:
+        if ((map = map_find(op->map)) != NULL)
+            map_tile_invalidate(automap, map, op->x, op->y, op->x, op->y);
+        break;
+
+    case MAP_OP_LINK:
+        node = map_node_lookup(automap, op->node);
+        other = map_node_lookup(automap, op->other);
+
+        if (!node || !other)
+        {
+            map_tile_flush(automap);
+            break;
+        }
+
+        if (node->map == other->map)
+        {
+            node->map->span = MAX(node->map->span, ABS(other->x - node->x));
+            node->map->span = MAX(node->map->span, ABS(other->y - node->y));
+            map_tile_invalidate(automap, node->map, node->x, node->y,
+                                other->x, other->y);
+        } else {
+            /* Up and down arrows on the dots */
+            map_tile_invalidate(automap, node->map, node->x, node->y,
+                                node->x, node->y);
+            map_tile_invalidate(automap, other->map, other->x, other->y,
+                                other->x, other->y);
+        }
+        break;
+
+    case MAP_OP_MOVE:
+        if ((node = map_node_lookup(automap, op->node)) == NULL)
+        {
+            map_tile_flush(automap);
+            break;
+        }
+
+        x1 = MIN(node->x - op->x, node->x + op->x);
+        x2 = MAX(node->x - op->x, node->x + op->x);
+        y1 = MIN(node->y - op->y, node->y + op->y);
+        y2 = MAX(node->y - op->y, node->y + op->y);
+
+        for (i = 0; i < 8; i++)
+        {
+            if ((other = node->connections[i].node) == NULL)
+                continue;
+
+            x1 = MIN(x1, other->x); x2 = MAX(x2, other->x);
+            y1 = MIN(y1, other->y); y2 = MAX(y2, other->y);
+        }
+
+        map_tile_invalidate(automap, node->map, x1, y1, x2, y2);
+
+        /* Before or after, the span covers both */
+        node->map->span = MAX(node->map->span, x2 - x1);
+        node->map->span = MAX(node->map->span, y2 - y1);
+        break;
+
+    case MAP_OP_PLAYER:
+        node = map_node_lookup(automap, op->node);
+        other = map_node_lookup(automap, op->other);
+
+        if (!node || !other || !map_node_reachable(automap, node, other))
+            map_tile_flush(automap);
+        break;
+
+    case MAP_OP_UNLINK:
+    case MAP_OP_NODE_DELETE:
+    case MAP_OP_MAP_DELETE:
+        map_tile_flush(automap);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* The node whose dot is at pixel (x, y) of ws, if any
+ */
+MapNode *map_node_at(AutoMap *automap, struct win_scale *ws, gint x, gint y)
+{
+    gint unit = ws->mapped_unit, half = MAX(unit / 4, 3);
+    gint gx = x + ws->origin_x, gy = y + ws->origin_y;
+    MapNode key, *node;
+    GList *list;
+
+    key.x = floor_div(gx + unit / 2, unit);
+    key.y = -floor_div(gy + unit / 2, unit);
+
+    if ((list = g_hash_table_lookup(automap->map->nodes, &key)) == NULL)
+        return NULL;
+
+    node = list->data;
+
+    if (ABS(node->x * unit - gx) > half || ABS(-node->y * unit - gy) > half)
+        return NULL;
+
+    return node;
+}
+
+#endif /* WITHOUT_MAPPER */
@@ -0,0 +1,338 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+#ifndef WITHOUT_MAPPER
+
+#include <string.h>
+#include <gtk/gtk.h>
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* Every change recorded with map_record() is also kept here, along with
+ * the change that takes it back, both written the same way as journal
+ * records. Undoing applies the inverse changes with map_op_apply(), so
+ * nothing is copied or reloaded, and undone changes can be redone the
+ * same way.
+ *
+ * Changes recorded while handling one event (a drag, a move, deleting
+ * a room) are undone together: a group is started by the first change
+ * and ended when GTK next goes idle. Only the last MAP_UNDO_STEPS
+ * changes are kept.
+ */
+
+struct _MapUndo {
+
+    GList   *done;      /* Groups, most recent first                   */
+    GList   *oldest;    /* The last link of done, so it goes at once   */
+    GList   *undone;    /* Groups undone, most recently undone first   */
+    guint    steps;     /* Changes held in both                        */
+    guint    idle;      /* Ends the group being recorded, 0 if none    */
+    gboolean applying;  /* Changes are being undone or redone          */
+};
+
+/* A group holds a GSList of these, last change first. Each holds the
+ * change and its inverse, one record per line
+ */
+typedef gchar UndoStep;
+
+typedef struct {
+
+    GSList  *steps;
+    guint    count;     /* How many there are, for MapUndo's steps     */
+} UndoGroup;
+
+static UndoStep *undo_step(MapOp *op, MapOp *inverse)
+{
+    GString *out = g_string_new("");
+    UndoStep *step;
+
+    map_op_format(out, op, 0);
+    map_op_format(out, inverse, 0);
+
+    step = out->str;
+    g_string_free(out, FALSE);
+
+    return step;
+}
+
+static void undo_group_free(MapUndo *undo, UndoGroup *group)
+{
+    GSList *puck;
+
+    for (puck = group->steps; puck != NULL; puck = puck->next)
+        g_free(puck->data);
+
+    undo->steps -= group->count;
+    g_slist_free(group->steps);
+    g_free(group);
+}
+
+static void undo_groups_free(MapUndo *undo, GList *groups)
+{
+    GList *puck;
+
+    for (puck = groups; puck != NULL; puck = puck->next)
+        undo_group_free(undo, puck->data);
+
+    g_list_free(groups);
+}
+
+/* The change that takes op back
+ */
+static void undo_invert(MapOp *op, MapOp *inverse)
+{
+    *inverse = *op;
+
+    switch (op->type)
+    {
+    case MAP_OP_MAP_NEW:     inverse->type = MAP_OP_MAP_DELETE;  break;
+    case MAP_OP_MAP_DELETE:  inverse->type = MAP_OP_MAP_NEW;     break;
+    case MAP_OP_NODE_NEW:    inverse->type = MAP_OP_NODE_DELETE; break;
+    case MAP_OP_NODE_DELETE: inverse->type = MAP_OP_NODE_NEW;    break;
+    case MAP_OP_LINK:        inverse->type = MAP_OP_UNLINK;      break;
+    case MAP_OP_UNLINK:      inverse->type = MAP_OP_LINK;        break;
+
+    case MAP_OP_MOVE:
+        inverse->x = -op->x;
+        inverse->y = -op->y;
+        break;
+
+    case MAP_OP_PLAYER:
+        inverse->node = op->other;
+        inverse->other = op->node;
+        break;
+
+    case MAP_OP_EDGE:  inverse->x = op->old;            break;
+    case MAP_OP_COST:  inverse->y = op->old;            break;
+    case MAP_OP_ROOM:  inverse->other = op->old;        break;
+    case MAP_OP_INFO:  inverse->text = op->old_text;    break;
+    }
+}
+
+static gboolean undo_idle(AutoMap *automap)
+{
+    automap->undo->idle = 0;
+
+    return FALSE;
+}
+
+static void undo_group_end(MapUndo *undo)
+{
+    if (undo->idle)
+        gtk_idle_remove(undo->idle);
+
+    undo->idle = 0;
+}
+
+/* Put group on top of done
+ */
+static void undo_done_push(MapUndo *undo, UndoGroup *group)
+{
+    undo->done = g_list_prepend(undo->done, group);
+
+    if (undo->oldest == NULL)
+        undo->oldest = undo->done;
+}
+
+/* Keep op for undoing. Called by map_record()
+ */
+void map_undo_record(AutoMap *automap, MapOp *op)
+{
+    MapUndo *undo = automap->undo;
+    UndoGroup *group;
+    MapOp inverse;
+
+    if (undo == NULL)
+        undo = automap->undo = g_malloc0(sizeof(MapUndo));
+
+    if (undo->applying)
+        return;
+
+    /* Doing something new loses what was undone */
+    undo_groups_free(undo, undo->undone);
+    undo->undone = NULL;
+
+    if (undo->idle == 0 || undo->done == NULL)
+    {
+        undo_done_push(undo, g_malloc0(sizeof(UndoGroup)));
+        undo->idle = gtk_idle_add((GtkFunction)undo_idle, automap);
+    }
+
+    group = undo->done->data;
+
+    undo_invert(op, &inverse);
+    group->steps = g_slist_prepend(group->steps, undo_step(op, &inverse));
+    group->count++;
+    undo->steps++;
+
+    /* Forget the oldest groups, but never the one being recorded */
+    while (undo->steps > MAP_UNDO_STEPS && undo->done->next)
+    {
+        GList *last = undo->oldest;
+
+        undo->oldest = last->prev;
+        undo->oldest->next = NULL;
+        undo_group_free(undo, last->data);
+        g_list_free_1(last);
+    }
+}
+
+/* Apply one record of step, the first line (the change) or the second
+ * (its inverse)
+ */
+static void undo_apply(AutoMap *automap, UndoStep *step, gboolean inverse,
+                       GSList **maps)
+{
+    gchar *line = g_strdup(inverse ? strchr(step, '\n') + 1 : step);
+    MapNode *node;
+    guint32 seq;
+    MapOp op;
+
+    if (!map_op_parse(line, &op, &seq) || !map_op_apply(automap, &op))
+    {
+        g_warning("map_undo: could not apply %s", line);
+        g_free(line);
+        return;
+    }
+
+    map_record(automap, &op);
+
+    /* Remember which maps need their trails and extents fixing up */
+    if ((node = map_node_lookup(automap, op.node)) != NULL &&
+        !g_slist_find(*maps, node->map))
+        *maps = g_slist_prepend(*maps, node->map);
+
+    if (op.type == MAP_OP_UNLINK || op.type == MAP_OP_LINK)
+        if ((node = map_node_lookup(automap, op.other)) != NULL &&
+            !g_slist_find(*maps, node->map))
+            *maps = g_slist_prepend(*maps, node->map);
+
+    g_free(line);
+}
+
+static void undo_tidy(AutoMap *automap, GSList *maps)
+{
+    GSList *puck;
+
+    for (puck = maps; puck != NULL; puck = puck->next)
+    {
+        Map *map = puck->data;
+
+        /* Undoing may have taken a map away altogether */
+        if (!g_list_find(MapList, map))
+            continue;
+
+        map_nodelist_rebuild(map);
+        map_extents_rebuild(map);
+    }
+
+    g_slist_free(maps);
+
+    if (automap->player)
+        automap->map = automap->player->map;
+}
+
+/* Take back the last group of changes. FALSE if there were none
+ */
+gboolean map_undo(AutoMap *automap)
+{
+    MapUndo *undo = automap->undo;
+    UndoGroup *group;
+    GSList *puck, *maps = NULL;
+    GList *link;
+
+    if (undo == NULL || undo->done == NULL)
+        return FALSE;
+
+    undo_group_end(undo);
+
+    link = undo->done;
+    group = link->data;
+    undo->done = g_list_remove_link(undo->done, link);
+    g_list_free_1(link);
+
+    if (undo->done == NULL)
+        undo->oldest = NULL;
+
+    undo->applying = TRUE;
+
+    for (puck = group->steps; puck != NULL; puck = puck->next)
+        undo_apply(automap, puck->data, TRUE, &maps);
+
+    undo->applying = FALSE;
+
+    /* Redone first change first */
+    group->steps = g_slist_reverse(group->steps);
+    undo->undone = g_list_prepend(undo->undone, group);
+    undo_tidy(automap, maps);
+
+    return TRUE;
+}
+
+/* Make the last group of changes undone again
+ */
+gboolean map_redo(AutoMap *automap)
+{
+    MapUndo *undo = automap->undo;
+    UndoGroup *group;
+    GSList *puck, *maps = NULL;
+    GList *link;
+
+    if (undo == NULL || undo->undone == NULL)
+        return FALSE;
+
+    undo_group_end(undo);
+
+    link = undo->undone;
+    group = link->data;
+    undo->undone = g_list_remove_link(undo->undone, link);
+    g_list_free_1(link);
+
+    undo->applying = TRUE;
+
+    for (puck = group->steps; puck != NULL; puck = puck->next)
+        undo_apply(automap, puck->data, FALSE, &maps);
+
+    undo->applying = FALSE;
+
+    group->steps = g_slist_reverse(group->steps);
+    undo_done_push(undo, group);
+    undo_tidy(automap, maps);
+
+    return TRUE;
+}
+
+void map_undo_free(AutoMap *automap)
+{
+    MapUndo *undo = automap->undo;
+
+    if (undo == NULL)
+        return;
+
+    undo_group_end(undo);
+    undo_groups_free(undo, undo->done);
+    undo_groups_free(undo, undo->undone);
+    g_free(undo);
+    automap->undo = NULL;
+}
+
+#endif /* WITHOUT_MAPPER */
@@ -0,0 +1,581 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Timings for the automapper on big made up maps, built with
+ * `make mapbench'.
+ *
+ * Maps of each kind and size asked for are written to files in the
+ * format load_automap_from_file() reads, and then loaded, drawn at
+ * each zoom, clicked on, routed across and saved again, with how long
+ * each took printed one line per measurement:
+ *
+ *   kind  nodes  test  zoom  run  count  seconds
+ *
+ * separated by tabs. Lines starting with # are comments. The kinds are
+ *
+ *   grid    rooms on a square grid, linked to all four neighbours
+ *   maze    the same, but only linked along a random spanning tree with
+ *           a few loops added back
+ *   levels  BENCH_LEVELS grids one above the other, with stairs up and
+ *           down between them every BENCH_STAIRS rooms
+ *
+ * Drawing needs an X display, Xvfb will do.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+#ifdef WITHOUT_MAPPER
+
+int main(int argc, char *argv[])
+{
+    fprintf(stderr, "mapbench: amcl was configured without the mapper\n");
+    return 1;
+}
+
+#else
+
+#define BENCH_LEVELS 8
+#define BENCH_STAIRS 97
+
+typedef enum { GRID, MAZE, LEVELS } BenchKind;
+
+static gchar *kind_names[] = { "grid", "maze", "levels", NULL };
+
+/* Maze walls knocked through, per room */
+#define OPEN_NORTH 1
+#define OPEN_EAST  2
+
+static gint   hits = 100000;
+static gint   routes = 100;
+static gint   repeats = 3;
+static gchar *dir = NULL;
+static gboolean keep = FALSE;
+
+/*
+ * Making the maps
+ */
+static void bench_node(FILE *file, gint id, gint x, gint y, gchar *map,
+                       gint links[10])
+{
+    gint i;
+
+    fprintf(file, "%d (%d, %d) %s ", id, x, y, map);
+
+    for (i = 0; i < 10; i++)
+        fprintf(file, "%s %d ", direction[i], links[i]);
+
+    fputc('\n', file);
+}
+
+/* Write one level of width rooms to a row, count rooms in all, numbered
+ * from base. open says which ways are linked, NULL for all of them.
+ * Every stairs'th room goes up to the same room on the level above,
+ * and down from the one below, if there are such levels
+ */
+static void bench_level(FILE *file, gchar *map, gint base, gint count,
+                        gint width, guint8 *open, gint stairs,
+                        gboolean up, gboolean down)
+{
+    gint links[10], i, x, y;
+
+    for (i = 0; i < count; i++)
+    {
+        x = i % width;
+        y = i / width;
+
+        memset(links, 0xff, sizeof(links));
+
+        if (i + width < count && (!open || open[i] & OPEN_NORTH))
+            links[NORTH] = base + i + width;
+
+        if (x + 1 < width && i + 1 < count && (!open || open[i] & OPEN_EAST))
+            links[EAST] = base + i + 1;
+
+        if (y > 0 && (!open || open[i - width] & OPEN_NORTH))
+            links[SOUTH] = base + i - width;
+
+        if (x > 0 && (!open || open[i - 1] & OPEN_EAST))
+            links[WEST] = base + i - 1;
+
+        if (stairs && i % stairs == 0)
+        {
+            if (up)
+                links[UP] = base + count + i;
+
+            if (down)
+                links[DOWN] = base - count + i;
+        }
+
+        bench_node(file, base + i, x, y, map, links);
+    }
+}
+
+/* Knock through the walls of a maze of count rooms width to a row,
+ * leaving a spanning tree (so every room can be reached), then knock
+ * through one wall in twenty more to make some loops
+ */
+static guint8 *bench_maze(gint count, gint width)
+{
+    guint8 *open = g_malloc0(count), *seen = g_malloc0(count);
+    gint *stack = g_new(gint, count), depth = 0, i;
+
+    seen[0] = TRUE;
+    stack[depth++] = 0;
+
+    while (depth)
+    {
+        gint room = stack[depth - 1], next[4], ways = 0, to;
+
+        if (room + width < count && !seen[room + width])
+            next[ways++] = room + width;
+
+        if (room % width + 1 < width && room + 1 < count && !seen[room + 1])
+            next[ways++] = room + 1;
+
+        if (room >= width && !seen[room - width])
+            next[ways++] = room - width;
+
+        if (room % width > 0 && !seen[room - 1])
+            next[ways++] = room - 1;
+
+        if (ways == 0)
+        {
+            depth--;
+            continue;
+        }
+
+        to = next[rand() % ways];
+
+        if (to == room + width)      open[room] |= OPEN_NORTH;
+        else if (to == room + 1)     open[room] |= OPEN_EAST;
+        else if (to == room - width) open[to] |= OPEN_NORTH;
+        else                         open[to] |= OPEN_EAST;
+
+        seen[to] = TRUE;
+        stack[depth++] = to;
+    }
+
+    for (i = 0; i < count; i++)
+        if (rand() % 20 == 0)
+            open[i] |= rand() & 1 ? OPEN_NORTH : OPEN_EAST;
+
+    g_free(seen);
+    g_free(stack);
+
+    return open;
+}
+
+static gboolean bench_write(gchar *filename, BenchKind kind, gint nodes)
+{
+    FILE *file = fopen(filename, "w");
+    gint levels = kind == LEVELS ? BENCH_LEVELS : 1;
+    gint count = (nodes + levels - 1) / levels;
+    gint width = (gint)ceil(sqrt(count));
+    guint8 *open;
+    gchar map[32];
+    gint l;
+
+    if (file == NULL)
+    {
+        g_warning("mapbench: Could not open %s for writing: %s\n",
+                  filename, g_strerror(errno));
+        return FALSE;
+    }
+
+    open = kind == MAZE ? bench_maze(count, width) : NULL;
+
+    fprintf(file, "automap map %s0 player 0 zoom 1.00, center (0, 0) journal 0\n",
+            kind_names[kind]);
+
+    for (l = 0; l < levels; l++)
+        fprintf(file, "map %s%d min_x 0 min_y 0 max_x %d max_y %d nodelist %d \n",
+                kind_names[kind], l, width - 1, (count - 1) / width, l * count);
+
+    for (l = 0; l < levels; l++)
+    {
+        g_snprintf(map, 32, "%s%d", kind_names[kind], l);
+        bench_level(file, map, l * count, count, width, open,
+                    kind == LEVELS ? BENCH_STAIRS : 0, l + 1 < levels, l > 0);
+    }
+
+    g_free(open);
+
+    if (fclose(file) != 0)
+    {
+        g_warning("mapbench: Could not write %s: %s\n", filename, g_strerror(errno));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Timing
+ */
+static void bench_report(BenchKind kind, gint nodes, gchar *test, gfloat zoom,
+                         gint run, gint count, GTimer *timer)
+{
+    gchar z[16];
+
+    if (zoom > 0)
+        g_snprintf(z, 16, "%g", zoom);
+    else
+        strcpy(z, "-");
+
+    printf("%s\t%d\t%s\t%s\t%d\t%d\t%.6f\n", kind_names[kind], nodes, test, z,
+           run, count, g_timer_elapsed(timer, NULL));
+    fflush(stdout);
+}
+
+static void bench_events(void)
+{
+    while (gtk_events_pending())
+        gtk_main_iteration();
+}
+
+static void bench_unlink(gchar *filename)
+{
+    gchar *name;
+
+    unlink(filename);
+    name = g_strconcat(filename, ".journal", NULL);
+    unlink(name);
+    g_free(name);
+    name = g_strconcat(filename, ".landmarks", NULL);
+    unlink(name);
+    g_free(name);
+}
+
+static void bench_close(AutoMap *automap)
+{
+    free_maps(automap);
+    AutoMapList = g_list_remove(AutoMapList, automap);
+    gtk_widget_destroy(automap->window);
+
+    if (automap->pixmap)
+        gdk_pixmap_unref(automap->pixmap);
+
+    g_hash_table_destroy(automap->ids);
+    g_free(automap);
+    bench_events();
+}
+
+static AutoMap *bench_load(gchar *filename, BenchKind kind, gint nodes,
+                           GTimer *timer)
+{
+    AutoMap *automap = NULL;
+    gint run;
+
+    for (run = 0; run < repeats; run++)
+    {
+        if (automap)
+            bench_close(automap);
+
+        g_timer_start(timer);
+        load_automap_from_file(filename, NULL);
+        g_timer_stop(timer);
+
+        automap = g_list_last(AutoMapList)->data;
+        bench_report(kind, nodes, "load", 0, run,
+                     g_hash_table_size(automap->ids), timer);
+    }
+
+    /* The window has to be up before anything can be drawn */
+    while (automap->pixmap == NULL)
+        gtk_main_iteration();
+
+    return automap;
+}
+
+static void bench_draw(AutoMap *automap, BenchKind kind, gint nodes,
+                       gfloat zoom, GTimer *timer)
+{
+    gint run;
+
+    automap->zoom = zoom;
+    automap->x = automap->player->x;
+    automap->y = automap->player->y;
+
+    for (run = 0; run < repeats; run++)
+    {
+        /* Nothing drawn before */
+        map_tile_flush(automap);
+        gdk_flush();
+
+        g_timer_start(timer);
+        draw_map(automap);
+        gdk_flush();
+        g_timer_stop(timer);
+        bench_report(kind, nodes, "draw", zoom, run, 1, timer);
+
+        /* Everything drawn before */
+        g_timer_start(timer);
+        draw_map(automap);
+        gdk_flush();
+        g_timer_stop(timer);
+        bench_report(kind, nodes, "redraw", zoom, run, 1, timer);
+    }
+}
+
+static void bench_hit(AutoMap *automap, BenchKind kind, gint nodes,
+                      gfloat zoom, GTimer *timer)
+{
+    struct win_scale ws;
+    gint *at = g_new(gint, hits * 2);
+    gint run, i;
+
+    automap->zoom = zoom;
+    automap->x = automap->player->x;
+    automap->y = automap->player->y;
+    ws = *map_coords(automap);
+
+    /* Where to click, worked out before the clock starts */
+    for (i = 0; i < hits; i++)
+    {
+        at[i * 2] = rand() % ws.width;
+        at[i * 2 + 1] = rand() % ws.height;
+    }
+
+    for (run = 0; run < repeats; run++)
+    {
+        g_timer_start(timer);
+
+        for (i = 0; i < hits; i++)
+            map_node_at(automap, &ws, at[i * 2], at[i * 2 + 1]);
+
+        g_timer_stop(timer);
+        bench_report(kind, nodes, "hit", zoom, run, hits, timer);
+    }
+
+    g_free(at);
+}
+
+static void collect_node(gpointer id, MapNode *node, GPtrArray *all)
+{
+    g_ptr_array_add(all, node);
+}
+
+/* What node_goto() does, without printing the way */
+static void bench_goto(AutoMap *automap, BenchKind kind, gint nodes,
+                       GTimer *timer)
+{
+    GPtrArray *all = g_ptr_array_new();
+    gint run, i;
+
+    g_hash_table_foreach(automap->ids, (GHFunc)collect_node, all);
+
+    /* Working out the landmarks is timed on its own, it only happens
+     * once for a map
+     */
+    g_timer_start(timer);
+
+    while (map_landmarks(automap) == NULL && automap->landmark_job)
+        gtk_main_iteration();
+
+    g_timer_stop(timer);
+    bench_report(kind, nodes, "landmarks", 0, 0, 1, timer);
+
+    for (run = 0; run < repeats; run++)
+    {
+        g_timer_start(timer);
+
+        for (i = 0; i < routes; i++)
+        {
+            MapNode *from = g_ptr_array_index(all, rand() % all->len);
+            MapNode *to = g_ptr_array_index(all, rand() % all->len);
+
+            g_list_free(map_route(automap, from, to));
+        }
+
+        g_timer_stop(timer);
+        bench_report(kind, nodes, "goto", 0, run, routes, timer);
+    }
+
+    g_ptr_array_free(all, TRUE);
+}
+
+static void bench_save(AutoMap *automap, gchar *filename, BenchKind kind,
+                       gint nodes, GTimer *timer)
+{
+    gint run;
+
+    for (run = 0; run < repeats; run++)
+    {
+        g_timer_start(timer);
+        save_maps(filename, automap);
+
+        /* Wait for the snapshot to be written */
+        map_journal_close(automap->journal);
+        automap->journal = NULL;
+        g_timer_stop(timer);
+
+        bench_report(kind, nodes, "save", 0, run, nodes, timer);
+    }
+
+    if (!keep)
+        bench_unlink(filename);
+}
+
+static void bench(BenchKind kind, gint nodes, gfloat *zooms)
+{
+    GTimer *timer = g_timer_new();
+    gchar *filename, *saved;
+    AutoMap *automap;
+    gint i;
+
+    filename = g_strdup_printf("%s/mapbench-%s-%d.map", dir, kind_names[kind], nodes);
+    saved = g_strdup_printf("%s/mapbench-%s-%d.saved", dir, kind_names[kind], nodes);
+
+    g_timer_start(timer);
+
+    if (!bench_write(filename, kind, nodes))
+    {
+        g_free(filename);
+        g_free(saved);
+        g_timer_destroy(timer);
+        return;
+    }
+
+    g_timer_stop(timer);
+    bench_report(kind, nodes, "generate", 0, 0, nodes, timer);
+
+    automap = bench_load(filename, kind, nodes, timer);
+
+    for (i = 0; zooms[i] > 0; i++)
+        bench_draw(automap, kind, nodes, zooms[i], timer);
+
+    for (i = 0; zooms[i] > 0; i++)
+        bench_hit(automap, kind, nodes, zooms[i], timer);
+
+    bench_goto(automap, kind, nodes, timer);
+    bench_save(automap, saved, kind, nodes, timer);
+    bench_close(automap);
+
+    if (!keep)
+        bench_unlink(filename);
+
+    g_free(filename);
+    g_free(saved);
+    g_timer_destroy(timer);
+}
+
+/*
+ * Options
+ */
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: mapbench [options]\n"
+            "  -k kinds    grid, maze and/or levels (grid,maze,levels)\n"
+            "  -n sizes    rooms per map (10000,100000,1000000)\n"
+            "  -z zooms    zooms to draw at (0.5,1,4,16,40)\n"
+            "  -r repeats  times to repeat each test (3)\n"
+            "  -c hits     clicks per hit test (100000)\n"
+            "  -g routes   routes per goto test (100)\n"
+            "  -s seed     for the random numbers (1)\n"
+            "  -d dir      where to write the maps (/tmp)\n"
+            "  -K          keep the map files\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    gchar *kinds = "grid,maze,levels", *sizes = "10000,100000,1000000";
+    gchar *zoomlist = "0.5,1,4,16,40", **k, **n, **z;
+    gfloat *zooms;
+    gint c, i, j, nz;
+
+    gtk_init(&argc, &argv);
+    srand(1);
+
+    while ((c = getopt(argc, argv, "k:n:z:r:c:g:s:d:K")) != -1)
+    {
+        switch (c)
+        {
+        case 'k': kinds = optarg;              break;
+        case 'n': sizes = optarg;              break;
+        case 'z': zoomlist = optarg;           break;
+        case 'r': repeats = MAX(atoi(optarg), 1); break;
+        case 'c': hits = MAX(atoi(optarg), 1);    break;
+        case 'g': routes = MAX(atoi(optarg), 1);  break;
+        case 's': srand(atoi(optarg));         break;
+        case 'd': dir = optarg;                break;
+        case 'K': keep = TRUE;                 break;
+        default:  usage();
+        }
+    }
+
+    if (optind < argc)
+        usage();
+
+    if (dir == NULL)
+        dir = g_get_tmp_dir();
+
+    k = g_strsplit(kinds, ",", 0);
+    n = g_strsplit(sizes, ",", 0);
+    z = g_strsplit(zoomlist, ",", 0);
+
+    for (nz = 0; z[nz]; nz++)
+        ;
+
+    zooms = g_new0(gfloat, nz + 1);
+
+    for (i = 0; i < nz; i++)
+        zooms[i] = CLAMP(atof(z[i]), MAP_ZOOM_MIN, MAP_ZOOM_MAX);
+
+    printf("# kind\tnodes\ttest\tzoom\trun\tcount\tseconds\n");
+
+    for (i = 0; k[i]; i++)
+    {
+        for (c = 0; kind_names[c]; c++)
+            if (!strcmp(k[i], kind_names[c]))
+                break;
+
+        if (kind_names[c] == NULL)
+        {
+            fprintf(stderr, "mapbench: unknown kind of map %s\n", k[i]);
+            usage();
+        }
+
+        for (j = 0; n[j]; j++)
+            if (atoi(n[j]) > 0)
+                bench(c, atoi(n[j]), zooms);
+    }
+
+    g_strfreev(k);
+    g_strfreev(n);
+    g_strfreev(z);
+    g_free(zooms);
+
+    return 0;
+}
+
+#endif /* WITHOUT_MAPPER */
@@ -0,0 +1,165 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* amcl-mapmerge, merges one map file into another without a display:
+ *
+ *   amcl-mapmerge [-n] ours theirs [output]
+ *
+ * What is in theirs and not in ours is added, as the Merge button of
+ * the automap window does (see map_merge.c), and the result written to
+ * output, or the standard output. What was done and every conflict is
+ * reported on the standard error. With -n nothing is written, and the
+ * report goes to the standard output instead.
+ *
+ * Only the map files are read, not their journals: save the maps from
+ * the client first.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+
+#include "map.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+#ifdef WITHOUT_MAPPER
+
+int main(int argc, char *argv[])
+{
+    fprintf(stderr, "amcl-mapmerge: amcl was configured without the mapper\n");
+    return 1;
+}
+
+#else
+
+static AutoMap *merge_read(gchar *filename)
+{
+    AutoMap *automap;
+    guint32 seq;
+    FILE *file;
+
+    if ((file = fopen(filename, "r")) == NULL)
+    {
+        fprintf(stderr, "amcl-mapmerge: %s: %s\n", filename, g_strerror(errno));
+        return NULL;
+    }
+
+    automap = g_malloc0(sizeof(AutoMap));
+    automap->ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    automap->zoom = 1;
+
+    MapList = map_read(file, automap, &seq);
+    fclose(file);
+
+    return automap;
+}
+
+static gboolean merge_write(AutoMap *automap, gchar *filename)
+{
+    GString *out = g_string_new("");
+    FILE *file;
+    gboolean ok;
+
+    if (automap->map == NULL)
+    {
+        fprintf(stderr, "amcl-mapmerge: no maps to write\n");
+        g_string_free(out, TRUE);
+        return FALSE;
+    }
+
+    map_write(out, automap, 0);
+
+    if (!strcmp(filename, "-"))
+        file = stdout;
+    else if ((file = fopen(filename, "w")) == NULL)
+    {
+        fprintf(stderr, "amcl-mapmerge: %s: %s\n", filename, g_strerror(errno));
+        g_string_free(out, TRUE);
+        return FALSE;
+    }
+
+    ok = fwrite(out->str, 1, out->len, file) == out->len;
+
+    if (file != stdout)
+        ok = (fclose(file) == 0) && ok;
+    else
+        ok = (fflush(file) == 0) && ok;
+
+    if (!ok)
+        fprintf(stderr, "amcl-mapmerge: %s: %s\n", filename, g_strerror(errno));
+
+    g_string_free(out, TRUE);
+
+    return ok;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: amcl-mapmerge [-n] ours theirs [output]\n"
+            "  -n          only report what merging would do\n"
+            "output may be - for the standard output (the default)\n"
+            "journals are not read, save the maps from amcl first\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    AutoMap *automap;
+    GString *report;
+    gboolean apply = TRUE, ok;
+    gchar *output = "-";
+    gint c;
+
+    while ((c = getopt(argc, argv, "n")) != -1)
+    {
+        switch (c)
+        {
+        case 'n': apply = FALSE; break;
+        default:  usage();
+        }
+    }
+
+    if (argc - optind != 2 && argc - optind != 3)
+        usage();
+
+    if (argc - optind == 3)
+        output = argv[optind + 2];
+
+    if ((automap = merge_read(argv[optind])) == NULL)
+        return 1;
+
+    if ((report = map_merge_file(automap, argv[optind + 1], apply)) == NULL)
+        return 1;
+
+    fputs(report->str, apply ? stderr : stdout);
+    g_string_free(report, TRUE);
+
+    ok = !apply || merge_write(automap, output);
+
+    return ok ? 0 : 1;
+}
+
+#endif /* WITHOUT_MAPPER */
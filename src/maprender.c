@@ -0,0 +1,1035 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* amcl-maprender, draws one map of a map file to a PNG or SVG file
+ * without a display:
+ *
+ *   amcl-maprender [-m map] [-u unit] [-t tile] [-j threads]
+ *                  [-f png|svg] mapfile output
+ *
+ * Rooms are drawn as in the automap window: a box per room, lines
+ * between linked rooms, arrows for the ways up and down, rooms the
+ * player can't get to greyed, and a dot on the room the player is in.
+ * unit is how many pixels apart rooms are.
+ *
+ * The picture is cut into bands tile pixels high. For PNG files the
+ * bands are drawn by threads threads, at most two bands each at a time,
+ * and written out in order as they are finished, so the whole picture
+ * is never in memory at once. SVG files are written band by band too.
+ *
+ * Only glib is used, and zlib to compress the PNG file if configure
+ * found it; without it, the image data is stored uncompressed.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+static char const rcsid[] =
+    "$Id$";
+
+#define RENDER_NONE ((guint32) -1)
+#define RENDER_DIRS 10
+#define RENDER_UP   8
+#define RENDER_DOWN 9
+
+#define GREY 0xc0
+
+typedef struct {
+    gint32  x, y;
+    guint32 id;
+    gint    map;
+    guint32 link[RENDER_DIRS];  /* Node ids, RENDER_NONE for no link */
+} RenderNode;
+
+typedef struct {
+
+    /* From the map file */
+    gchar      *current;        /* Map the automap was showing      */
+    guint32     player;
+    GHashTable *maps;           /* Name -> number + 1               */
+    RenderNode *nodes;
+    guint       count, size;
+    gint       *index;          /* Node id -> place in nodes, or -1 */
+    guint       index_size;
+
+    /* What to draw */
+    gint        map;
+    gint        unit, half, tile;
+    gint        min_x, max_y;
+    gint        width, height;
+    guint       bands;
+    guint      *band_start;     /* Where each band's rooms start in */
+    guint      *band_nodes;     /* this list                        */
+    guint8     *reachable;
+    guint       player_node;
+} Render;
+
+/*
+ * Reading the map file
+ */
+static RenderNode *render_lookup(Render *r, guint32 id)
+{
+    if (id >= r->index_size || r->index[id] < 0)
+        return NULL;
+
+    return &r->nodes[r->index[id]];
+}
+
+/* A room, as written by write_node() in map.c */
+static gboolean render_node(Render *r, gchar *line)
+{
+    RenderNode *node;
+    gchar *p = line, *name;
+    gint i, map;
+
+    if (r->count == r->size)
+    {
+        r->size = r->size ? r->size * 2 : 4096;
+        r->nodes = g_realloc(r->nodes, r->size * sizeof(RenderNode));
+    }
+
+    node = &r->nodes[r->count];
+    node->id = strtoul(p, &p, 10);
+
+    while (*p == ' ' || *p == '(') p++;
+    node->x = strtol(p, &p, 10);
+
+    while (*p == ' ' || *p == ',') p++;
+    node->y = strtol(p, &p, 10);
+
+    while (*p == ' ' || *p == ')') p++;
+
+    for (name = p; *p && *p != ' ' && *p != '\n'; p++)
+        ;
+
+    if (*p == '\0')
+        return FALSE;
+
+    *p++ = '\0';
+
+    if ((map = GPOINTER_TO_INT(g_hash_table_lookup(r->maps, name))) == 0)
+        return FALSE;
+
+    node->map = map - 1;
+
+    for (i = 0; i < RENDER_DIRS; i++)
+    {
+        glong link;
+
+        /* The direction name, then the room it leads to */
+        while (*p == ' ') p++;
+        while (*p && *p != ' ') p++;
+
+        link = strtol(p, &p, 10);
+        node->link[i] = link < 0 ? RENDER_NONE : (guint32)link;
+    }
+
+    if (node->id >= r->index_size)
+    {
+        guint size = r->index_size;
+
+        r->index_size = MAX(node->id + 1, r->index_size * 2);
+        r->index = g_realloc(r->index, r->index_size * sizeof(gint));
+        memset(r->index + size, 0xff, (r->index_size - size) * sizeof(gint));
+    }
+
+    r->index[node->id] = r->count++;
+
+    return TRUE;
+}
+
+static gboolean render_read(Render *r, gchar *filename)
+{
+    FILE *file = fopen(filename, "r");
+    gchar buf[BUFSIZ], name[BUFSIZ];
+    guint line = 0;
+
+    if (file == NULL)
+    {
+        g_warning("amcl-maprender: Could not open %s for reading: %s\n",
+                  filename, g_strerror(errno));
+        return FALSE;
+    }
+
+    r->maps = g_hash_table_new(g_str_hash, g_str_equal);
+
+    while (fgets(buf, BUFSIZ, file) != NULL)
+    {
+        line++;
+
+        /* The automap itself */
+        if (line == 1)
+        {
+            if (sscanf(buf, "automap map %s player %u", name, &r->player) != 2)
+                break;
+
+            r->current = g_strdup(name);
+            continue;
+        }
+
+        /* What is known about a room, and what links cost, don't matter */
+        if (buf[0] == ' ' || !strncmp(buf, "costs ", 6))
+            continue;
+
+        if (!strncmp(buf, "map ", 4))
+        {
+            if (sscanf(buf, "map %s", name) == 1)
+                g_hash_table_insert(r->maps, g_strdup(name),
+                                    GINT_TO_POINTER(g_hash_table_size(r->maps) + 1));
+            continue;
+        }
+
+        if (!render_node(r, buf))
+            break;
+    }
+
+    if (!feof(file))
+    {
+        g_warning("amcl-maprender: %s: line %u is damaged\n", filename, line);
+        fclose(file);
+        return FALSE;
+    }
+
+    fclose(file);
+    return TRUE;
+}
+
+/* The rooms in the player's part of the map, or maps
+ */
+static guint render_find(guint *group, guint n)
+{
+    while (group[n] != n)
+        n = group[n] = group[group[n]];
+
+    return n;
+}
+
+static void render_reachable(Render *r)
+{
+    guint *group = g_new(guint, r->count), i, d, player;
+    RenderNode *node, *other;
+
+    for (i = 0; i < r->count; i++)
+        group[i] = i;
+
+    for (i = 0; i < r->count; i++)
+        for (d = 0, node = &r->nodes[i]; d < RENDER_DIRS; d++)
+            if ((other = render_lookup(r, node->link[d])) != NULL)
+                group[render_find(group, i)] = render_find(group, other - r->nodes);
+
+    r->reachable = g_malloc0(r->count);
+    node = render_lookup(r, r->player);
+    r->player_node = node ? node - r->nodes : RENDER_NONE;
+
+    if (node)
+    {
+        player = render_find(group, r->player_node);
+
+        for (i = 0; i < r->count; i++)
+            r->reachable[i] = render_find(group, i) == player;
+    }
+
+    g_free(group);
+}
+
+/*
+ * Laying the picture out
+ */
+static void render_point(Render *r, RenderNode *node, gint *x, gint *y)
+{
+    *x = (node->x - r->min_x) * r->unit + r->unit / 2;
+    *y = (r->max_y - node->y) * r->unit + r->unit / 2;
+}
+
+/* The rows the room and the lines out of it cover */
+static void render_rows(Render *r, RenderNode *node, gint *y1, gint *y2)
+{
+    RenderNode *other;
+    gint x, y, d;
+
+    render_point(r, node, &x, y1);
+    *y2 = *y1;
+
+    for (d = 0; d < 8; d++)
+    {
+        if ((other = render_lookup(r, node->link[d])) == NULL ||
+            other->map != node->map)
+            continue;
+
+        render_point(r, other, &x, &y);
+        *y1 = MIN(*y1, y);
+        *y2 = MAX(*y2, y);
+    }
+
+    *y1 = MAX(*y1 - r->half - 1, 0) / r->tile;
+    *y2 = MIN(*y2 + r->half + 1, r->height - 1) / r->tile;
+}
+
+/* Work out how big the picture is, and which rooms each band needs
+ */
+static gboolean render_layout(Render *r, gchar *mapname)
+{
+    gint map = GPOINTER_TO_INT(g_hash_table_lookup(r->maps, mapname));
+    gint min_x = G_MAXINT, min_y = G_MAXINT, max_x = G_MININT, max_y = G_MININT;
+    guint i, b, *fill;
+    gint y1, y2;
+
+    if (map == 0)
+    {
+        g_warning("amcl-maprender: there is no map called %s\n", mapname);
+        return FALSE;
+    }
+
+    r->map = map - 1;
+
+    for (i = 0; i < r->count; i++)
+    {
+        RenderNode *node = &r->nodes[i];
+
+        if (node->map != r->map)
+            continue;
+
+        min_x = MIN(min_x, node->x);
+        max_x = MAX(max_x, node->x);
+        min_y = MIN(min_y, node->y);
+        max_y = MAX(max_y, node->y);
+    }
+
+    if (min_x > max_x)
+    {
+        g_warning("amcl-maprender: map %s has no rooms\n", mapname);
+        return FALSE;
+    }
+
+    r->half = MAX(r->unit / 4, 1);
+    r->min_x = min_x;
+    r->max_y = max_y;
+    r->width = (max_x - min_x + 1) * r->unit;
+    r->height = (max_y - min_y + 1) * r->unit;
+    r->bands = (r->height + r->tile - 1) / r->tile;
+
+    /* Count the rooms in each band, then fill them in */
+    r->band_start = g_new0(guint, r->bands + 1);
+
+    for (i = 0; i < r->count; i++)
+    {
+        if (r->nodes[i].map != r->map)
+            continue;
+
+        render_rows(r, &r->nodes[i], &y1, &y2);
+
+        for (b = y1; b <= y2; b++)
+            r->band_start[b + 1]++;
+    }
+
+    for (b = 0; b < r->bands; b++)
+        r->band_start[b + 1] += r->band_start[b];
+
+    r->band_nodes = g_new(guint, r->band_start[r->bands]);
+    fill = g_memdup(r->band_start, r->bands * sizeof(guint));
+
+    for (i = 0; i < r->count; i++)
+    {
+        if (r->nodes[i].map != r->map)
+            continue;
+
+        render_rows(r, &r->nodes[i], &y1, &y2);
+
+        for (b = y1; b <= y2; b++)
+            r->band_nodes[fill[b]++] = i;
+    }
+
+    g_free(fill);
+    return TRUE;
+}
+
+/*
+ * Drawing a band of rows
+ */
+typedef struct {
+    guchar *pixels;
+    gint    width, top, rows;
+} RenderBand;
+
+static inline void band_plot(RenderBand *band, gint x, gint y, guchar shade)
+{
+    if (x >= 0 && x < band->width && y >= band->top && y < band->top + band->rows)
+        memset(band->pixels + ((y - band->top) * band->width + x) * 3, shade, 3);
+}
+
+static void band_line(RenderBand *band, gint x1, gint y1, gint x2, gint y2)
+{
+    gint dx = ABS(x2 - x1), dy = -ABS(y2 - y1);
+    gint sx = x1 < x2 ? 1 : -1, sy = y1 < y2 ? 1 : -1, err = dx + dy;
+
+    /* Nothing of it in this band */
+    if (MAX(y1, y2) < band->top || MIN(y1, y2) >= band->top + band->rows)
+        return;
+
+    for (;;)
+    {
+        band_plot(band, x1, y1, 0);
+
+        if (x1 == x2 && y1 == y2)
+            break;
+
+        if (err * 2 >= dy) { err += dy; x1 += sx; }
+        if (err * 2 <= dx) { err += dx; y1 += sy; }
+    }
+}
+
+/* As gdk_draw_rectangle(), filled rectangles are a pixel smaller */
+static void band_box(RenderBand *band, gint x, gint y, gint w, gint h,
+                     gboolean filled, guchar shade)
+{
+    gint i, j;
+
+    if (filled)
+    {
+        for (j = y; j < y + h; j++)
+            for (i = x; i < x + w; i++)
+                band_plot(band, i, j, shade);
+        return;
+    }
+
+    band_line(band, x, y, x + w, y);
+    band_line(band, x, y + h, x + w, y + h);
+    band_line(band, x, y, x, y + h);
+    band_line(band, x + w, y, x + w, y + h);
+}
+
+static void band_disc(RenderBand *band, gint x, gint y, gint radius)
+{
+    gint i, j;
+
+    for (j = -radius; j <= radius; j++)
+        for (i = -radius; i <= radius; i++)
+            if (i * i + j * j <= radius * radius)
+                band_plot(band, x + i, y + j, 0);
+}
+
+/* The line from the edge of one room to the edge of the other, as
+ * draw_line() in map.c
+ */
+static void render_link(Render *r, gint *p1, gint *p2)
+{
+    if (p1[0] < p2[0])      { p1[0] += r->half; p2[0] -= r->half; }
+    else if (p1[0] > p2[0]) { p1[0] -= r->half; p2[0] += r->half; }
+
+    if (p1[1] < p2[1])      { p1[1] += r->half; p2[1] -= r->half; }
+    else if (p1[1] > p2[1]) { p1[1] -= r->half; p2[1] += r->half; }
+}
+
+static void render_band(Render *r, guint b, guchar *pixels)
+{
+    RenderBand band;
+    gint p1[2], p2[2], w = r->half;
+    guint i, d;
+
+    band.pixels = pixels;
+    band.width = r->width;
+    band.top = b * r->tile;
+    band.rows = MIN(r->tile, r->height - band.top);
+    memset(pixels, 0xff, band.rows * band.width * 3);
+
+    /* Each line is drawn by the room with the lower number */
+    for (i = r->band_start[b]; i < r->band_start[b + 1]; i++)
+    {
+        RenderNode *node = &r->nodes[r->band_nodes[i]], *other;
+
+        for (d = 0; d < 8; d++)
+        {
+            if ((other = render_lookup(r, node->link[d])) == NULL ||
+                other->map != node->map || other <= node)
+                continue;
+
+            render_point(r, node, &p1[0], &p1[1]);
+            render_point(r, other, &p2[0], &p2[1]);
+            render_link(r, p1, p2);
+            band_line(&band, p1[0], p1[1], p2[0], p2[1]);
+        }
+    }
+
+    /* Then the rooms over them, as draw_dot() */
+    for (i = r->band_start[b]; i < r->band_start[b + 1]; i++)
+    {
+        guint n = r->band_nodes[i];
+        RenderNode *node = &r->nodes[n];
+        gint x, y;
+
+        render_point(r, node, &x, &y);
+        band_box(&band, x - w, y - w, w * 2, w * 2, TRUE,
+                 r->reachable[n] ? 0xff : GREY);
+        band_box(&band, x - w, y - w, w * 2, w * 2, FALSE, 0);
+
+        if (node->link[RENDER_UP] != RENDER_NONE)
+        {
+            band_line(&band, x + w/2, y - w/5*4, x + w/2, y + w/5*4);
+            band_line(&band, x + w/2, y - w/5*4, x + w/5, y - w/5*2);
+            band_line(&band, x + w/2, y - w/5*4, x + w/5*4, y - w/5*2);
+        }
+
+        if (node->link[RENDER_DOWN] != RENDER_NONE)
+        {
+            band_line(&band, x - w/2, y + w/5*4, x - w/2, y - w/5*4);
+            band_line(&band, x - w/2, y + w/5*4, x - w/5, y + w/5*2);
+            band_line(&band, x - w/2, y + w/5*4, x - w/5*4, y + w/5*2);
+        }
+
+        if (n == r->player_node)
+            band_disc(&band, x, y, MAX(r->unit / 8, 2));
+    }
+}
+
+/*
+ * PNG files
+ */
+typedef struct {
+    FILE    *file;
+    guchar   out[65536];    /* Compressed data not yet written */
+    guint    len;
+    guchar  *row;           /* A row with its filter byte      */
+    gboolean failed;
+#ifdef HAVE_LIBZ
+    z_stream z;
+#else
+    guint32  adler;
+#endif
+} RenderPng;
+
+static guint32 crc_table[256];
+
+static void crc_init(void)
+{
+    guint32 c, n, k;
+
+    for (n = 0; n < 256; n++)
+    {
+        for (c = n, k = 0; k < 8; k++)
+            c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+
+        crc_table[n] = c;
+    }
+}
+
+static guint32 crc_update(guint32 crc, guchar *data, guint len)
+{
+    while (len--)
+        crc = crc_table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+    return crc;
+}
+
+static void png_word(guchar *p, guint32 word)
+{
+    p[0] = word >> 24; p[1] = word >> 16; p[2] = word >> 8; p[3] = word;
+}
+
+static void png_chunk(RenderPng *png, gchar *type, guchar *data, guint len)
+{
+    guchar head[8], tail[4];
+    guint32 crc;
+
+    png_word(head, len);
+    memcpy(head + 4, type, 4);
+    crc = crc_update(0xffffffff, head + 4, 4);
+    png_word(tail, crc_update(crc, data, len) ^ 0xffffffff);
+
+    if (fwrite(head, 8, 1, png->file) != 1 ||
+        (len && fwrite(data, len, 1, png->file) != 1) ||
+        fwrite(tail, 4, 1, png->file) != 1)
+        png->failed = TRUE;
+}
+
+static void png_flush(RenderPng *png)
+{
+    if (png->len)
+        png_chunk(png, "IDAT", png->out, png->len);
+
+    png->len = 0;
+}
+
+#ifdef HAVE_LIBZ
+
+static void png_deflate(RenderPng *png, guchar *data, guint len, gint flush)
+{
+    gint ret;
+
+    png->z.next_in = data;
+    png->z.avail_in = len;
+
+    do {
+        png->z.next_out = png->out + png->len;
+        png->z.avail_out = sizeof(png->out) - png->len;
+        ret = deflate(&png->z, flush);
+        png->len = sizeof(png->out) - png->z.avail_out;
+
+        if (png->len == sizeof(png->out))
+            png_flush(png);
+    } while (flush == Z_FINISH ? ret == Z_OK : png->z.avail_in > 0);
+}
+
+static void png_start(RenderPng *png)
+{
+    memset(&png->z, 0, sizeof(png->z));
+    deflateInit(&png->z, Z_BEST_SPEED);
+}
+
+static void png_data(RenderPng *png, guchar *data, guint len)
+{
+    png_deflate(png, data, len, Z_NO_FLUSH);
+}
+
+static void png_finish(RenderPng *png)
+{
+    png_deflate(png, NULL, 0, Z_FINISH);
+    deflateEnd(&png->z);
+    png_flush(png);
+}
+
+#else
+
+/* Without zlib, the data goes in stored deflate blocks */
+static void png_put(RenderPng *png, guchar *data, guint len)
+{
+    while (len)
+    {
+        guint n = MIN(len, sizeof(png->out) - png->len);
+
+        memcpy(png->out + png->len, data, n);
+        png->len += n;
+        data += n;
+        len -= n;
+
+        if (png->len == sizeof(png->out))
+            png_flush(png);
+    }
+}
+
+static void png_start(RenderPng *png)
+{
+    guchar head[2] = { 0x78, 0x01 };
+
+    png->adler = 1;
+    png_put(png, head, 2);
+}
+
+static void png_block(RenderPng *png, guchar *data, guint len, gboolean last)
+{
+    guchar head[5];
+
+    head[0] = last;
+    head[1] = len & 0xff;
+    head[2] = len >> 8;
+    head[3] = ~len & 0xff;
+    head[4] = (~len >> 8) & 0xff;
+    png_put(png, head, 5);
+    png_put(png, data, len);
+}
+
+static void png_data(RenderPng *png, guchar *data, guint len)
+{
+    guint32 a = png->adler & 0xffff, b = png->adler >> 16;
+    guint i;
+
+    for (i = 0; i < len; i++)
+    {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    png->adler = (b << 16) | a;
+
+    while (len)
+    {
+        guint n = MIN(len, 65535);
+
+        png_block(png, data, n, FALSE);
+        data += n;
+        len -= n;
+    }
+}
+
+static void png_finish(RenderPng *png)
+{
+    guchar adler[4];
+
+    png_block(png, NULL, 0, TRUE);
+    png_word(adler, png->adler);
+    png_put(png, adler, 4);
+    png_flush(png);
+}
+
+#endif
+
+static void png_begin(RenderPng *png, Render *r)
+{
+    static guchar signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    guchar ihdr[13];
+
+    crc_init();
+
+    if (fwrite(signature, 8, 1, png->file) != 1)
+        png->failed = TRUE;
+
+    png_word(ihdr, r->width);
+    png_word(ihdr + 4, r->height);
+    ihdr[8] = 8;    /* Bits per sample     */
+    ihdr[9] = 2;    /* RGB                 */
+    ihdr[10] = 0;   /* Deflate             */
+    ihdr[11] = 0;   /* Filters per row     */
+    ihdr[12] = 0;   /* Not interlaced      */
+    png_chunk(png, "IHDR", ihdr, 13);
+    png_start(png);
+
+    /* No filtering */
+    png->row = g_malloc(r->width * 3 + 1);
+    png->row[0] = 0;
+}
+
+static void png_band(RenderPng *png, Render *r, guchar *pixels, guint b)
+{
+    gint rows = MIN(r->tile, r->height - (gint)b * r->tile), y;
+
+    for (y = 0; y < rows; y++)
+    {
+        memcpy(png->row + 1, pixels + y * r->width * 3, r->width * 3);
+        png_data(png, png->row, r->width * 3 + 1);
+    }
+}
+
+static void png_end(RenderPng *png)
+{
+    png_finish(png);
+    png_chunk(png, "IEND", NULL, 0);
+    g_free(png->row);
+}
+
+#ifdef HAVE_LIBPTHREAD
+
+/* Bands are handed out to the threads in order, each drawing into one
+ * of slots buffers, which are written out in order as they are done
+ */
+typedef struct {
+    Render         *r;
+    guint           slots;
+    guchar        **pixels;
+    gboolean       *ready;
+    guint           next;       /* Next band to draw                 */
+    guint           written;    /* Bands written out                 */
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+} RenderQueue;
+
+static void *render_thread(RenderQueue *q)
+{
+    guint b;
+
+    pthread_mutex_lock(&q->lock);
+
+    while ((b = q->next) < q->r->bands)
+    {
+        q->next++;
+
+        /* Wait for the band using the buffer before to be written */
+        while (b >= q->written + q->slots)
+            pthread_cond_wait(&q->cond, &q->lock);
+
+        pthread_mutex_unlock(&q->lock);
+        render_band(q->r, b, q->pixels[b % q->slots]);
+        pthread_mutex_lock(&q->lock);
+
+        q->ready[b % q->slots] = TRUE;
+        pthread_cond_broadcast(&q->cond);
+    }
+
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+static void render_png(Render *r, RenderPng *png, gint threads)
+{
+    pthread_t *thread = g_new(pthread_t, threads);
+    RenderQueue q;
+    guint b;
+    gint i, started;
+
+    memset(&q, 0, sizeof(q));
+    q.r = r;
+    q.slots = threads * 2;
+    q.pixels = g_new(guchar *, q.slots);
+    q.ready = g_new0(gboolean, q.slots);
+    pthread_mutex_init(&q.lock, NULL);
+    pthread_cond_init(&q.cond, NULL);
+
+    for (b = 0; b < q.slots; b++)
+        q.pixels[b] = g_malloc(r->width * r->tile * 3);
+
+    for (started = 0; started < threads; started++)
+        if (pthread_create(&thread[started], NULL,
+                           (void *(*)(void *))render_thread, &q) != 0)
+            break;
+
+    for (b = 0; b < r->bands; b++)
+    {
+        /* No threads at all, do it here */
+        if (started == 0)
+        {
+            render_band(r, b, q.pixels[0]);
+            png_band(png, r, q.pixels[0], b);
+            continue;
+        }
+
+        pthread_mutex_lock(&q.lock);
+
+        while (!q.ready[b % q.slots])
+            pthread_cond_wait(&q.cond, &q.lock);
+
+        pthread_mutex_unlock(&q.lock);
+        png_band(png, r, q.pixels[b % q.slots], b);
+        pthread_mutex_lock(&q.lock);
+
+        q.ready[b % q.slots] = FALSE;
+        q.written++;
+        pthread_cond_broadcast(&q.cond);
+        pthread_mutex_unlock(&q.lock);
+    }
+
+    for (i = 0; i < started; i++)
+        pthread_join(thread[i], NULL);
+
+    for (b = 0; b < q.slots; b++)
+        g_free(q.pixels[b]);
+
+    pthread_mutex_destroy(&q.lock);
+    pthread_cond_destroy(&q.cond);
+    g_free(q.pixels);
+    g_free(q.ready);
+    g_free(thread);
+}
+
+#else
+
+static void render_png(Render *r, RenderPng *png, gint threads)
+{
+    guchar *pixels = g_malloc(r->width * r->tile * 3);
+    guint b;
+
+    for (b = 0; b < r->bands; b++)
+    {
+        render_band(r, b, pixels);
+        png_band(png, r, pixels, b);
+    }
+
+    g_free(pixels);
+}
+
+#endif
+
+static gboolean write_png(Render *r, FILE *file, gint threads)
+{
+    RenderPng *png = g_malloc0(sizeof(RenderPng));
+    gboolean failed;
+
+    png->file = file;
+    png_begin(png, r);
+    render_png(r, png, threads);
+    png_end(png);
+
+    failed = png->failed;
+    g_free(png);
+
+    return !failed;
+}
+
+/*
+ * SVG files. Each room and line is written once, in the band the room
+ * (or the lower numbered room) is in
+ */
+static gboolean write_svg(Render *r, FILE *file)
+{
+    gint p1[2], p2[2], w = r->half;
+    guint b, i, d;
+
+    fprintf(file, "<?xml version=\"1.0\"?>\n"
+            "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\""
+            " viewBox=\"0 0 %d %d\">\n"
+            "<rect width=\"%d\" height=\"%d\" fill=\"white\"/>\n",
+            r->width, r->height, r->width, r->height, r->width, r->height);
+
+    for (b = 0; b < r->bands; b++)
+    {
+        fprintf(file, "<g id=\"band%u\" stroke=\"black\" stroke-width=\"1\">\n", b);
+
+        for (i = r->band_start[b]; i < r->band_start[b + 1]; i++)
+        {
+            guint n = r->band_nodes[i];
+            RenderNode *node = &r->nodes[n], *other;
+            gint x, y;
+
+            render_point(r, node, &x, &y);
+
+            if (y / r->tile != b)
+                continue;
+
+            for (d = 0; d < 8; d++)
+            {
+                if ((other = render_lookup(r, node->link[d])) == NULL ||
+                    other->map != node->map || other <= node)
+                    continue;
+
+                p1[0] = x; p1[1] = y;
+                render_point(r, other, &p2[0], &p2[1]);
+                render_link(r, p1, p2);
+                fprintf(file, "<line x1=\"%d\" y1=\"%d\" x2=\"%d\" y2=\"%d\"/>\n",
+                        p1[0], p1[1], p2[0], p2[1]);
+            }
+
+            fprintf(file, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"%s\"/>\n",
+                    x - w, y - w, w * 2, w * 2,
+                    r->reachable[n] ? "white" : "#c0c0c0");
+
+            if (node->link[RENDER_UP] != RENDER_NONE)
+                fprintf(file, "<path fill=\"none\" d=\"M%d %dV%dM%d %dL%d %dL%d %d\"/>\n",
+                        x + w/2, y + w/5*4, y - w/5*4, x + w/5, y - w/5*2,
+                        x + w/2, y - w/5*4, x + w/5*4, y - w/5*2);
+
+            if (node->link[RENDER_DOWN] != RENDER_NONE)
+                fprintf(file, "<path fill=\"none\" d=\"M%d %dV%dM%d %dL%d %dL%d %d\"/>\n",
+                        x - w/2, y - w/5*4, y + w/5*4, x - w/5, y + w/5*2,
+                        x - w/2, y + w/5*4, x - w/5*4, y + w/5*2);
+
+            if (n == r->player_node)
+                fprintf(file, "<circle cx=\"%d\" cy=\"%d\" r=\"%d\"/>\n",
+                        x, y, MAX(r->unit / 8, 2));
+        }
+
+        fprintf(file, "</g>\n");
+    }
+
+    fprintf(file, "</svg>\n");
+
+    return !ferror(file);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: amcl-maprender [options] mapfile output\n"
+            "  -m map      map to draw (the one the automap was showing)\n"
+            "  -u unit     pixels between rooms (16)\n"
+            "  -t tile     rows drawn at a time (256)\n"
+            "  -j threads  threads drawing (one per processor)\n"
+            "  -f format   png or svg (from the output name, else png)\n"
+            "output may be - for the standard output\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    Render r;
+    gchar *mapname = NULL, *format = NULL, *output;
+    gint c, threads = 0;
+    gboolean ok;
+    FILE *file;
+
+    memset(&r, 0, sizeof(r));
+    r.unit = 16;
+    r.tile = 256;
+
+    while ((c = getopt(argc, argv, "m:u:t:j:f:")) != -1)
+    {
+        switch (c)
+        {
+        case 'm': mapname = optarg;                  break;
+        case 'u': r.unit = CLAMP(atoi(optarg), 2, 400); break;
+        case 't': r.tile = MAX(atoi(optarg), 1);       break;
+        case 'j': threads = MAX(atoi(optarg), 1);      break;
+        case 'f': format = optarg;                   break;
+        default:  usage();
+        }
+    }
+
+    if (argc - optind != 2)
+        usage();
+
+    output = argv[optind + 1];
+
+    if (format == NULL)
+    {
+        gint len = strlen(output);
+
+        format = len > 4 && !g_strcasecmp(output + len - 4, ".svg") ? "svg" : "png";
+    }
+
+    if (g_strcasecmp(format, "png") && g_strcasecmp(format, "svg"))
+        usage();
+
+#ifdef _SC_NPROCESSORS_ONLN
+    if (threads == 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    threads = CLAMP(threads, 1, 64);
+
+    if (!render_read(&r, argv[optind]))
+        return 1;
+
+    if (mapname == NULL)
+        mapname = r.current;
+
+    if (mapname == NULL || !render_layout(&r, mapname))
+        return 1;
+
+    render_reachable(&r);
+
+    if (!strcmp(output, "-"))
+        file = stdout;
+    else if ((file = fopen(output, "wb")) == NULL)
+    {
+        g_warning("amcl-maprender: Could not open %s for writing: %s\n",
+                  output, g_strerror(errno));
+        return 1;
+    }
+
+    ok = g_strcasecmp(format, "svg") ? write_png(&r, file, threads)
+                                     : write_svg(&r, file);
+
+    if (fclose(file) != 0 || !ok)
+    {
+        g_warning("amcl-maprender: Could not write %s: %s\n",
+                  output, g_strerror(errno));
+        return 1;
+    }
+
+    return 0;
+}
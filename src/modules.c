@@ -32,6 +32,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <unistd.h>
 #include <string.h>
 #include <pwd.h>
@@ -44,15 +45,177 @@ static char const rcsid[] =
 
 GList     *Plugin_list;
 GList     *Plugin_data_list;
+
+/* What is in Plugin_data_list for enabled plugins, by direction, each
+ * array ended by a NULL plugin. Reading or sending data only walks
+ * these; they are made again when plugins register data functions or
+ * are turned on or off, so not while they are being walked
+ */
+static PLUGIN_HOOK  plugin_hooks_none[1];
+PLUGIN_HOOK        *Plugin_hooks[PLUGIN_DATA_DIRECTIONS] = {
+  plugin_hooks_none, plugin_hooks_none, plugin_hooks_none
+};
+
 GtkWidget *plugin_name_entry;
 GtkWidget *plugin_author_entry;
 GtkWidget *plugin_version_entry;
 GtkWidget *plugin_desc_entry;
 GtkWidget *plugin_enable_check;
+GtkWidget *plugin_timing_label;
 gint       plugin_selected_row;
 FILE      *plugin_information;
 gint       amount;
 
+/* What is known of each plugin without loading it, kept in
+ * ~/.amcl/plugins_index a line a plugin: the file name, its mtime and
+ * size, then the four strings of its PLUGIN_INFO, all split by tabs. A
+ * line is only used while the file has the same mtime and size, so
+ * plugins that aren't enabled needn't be loaded to be listed
+ */
+typedef struct {
+  glong   mtime;
+  glong   size;
+  gchar  *info[4];
+} PLUGIN_INDEX;
+
+static GHashTable *plugin_index;        /* File name -> PLUGIN_INDEX */
+static GList      *plugin_load_queue;
+
+static void plugin_index_free (gchar *name, PLUGIN_INDEX *entry, gpointer data)
+{
+  gint i;
+
+  g_free (name);
+
+  for (i = 0; i < 4; i++)
+    g_free (entry->info[i]);
+
+  g_free (entry);
+}
+
+static void plugin_index_load (void)
+{
+  PLUGIN_INDEX *entry;
+  FILE         *fp;
+  gchar         filename[256];
+  gchar         line[1024];
+  gchar       **field;
+  gint          i;
+
+  plugin_index = g_hash_table_new (g_str_hash, g_str_equal);
+
+  g_snprintf (filename, sizeof (filename), "%s%s", uid_info->pw_dir, "/.amcl/plugins_index");
+
+  if ((fp = fopen (filename, "r")) == NULL)
+    return;
+
+  while (fgets (line, sizeof (line), fp) != NULL) {
+    g_strchomp (line);
+    field = g_strsplit (line, "\t", 7);
+
+    for (i = 0; field[i] != NULL; i++)
+      ;
+
+    if (i == 7 && g_hash_table_lookup (plugin_index, field[0]) == NULL) {
+      entry = g_new0 (PLUGIN_INDEX, 1);
+      entry->mtime = atol (field[1]);
+      entry->size  = atol (field[2]);
+
+      for (i = 0; i < 4; i++)
+	entry->info[i] = g_strdup (field[i + 3]);
+
+      g_hash_table_insert (plugin_index, g_strdup (field[0]), entry);
+    }
+
+    g_strfreev (field);
+  }
+
+  fclose (fp);
+}
+
+/* The entry for a plugin, if its file is as it was when it was made */
+static PLUGIN_INDEX *plugin_index_lookup (PLUGIN_OBJECT *p)
+{
+  PLUGIN_INDEX *entry;
+  struct stat   st;
+
+  if ((entry = g_hash_table_lookup (plugin_index, p->name)) == NULL ||
+      stat (p->filename, &st) < 0 ||
+      entry->mtime != st.st_mtime || entry->size != st.st_size)
+    return NULL;
+
+  return entry;
+}
+
+/* Note what a plugin that has just been loaded said it is, or forget
+ * it if it couldn't be loaded
+ */
+static void plugin_index_update (PLUGIN_OBJECT *p, gboolean loaded)
+{
+  PLUGIN_INDEX *entry;
+  gpointer      key, value;
+  struct stat   st;
+
+  if (g_hash_table_lookup_extended (plugin_index, p->name, &key, &value)) {
+    g_hash_table_remove (plugin_index, p->name);
+    plugin_index_free (key, value, NULL);
+  }
+
+  if (!loaded || stat (p->filename, &st) < 0)
+    return;
+
+  entry = g_new0 (PLUGIN_INDEX, 1);
+  entry->mtime   = st.st_mtime;
+  entry->size    = st.st_size;
+  entry->info[0] = g_strdup (p->info->plugin_name);
+  entry->info[1] = g_strdup (p->info->plugin_author);
+  entry->info[2] = g_strdup (p->info->plugin_version);
+  entry->info[3] = g_strdup (p->info->plugin_descr);
+
+  g_hash_table_insert (plugin_index, g_strdup (p->name), entry);
+}
+
+static void plugin_index_save (void)
+{
+  PLUGIN_INDEX *entry;
+  PLUGIN_OBJECT *p;
+  GList        *t;
+  FILE         *fp;
+  gchar         filename[256];
+  gchar        *s;
+  gint          i;
+
+  if (plugin_index == NULL)
+    return;
+
+  g_snprintf (filename, sizeof (filename), "%s%s", uid_info->pw_dir, "/.amcl/plugins_index");
+
+  if ((fp = fopen (filename, "w")) == NULL)
+    return;
+
+  /* Only for the plugins there still are */
+  for (t = g_list_first(Plugin_list); t != NULL; t = t->next) {
+    p = (PLUGIN_OBJECT *) t->data;
+
+    if (p == NULL || (entry = g_hash_table_lookup (plugin_index, p->name)) == NULL)
+      continue;
+
+    fprintf (fp, "%s\t%ld\t%ld", p->name, entry->mtime, entry->size);
+
+    for (i = 0; i < 4; i++) {
+      for (s = entry->info[i]; *s; s++)
+	if (*s == '\t' || *s == '\n')
+	  *s = ' ';
+
+      fprintf (fp, "\t%s", entry->info[i]);
+    }
+
+    fprintf (fp, "\n");
+  }
+
+  fclose (fp);
+}
+
 PLUGIN_OBJECT *plugin_get_plugin_object_by_handle (gint handle)
 {
   PLUGIN_OBJECT *p;
@@ -88,6 +251,131 @@ PLUGIN_OBJECT *plugin_get_plugin_object_by_name (gchar *name)
   return NULL;
 }
 
+void plugin_hooks_rebuild (void)
+{
+  PLUGIN_DATA *pd;
+  GList       *t;
+  gint         dir, n;
+
+  for (dir = 0; dir < PLUGIN_DATA_DIRECTIONS; dir++) {
+    if (Plugin_hooks[dir] != plugin_hooks_none)
+      g_free (Plugin_hooks[dir]);
+
+    n = 0;
+
+    for (t = g_list_first(Plugin_data_list); t != NULL; t = t->next) {
+      pd = (PLUGIN_DATA *) t->data;
+
+      if (pd && pd->plugin && pd->plugin->enabeled && pd->dir == dir)
+	n++;
+    }
+
+    if (n == 0) {
+      Plugin_hooks[dir] = plugin_hooks_none;
+      continue;
+    }
+
+    Plugin_hooks[dir] = g_new0 (PLUGIN_HOOK, n + 1);
+    n = 0;
+
+    for (t = g_list_first(Plugin_data_list); t != NULL; t = t->next) {
+      pd = (PLUGIN_DATA *) t->data;
+
+      if (pd && pd->plugin && pd->plugin->enabeled && pd->dir == dir) {
+	Plugin_hooks[dir][n].datafunc = pd->datafunc;
+	Plugin_hooks[dir][n].linefunc = pd->linefunc;
+	Plugin_hooks[dir][n].plugin   = pd->plugin;
+	Plugin_hooks[dir][n].handle   = (gint) pd->plugin->handle;
+	n++;
+      }
+    }
+  }
+
+  plugin_idles_wake ();
+}
+
+static gint plugin_hooks_rebuild_idle (gpointer data)
+{
+  plugin_hooks_rebuild ();
+
+  return FALSE;
+}
+
+/* Count a call to one of p's functions that took from start to now,
+ * and stop p if it took too long and that has been asked for
+ */
+static void plugin_timing_add (PLUGIN_OBJECT *p, struct timeval *start, gchar *what)
+{
+  PLUGIN_TIMING  *t = &p->timing;
+  struct timeval  now;
+  glong           us, limit;
+  gint            b;
+  gdouble         ms;
+
+  gettimeofday (&now, NULL);
+  us = (now.tv_sec - start->tv_sec) * 1000000 + now.tv_usec - start->tv_usec;
+  ms = us / 1000.0;
+
+  for (b = 0, limit = 10; b < PLUGIN_TIMING_BUCKETS - 1 && us >= limit; b++)
+    limit *= 10;
+
+  t->calls++;
+  t->total += ms;
+  t->buckets[b]++;
+
+  if (ms > t->max)
+    t->max = ms;
+
+  if (prefs.PluginBudget <= 0 || ms <= prefs.PluginBudget)
+    return;
+
+  t->over++;
+
+  if (prefs.PluginBudgetDisable) {
+    g_message ("Plugin `%s' took %.1f ms in its %s function, it has been disabled.",
+	       p->name, ms, what);
+
+    /* The hooks are being walked, so are made again afterwards */
+    p->enabeled = FALSE;
+    gtk_idle_add (plugin_hooks_rebuild_idle, NULL);
+  } else if (now.tv_sec != t->warned) {
+    g_message ("Plugin `%s' took %.1f ms in its %s function, %d ms are allowed.",
+	       p->name, ms, what, prefs.PluginBudget);
+    t->warned = now.tv_sec;
+  }
+}
+
+/* Call a data function, timed */
+void plugin_hook_data (PLUGIN_HOOK *h, CONNECTION_DATA *c, gchar *data)
+{
+  struct timeval start;
+
+  if (!h->plugin->enabeled)
+    return;
+
+  gettimeofday (&start, NULL);
+  (* h->datafunc) (h->plugin, c, data, h->handle);
+  plugin_timing_add (h->plugin, &start, "data");
+}
+
+/* Call a line function, timed */
+gint plugin_hook_line (PLUGIN_HOOK *h, PLUGIN_LINE *line)
+{
+  struct timeval start;
+  gint           result;
+
+  if (!h->plugin->enabeled)
+    return PLUGIN_LINE_PASS;
+
+  gettimeofday (&start, NULL);
+  result = (* h->linefunc) (h->plugin, line, h->handle);
+  plugin_timing_add (h->plugin, &start, "line");
+
+  return result;
+}
+
+void plugin_reload_cb (GtkWidget *widget, gpointer data);
+
 void plugin_enable_check_cb (GtkWidget *widget, gpointer data)
 {
   PLUGIN_OBJECT *p;
@@ -100,12 +388,220 @@ void plugin_enable_check_cb (GtkWidget *widget, gpointer data)
   if (p != NULL) {
     if (GTK_TOGGLE_BUTTON (widget)->active) {
       p->enabeled = TRUE;
+
+      /* Listed, but not loaded until now */
+      if (!plugin_loaded (p)) {
+	plugin_reload_cb (widget, data);
+	return;
+      }
     } else {
       p->enabeled = FALSE;
     }
+
+    plugin_hooks_rebuild ();
   }
 }
 
+/* Take back what a plugin registered: its menu items, its data and
+ * line functions, and its timers, idle tasks and jobs
+ */
+static void plugin_unregister (PLUGIN_OBJECT *p)
+{
+  PLUGIN_DATA *pd;
+  GList       *t, *next;
+
+  for (t = p->menus; t != NULL; t = t->next)
+    gtk_widget_destroy (GTK_WIDGET (t->data));
+
+  g_list_free (p->menus);
+  p->menus = NULL;
+
+  plugin_async_remove (p);
+
+  for (t = g_list_first(Plugin_data_list); t != NULL; t = next) {
+    next = t->next;
+    pd = (PLUGIN_DATA *) t->data;
+
+    if (pd && pd->plugin == p) {
+      Plugin_data_list = g_list_remove_link (Plugin_data_list, t);
+      g_list_free_1 (t);
+      g_free (pd);
+    }
+  }
+
+  plugin_hooks_rebuild ();
+}
+
+/* dlopen() a plugin's file again. If the plugin has an
+ * amcl_plugin_unload() it is called first
+ */
+static gboolean plugin_reopen (PLUGIN_OBJECT *p)
+{
+  plugin_initfunc  unload;
+  PLUGIN_INFO     *info;
+
+  if (p->handle != NULL) {
+    if ((unload = (plugin_initfunc) dlsym (p->handle, "amcl_plugin_unload")) != NULL)
+      unload (p, (gint) p->handle);
+
+    dlclose (p->handle);
+  }
+
+  if ((p->handle = dlopen (p->filename, RTLD_LAZY)) == NULL) {
+    g_message ("Error getting plugin handle (%s): %s.", p->name, dlerror());
+    return FALSE;
+  }
+
+  if ((info = dlsym (p->handle, "amcl_plugin_info")) == NULL) {
+    g_message ("Error, not an AMCL module: %s.", p->name);
+    dlclose (p->handle);
+    p->handle = NULL;
+    return FALSE;
+  }
+
+  p->info = info;
+
+  if (p->info->init_function)
+    p->info->init_function (NULL, (gint) p->handle);
+
+  return TRUE;
+}
+
+/* Load a plugin from its file and run its init-function, or run it
+ * apart. A plugin that can't be loaded is kept, disabled, to be loaded
+ * once it is fixed
+ */
+gboolean plugin_load (PLUGIN_OBJECT *p)
+{
+  PLUGIN_INFO *info     = p->info;
+  gboolean     enabeled = p->enabeled;
+  gchar       *name;
+
+  g_message ("Loading plugin `%s'.", p->name);
+
+  p->enabeled = FALSE;
+
+  /* What it is called now is kept if it can't be loaded */
+  name = g_strdup (info->plugin_name);
+
+  /* Unless it is in the plugin, it is ours */
+  if (p->host || p->handle == NULL) {
+    g_free (info->plugin_name);
+    g_free (info->plugin_author);
+    g_free (info->plugin_version);
+    g_free (info->plugin_descr);
+    g_free (info);
+  }
+
+  p->info = NULL;
+
+  if (p->host ? !plugin_host_reload (p) : !plugin_reopen (p)) {
+    p->info = g_new0 (PLUGIN_INFO, 1);
+    p->info->plugin_name    = name;
+    p->info->plugin_author  = g_strdup ("");
+    p->info->plugin_version = g_strdup ("");
+    p->info->plugin_descr   = g_strdup_printf ("Couldn't be loaded from %s.",
+					       p->filename);
+    plugin_index_update (p, FALSE);
+    plugin_hooks_rebuild ();
+    return FALSE;
+  }
+
+  g_free (name);
+  plugin_index_update (p, TRUE);
+
+  p->enabeled = enabeled;
+  plugin_hooks_rebuild ();
+
+  return TRUE;
+}
+
+gboolean plugin_loaded (PLUGIN_OBJECT *p)
+{
+  if (p->host)
+    return plugin_host_running (p);
+
+  return p->handle != NULL;
+}
+
+/* Load a plugin again from its file, for when it has been changed,
+ * without touching the connections
+ */
+gboolean plugin_reload (PLUGIN_OBJECT *p)
+{
+  plugin_unregister (p);
+
+  return plugin_load (p);
+}
+
+/* Loads the plugins init_modules() left to be loaded, one at a time,
+ * once the main window is up
+ */
+static gint plugin_load_idle (gpointer data)
+{
+  PLUGIN_OBJECT *p;
+
+  if (plugin_load_queue == NULL)
+    return FALSE;
+
+  p = (PLUGIN_OBJECT *) plugin_load_queue->data;
+  plugin_load_queue = g_list_remove (plugin_load_queue, p);
+
+  /* Unless it was loaded from the plugin window meanwhile */
+  if (!plugin_loaded (p))
+    plugin_load (p);
+
+  return plugin_load_queue != NULL;
+}
+
+static void plugin_timing_show (PLUGIN_OBJECT *p)
+{
+  static gchar *bucket_names[PLUGIN_TIMING_BUCKETS] = {
+    "10us", "100us", "1ms", "10ms", "100ms", "1s", "more"
+  };
+  PLUGIN_TIMING *t = &p->timing;
+  GString       *text;
+  gint           b;
+
+  text = g_string_new ("");
+  g_string_sprintf (text, "%u calls, %.1f ms in all, %.1f ms at most",
+		    t->calls, t->total, t->max);
+
+  if (t->over > 0)
+    g_string_sprintfa (text, ", %u too long", t->over);
+
+  for (b = 0; b < PLUGIN_TIMING_BUCKETS; b++)
+    g_string_sprintfa (text, "%s%s%s: %u", b % 4 ? "  " : "\n",
+		       b < PLUGIN_TIMING_BUCKETS - 1 ? "< " : "", bucket_names[b],
+		       t->buckets[b]);
+
+  gtk_label_set_text (GTK_LABEL (plugin_timing_label), text->str);
+  g_string_free (text, TRUE);
+}
+
+/* While the plugin window is open, what the plugin shown has taken */
+static gint plugin_timing_tag;
+
+static gint plugin_timing_refresh (gpointer data)
+{
+  PLUGIN_OBJECT *p;
+  gchar *text;
+
+  if (gtk_clist_get_text ((GtkCList *) data, plugin_selected_row, 0, &text) &&
+      (p = plugin_get_plugin_object_by_name (text)) != NULL)
+    plugin_timing_show (p);
+
+  return TRUE;
+}
+
+static void plugin_information_destroy (GtkWidget *widget, gpointer data)
+{
+  if (plugin_timing_tag)
+    gtk_timeout_remove (plugin_timing_tag);
+
+  plugin_timing_tag = 0;
+}
+
 void plugin_clist_select_row_cb (GtkWidget *w, gint r, gint c, GdkEventButton *e, gpointer data)
 {
   PLUGIN_OBJECT *p;
@@ -124,6 +620,7 @@ void plugin_clist_select_row_cb (GtkWidget *w, gint r, gint c, GdkEventButton *e
     gtk_entry_set_text (GTK_ENTRY (plugin_desc_entry),    p->info->plugin_descr);
     if (p->enabeled)
       gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(plugin_enable_check),TRUE);
+    plugin_timing_show (p);
   }
 }
 
@@ -140,6 +637,23 @@ void plugin_clist_append (PLUGIN_OBJECT *p, GtkCList *clist)
   amount++;
 }
 
+void plugin_reload_cb (GtkWidget *widget, gpointer data)
+{
+  PLUGIN_OBJECT *p;
+  gchar *text;
+
+  gtk_clist_get_text ((GtkCList *) data, plugin_selected_row, 0, &text);
+
+  if ((p = plugin_get_plugin_object_by_name (text)) == NULL)
+    return;
+
+  plugin_reload (p);
+
+  gtk_clist_set_text ((GtkCList *) data, plugin_selected_row, 0, p->info->plugin_name);
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (plugin_enable_check), p->enabeled);
+  plugin_clist_select_row_cb (NULL, plugin_selected_row, 0, NULL, data);
+}
+
 void do_plugin_information(GtkWidget *widget, gpointer data)
 {
   GtkWidget *window1;
@@ -154,13 +668,14 @@ void do_plugin_information(GtkWidget *widget, gpointer data)
   GtkWidget *label8;
   GtkWidget *label5;
   GtkWidget *label9;
+  GtkWidget *button_reload;
 
   window1 = gtk_window_new (GTK_WINDOW_TOPLEVEL);
   gtk_object_set_data (GTK_OBJECT (window1), "window1", window1);
   gtk_container_border_width (GTK_CONTAINER (window1), 7);
   gtk_window_set_title (GTK_WINDOW (window1), "AMCL Plugin Information");
   gtk_window_set_policy (GTK_WINDOW (window1), TRUE, TRUE, FALSE);
-  gtk_widget_set_usize (window1, 430, 275);
+  gtk_widget_set_usize (window1, 430, 360);
 
   hbox1 = gtk_hbox_new (FALSE, 0);
   gtk_object_set_data (GTK_OBJECT (window1), "hbox1", hbox1);
@@ -260,9 +775,31 @@ void do_plugin_information(GtkWidget *widget, gpointer data)
   gtk_signal_connect(GTK_OBJECT(plugin_enable_check), "toggled",
 		     GTK_SIGNAL_FUNC(plugin_enable_check_cb), (gpointer) clist1);
 
+  button_reload = gtk_button_new_with_label (" Reload Plugin ");
+  gtk_object_set_data (GTK_OBJECT (window1), "button_reload", button_reload);
+  gtk_widget_show (button_reload);
+  gtk_box_pack_start (GTK_BOX (vbox1), button_reload, FALSE, TRUE, 5);
+  GTK_WIDGET_UNSET_FLAGS (button_reload, GTK_CAN_FOCUS);
+  gtk_signal_connect(GTK_OBJECT(button_reload), "clicked",
+		     GTK_SIGNAL_FUNC(plugin_reload_cb), (gpointer) clist1);
+
+  plugin_timing_label = gtk_label_new ("");
+  gtk_object_set_data (GTK_OBJECT (window1), "plugin_timing_label", plugin_timing_label);
+  gtk_widget_show (plugin_timing_label);
+  gtk_box_pack_start (GTK_BOX (vbox1), plugin_timing_label, FALSE, TRUE, 0);
+  gtk_label_set_justify (GTK_LABEL (plugin_timing_label), GTK_JUSTIFY_LEFT);
+  gtk_misc_set_alignment (GTK_MISC (plugin_timing_label), 0.0, 0.5);
+
   g_list_foreach (Plugin_list, (GFunc) plugin_clist_append, clist1);
   gtk_clist_select_row (GTK_CLIST (clist1), 0, 0);
 
+  if (plugin_timing_tag)
+    gtk_timeout_remove (plugin_timing_tag);
+
+  plugin_timing_tag = gtk_timeout_add (1000, plugin_timing_refresh, clist1);
+  gtk_signal_connect (GTK_OBJECT (window1), "destroy",
+		      GTK_SIGNAL_FUNC (plugin_information_destroy), NULL);
+
   gtk_widget_show(window1);
 }
 
@@ -294,6 +831,8 @@ void save_plugins()
     
     fclose (fp);
   }
+
+  plugin_index_save ();
 }
 
 int init_modules(char *path)
@@ -306,6 +845,7 @@ int init_modules(char *path)
 
   g_snprintf(filename, sizeof(filename), "%s%s", uid_info->pw_dir, "/.amcl/plugins_info");
   plugin_information = fopen(filename, "r");
+  plugin_index_load();
 
   if ((directory = opendir(path)) == NULL) {
     g_message("Plugin error (%s): %s", path, strerror(errno));
@@ -313,7 +853,6 @@ int init_modules(char *path)
   }
   
   while ((direntity = readdir(directory))) {
-    PLUGIN_OBJECT *plugin;
     gchar *suffix;
     
     if (strrchr(direntity->d_name, '/'))
@@ -328,12 +867,11 @@ int init_modules(char *path)
     if (!suffix || strcmp(suffix, ".plugin"))
       continue;
     
-    plugin = plugin_query(direntity->d_name, path);
-    if (!plugin)
-      continue;
-    
-    plugin_register(plugin);
+    plugin_add(direntity->d_name, path);
   }
+
+  if (plugin_load_queue)
+    gtk_idle_add (plugin_load_idle, NULL);
   
   if (plugin_information)
     fclose(plugin_information);
@@ -342,35 +880,6 @@ int init_modules(char *path)
   return TRUE;
 }
 
-PLUGIN_OBJECT *plugin_query (gchar *plugin_name, gchar *plugin_path)
-{
-    PLUGIN_OBJECT *new_plugin = g_new0(PLUGIN_OBJECT, 1);
-    gchar filename[60];
-
-    new_plugin->name = g_strdup(plugin_name);
-    sprintf (filename, "%s%s", plugin_path, plugin_name);
-    if ((new_plugin->handle = dlopen (filename, RTLD_LAZY)) == NULL)
-    {
-        g_message ("Error getting plugin handle (%s): %s.", plugin_name, dlerror());
-        goto error;
-    } else {
-        if ((new_plugin->info = dlsym(new_plugin->handle,"amcl_plugin_info")) == NULL)
-        {
-            g_message ("Error, not an AMCL module: %s.", plugin_name, dlerror());
-            goto error;
-        }
-        new_plugin->filename = g_strdup (filename);
-        return new_plugin;
-    }
-
-error:
-    g_free (new_plugin->name);
-    g_free (new_plugin->filename);
-    g_free (new_plugin);
-
-    return NULL;
-}
-
 void plugin_check_enable(PLUGIN_OBJECT *plugin)
 {
   gchar line[255];
@@ -386,19 +895,42 @@ void plugin_check_enable(PLUGIN_OBJECT *plugin)
   rewind(plugin_information);
 }
 
-void plugin_register(PLUGIN_OBJECT *plugin)
+/* List a plugin, with what the index says of it. Enabled plugins, and
+ * those the index knows nothing of, are loaded once the main window is
+ * up
+ */
+PLUGIN_OBJECT *plugin_add (gchar *plugin_name, gchar *plugin_path)
 {
-    g_message ("Registering plugin `%s'.", plugin->name);
-    g_message ("Plug-in internal name is `%s'.", plugin->info->plugin_name);
+  PLUGIN_OBJECT *p = g_new0 (PLUGIN_OBJECT, 1);
+  PLUGIN_INDEX  *entry;
+
+  p->name     = g_strdup (plugin_name);
+  p->filename = g_strconcat (plugin_path, plugin_name, NULL);
+  p->info     = g_new0 (PLUGIN_INFO, 1);
+
+  if (prefs.PluginsApart)
+    plugin_host_add (p);
+
+  if ((entry = plugin_index_lookup (p)) != NULL) {
+    p->info->plugin_name    = g_strdup (entry->info[0]);
+    p->info->plugin_author  = g_strdup (entry->info[1]);
+    p->info->plugin_version = g_strdup (entry->info[2]);
+    p->info->plugin_descr   = g_strdup (entry->info[3]);
+  } else {
+    p->info->plugin_name    = g_strdup (plugin_name);
+    p->info->plugin_author  = g_strdup ("");
+    p->info->plugin_version = g_strdup ("");
+    p->info->plugin_descr   = g_strdup ("Not loaded yet.");
+  }
 
-    plugin_check_enable(plugin);
+  if (plugin_information)
+    plugin_check_enable (p);
 
-    Plugin_list = g_list_append(Plugin_list, (gpointer) plugin);
-    
-    if (plugin->info->init_function)
-    {
-        g_message ("Running init-function...");
-        plugin->info->init_function(NULL, (gint) plugin->handle);
-    }
+  Plugin_list = g_list_append (Plugin_list, (gpointer) p);
+
+  if (p->enabeled || entry == NULL)
+    plugin_load_queue = g_list_append (plugin_load_queue, p);
+
+  return p;
 }
 #endif
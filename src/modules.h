@@ -24,12 +24,35 @@
 typedef struct _plugin_object PLUGIN_OBJECT;
 typedef struct _plugin_info   PLUGIN_INFO;
 typedef struct _plugin_data   PLUGIN_DATA;
+typedef struct _plugin_hook   PLUGIN_HOOK;
+typedef struct _plugin_style  PLUGIN_STYLE;
+typedef struct _plugin_line   PLUGIN_LINE;
+typedef struct _plugin_ring   PLUGIN_RING;
+typedef struct _plugin_shared PLUGIN_SHARED;
+typedef struct _plugin_msg    PLUGIN_MESSAGE;
+typedef struct _plugin_timing PLUGIN_TIMING;
 
 typedef void      (*plugin_initfunc) (PLUGIN_OBJECT *,   gint   );
 typedef void      (*plugin_menufunc) (GtkWidget *,       gint   );
 typedef void      (*plugin_datafunc) (PLUGIN_OBJECT *, CONNECTION_DATA *, gchar *, gint);
+typedef gint      (*plugin_linefunc) (PLUGIN_OBJECT *, PLUGIN_LINE *,     gint);
+typedef gboolean  (*plugin_taskfunc) (PLUGIN_OBJECT *, gpointer,          gint);
+typedef void      (*plugin_workfunc) (gpointer                               );
+typedef void      (*plugin_donefunc) (PLUGIN_OBJECT *, gpointer,          gint);
 
-typedef enum { PLUGIN_DATA_IN, PLUGIN_DATA_OUT } PLUGIN_DATA_DIRECTION;
+typedef enum { PLUGIN_DATA_IN, PLUGIN_DATA_OUT, PLUGIN_DATA_LINE } PLUGIN_DATA_DIRECTION;
+#define PLUGIN_DATA_DIRECTIONS 3
+
+/*
+ * Version 2 of the API added line functions, which return one of these,
+ * version 3 plugin_connection_send() and plugins run apart, version 4
+ * timers, idle tasks and jobs, version 5 commands sent on a timer
+ */
+#define PLUGIN_API_VERSION  5
+
+#define PLUGIN_LINE_PASS    0   /* Show the line as it is            */
+#define PLUGIN_LINE_GAG     1   /* Show nothing, trigger nothing     */
+#define PLUGIN_LINE_REPLACE 2   /* Show what plugin_line_replace got */
 
 /*
  * Structures
@@ -37,9 +60,43 @@ typedef enum { PLUGIN_DATA_IN, PLUGIN_DATA_OUT } PLUGIN_DATA_DIRECTION;
 struct _plugin_data {
   PLUGIN_OBJECT         *plugin;
   plugin_datafunc        datafunc;
+  plugin_linefunc        linefunc;
   PLUGIN_DATA_DIRECTION  dir;
 };
 
+/* A data or line function of an enabled plugin, ready to call */
+struct _plugin_hook {
+  plugin_datafunc        datafunc;
+  plugin_linefunc        linefunc;
+  PLUGIN_OBJECT         *plugin;
+  gint                   handle;
+};
+
+/* Text in one colour. Colours are the ANSI ones, 0 to 7, or -1 for
+ * the default
+ */
+struct _plugin_style {
+  gint                   start;
+  gint                   length;
+  gint                   fg;
+  gint                   bg;
+  gboolean               bold;
+};
+
+/* A line from the mud, after telnet, as line functions get it. Only
+ * replacement is theirs to change, with plugin_line_replace()
+ */
+struct _plugin_line {
+  CONNECTION_DATA       *connection;
+  const gchar           *text;          /* No colours, no newline   */
+  gint                   length;
+  const PLUGIN_STYLE    *styles;        /* Covering all of text     */
+  gint                   n_styles;
+  gboolean               prompt;        /* Not ended by a newline   */
+  const gchar           *raw;           /* With the colour codes    */
+  gchar                 *replacement;
+};
+
 struct _plugin_info {
   gchar            *plugin_name;
   gchar            *plugin_author;
@@ -48,22 +105,116 @@ struct _plugin_info {
   plugin_initfunc   init_function;
 };
 
+/* How long the data and line functions of a plugin have taken, in
+ * ms. Bucket n counts calls under 10^n microseconds, the last the rest
+ */
+#define PLUGIN_TIMING_BUCKETS 7
+
+struct _plugin_timing {
+  guint                  calls;
+  gdouble                total;
+  gdouble                max;
+  guint                  buckets[PLUGIN_TIMING_BUCKETS];
+  guint                  over;          /* Calls over prefs.PluginBudget */
+  glong                  warned;        /* When, in seconds          */
+};
+
 struct _plugin_object {
   void     *handle;
   gchar    *name;
   gchar    *filename;
   gboolean  enabeled;
   PLUGIN_INFO *info;
+  gpointer  host;               /* Run by amcl-pluginhost if set */
+  GList    *menus;              /* Its menu items                */
+  PLUGIN_TIMING timing;
 };
 
+/*
+ * Plugins run apart, by amcl-pluginhost, are talked to through two
+ * rings in shared memory, each written by one side and read by the
+ * other, see modules_ring.c and modules_host.c
+ */
+#define PLUGIN_RING_SIZE 65536  /* A power of two */
+
+struct _plugin_ring {
+  volatile guint32       head;          /* Written by the writer only */
+  volatile guint32       tail;          /* Written by the reader only */
+  gchar                  data[PLUGIN_RING_SIZE];
+};
+
+struct _plugin_shared {
+  PLUGIN_RING            events;        /* From amcl to the plugin */
+  PLUGIN_RING            commands;      /* From the plugin to amcl */
+};
+
+/* Each message in a ring, followed by length bytes of text */
+struct _plugin_msg {
+  guint32                length;
+  guint16                type;
+  guint16                connection;    /* Index in connections[] */
+  gint32                 arg;
+};
+
+/* Commands, from the plugin */
+#define PLUGIN_HOST_INFO      1 /* Name, author, version, description */
+#define PLUGIN_HOST_DATA      3 /* arg is a PLUGIN_DATA_DIRECTION     */
+#define PLUGIN_HOST_TEXT      4 /* arg is the message type            */
+#define PLUGIN_HOST_POPUP     5
+#define PLUGIN_HOST_SEND      6
+#define PLUGIN_HOST_AFTER     7 /* arg is ms, text the command        */
+#define PLUGIN_HOST_EVERY     8 /* The same, over and over            */
+#define PLUGIN_HOST_READY     9 /* Its init-function has returned     */
+
+/* Events, to the plugin */
+#define PLUGIN_HOST_DATA_IN  16
+#define PLUGIN_HOST_DATA_OUT 17
+#define PLUGIN_HOST_LINE     18 /* arg is TRUE for prompts            */
+#define PLUGIN_HOST_DROPPED  20 /* arg events were missed             */
+
 /*
  * Functions
  */
 PLUGIN_OBJECT *plugin_get_plugin_object_by_handle (gint handle   );
-PLUGIN_OBJECT *plugin_query    (gchar *plugin_name, gchar *pp    );
-void           plugin_register (PLUGIN_OBJECT *plugin            );
+PLUGIN_OBJECT *plugin_add      (gchar *plugin_name, gchar *pp    );
+gboolean       plugin_load     (PLUGIN_OBJECT *plugin            );
+gboolean       plugin_loaded   (PLUGIN_OBJECT *plugin            );
+void           plugin_hooks_rebuild (void                        );
+gboolean       plugin_reload   (PLUGIN_OBJECT *plugin            );
+void           plugin_hook_data (PLUGIN_HOOK *h, CONNECTION_DATA *c, gchar *data);
+gint           plugin_hook_line (PLUGIN_HOOK *h, PLUGIN_LINE *line);
+
+/* modules_api.c */
+void           plugin_add_connection_text (CONNECTION_DATA *c, gchar *t, gint ct);
+
+/* modules_async.c */
+gint           plugin_task_add (PLUGIN_OBJECT *p, glong interval,
+                                plugin_taskfunc func, gpointer data);
+void           plugin_task_remove (gint id                         );
+void           plugin_idles_wake  (void                            );
+gint           plugin_job_add  (PLUGIN_OBJECT *p, plugin_workfunc work,
+                                plugin_donefunc done, gpointer data);
+void           plugin_async_remove (PLUGIN_OBJECT *p              );
+
+/* modules_line.c */
+gchar         *plugin_line_filter (CONNECTION_DATA *connection, gchar *raw,
+                                   gboolean prompt                );
+
+/* modules_ring.c */
+gboolean       plugin_ring_put (PLUGIN_RING *ring, gint type, gint connection,
+                                gint arg, const gchar *text, gint length);
+gchar         *plugin_ring_get (PLUGIN_RING *ring, PLUGIN_MESSAGE *message,
+                                gboolean *broken                  );
+void           plugin_ring_wake (gint fd                          );
+gboolean       plugin_ring_woken (gint fd                         );
+
+/* modules_host.c */
+void           plugin_host_add (PLUGIN_OBJECT *plugin             );
+gboolean       plugin_host_running (PLUGIN_OBJECT *plugin         );
+gboolean       plugin_host_reload (PLUGIN_OBJECT *plugin         );
 
 /*
  * Variables
  */
-extern GList *Plugin_data_list;
+extern GList       *Plugin_data_list;
+extern PLUGIN_HOOK *Plugin_hooks[PLUGIN_DATA_DIRECTIONS];
@@ -37,10 +37,27 @@ void plugin_add_connection_text(CONNECTION_DATA *connection, gchar *message, gin
     textfield_add (connection->window, message, color);
 }
 
+void plugin_connection_send (CONNECTION_DATA *connection, gchar *text)
+{
+  connection_send (connection ? connection : main_connection, text);
+}
+
+gint plugin_connection_timer (CONNECTION_DATA *connection, gint ms, gchar *command,
+			      gboolean repeat)
+{
+  return timer_add (connection ? connection : main_connection, ms, command, repeat);
+}
+
+void plugin_connection_untimer (gint id)
+{
+  timer_remove (id);
+}
+
 gboolean plugin_register_menu (gint handle, gchar *name, gchar *function)
 {
   GtkSignalFunc  sig_function;
   GtkWidget     *menu_place;
+  PLUGIN_OBJECT *p;
 
   if ((sig_function = (GtkSignalFunc) dlsym ((void *) handle, function)) == NULL) {
     g_message ("Error register menu: %s", dlerror());
@@ -52,6 +69,10 @@ gboolean plugin_register_menu (gint handle, gchar *name, gchar *function)
   gtk_widget_show (menu_place);
   gtk_signal_connect (GTK_OBJECT (menu_place), "activate",
 		      sig_function, NULL);
+
+  /* Taken away again if the plugin is reloaded */
+  if ((p = plugin_get_plugin_object_by_handle (handle)) != NULL)
+    p->menus = g_list_append (p->menus, menu_place);
   
   return TRUE;
 }
@@ -59,11 +80,11 @@ gboolean plugin_register_menu (gint handle, gchar *name, gchar *function)
 gboolean plugin_register_data (gint handle, gchar *function, PLUGIN_DATA_DIRECTION dir)
 {
   PLUGIN_DATA    * data;
-  plugin_datafunc  datafunc;
+  gpointer         func;
+  static gchar   * names[] = { "incoming", "outgoing", "lines" };
 
-  if ((datafunc = (plugin_datafunc) dlsym ((void *) handle, function)) == NULL) {
-    g_message ("Error register for data %s: %s", dir == PLUGIN_DATA_IN ? "incoming" : "outgoing",
-	       dlerror());
+  if ((func = dlsym ((void *) handle, function)) == NULL) {
+    g_message ("Error register for data %s: %s", names[dir], dlerror());
     return FALSE;
   }
 
@@ -72,10 +93,15 @@ gboolean plugin_register_data (gint handle, gchar *function, PLUGIN_DATA_DIRECTI
   if ((data->plugin = plugin_get_plugin_object_by_handle(handle)) == NULL)
     g_message("Error getting plugin from handle.");
 
-  data->datafunc = datafunc;
+  if (dir == PLUGIN_DATA_LINE)
+    data->linefunc = (plugin_linefunc) func;
+  else
+    data->datafunc = (plugin_datafunc) func;
+
   data->dir      = dir;
 
   Plugin_data_list = g_list_append(Plugin_data_list, (gpointer) data);
+  plugin_hooks_rebuild ();
 
   return TRUE;
 }
@@ -89,3 +115,82 @@ gboolean plugin_register_data_outgoing (gint handle, gchar *function)
 {
   return plugin_register_data (handle, function, PLUGIN_DATA_OUT);
 }
+
+gboolean plugin_register_line (gint handle, gchar *function)
+{
+  return plugin_register_data (handle, function, PLUGIN_DATA_LINE);
+}
+
+void plugin_line_replace (PLUGIN_LINE *line, gchar *text)
+{
+  g_free (line->replacement);
+  line->replacement = g_strdup (text);
+}
+
+gint plugin_api_version (void)
+{
+  return PLUGIN_API_VERSION;
+}
+
+/* Have function called every interval ms, for as long as it returns
+ * TRUE. The number returned is for plugin_remove_task()
+ */
+gint plugin_register_timer (gint handle, gint interval, gchar *function, gpointer data)
+{
+  PLUGIN_OBJECT *p;
+  gpointer       func;
+
+  if ((func = dlsym ((void *) handle, function)) == NULL) {
+    g_message ("Error register timer: %s", dlerror());
+    return 0;
+  }
+
+  if ((p = plugin_get_plugin_object_by_handle (handle)) == NULL)
+    return 0;
+
+  return plugin_task_add (p, MAX (interval, 1), (plugin_taskfunc) func, data);
+}
+
+/* Have function called when nothing else is to be done, for as long
+ * as it returns TRUE
+ */
+gint plugin_register_idle (gint handle, gchar *function, gpointer data)
+{
+  PLUGIN_OBJECT *p;
+  gpointer       func;
+
+  if ((func = dlsym ((void *) handle, function)) == NULL) {
+    g_message ("Error register idle: %s", dlerror());
+    return 0;
+  }
+
+  if ((p = plugin_get_plugin_object_by_handle (handle)) == NULL)
+    return 0;
+
+  return plugin_task_add (p, 0, (plugin_taskfunc) func, data);
+}
+
+void plugin_remove_task (gint id)
+{
+  plugin_task_remove (id);
+}
+
+/* Have work done by another thread, then done, if not NULL, called as
+ * timers are
+ */
+gint plugin_queue_job (gint handle, gchar *work, gchar *done, gpointer data)
+{
+  PLUGIN_OBJECT *p;
+  gpointer       workfunc, donefunc = NULL;
+
+  if ((workfunc = dlsym ((void *) handle, work)) == NULL ||
+      (done != NULL && (donefunc = dlsym ((void *) handle, done)) == NULL)) {
+    g_message ("Error queue job: %s", dlerror());
+    return 0;
+  }
+
+  if ((p = plugin_get_plugin_object_by_handle (handle)) == NULL)
+    return 0;
+
+  return plugin_job_add (p, (plugin_workfunc) workfunc, (plugin_donefunc) donefunc, data);
+}
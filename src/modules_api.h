@@ -29,5 +29,34 @@ extern gboolean plugin_register_menu          (gint h, gchar *name, gchar *funct
 extern gboolean plugin_register_data_incoming (gint h, gchar *function              );
 extern gboolean plugin_register_data_outgoing (gint h, gchar *function              );
 
+/*
+ * Since version 2, see PLUGIN_API_VERSION.
+ */
+extern gint     plugin_api_version            (void                                 );
+extern gboolean plugin_register_line          (gint h, gchar *function              );
+extern void     plugin_line_replace           (PLUGIN_LINE *line, gchar *text       );
+
+/*
+ * Since version 3.
+ */
+extern void     plugin_connection_send        (CONNECTION_DATA *c, gchar *text      );
+
+/*
+ * Since version 4.
+ */
+extern gint     plugin_register_timer         (gint h, gint ms, gchar *function,
+                                               gpointer data                        );
+extern gint     plugin_register_idle          (gint h, gchar *function, gpointer data);
+extern void     plugin_remove_task            (gint id                              );
+extern gint     plugin_queue_job              (gint h, gchar *work, gchar *done,
+                                               gpointer data                        );
+
+/*
+ * Since version 5.
+ */
+extern gint     plugin_connection_timer       (CONNECTION_DATA *c, gint ms, gchar *command,
+                                               gboolean repeat                      );
+extern void     plugin_connection_untimer     (gint id                              );
+
 
 #endif /* __MODULE__ */
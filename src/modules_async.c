@@ -0,0 +1,466 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1999 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Timers, idle tasks and jobs for plugins, version 4 of the plugin API.
+ *
+ * Timers go on the timer wheel of timer.c, with those of connections,
+ * so there is one gtk_timeout for all of them. Idle tasks take turns, one per
+ * idle call, so input is looked at between them; those of disabled
+ * plugins are put aside until they are enabled. Jobs are done by a
+ * few worker threads, and what is to be done when each is finished is
+ * done back in the main loop.
+ *
+ * Workers only ever touch the jobs and the lists of them, under
+ * plugin_job_lock: GLib isn't told about threads, so nothing in them
+ * allocates or frees.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gtk/gtk.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#include "amcl.h"
+#include "modules.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+#define PLUGIN_WORKERS_MAX 4
+
+typedef struct _plugin_task PLUGIN_TASK;
+typedef struct _plugin_job  PLUGIN_JOB;
+
+/* A timer, or an idle task if interval is 0 */
+struct _plugin_task {
+  gint             id;
+  PLUGIN_OBJECT   *plugin;
+  plugin_taskfunc  func;
+  gpointer         data;
+  glong            interval;            /* ms                        */
+  gint             timer;               /* On the timer wheel        */
+};
+
+struct _plugin_job {
+  PLUGIN_JOB      *next;
+  gint             id;
+  PLUGIN_OBJECT   *plugin;
+  plugin_workfunc  work;
+  plugin_donefunc  done;
+  gpointer         data;
+  gboolean         cancelled;           /* Not to have done called   */
+};
+
+static GList       *plugin_timers;
+static GList       *plugin_idles;
+static GList       *plugin_idles_parked; /* Of disabled plugins      */
+static gint         plugin_idle_tag;
+static gint         plugin_task_id;
+
+/* The task being run, and whether it was removed while it ran */
+static PLUGIN_TASK *plugin_task_running;
+static gboolean     plugin_task_removed;
+
+static PLUGIN_JOB  *plugin_jobs_waiting;
+static PLUGIN_JOB  *plugin_jobs_done;
+static gint         plugin_job_id;
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t plugin_job_lock     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  plugin_job_ready    = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  plugin_job_finished = PTHREAD_COND_INITIALIZER;
+static PLUGIN_JOB     *plugin_jobs_working[PLUGIN_WORKERS_MAX];
+static gint            plugin_workers;
+static gboolean        plugin_workers_tried;
+static gint            plugin_job_pipe[2] = { -1, -1 };
+static gint            plugin_job_input;
+
+#define plugin_job_lock()   pthread_mutex_lock (&plugin_job_lock)
+#define plugin_job_unlock() pthread_mutex_unlock (&plugin_job_lock)
+#else
+#define plugin_job_lock()
+#define plugin_job_unlock()
+#endif
+
+/* Run a task, FALSE if it is done with */
+static gboolean plugin_task_run (PLUGIN_TASK *task)
+{
+  gboolean again;
+
+  /* Disabled plugins keep their timers, but they aren't run */
+  if (!task->plugin->enabeled)
+    return TRUE;
+
+  plugin_task_running = task;
+  plugin_task_removed = FALSE;
+
+  again = (* task->func) (task->plugin, task->data, (gint) task->plugin->handle);
+
+  plugin_task_running = NULL;
+
+  return again && !plugin_task_removed;
+}
+
+/* Called by the timer wheel. A timer done with is taken off it by
+ * returning FALSE
+ */
+static gint plugin_timer_run (gpointer data)
+{
+  PLUGIN_TASK *task = data;
+
+  if (plugin_task_run (task))
+    return TRUE;
+
+  plugin_timers = g_list_remove (plugin_timers, task);
+  g_free (task);
+
+  return FALSE;
+}
+
+static gint plugin_idles_run (gpointer data)
+{
+  PLUGIN_TASK *task;
+
+  if (plugin_idles == NULL) {
+    plugin_idle_tag = 0;
+    return FALSE;
+  }
+
+  task = (PLUGIN_TASK *) plugin_idles->data;
+  plugin_idles = g_list_remove (plugin_idles, task);
+
+  /* Taking turns with nothing to do would keep the idle call going */
+  if (!task->plugin->enabeled)
+    plugin_idles_parked = g_list_append (plugin_idles_parked, task);
+  else if (plugin_task_run (task))
+    plugin_idles = g_list_append (plugin_idles, task);
+  else
+    g_free (task);
+
+  if (plugin_idles != NULL)
+    return TRUE;
+
+  plugin_idle_tag = 0;
+  return FALSE;
+}
+
+/* Give the idle tasks put aside back their turns, if their plugins
+ * have been enabled again. Called whenever plugins are
+ */
+void plugin_idles_wake (void)
+{
+  GList *t, *next;
+
+  for (t = plugin_idles_parked; t != NULL; t = next) {
+    next = t->next;
+
+    if (((PLUGIN_TASK *) t->data)->plugin->enabeled) {
+      plugin_idles_parked = g_list_remove_link (plugin_idles_parked, t);
+      plugin_idles = g_list_concat (plugin_idles, t);
+    }
+  }
+
+  if (plugin_idles != NULL && !plugin_idle_tag)
+    plugin_idle_tag = gtk_idle_add (plugin_idles_run, NULL);
+}
+
+/* Add a timer, or an idle task if interval is 0 */
+gint plugin_task_add (PLUGIN_OBJECT *p, glong interval, plugin_taskfunc func, gpointer data)
+{
+  PLUGIN_TASK *task = g_new0 (PLUGIN_TASK, 1);
+
+  task->id       = ++plugin_task_id;
+  task->plugin   = p;
+  task->func     = func;
+  task->data     = data;
+  task->interval = MAX (interval, 0);
+
+  if (task->interval == 0) {
+    plugin_idles = g_list_append (plugin_idles, task);
+
+    if (!plugin_idle_tag)
+      plugin_idle_tag = gtk_idle_add (plugin_idles_run, NULL);
+  } else {
+    task->timer = timer_add_func (task->interval, plugin_timer_run, task);
+    plugin_timers = g_list_prepend (plugin_timers, task);
+  }
+
+  return task->id;
+}
+
+static gboolean plugin_task_match (PLUGIN_TASK *task, gint id, PLUGIN_OBJECT *p)
+{
+  return id ? task->id == id : task->plugin == p;
+}
+
+/* Remove the task id, or all the tasks of p if id is 0 */
+static void plugin_tasks_remove (gint id, PLUGIN_OBJECT *p)
+{
+  GList *lists[3], *t, *next;
+  gint   i;
+
+  if (plugin_task_running && plugin_task_match (plugin_task_running, id, p))
+    plugin_task_removed = TRUE;
+
+  lists[0] = plugin_timers;
+  lists[1] = plugin_idles;
+  lists[2] = plugin_idles_parked;
+
+  for (i = 0; i < 3; i++) {
+    for (t = lists[i]; t != NULL; t = next) {
+      PLUGIN_TASK *task = t->data;
+
+      next = t->next;
+
+      /* A timer running is freed when it returns */
+      if (!plugin_task_match (task, id, p) || task == plugin_task_running)
+	continue;
+
+      if (task->timer)
+	timer_remove (task->timer);
+
+      g_free (task);
+      lists[i] = g_list_remove_link (lists[i], t);
+      g_list_free_1 (t);
+    }
+  }
+
+  plugin_timers = lists[0];
+  plugin_idles = lists[1];
+  plugin_idles_parked = lists[2];
+}
+
+void plugin_task_remove (gint id)
+{
+  if (id > 0)
+    plugin_tasks_remove (id, NULL);
+}
+
+/*
+ * Jobs
+ */
+static void plugin_jobs_finish (void)
+{
+  PLUGIN_JOB *done, *job;
+
+  plugin_job_lock ();
+  done = plugin_jobs_done;
+  plugin_jobs_done = NULL;
+  plugin_job_unlock ();
+
+  while ((job = done) != NULL) {
+    done = job->next;
+
+    if (!job->cancelled && job->done)
+      (* job->done) (job->plugin, job->data, (gint) job->plugin->handle);
+
+    g_free (job);
+  }
+}
+
+/* Take the first job waiting and do it, with the lock held */
+static void plugin_job_do (gint worker)
+{
+  PLUGIN_JOB *job = plugin_jobs_waiting;
+
+  plugin_jobs_waiting = job->next;
+
+#ifdef HAVE_LIBPTHREAD
+  plugin_jobs_working[worker] = job;
+#endif
+
+  plugin_job_unlock ();
+  (* job->work) (job->data);
+  plugin_job_lock ();
+
+#ifdef HAVE_LIBPTHREAD
+  plugin_jobs_working[worker] = NULL;
+#endif
+
+  job->next = plugin_jobs_done;
+  plugin_jobs_done = job;
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void *plugin_worker (void *arg)
+{
+  gint  worker = GPOINTER_TO_INT (arg);
+  gchar c = 0;
+
+  plugin_job_lock ();
+
+  for (;;) {
+    while (plugin_jobs_waiting == NULL)
+      pthread_cond_wait (&plugin_job_ready, &plugin_job_lock);
+
+    plugin_job_do (worker);
+    pthread_cond_broadcast (&plugin_job_finished);
+
+    plugin_job_unlock ();
+    write (plugin_job_pipe[1], &c, 1);
+    plugin_job_lock ();
+  }
+
+  return NULL;
+}
+
+static void plugin_jobs_input (gpointer data, gint source, GdkInputCondition condition)
+{
+  gchar buf[64];
+
+  read (plugin_job_pipe[0], buf, sizeof (buf));
+  plugin_jobs_finish ();
+}
+
+static void plugin_workers_start (void)
+{
+  pthread_t thread;
+  gint      n = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+  n = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+
+  n = CLAMP (n, 1, PLUGIN_WORKERS_MAX);
+  plugin_workers_tried = TRUE;
+
+  if (pipe (plugin_job_pipe) < 0)
+    return;
+
+  plugin_job_input = gdk_input_add (plugin_job_pipe[0], GDK_INPUT_READ,
+				    (GdkInputFunction) plugin_jobs_input, NULL);
+
+  for (plugin_workers = 0; plugin_workers < n; plugin_workers++)
+    if (pthread_create (&thread, NULL, plugin_worker,
+			GINT_TO_POINTER (plugin_workers)) != 0)
+      break;
+}
+#endif
+
+/* Without worker threads, a job at a time is done when idle */
+static gint plugin_jobs_idle (gpointer data)
+{
+  if (plugin_jobs_waiting != NULL)
+    plugin_job_do (0);
+
+  plugin_jobs_finish ();
+
+  return plugin_jobs_waiting != NULL;
+}
+
+/* Have work(data) done by a worker, then done(plugin, data, handle)
+ * called in the main loop
+ */
+gint plugin_job_add (PLUGIN_OBJECT *p, plugin_workfunc work, plugin_donefunc done,
+		     gpointer data)
+{
+  PLUGIN_JOB *job = g_new0 (PLUGIN_JOB, 1);
+  PLUGIN_JOB **last;
+
+  job->id     = ++plugin_job_id;
+  job->plugin = p;
+  job->work   = work;
+  job->done   = done;
+  job->data   = data;
+
+#ifdef HAVE_LIBPTHREAD
+  if (!plugin_workers_tried)
+    plugin_workers_start ();
+#endif
+
+  plugin_job_lock ();
+
+  /* In the order they were asked for */
+  for (last = &plugin_jobs_waiting; *last != NULL; last = &(*last)->next)
+    ;
+
+  *last = job;
+
+#ifdef HAVE_LIBPTHREAD
+  if (plugin_workers > 0) {
+    pthread_cond_signal (&plugin_job_ready);
+    plugin_job_unlock ();
+    return job->id;
+  }
+#endif
+
+  plugin_job_unlock ();
+
+  if (plugin_jobs_waiting == job)
+    gtk_idle_add (plugin_jobs_idle, NULL);
+
+  return job->id;
+}
+
+/* Whether a job of p is being worked on, with the lock held */
+static gboolean plugin_jobs_working_for (PLUGIN_OBJECT *p)
+{
+#ifdef HAVE_LIBPTHREAD
+  gint i;
+
+  for (i = 0; i < plugin_workers; i++)
+    if (plugin_jobs_working[i] && plugin_jobs_working[i]->plugin == p)
+      return TRUE;
+#endif
+
+  return FALSE;
+}
+
+/* Forget the jobs of p, waiting for those being worked on, as their
+ * work is in the plugin
+ */
+static void plugin_jobs_remove (PLUGIN_OBJECT *p)
+{
+  PLUGIN_JOB **j, *job;
+
+  plugin_job_lock ();
+
+  for (j = &plugin_jobs_waiting; (job = *j) != NULL; ) {
+    if (job->plugin == p) {
+      *j = job->next;
+      g_free (job);
+    } else {
+      j = &job->next;
+    }
+  }
+
+#ifdef HAVE_LIBPTHREAD
+  while (plugin_jobs_working_for (p))
+    pthread_cond_wait (&plugin_job_finished, &plugin_job_lock);
+#endif
+
+  for (job = plugin_jobs_done; job != NULL; job = job->next)
+    if (job->plugin == p)
+      job->cancelled = TRUE;
+
+  plugin_job_unlock ();
+}
+
+/* Take away the timers, idle tasks and jobs of p */
+void plugin_async_remove (PLUGIN_OBJECT *p)
+{
+  plugin_tasks_remove (0, p);
+  plugin_jobs_remove (p);
+}
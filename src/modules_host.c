@@ -0,0 +1,382 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1999 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Plugins run apart. With "Run plugins apart" set in the preferences
+ * each plugin is loaded by an amcl-pluginhost process of its own (see
+ * pluginhost.c) instead of into amcl, so a plugin that is slow only
+ * slows itself and one that crashes only stops itself.
+ *
+ * What the plugin registers comes back here as commands, and is
+ * registered on its behalf: its data and line functions become
+ * functions here that put events in its ring and return at once. When
+ * the plugin falls a ring behind, events are dropped and it is told
+ * how many, rather than amcl waiting for it; the plugin waits for amcl
+ * when its own ring is full. Run apart, line functions can't gag or
+ * replace lines, and outgoing functions can't change commands, as amcl
+ * doesn't wait for their answer.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gtk/gtk.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "amcl.h"
+#include "modules.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* How long, in ms, a plugin has to say what it is when started */
+#define PLUGIN_HOST_START_WAIT 5000
+
+/* And to stop when told to, before it is killed */
+#define PLUGIN_HOST_STOP_WAIT  1000
+
+typedef struct {
+  PLUGIN_OBJECT *plugin;
+  PLUGIN_SHARED *shared;
+  gint           fd;            /* -1 once the plugin has gone */
+  pid_t          pid;
+  gint           input;
+  guint          dropped;       /* Events not yet told about */
+  gboolean       ready;         /* Its init-function has returned */
+} PLUGIN_HOST;
+
+static CONNECTION_DATA *plugin_host_connection (gint index)
+{
+  if (index >= 0 && index < 15 && connections[index] != NULL)
+    return connections[index];
+
+  return main_connection;
+}
+
+static void plugin_host_event (PLUGIN_HOST *host, gint type, CONNECTION_DATA *c,
+			       gint arg, gchar *text)
+{
+  gint index = c ? c->notebook : 0;
+
+  if (host->fd < 0)
+    return;
+
+  if (host->dropped > 0) {
+    if (!plugin_ring_put (&host->shared->events, PLUGIN_HOST_DROPPED, 0,
+			  host->dropped, NULL, 0)) {
+      host->dropped++;
+      return;
+    }
+
+    host->dropped = 0;
+  }
+
+  if (!plugin_ring_put (&host->shared->events, type, index, arg, text, -1)) {
+    host->dropped++;
+    return;
+  }
+
+  plugin_ring_wake (host->fd);
+}
+
+static void plugin_host_data_in (PLUGIN_OBJECT *p, CONNECTION_DATA *c, gchar *data, gint h)
+{
+  plugin_host_event ((PLUGIN_HOST *) p->host, PLUGIN_HOST_DATA_IN, c, 0, data);
+}
+
+static void plugin_host_data_out (PLUGIN_OBJECT *p, CONNECTION_DATA *c, gchar *data, gint h)
+{
+  plugin_host_event ((PLUGIN_HOST *) p->host, PLUGIN_HOST_DATA_OUT, c, 0, data);
+}
+
+static gint plugin_host_line (PLUGIN_OBJECT *p, PLUGIN_LINE *line, gint h)
+{
+  plugin_host_event ((PLUGIN_HOST *) p->host, PLUGIN_HOST_LINE, line->connection,
+		     line->prompt, (gchar *) line->raw);
+
+  return PLUGIN_LINE_PASS;
+}
+
+static void plugin_host_info (PLUGIN_HOST *host, gchar *text, gint length)
+{
+  PLUGIN_INFO *info = g_new0 (PLUGIN_INFO, 1);
+  gchar       *end  = text + length;
+  gchar      **field[4];
+  gint         i;
+
+  field[0] = &info->plugin_name;
+  field[1] = &info->plugin_author;
+  field[2] = &info->plugin_version;
+  field[3] = &info->plugin_descr;
+
+  for (i = 0; i < 4; i++) {
+    *field[i] = g_strdup (text < end ? text : "");
+    text += strlen (text) + 1;
+  }
+
+  host->plugin->info = info;
+}
+
+static void plugin_host_command (PLUGIN_HOST *host, PLUGIN_MESSAGE *m, gchar *text)
+{
+  PLUGIN_DATA *data;
+
+  switch (m->type) {
+  case PLUGIN_HOST_INFO:
+    if (host->plugin->info == NULL)
+      plugin_host_info (host, text, m->length);
+    break;
+
+  case PLUGIN_HOST_DATA:
+    if (m->arg < 0 || m->arg >= PLUGIN_DATA_DIRECTIONS)
+      break;
+
+    data = g_new0 (PLUGIN_DATA, 1);
+    data->plugin = host->plugin;
+    data->dir    = m->arg;
+
+    if (data->dir == PLUGIN_DATA_LINE)
+      data->linefunc = plugin_host_line;
+    else if (data->dir == PLUGIN_DATA_OUT)
+      data->datafunc = plugin_host_data_out;
+    else
+      data->datafunc = plugin_host_data_in;
+
+    Plugin_data_list = g_list_append (Plugin_data_list, (gpointer) data);
+    plugin_hooks_rebuild ();
+    break;
+
+  case PLUGIN_HOST_TEXT:
+    plugin_add_connection_text (plugin_host_connection (m->connection), text, m->arg);
+    break;
+
+  case PLUGIN_HOST_POPUP:
+    popup_window (text);
+    break;
+
+  case PLUGIN_HOST_SEND:
+    connection_send (plugin_host_connection (m->connection), text);
+    break;
+
+  case PLUGIN_HOST_READY:
+    host->ready = TRUE;
+    break;
+
+  case PLUGIN_HOST_AFTER:
+  case PLUGIN_HOST_EVERY:
+    timer_add (plugin_host_connection (m->connection), m->arg, text,
+	       m->type == PLUGIN_HOST_EVERY);
+    break;
+  }
+}
+
+/* Everything the plugin has sent, then room made for it to send more */
+static gboolean plugin_host_commands (PLUGIN_HOST *host)
+{
+  PLUGIN_MESSAGE  m;
+  gchar          *text;
+  gboolean        alive = plugin_ring_woken (host->fd);
+  gboolean        read  = FALSE;
+  gboolean        broken;
+
+  while (host->fd >= 0 &&
+	 (text = plugin_ring_get (&host->shared->commands, &m, &broken)) != NULL) {
+    plugin_host_command (host, &m, text);
+    g_free (text);
+    read = TRUE;
+  }
+
+  /* Whatever wrote that can't be trusted with more */
+  if (host->fd >= 0 && broken)
+    return FALSE;
+
+  if (read && host->fd >= 0)
+    plugin_ring_wake (host->fd);
+
+  return alive;
+}
+
+static void plugin_host_stop (PLUGIN_HOST *host)
+{
+  gint waited;
+
+  if (host->fd < 0)
+    return;
+
+  if (host->input)
+    gdk_input_remove (host->input);
+
+  close (host->fd);
+  host->fd = -1;
+  host->input = 0;
+  munmap (host->shared, sizeof (PLUGIN_SHARED));
+
+  /* It has gone already, unless it is being stopped to be reloaded */
+  if (host->pid > 0) {
+    kill (host->pid, SIGTERM);
+
+    /* A plugin can keep SIGTERM from it, but not hold amcl up */
+    for (waited = 0; waitpid (host->pid, NULL, WNOHANG) == 0; waited += 10) {
+      if (waited >= PLUGIN_HOST_STOP_WAIT) {
+	kill (host->pid, SIGKILL);
+	waitpid (host->pid, NULL, 0);
+	break;
+      }
+
+      usleep (10000);
+    }
+  }
+}
+
+static void plugin_host_read (PLUGIN_HOST *host, gint source, GdkInputCondition condition)
+{
+  if (plugin_host_commands (host))
+    return;
+
+  plugin_host_stop (host);
+  g_message ("Plugin `%s' has stopped.", host->plugin->name);
+
+  host->plugin->enabeled = FALSE;
+  plugin_hooks_rebuild ();
+}
+
+/* Start amcl-pluginhost on p->filename, and wait for its plugin to
+ * be ready
+ */
+static gboolean plugin_host_run (PLUGIN_HOST *host)
+{
+  PLUGIN_OBJECT *p = host->plugin;
+  struct pollfd  pfd;
+  gchar          shmname[] = "/tmp/amcl-pluginXXXXXX";
+  gchar          shmfd_arg[16], fd_arg[16];
+  gint           shmfd, fds[2];
+
+  if ((shmfd = mkstemp (shmname)) < 0) {
+    g_message ("Error starting plugin (%s): %s.", p->name, strerror (errno));
+    return FALSE;
+  }
+
+  unlink (shmname);
+
+  if (ftruncate (shmfd, sizeof (PLUGIN_SHARED)) < 0 ||
+      socketpair (AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+    g_message ("Error starting plugin (%s): %s.", p->name, strerror (errno));
+    close (shmfd);
+    return FALSE;
+  }
+
+  host->shared = mmap (NULL, sizeof (PLUGIN_SHARED), PROT_READ | PROT_WRITE,
+		       MAP_SHARED, shmfd, 0);
+
+  if (host->shared == MAP_FAILED) {
+    g_message ("Error starting plugin (%s): %s.", p->name, strerror (errno));
+    close (shmfd); close (fds[0]); close (fds[1]);
+    return FALSE;
+  }
+
+  if ((host->pid = fork ()) == 0) {
+    glong fd, max = sysconf (_SC_OPEN_MAX);
+
+    /* Mud sockets and the X connection are amcl's alone, or closing
+     * them there wouldn't close them
+     */
+    for (fd = 3; fd < (max > 0 ? max : 256); fd++)
+      if (fd != shmfd && fd != fds[1])
+	close (fd);
+
+    g_snprintf (shmfd_arg, sizeof (shmfd_arg), "%d", shmfd);
+    g_snprintf (fd_arg, sizeof (fd_arg), "%d", fds[1]);
+    execl (BINDIR "/amcl-pluginhost", "amcl-pluginhost", shmfd_arg, fd_arg,
+	   p->filename, NULL);
+    g_message ("Error starting " BINDIR "/amcl-pluginhost: %s.", strerror (errno));
+    _exit (1);
+  }
+
+  close (shmfd);
+  close (fds[1]);
+  host->fd = fds[0];
+  host->input = 0;
+  host->dropped = 0;
+  host->ready = FALSE;
+  fcntl (host->fd, F_SETFL, O_NONBLOCK);
+
+  if (host->pid < 0) {
+    g_message ("Error starting plugin (%s): %s.", p->name, strerror (errno));
+    plugin_host_stop (host);
+    return FALSE;
+  }
+
+  /* Wait for its init-function to return, so what it registers there
+   * is registered here before any line is sent its way
+   */
+  pfd.fd = host->fd;
+  pfd.events = POLLIN;
+
+  while (!host->ready) {
+    if (poll (&pfd, 1, PLUGIN_HOST_START_WAIT) <= 0 || !plugin_host_commands (host)) {
+      g_message ("Plugin `%s' didn't start.", p->name);
+      plugin_host_stop (host);
+      return FALSE;
+    }
+  }
+
+  host->input = gdk_input_add (host->fd, GDK_INPUT_READ,
+			       (GdkInputFunction) plugin_host_read, host);
+
+  return TRUE;
+}
+
+/* Have p run apart; it is started by plugin_host_reload() */
+void plugin_host_add (PLUGIN_OBJECT *p)
+{
+  PLUGIN_HOST *host = g_new0 (PLUGIN_HOST, 1);
+
+  host->plugin = p;
+  host->fd     = -1;
+  p->host      = host;
+}
+
+gboolean plugin_host_running (PLUGIN_OBJECT *p)
+{
+  return ((PLUGIN_HOST *) p->host)->fd >= 0;
+}
+
+/* Stop the plugin's amcl-pluginhost, if it is running, and start
+ * another on what is in its file now. What the plugin registered, and
+ * its info, must have been taken back
+ */
+gboolean plugin_host_reload (PLUGIN_OBJECT *p)
+{
+  PLUGIN_HOST *host = (PLUGIN_HOST *) p->host;
+
+  plugin_host_stop (host);
+
+  return plugin_host_run (host);
+}
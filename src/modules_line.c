@@ -0,0 +1,196 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1999 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Line functions, version 2 of the plugin API. read_from_connection()
+ * cuts what the mud sends into lines and prompts once telnet is done
+ * with it, and each is shown here to the line functions of enabled
+ * plugins as text without colour codes and the runs of colour it was
+ * in, so they needn't parse any of it themselves. They can let it be
+ * shown, gag it or replace it, before it is shown or triggers see it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gtk/gtk.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amcl.h"
+#include "modules.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* Made again for every line, so kept */
+static GString *line_text;
+static GArray  *line_styles;
+
+static void plugin_line_sgr (CONNECTION_DATA *connection, gint code)
+{
+  if (code == 0) {
+    connection->ansi_fg   = -1;
+    connection->ansi_bg   = -1;
+    connection->ansi_bold = FALSE;
+  } else if (code == 1) {
+    connection->ansi_bold = TRUE;
+  } else if (code == 22) {
+    connection->ansi_bold = FALSE;
+  } else if (code >= 30 && code <= 37) {
+    connection->ansi_fg = code - 30;
+  } else if (code == 39) {
+    connection->ansi_fg = -1;
+  } else if (code >= 40 && code <= 47) {
+    connection->ansi_bg = code - 40;
+  } else if (code == 49) {
+    connection->ansi_bg = -1;
+  }
+}
+
+/* Split raw into its text and the colours the text is in. The colour
+ * the mud sets goes on to the next line, so is kept in the connection
+ */
+static void plugin_line_parse (CONNECTION_DATA *connection, const gchar *raw)
+{
+  PLUGIN_STYLE style;
+  const guchar *p = (const guchar *) raw;
+
+  g_string_truncate (line_text, 0);
+  g_array_set_size (line_styles, 0);
+  style.length = 0;
+
+  while (*p) {
+    if (*p == '\033' && p[1] == '[') {
+      gint code = 0;
+
+      for (p += 2; isdigit (*p) || *p == ';'; p++) {
+	if (*p == ';') {
+	  plugin_line_sgr (connection, code);
+	  code = 0;
+	} else {
+	  code = code * 10 + *p - '0';
+	}
+      }
+
+      if (*p == 'm')
+	plugin_line_sgr (connection, code);
+
+      if (*p)
+	p++;
+
+      continue;
+    }
+
+    /* Prompt marks from telnet, and the like */
+    if (*p < ' ' && *p != '\t') {
+      p++;
+      continue;
+    }
+
+    if (style.length == 0 || style.fg != connection->ansi_fg ||
+	style.bg != connection->ansi_bg || style.bold != connection->ansi_bold) {
+      if (style.length > 0)
+	g_array_append_val (line_styles, style);
+
+      style.start  = line_text->len;
+      style.length = 0;
+      style.fg     = connection->ansi_fg;
+      style.bg     = connection->ansi_bg;
+      style.bold   = connection->ansi_bold;
+    }
+
+    g_string_append_c (line_text, *p++);
+    style.length++;
+  }
+
+  if (style.length > 0)
+    g_array_append_val (line_styles, style);
+}
+
+/* What to show for a line or prompt from the mud, once the line
+ * functions have seen it: NULL if one gagged it, else raw or a copy of
+ * what replaced it, which the caller frees. Later plugins see what
+ * earlier ones replaced a line with. Only what is shown moves the
+ * connection's colour on, so it is put back before a replacement is
+ * parsed, or when the line is gagged
+ */
+gchar *plugin_line_filter (CONNECTION_DATA *connection, gchar *raw, gboolean prompt)
+{
+  PLUGIN_LINE  line;
+  PLUGIN_HOOK *h;
+  gchar       *shown = raw;
+  gshort       fg    = connection->ansi_fg;
+  gshort       bg    = connection->ansi_bg;
+  gboolean     bold  = connection->ansi_bold;
+
+  if (line_text == NULL) {
+    line_text   = g_string_new ("");
+    line_styles = g_array_new (FALSE, FALSE, sizeof (PLUGIN_STYLE));
+  }
+
+  memset (&line, 0, sizeof (line));
+  line.connection = connection;
+  line.prompt     = prompt;
+  line.raw        = raw;
+
+  plugin_line_parse (connection, raw);
+
+  for (h = Plugin_hooks[PLUGIN_DATA_LINE]; h->plugin != NULL; h++) {
+    line.text     = line_text->str;
+    line.length   = line_text->len;
+    line.styles   = (PLUGIN_STYLE *) line_styles->data;
+    line.n_styles = line_styles->len;
+
+    switch (plugin_hook_line (h, &line)) {
+    case PLUGIN_LINE_GAG:
+      if (shown != raw)
+	g_free (shown);
+      g_free (line.replacement);
+      connection->ansi_fg   = fg;
+      connection->ansi_bg   = bg;
+      connection->ansi_bold = bold;
+      return NULL;
+
+    case PLUGIN_LINE_REPLACE:
+      if (line.replacement == NULL)
+	break;
+
+      if (shown != raw)
+	g_free (shown);
+
+      line.raw = shown = line.replacement;
+      line.replacement = NULL;
+      connection->ansi_fg   = fg;
+      connection->ansi_bg   = bg;
+      connection->ansi_bold = bold;
+      plugin_line_parse (connection, shown);
+      break;
+
+    default:
+      break;
+    }
+
+    g_free (line.replacement);
+    line.replacement = NULL;
+  }
+
+  return shown;
+}
@@ -0,0 +1,176 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1999 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * The rings amcl and amcl-pluginhost talk through. Each ring has one
+ * writer, which alone moves head, and one reader, which alone moves
+ * tail, so neither needs a lock: head and tail only ever grow, and
+ * what is between them is the messages not yet read. A byte written
+ * to the socket between the two wakes the other side; the byte says
+ * nothing, the rings say what happened.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gtk/gtk.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "amcl.h"
+#include "modules.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* What is written before head moves is seen before it has moved */
+#define plugin_ring_barrier() __sync_synchronize ()
+
+#define RING_MASK (PLUGIN_RING_SIZE - 1)
+
+static void plugin_ring_copy_in (PLUGIN_RING *ring, guint32 at, const void *from,
+				 guint32 length)
+{
+  guint32 offset = at & RING_MASK;
+  guint32 first  = MIN (length, PLUGIN_RING_SIZE - offset);
+
+  memcpy (ring->data + offset, from, first);
+  memcpy (ring->data, (const gchar *) from + first, length - first);
+}
+
+static void plugin_ring_copy_out (PLUGIN_RING *ring, guint32 at, void *to,
+				  guint32 length)
+{
+  guint32 offset = at & RING_MASK;
+  guint32 first  = MIN (length, PLUGIN_RING_SIZE - offset);
+
+  memcpy (to, ring->data + offset, first);
+  memcpy ((gchar *) to + first, ring->data, length - first);
+}
+
+/* Add a message, or FALSE if there is no room for it yet. Text longer
+ * than a quarter of the ring is cut short
+ */
+gboolean plugin_ring_put (PLUGIN_RING *ring, gint type, gint connection,
+			  gint arg, const gchar *text, gint length)
+{
+  PLUGIN_MESSAGE message;
+  guint32        head = ring->head;
+
+  if (text == NULL)
+    length = 0;
+  else if (length < 0)
+    length = strlen (text);
+
+  length = MIN (length, PLUGIN_RING_SIZE / 4);
+
+  if (PLUGIN_RING_SIZE - (head - ring->tail) < sizeof (message) + length)
+    return FALSE;
+
+  message.length     = length;
+  message.type       = type;
+  message.connection = connection;
+  message.arg        = arg;
+
+  plugin_ring_copy_in (ring, head, &message, sizeof (message));
+  plugin_ring_copy_in (ring, head + sizeof (message), text, length);
+
+  plugin_ring_barrier ();
+  ring->head = head + sizeof (message) + length;
+
+  return TRUE;
+}
+
+/* The next message, with its text, to be freed, or NULL if there is
+ * none yet. The other side writes the ring, so what it says is only
+ * believed if it fits in what has been written; if not, *broken is
+ * set, and the other side is to be taken as gone
+ */
+gchar *plugin_ring_get (PLUGIN_RING *ring, PLUGIN_MESSAGE *message,
+			gboolean *broken)
+{
+  guint32  tail = ring->tail;
+  guint32  used = ring->head - tail;
+  gchar   *text;
+
+  *broken = FALSE;
+
+  if (used == 0)
+    return NULL;
+
+  if (used < sizeof (*message) || used > PLUGIN_RING_SIZE) {
+    *broken = TRUE;
+    return NULL;
+  }
+
+  plugin_ring_barrier ();
+
+  plugin_ring_copy_out (ring, tail, message, sizeof (*message));
+
+  if (message->length > used - sizeof (*message)) {
+    *broken = TRUE;
+    return NULL;
+  }
+
+  text = g_malloc (message->length + 1);
+  plugin_ring_copy_out (ring, tail + sizeof (*message), text, message->length);
+  text[message->length] = '\0';
+
+  plugin_ring_barrier ();
+  ring->tail = tail + sizeof (*message) + message->length;
+
+  return text;
+}
+
+/* Tell the other side to look at the rings. If the socket is full it
+ * has enough to wake it already, and if the other side has gone that
+ * is found out when reading
+ */
+void plugin_ring_wake (gint fd)
+{
+  gchar c = 0;
+
+  while (send (fd, &c, 1, MSG_NOSIGNAL) < 0 && errno == EINTR)
+    ;
+}
+
+/* Take the wakeups there are, FALSE if the other side has gone */
+gboolean plugin_ring_woken (gint fd)
+{
+  gchar buf[256];
+  gint  n;
+
+  for (;;) {
+    n = read (fd, buf, sizeof (buf));
+
+    if (n > 0)
+      continue;
+
+    if (n == 0)
+      return FALSE;
+
+    if (errno == EINTR)
+      continue;
+
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+  }
+}
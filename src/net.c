@@ -61,6 +61,13 @@ extern bool Keyflag;
 gchar *host, *port;
 extern GList *alias_list2;
 
+/* How long, in ms, the mud may pause in the middle of a line before
+ * what it sent is taken to be a prompt, for line plugins
+ */
+#define PROMPT_WAIT 250
+
+static gint connection_prompt_wait (CONNECTION_DATA *connection);
+
 /* mudFTP, www.abandoned.org/drylock/ */
 static void str_replace (char *buf, const char *s, const char *repl)
 {
@@ -113,43 +120,114 @@ static gchar *alias_check (gchar *buf, gchar *word, gchar *foo)
   return sent;
 }
 
+/* Show each command to the plugins that asked for outgoing data. They
+ * get the command in place, without its newline, and may change it
+ * there as long as it gets no longer
+ */
+static void plugin_data_outgoing (CONNECTION_DATA *connection, gchar *command)
+{
+  PLUGIN_HOOK *h;
+
+  for (h = Plugin_hooks[PLUGIN_DATA_OUT]; h->plugin != NULL; h++)
+    plugin_hook_data (h, connection, command);
+}
+
+/* Everything sent to a mud goes through here, typed, triggered or
+ * sent by other parts of the client. An alias on the first word is
+ * expanded, the text is split into commands at newlines and the
+ * command separator, timer commands are taken out, each command left
+ * is shown to the plugins, and what is left is sent in one go. All of
+ * it happens in the one buffer: commands a plugin empties aren't sent,
+ * and the rest are moved up over the gaps. Text not ending in a
+ * newline is sent without one.
+ */
+static void connection_send_text (CONNECTION_DATA *connection, gchar *text,
+				  gboolean alias, gboolean echo)
+{
+  gchar  separators[3];
+  gchar *sent = NULL;
+  gchar *command, *end, *out;
+  gint   length;
+
+  if (alias) {
+    gchar *word = g_malloc0 (strlen (text) + 2);
+    gchar *foo  = g_malloc0 (strlen (text) + 2);
+
+    sent = alias_check (text, word, foo);
+
+    g_free (word);
+    g_free (foo);
+  }
+
+  if ( !sent )
+    sent = g_strdup (text);
+
+  separators[0] = '\n';
+  separators[1] = prefs.CommDev[0];
+  separators[2] = '\0';
+
+  for (command = out = sent; *command != '\0'; command = end) {
+    gboolean ended;
+
+    /* #after, #every and the like, see timer.c */
+    if ((end = timer_command (connection, command, separators, echo)) != NULL) {
+      if (*end != '\0')
+	end++;
+      continue;
+    }
+
+    end    = command + strcspn (command, separators);
+    ended  = (*end != '\0');
+    length = end - command;
+
+    if (ended)
+      *end++ = '\0';
+
+    plugin_data_outgoing (connection, command);
+
+    /* Emptied by a plugin */
+    if (length > 0 && *command == '\0')
+      continue;
+
+    length = strlen (command);
+    memmove (out, command, length);
+    out += length;
+
+    if (ended)
+      *out++ = '\n';
+  }
+
+  *out = '\0';
+
+  if (out > sent && connection->connected) {
+    /* error checking here */
+    send (connection->sockfd, sent, out - sent, 0);
+#ifndef WITHOUT_MAPPER
+    map_room_command (sent);
+#endif
+  }
+
+  if (echo && out > sent)
+    textfield_add (connection->window, sent, MESSAGE_SENT);
+
+  g_free (sent);
+}
+
 /* Added by Bret Robideaux (fayd@alliences.org)
  * I needed a separate way to send triggered actions to game, without
  * messing up the players command line or adding to his history.
  */
-static void action_send_to_connection (gchar *entry_text, CONNECTION_DATA *connection)
+void action_send_to_connection (gchar *entry_text, CONNECTION_DATA *connection)
 {
     gchar *temp_entry;
-    gchar *word;
-    gchar *foo;
-    gchar *sent=0;
-    gint   i = 0;
 
     temp_entry = g_malloc0 (strlen (entry_text) + 2);
-    word       = g_malloc0 (strlen (entry_text) + 2);
-    foo        = g_malloc0 (strlen (entry_text) + 2);
     strcat (temp_entry, entry_text);
     strcat (temp_entry, "\n");
 
-    sent = alias_check (temp_entry, word, foo);
-
-    if ( !sent )
-        sent = temp_entry;
-
-    for(;sent[i]!=0;i++)
-      if(sent[i] == prefs.CommDev[0]) sent[i] = '\n';
-    
-    if (connection->connected) {
-      /* error checking here */
-      send (connection->sockfd, sent, strlen (sent), 0);
-    }
-
-    if ( sent != temp_entry )
-        g_free (sent);
+    connection_send_text (connection, temp_entry, TRUE, FALSE);
 
     g_free (temp_entry);
-    g_free (word);
-    g_free (foo);
 }
 
 
@@ -187,6 +265,14 @@ CONNECTION_DATA *make_connection( gchar *hoster, gchar *porter)
 
 void disconnect (GtkWidget *widget, CONNECTION_DATA *connection)
 {
+    if (connection->partial_wait)
+    {
+        gtk_timeout_remove (connection->partial_wait);
+        connection_prompt_wait (connection);
+    }
+
+    timer_remove_connection (connection);
+
     close (connection->sockfd);
     gdk_input_remove (connection->data_ready);
     textfield_add (connection->window, "*** Connection closed.\n", MESSAGE_NORMAL);
@@ -243,6 +329,10 @@ void open_connection (CONNECTION_DATA *connection)
 
     textfield_add (connection->window, "*** Connection established.\n", MESSAGE_NORMAL);
 
+    connection->ansi_fg   = -1;
+    connection->ansi_bg   = -1;
+    connection->ansi_bold = FALSE;
+
     connection->data_ready = gdk_input_add(connection->sockfd, GDK_INPUT_READ,
 					   GTK_SIGNAL_FUNC(read_from_connection),
 					   (gpointer) connection);
@@ -251,14 +341,130 @@ void open_connection (CONNECTION_DATA *connection)
     gtk_widget_set_sensitive (menu_main_disconnect, TRUE);
 }
 
+/* Text from the mud, after telnet: shown, followed on the automap and
+ * checked for triggers
+ */
+static void connection_show (CONNECTION_DATA *connection, gchar *text)
+{
+    gchar  triggered_action[85];
+
+    textfield_add (connection->window, text, MESSAGE_ANSI);
+
+#ifndef WITHOUT_MAPPER
+    /* Follow the player around the automap */
+    map_room_text (text);
+#endif
+
+    /* Added by Bret Robideaux (fayd@alliences.org)
+     * OK, this seems like a good place to handle checking for action triggers
+     */
+    if ( check_actions (text, triggered_action) )
+    {
+        action_send_to_connection (triggered_action, connection);
+    }
+}
+
+/* Prompts go their own way, see prompt.c. They are still checked for
+ * actions, but never seen by the automapper
+ */
+static void connection_prompt (CONNECTION_DATA *connection, gchar *prompt)
+{
+    gchar  triggered_action[85];
+
+    if (!prompt_show (connection, prompt))
+        textfield_add (connection->window, prompt, MESSAGE_ANSI);
+
+    if ( check_actions (prompt, triggered_action) )
+    {
+        action_send_to_connection (triggered_action, connection);
+    }
+}
+
+static void connection_line (CONNECTION_DATA *connection, gchar *line, gboolean prompt)
+{
+    gchar *shown = plugin_line_filter (connection, line, prompt);
+
+    if (shown == NULL)
+        return;
+
+    if (prompt)
+    {
+        connection_prompt (connection, shown);
+    } else {
+        gchar *text = g_strconcat (shown, "\n", NULL);
+
+        connection_show (connection, text);
+        g_free (text);
+    }
+
+    if (shown != line)
+        g_free (shown);
+}
+
+/* The mud didn't end what it sent last, and has sent nothing since, so
+ * it is taken to be a prompt
+ */
+static gint connection_prompt_wait (CONNECTION_DATA *connection)
+{
+    gchar *prompt;
+
+    connection->partial_wait = 0;
+
+    if (connection->partial == NULL || connection->partial->len == 0)
+        return FALSE;
+
+    prompt = g_strdup (connection->partial->str);
+    g_string_truncate (connection->partial, 0);
+    connection_line (connection, prompt, TRUE);
+    g_free (prompt);
+
+    return FALSE;
+}
+
+/* Cut text into lines and prompts. Prompts end at a telnet GA or EOR,
+ * which pre_process() left as \377; what isn't ended is a prompt if it
+ * matches the prompt pattern, or else waits for the rest of it, and
+ * becomes a prompt if the rest doesn't come
+ */
+static void connection_read_lines (CONNECTION_DATA *connection, gchar *text)
+{
+    gchar *line, *end;
+
+    if (connection->partial == NULL)
+        connection->partial = g_string_new ("");
+
+    if (connection->partial_wait)
+    {
+        gtk_timeout_remove (connection->partial_wait);
+        connection->partial_wait = 0;
+    }
+
+    g_string_append (connection->partial, text);
+
+    for (line = connection->partial->str; (end = strpbrk (line, "\n\377")) != NULL;
+         line = end + 1)
+    {
+        gboolean prompt = (*end != '\n');
+
+        *end = '\0';
+        connection_line (connection, line, prompt);
+    }
+
+    g_string_erase (connection->partial, 0, line - connection->partial->str);
+
+    if (connection->partial->len > 0 && prompt_match (connection->partial->str))
+        connection_prompt_wait (connection);
+    else if (connection->partial->len > 0)
+        connection->partial_wait =
+            gtk_timeout_add (PROMPT_WAIT, (GtkFunction) connection_prompt_wait,
+                             connection);
+}
+
 void read_from_connection (CONNECTION_DATA *connection, gint source, GdkInputCondition condition)
 {
     gchar  buf[4096];
-    gchar  triggered_action[85];
     gint   numbytes;
-    gchar *m;
-    gint   len;
-    GList *t;
+    PLUGIN_HOOK *h;
     
     if ( (numbytes = recv (connection->sockfd, buf, 2048, 0) ) == - 1 )
     {
@@ -281,34 +487,23 @@ void read_from_connection (CONNECTION_DATA *connection, gint source, GdkInputCon
         return;
     }
 
-    for (t = g_list_first(Plugin_data_list); t != NULL; t = t->next) {
-      PLUGIN_DATA *pd;
-      
-      if (t->data != NULL) {
-	pd = (PLUGIN_DATA *) t->data;
-
-	if (pd->plugin && pd->plugin->enabeled && (pd->dir == PLUGIN_DATA_IN)) {
-	  (* pd->datafunc) (pd->plugin, connection, buf, (gint) pd->plugin->handle);
-	}
-      }
-    }
+    for (h = Plugin_hooks[PLUGIN_DATA_IN]; h->plugin != NULL; h++)
+      plugin_hook_data (h, connection, buf);
     
     str_replace (buf, "\r", "");
 
     /* Changes by Benjamin Curtis */
-    len = pre_process(buf, connection);
-    m   = (gchar *) malloc(len + 2);
-    memcpy(m, buf, len+1);
+    pre_process(buf, connection);
 
-    textfield_add (connection->window, m, MESSAGE_ANSI);
-
-    /* Added by Bret Robideaux (fayd@alliances.org)
-     * OK, this seems like a good place to handle checking for action triggers
+    /* Plugins with line functions get whole lines, and prompts are
+     * taken apart; otherwise nobody waits
      */
-    if ( check_actions (buf, triggered_action) )
-    {
-        action_send_to_connection (triggered_action, connection);
-    }
+    if (Plugin_hooks[PLUGIN_DATA_LINE]->plugin != NULL ||
+        (connection->partial && connection->partial->len > 0) ||
+        strchr (buf, '\377') || prompt_have_pattern ())
+        connection_read_lines (connection, buf);
+    else
+        connection_show (connection, buf);
 }
 
 void send_to_connection (GtkWidget *widget, gpointer data)
@@ -318,14 +513,8 @@ void send_to_connection (GtkWidget *widget, gpointer data)
 
   extern GList *EntryHistory;
   extern GList *EntryCurr;
-  GList *tmp;
-  ALIAS_DATA *alias;
   gchar *entry_text;
   gchar *temp_entry;
-  gchar *word;
-  gchar *foo;
-  gchar *sent=0;
-  gint   i=0;
 
   Keyflag = TRUE;
   number = gtk_notebook_get_current_page (GTK_NOTEBOOK (main_notebook));
@@ -336,8 +525,7 @@ void send_to_connection (GtkWidget *widget, gpointer data)
 
   if (entry_text[0] == '\0') 
     {
-      send (cd->sockfd, "\n", 1, 0);
-      textfield_add(cd->window, "\n",MESSAGE_SENT);
+      connection_send_text (cd, "\n", FALSE, TRUE);
       return;
     }
   
@@ -358,66 +546,22 @@ void send_to_connection (GtkWidget *widget, gpointer data)
   EntryCurr = g_list_last (EntryHistory);
   
   temp_entry = g_malloc0 (strlen (entry_text) + 2);
-  word       = g_malloc0 (strlen (entry_text) + 2);
-  foo        = g_malloc0 (strlen (entry_text) + 2);
   strcat (temp_entry, entry_text);
   strcat (temp_entry, "\n");
-  sscanf (temp_entry, "%s %[^\n]", word, foo);
-  
-  for ( tmp = g_list_first (alias_list2); tmp != NULL; tmp = tmp->next ) {
-    if ( tmp->data != NULL ) {
-      alias = (ALIAS_DATA *) tmp->data;
-      
-      if ( alias->alias && !strcmp (word, alias->alias) ) {
-	sent = g_malloc0(strlen(alias->replace)+strlen(foo)+3);
-	sprintf (sent, "%s %s\n", alias->replace, foo);
-	break;
-      }
-    }
-  }
 
-  if( !sent )
-    sent = temp_entry;
-
-  for(;sent[i]!=0;i++)
-    if(sent[i] == prefs.CommDev[0]) sent[i] = '\n';
-  
-  if (cd->connected) {
-    /* error checking here */
-    send (cd->sockfd, sent, strlen (sent), 0);
-  }
+  connection_send_text (cd, temp_entry, TRUE, prefs.EchoText);
 
-  if (prefs.EchoText) {
-    textfield_add (cd->window, sent, MESSAGE_SENT);
-  }
-  
   if ( prefs.KeepText )
     gtk_entry_select_region (GTK_ENTRY (text_entry), 0,
 			     GTK_ENTRY (text_entry)->text_length);
   else
     gtk_entry_set_text (GTK_ENTRY (text_entry), "");
   
-  if( sent != temp_entry )
-    g_free( sent );
-  
   g_free (temp_entry);
-  g_free (word);
-  g_free (foo);
 }
 
 void connection_send (CONNECTION_DATA *connection, gchar *message)
 {
-  gint i=0;
-  
-  gchar *sent = g_strdup (message);
-  
-  for(;sent[i]!=0;i++)
-    if(sent[i] == prefs.CommDev[0]) sent[i] = '\n';
-  
-  if (connection->echo && prefs.EchoText) { 
-    textfield_add (connection->window, message, MESSAGE_SENT);
-  }
-  
-  send (connection->sockfd, message, strlen (message), 0);
-  free(sent);
+  connection_send_text (connection, message, FALSE,
+			connection->echo && prefs.EchoText);
 }
@@ -0,0 +1,352 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1999 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* amcl-pluginhost, runs one plugin apart from amcl. Started by amcl
+ * (see modules_host.c), never by hand:
+ *
+ *   amcl-pluginhost shmfd sockfd plugin
+ *
+ * The plugin API functions are here too, the same to the plugin, but
+ * what they do is put commands in the ring to amcl. What amcl sees
+ * comes back as events, handed to the plugin's functions as amcl would.
+ * There is no display here, so plugins run apart can't use GTK+, and
+ * can't have menu items either.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gtk/gtk.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/poll.h>
+#include <unistd.h>
+
+#include "amcl.h"
+#include "modules.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+/* Seen by modules_line.c, which is shared with amcl */
+static PLUGIN_HOOK  host_hooks_none[1];
+PLUGIN_HOOK        *Plugin_hooks[PLUGIN_DATA_DIRECTIONS] = {
+  host_hooks_none, host_hooks_none, host_hooks_none
+};
+
+static PLUGIN_SHARED   *host_shared;
+static gint             host_fd;
+static PLUGIN_OBJECT    host_plugin;
+static CONNECTION_DATA  host_connections[15];
+
+/* Put a command for amcl, waiting for room if amcl is behind */
+static void host_put (gint type, CONNECTION_DATA *c, gint arg, gchar *text, gint length)
+{
+  struct pollfd pfd;
+
+  pfd.fd = host_fd;
+  pfd.events = POLLIN;
+
+  while (!plugin_ring_put (&host_shared->commands, type, c ? c->notebook : 0,
+			   arg, text, length)) {
+    poll (&pfd, 1, -1);
+
+    if (!plugin_ring_woken (host_fd))
+      exit (0);
+  }
+
+  plugin_ring_wake (host_fd);
+}
+
+static gboolean host_register (gint handle, gchar *function, PLUGIN_DATA_DIRECTION dir)
+{
+  PLUGIN_HOOK *h;
+  gpointer     func;
+  gint         n;
+
+  if ((func = dlsym (host_plugin.handle, function)) == NULL) {
+    g_message ("Error register for data: %s", dlerror());
+    return FALSE;
+  }
+
+  for (n = 0; Plugin_hooks[dir][n].plugin != NULL; n++)
+    ;
+
+  h = g_new0 (PLUGIN_HOOK, n + 2);
+  memcpy (h, Plugin_hooks[dir], n * sizeof (PLUGIN_HOOK));
+
+  if (Plugin_hooks[dir] != host_hooks_none)
+    g_free (Plugin_hooks[dir]);
+
+  if (dir == PLUGIN_DATA_LINE)
+    h[n].linefunc = (plugin_linefunc) func;
+  else
+    h[n].datafunc = (plugin_datafunc) func;
+
+  h[n].plugin = &host_plugin;
+  h[n].handle = handle;
+  Plugin_hooks[dir] = h;
+
+  host_put (PLUGIN_HOST_DATA, NULL, dir, NULL, 0);
+
+  return TRUE;
+}
+
+/* Nothing waits for these here, so they aren't timed as in modules.c */
+void plugin_hook_data (PLUGIN_HOOK *h, CONNECTION_DATA *c, gchar *data)
+{
+  (* h->datafunc) (h->plugin, c, data, h->handle);
+}
+
+gint plugin_hook_line (PLUGIN_HOOK *h, PLUGIN_LINE *line)
+{
+  return (* h->linefunc) (h->plugin, line, h->handle);
+}
+
+/*
+ * The plugin API, see modules_api.c
+ */
+void plugin_popup_message (gchar *message)
+{
+  host_put (PLUGIN_HOST_POPUP, NULL, 0, message, -1);
+}
+
+void plugin_add_connection_text (CONNECTION_DATA *connection, gchar *message, gint color)
+{
+  host_put (PLUGIN_HOST_TEXT, connection, color, message, -1);
+}
+
+void plugin_connection_send (CONNECTION_DATA *connection, gchar *text)
+{
+  host_put (PLUGIN_HOST_SEND, connection, 0, text, -1);
+}
+
+/* A menu function would be run here, without a display */
+gboolean plugin_register_menu (gint handle, gchar *name, gchar *function)
+{
+  g_message ("Plugin `%s': menus can't be used apart.", host_plugin.name);
+  return FALSE;
+}
+
+gboolean plugin_register_data_incoming (gint handle, gchar *function)
+{
+  return host_register (handle, function, PLUGIN_DATA_IN);
+}
+
+gboolean plugin_register_data_outgoing (gint handle, gchar *function)
+{
+  return host_register (handle, function, PLUGIN_DATA_OUT);
+}
+
+gboolean plugin_register_line (gint handle, gchar *function)
+{
+  return host_register (handle, function, PLUGIN_DATA_LINE);
+}
+
+void plugin_line_replace (PLUGIN_LINE *line, gchar *text)
+{
+  g_free (line->replacement);
+  line->replacement = g_strdup (text);
+}
+
+gint plugin_api_version (void)
+{
+  return PLUGIN_API_VERSION;
+}
+
+/* There is no main loop here for these */
+gint plugin_register_timer (gint handle, gint interval, gchar *function, gpointer data)
+{
+  g_message ("Plugin `%s': timers can't be used apart.", host_plugin.name);
+  return 0;
+}
+
+gint plugin_register_idle (gint handle, gchar *function, gpointer data)
+{
+  g_message ("Plugin `%s': idle tasks can't be used apart.", host_plugin.name);
+  return 0;
+}
+
+void plugin_remove_task (gint id)
+{
+}
+
+/* Set by amcl, which doesn't answer, so there is no number to give */
+gint plugin_connection_timer (CONNECTION_DATA *connection, gint ms, gchar *command,
+			      gboolean repeat)
+{
+  host_put (repeat ? PLUGIN_HOST_EVERY : PLUGIN_HOST_AFTER, connection, ms,
+	    command, -1);
+
+  return 0;
+}
+
+void plugin_connection_untimer (gint id)
+{
+}
+
+/* Nothing here waits on the plugin, so it is done at once */
+gint plugin_queue_job (gint handle, gchar *work, gchar *done, gpointer data)
+{
+  plugin_workfunc workfunc;
+  plugin_donefunc donefunc = NULL;
+
+  if ((workfunc = (plugin_workfunc) dlsym (host_plugin.handle, work)) == NULL ||
+      (done != NULL && (donefunc = (plugin_donefunc) dlsym (host_plugin.handle, done)) == NULL)) {
+    g_message ("Error queue job: %s", dlerror());
+    return 0;
+  }
+
+  (* workfunc) (data);
+
+  if (donefunc)
+    (* donefunc) (&host_plugin, data, handle);
+
+  return 1;
+}
+
+static void host_event (PLUGIN_MESSAGE *m, gchar *text)
+{
+  CONNECTION_DATA *c = &host_connections[m->connection < 15 ? m->connection : 0];
+  PLUGIN_HOOK     *h;
+  gchar           *shown;
+
+  switch (m->type) {
+  case PLUGIN_HOST_DATA_IN:
+  case PLUGIN_HOST_DATA_OUT:
+    h = Plugin_hooks[m->type == PLUGIN_HOST_DATA_IN ? PLUGIN_DATA_IN : PLUGIN_DATA_OUT];
+
+    for (; h->plugin != NULL; h++)
+      plugin_hook_data (h, c, text);
+    break;
+
+  case PLUGIN_HOST_LINE:
+    /* What amcl shows is already decided */
+    shown = plugin_line_filter (c, text, m->arg);
+    if (shown != text)
+      g_free (shown);
+    break;
+
+  case PLUGIN_HOST_DROPPED:
+    g_message ("Plugin `%s' was too slow, %d events missed.",
+	       host_plugin.name, m->arg);
+    break;
+  }
+}
+
+int main (int argc, char *argv[])
+{
+  PLUGIN_INFO    *info;
+  PLUGIN_MESSAGE  m;
+  struct pollfd   pfd;
+  GString        *about;
+  gchar          *text;
+  gint            i;
+  gboolean        broken;
+
+  if (argc != 4) {
+    fprintf (stderr, "amcl-pluginhost is started by amcl.\n");
+    return 1;
+  }
+
+  host_fd = atoi (argv[2]);
+  host_shared = mmap (NULL, sizeof (PLUGIN_SHARED), PROT_READ | PROT_WRITE,
+		      MAP_SHARED, atoi (argv[1]), 0);
+
+  if (host_shared == MAP_FAILED) {
+    g_message ("Error starting plugin (%s): %s.", argv[3], strerror (errno));
+    return 1;
+  }
+
+  close (atoi (argv[1]));
+  fcntl (host_fd, F_SETFL, O_NONBLOCK);
+
+  if (strrchr (argv[3], '/'))
+    host_plugin.name = g_strdup (strrchr (argv[3], '/') + 1);
+  else
+    host_plugin.name = g_strdup (argv[3]);
+
+  host_plugin.filename = argv[3];
+  host_plugin.enabeled = TRUE;
+
+  if ((host_plugin.handle = dlopen (argv[3], RTLD_LAZY)) == NULL) {
+    g_message ("Error getting plugin handle (%s): %s.", host_plugin.name, dlerror());
+    return 1;
+  }
+
+  if ((info = dlsym (host_plugin.handle, "amcl_plugin_info")) == NULL) {
+    g_message ("Error, not an AMCL module: %s.", host_plugin.name);
+    return 1;
+  }
+
+  host_plugin.info = info;
+
+  for (i = 0; i < 15; i++) {
+    host_connections[i].notebook  = i;
+    host_connections[i].connected = TRUE;
+    host_connections[i].ansi_fg   = -1;
+    host_connections[i].ansi_bg   = -1;
+  }
+
+  /* The four strings, each ended by its NUL */
+  about = g_string_new (info->plugin_name);
+  g_string_append_c (about, '\n');
+  g_string_append (about, info->plugin_author);
+  g_string_append_c (about, '\n');
+  g_string_append (about, info->plugin_version);
+  g_string_append_c (about, '\n');
+  g_string_append (about, info->plugin_descr);
+  g_string_append_c (about, '\n');
+
+  for (text = about->str; (text = strchr (text, '\n')) != NULL; text++)
+    *text = '\0';
+
+  host_put (PLUGIN_HOST_INFO, NULL, 0, about->str, about->len);
+  g_string_free (about, TRUE);
+
+  if (info->init_function)
+    info->init_function (NULL, (gint) host_plugin.handle);
+
+  host_put (PLUGIN_HOST_READY, NULL, 0, NULL, 0);
+
+  pfd.fd = host_fd;
+  pfd.events = POLLIN;
+
+  for (;;) {
+    while ((text = plugin_ring_get (&host_shared->events, &m, &broken)) != NULL) {
+      host_event (&m, text);
+      g_free (text);
+    }
+
+    if (broken)
+      break;
+
+    poll (&pfd, 1, -1);
+
+    if (!plugin_ring_woken (host_fd))
+      break;
+  }
+
+  return 0;
+}
@@ -143,6 +143,21 @@ void load_prefs ( )
             if ( !strcmp (value, "On") )
                 prefs.Freeze = TRUE;
         }
+
+        if ( !strcmp (pref, "PluginsApart") )
+        {
+            if ( !strcmp (value, "On") )
+                prefs.PluginsApart = TRUE;
+        }
+
+        if ( !strcmp (pref, "PluginBudget") )
+            prefs.PluginBudget = atoi (value);
+
+        if ( !strcmp (pref, "PluginBudgetDisable") )
+        {
+            if ( !strcmp (value, "On") )
+                prefs.PluginBudgetDisable = TRUE;
+        }
     }
 
     if ( !prefs.FontName )
@@ -184,6 +199,15 @@ void save_prefs (GtkWidget *button, gpointer data)
     if ( prefs.Freeze )
         fprintf (fp, "Freeze On\n");
 
+    if ( prefs.PluginsApart )
+        fprintf (fp, "PluginsApart On\n");
+
+    if ( prefs.PluginBudget > 0 )
+        fprintf (fp, "PluginBudget %d\n", prefs.PluginBudget);
+
+    if ( prefs.PluginBudgetDisable )
+        fprintf (fp, "PluginBudgetDisable On\n");
+
     fprintf(fp, "CommDev \"%c\"\n", prefs.CommDev[0]);
 
     if ( strlen (prefs.FontName) > 0 )
@@ -216,6 +240,27 @@ void prefs_freeze_cb (GtkWidget *widget, GtkWidget *check_freeze)
         prefs.Freeze = FALSE;
 }
 
+void prefs_plugins_apart_cb (GtkWidget *widget, GtkWidget *check_apart)
+{
+    if ( GTK_TOGGLE_BUTTON (check_apart)->active )
+        prefs.PluginsApart = TRUE;
+    else
+        prefs.PluginsApart = FALSE;
+}
+
+void prefs_plugin_budget_cb (GtkWidget *widget, GtkWidget *entry_budget)
+{
+    prefs.PluginBudget = atoi (gtk_entry_get_text (GTK_ENTRY (entry_budget)));
+}
+
+void prefs_plugin_budget_disable_cb (GtkWidget *widget, GtkWidget *check_budget)
+{
+    if ( GTK_TOGGLE_BUTTON (check_budget)->active )
+        prefs.PluginBudgetDisable = TRUE;
+    else
+        prefs.PluginBudgetDisable = FALSE;
+}
+
 void prefs_divide_cb (GtkWidget *widget, GtkWidget *entry_divide)
 {
   gchar *s;
@@ -284,16 +329,21 @@ void window_prefs (GtkWidget *widget, gpointer data)
     GtkWidget *check_autosave;
     GtkWidget *check_button;
     GtkWidget *check_freeze;
+    GtkWidget *check_apart;
+    GtkWidget *check_budget;
     GtkWidget *vbox;
     GtkWidget *hbox;
     GtkWidget *hbox_font;
     GtkWidget *hbox_divide;
     GtkWidget *entry_divide;
+    GtkWidget *hbox_budget;
+    GtkWidget *entry_budget;
     GtkWidget *label;
     GtkWidget *button_close;
     GtkWidget *button_select_font;
     GtkWidget *separator;
     GtkTooltips *tooltip;
+    gchar buf[16];
 
     gtk_widget_set_sensitive (menu_option_prefs, FALSE);
                               
@@ -365,6 +415,51 @@ void window_prefs (GtkWidget *widget, gpointer data)
     gtk_widget_show (check_freeze);
     gtk_toggle_button_set_state (GTK_TOGGLE_BUTTON (check_freeze), prefs.Freeze);
 
+    check_apart = gtk_check_button_new_with_label ("Run plugins apart?");
+    gtk_box_pack_start (GTK_BOX (vbox), check_apart, FALSE, TRUE, 0);
+    gtk_signal_connect (GTK_OBJECT (check_apart), "toggled",
+                        GTK_SIGNAL_FUNC (prefs_plugins_apart_cb), check_apart);
+    gtk_tooltips_set_tip (tooltip, check_apart,
+                          "With this toggled on, each plugin is run in a process "
+                          "of its own, so a slow plugin can't slow AMCL down and "
+                          "one that crashes can't take AMCL with it. Plugins run "
+                          "apart can't gag lines or use windows of their own."
+                          "\nThis is used the next time AMCL is started."
+                          , NULL);
+    GTK_WIDGET_UNSET_FLAGS (check_apart, GTK_CAN_FOCUS);
+    gtk_widget_show (check_apart);
+    gtk_toggle_button_set_state (GTK_TOGGLE_BUTTON (check_apart), prefs.PluginsApart);
+
+    check_budget = gtk_check_button_new_with_label ("Disable plugins that take too long?");
+    gtk_box_pack_start (GTK_BOX (vbox), check_budget, FALSE, TRUE, 0);
+    gtk_signal_connect (GTK_OBJECT (check_budget), "toggled",
+                        GTK_SIGNAL_FUNC (prefs_plugin_budget_disable_cb), check_budget);
+    gtk_tooltips_set_tip (tooltip, check_budget,
+                          "With this toggled on, a plugin that takes longer than "
+                          "the time below over one line or piece of text is "
+                          "disabled. Otherwise it is only said in the log."
+                          , NULL);
+    GTK_WIDGET_UNSET_FLAGS (check_budget, GTK_CAN_FOCUS);
+    gtk_widget_show (check_budget);
+    gtk_toggle_button_set_state (GTK_TOGGLE_BUTTON (check_budget), prefs.PluginBudgetDisable);
+
+    hbox_budget = gtk_hbox_new (TRUE, 0);
+    gtk_container_add (GTK_CONTAINER (vbox), hbox_budget);
+    gtk_widget_show (hbox_budget);
+
+    label = gtk_label_new ("   Plugin time, ms (0 for any)");
+    gtk_box_pack_start (GTK_BOX (hbox_budget), label, TRUE, FALSE, 0);
+    gtk_widget_show (label);
+
+    entry_budget = gtk_entry_new_with_max_length (5);
+    g_snprintf (buf, sizeof (buf), "%d", prefs.PluginBudget);
+    gtk_entry_set_text (GTK_ENTRY (entry_budget), buf);
+    gtk_box_pack_start (GTK_BOX (hbox_budget), entry_budget, TRUE, FALSE, 0);
+    gtk_widget_set_usize(GTK_WIDGET(entry_budget),50,23);
+    gtk_widget_show (entry_budget);
+    gtk_signal_connect (GTK_OBJECT (entry_budget), "changed",
+                        GTK_SIGNAL_FUNC (prefs_plugin_budget_cb), entry_budget);
+
     hbox_divide = gtk_hbox_new (TRUE, 0);
     gtk_container_add (GTK_CONTAINER (vbox), hbox_divide);
     gtk_widget_show (hbox_divide);
@@ -0,0 +1,340 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-2000 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Prompts. The mud ends them with telnet GA or EOR; for muds that don't,
+ * a pattern can say what a prompt looks like. They don't go the way of
+ * other lines: the automapper never sees them, and what else is done
+ * with them is set in ~/.amcl/prompts, a keyword and its value on each
+ * line:
+ *
+ *   pattern REGEX              text not ended by a newline that matches
+ *                              is a prompt, at once
+ *   status FORMAT              shown in the status bar, \1 to \9 being
+ *                              the groups of pattern, \0 all of it
+ *   fixed yes                  show prompts below the text, not in it
+ *   trigger REGEX - COMMAND    send COMMAND when a prompt matches, with
+ *                              \0 to \9 as in status
+ *
+ * Patterns are POSIX extended ones, matched against the prompt without
+ * its colour codes.
+ */
+
+#include "config.h"
+
+#include <gtk/gtk.h>
+#include <ctype.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amcl.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+#define PROMPT_GROUPS 10
+
+typedef struct {
+    regex_t   pattern;
+    gchar    *command;
+} PROMPT_TRIGGER;
+
+static struct {
+
+    gboolean  loaded;
+    regex_t   pattern;
+    gboolean  have_pattern;
+    gchar    *status;
+    gboolean  fixed;
+    GList    *triggers;
+    guint     context;      /* Of the status bar */
+} prompts;
+
+static gboolean prompt_compile(regex_t *pattern, gchar *text)
+{
+    gint error;
+
+    if ((error = regcomp(pattern, text, REG_EXTENDED)) != 0)
+    {
+        gchar message[128];
+
+        regerror(error, pattern, message, 128);
+        g_warning("prompt_compile: bad pattern \"%s\": %s\n", text, message);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void prompt_set(gchar *keyword, gchar *text)
+{
+    if (!g_strcasecmp(keyword, "pattern"))
+    {
+        if (prompts.have_pattern)
+            regfree(&prompts.pattern);
+
+        prompts.have_pattern = *text && prompt_compile(&prompts.pattern, text);
+    }
+    else if (!g_strcasecmp(keyword, "status"))
+    {
+        g_free(prompts.status);
+        prompts.status = *text ? g_strdup(text) : NULL;
+    }
+    else if (!g_strcasecmp(keyword, "fixed"))
+    {
+        prompts.fixed = !g_strcasecmp(text, "yes");
+    }
+    else if (!g_strcasecmp(keyword, "trigger"))
+    {
+        PROMPT_TRIGGER *trigger;
+        gchar          *command = strstr(text, " - ");
+
+        if (command == NULL)
+        {
+            g_warning("prompt_set: trigger \"%s\" has no command\n", text);
+            return;
+        }
+
+        *command = '\0';
+        command += 3;
+
+        trigger = g_new0(PROMPT_TRIGGER, 1);
+
+        if (!prompt_compile(&trigger->pattern, text))
+        {
+            g_free(trigger);
+            return;
+        }
+
+        trigger->command = g_strdup(command);
+        prompts.triggers = g_list_append(prompts.triggers, trigger);
+    }
+}
+
+static void prompt_load(void)
+{
+    FILE *fp;
+    gchar filename[256], line[512];
+
+    prompts.loaded = TRUE;
+
+    g_snprintf(filename, 256, "%s/.amcl/prompts", g_get_home_dir());
+
+    if ((fp = fopen(filename, "r")) != NULL)
+    {
+        while (fgets(line, 512, fp) != NULL)
+        {
+            gchar *text = line;
+            gint len = strlen(line);
+
+            while (len && isspace((guchar)line[len - 1]))
+                line[--len] = '\0';
+
+            while (*text && !isspace((guchar)*text))
+                text++;
+
+            if (*text)
+                *text++ = '\0';
+
+            while (isspace((guchar)*text))
+                text++;
+
+            prompt_set(line, text);
+        }
+
+        fclose(fp);
+    }
+
+    if (prompts.fixed)
+        gtk_widget_show(prompt_label);
+
+    if (prompts.status)
+    {
+        prompts.context = gtk_statusbar_get_context_id(GTK_STATUSBAR(prompt_statusbar),
+                                                       "prompt");
+        gtk_widget_show(prompt_statusbar);
+    }
+}
+
+/* The prompt without colour codes */
+static gchar *prompt_plain(gchar *text)
+{
+    gchar *plain = g_malloc(strlen(text) + 1);
+    gchar *to = plain;
+
+    while (*text)
+    {
+        if (*text == '\033' && text[1] == '[')
+        {
+            for (text += 2; *text && !isalpha((guchar)*text); text++)
+                ;
+
+            if (*text)
+                text++;
+        }
+        else
+        {
+            *to++ = *text++;
+        }
+    }
+
+    *to = '\0';
+
+    return plain;
+}
+
+/* format with \0 to \9 replaced by what the groups of a pattern matched */
+static gchar *prompt_expand(gchar *format, gchar *text, regmatch_t *match)
+{
+    GString *expanded = g_string_new("");
+    gchar   *result;
+
+    for (; *format; format++)
+    {
+        if (*format == '\\' && isdigit((guchar)format[1]))
+        {
+            gint n = *++format - '0';
+
+            if (match[n].rm_so >= 0)
+                g_string_sprintfa(expanded, "%.*s",
+                                  (gint)(match[n].rm_eo - match[n].rm_so),
+                                  text + match[n].rm_so);
+        }
+        else
+        {
+            g_string_append_c(expanded, *format);
+        }
+    }
+
+    result = expanded->str;
+    g_string_free(expanded, FALSE);
+
+    return result;
+}
+
+static gboolean prompt_current(CONNECTION_DATA *connection)
+{
+    return connection->notebook ==
+        gtk_notebook_get_current_page(GTK_NOTEBOOK(main_notebook));
+}
+
+/* Whether text from the mud, not ended by a newline, looks like a
+ * prompt, for muds that don't send GA or EOR
+ */
+gboolean prompt_match(gchar *text)
+{
+    gchar    *plain;
+    gboolean  found;
+
+    if (!prompts.loaded)
+        prompt_load();
+
+    if (!prompts.have_pattern)
+        return FALSE;
+
+    plain = prompt_plain(text);
+    found = !regexec(&prompts.pattern, plain, 0, NULL, 0);
+    g_free(plain);
+
+    return found;
+}
+
+/* Whether there is a pattern, so text not ended has to be looked at */
+gboolean prompt_have_pattern(void)
+{
+    if (!prompts.loaded)
+        prompt_load();
+
+    return prompts.have_pattern;
+}
+
+/* A prompt from the mud. Its triggers are run and the status bar set
+ * from it; returns TRUE if it was shown below the text, so it isn't to
+ * be shown in it
+ */
+gboolean prompt_show(CONNECTION_DATA *connection, gchar *prompt)
+{
+    regmatch_t  match[PROMPT_GROUPS];
+    GList      *tmp;
+    gchar      *plain;
+
+    if (!prompts.loaded)
+        prompt_load();
+
+    plain = prompt_plain(prompt);
+
+    if (prompts.status && prompts.have_pattern &&
+        !regexec(&prompts.pattern, plain, PROMPT_GROUPS, match, 0))
+    {
+        g_free(connection->prompt_status);
+        connection->prompt_status = prompt_expand(prompts.status, plain, match);
+
+        if (prompt_current(connection))
+        {
+            gtk_statusbar_pop(GTK_STATUSBAR(prompt_statusbar), prompts.context);
+            gtk_statusbar_push(GTK_STATUSBAR(prompt_statusbar), prompts.context,
+                               connection->prompt_status);
+        }
+    }
+
+    for (tmp = prompts.triggers; tmp != NULL; tmp = tmp->next)
+    {
+        PROMPT_TRIGGER *trigger = tmp->data;
+
+        if (!regexec(&trigger->pattern, plain, PROMPT_GROUPS, match, 0))
+        {
+            gchar *command = prompt_expand(trigger->command, plain, match);
+
+            action_send_to_connection(command, connection);
+            g_free(command);
+        }
+    }
+
+    if (!prompts.fixed)
+    {
+        g_free(plain);
+        return FALSE;
+    }
+
+    g_free(connection->prompt);
+    connection->prompt = plain;
+
+    if (prompt_current(connection))
+        gtk_label_set_text(GTK_LABEL(prompt_label), plain);
+
+    return TRUE;
+}
+
+/* Show the prompt and status of another connection, its page chosen */
+void prompt_switch(CONNECTION_DATA *connection)
+{
+    if (!prompts.loaded)
+        return;
+
+    if (prompts.fixed)
+        gtk_label_set_text(GTK_LABEL(prompt_label),
+                           connection->prompt ? connection->prompt : "");
+
+    if (prompts.status)
+    {
+        gtk_statusbar_pop(GTK_STATUSBAR(prompt_statusbar), prompts.context);
+        gtk_statusbar_push(GTK_STATUSBAR(prompt_statusbar), prompts.context,
+                           connection->prompt_status ? connection->prompt_status : "");
+    }
+}
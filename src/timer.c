@@ -0,0 +1,518 @@
+/* AMCL - A simple Mud CLient
+ * Copyright (C) 1998-1999 Robin Ericsson <lobbin@localhost.nu>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Commands sent after a while, once or over and over, and the timers
+ * of plugins, which call a function instead. They are kept in a timer
+ * wheel: five rings of 64 slots, the first a slot for each of the next
+ * 64 ticks, each one after a slot for every 64 slots of the one
+ * before. A timer goes in the first ring that reaches as far as it is
+ * due, and is moved down a ring each time the ring below has gone
+ * round, so adding or removing one is the same work however many
+ * there are. One gtk_timeout drives it all, set for when the soonest
+ * timer is due, so the ticks can be short without waking up for every
+ * one.
+ */
+
+#include "config.h"
+
+#include <gtk/gtk.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "amcl.h"
+
+static char const rcsid[] =
+    "$Id$";
+
+#define TIMER_TICK    10                /* ms                         */
+#define TIMER_BITS    6
+#define TIMER_SLOTS   (1 << TIMER_BITS)
+#define TIMER_MASK    (TIMER_SLOTS - 1)
+#define TIMER_RINGS   5
+#define TIMER_MAX     ((1 << (TIMER_BITS * TIMER_RINGS)) - 1)
+#define TIMER_SLEEP   (1 << (TIMER_BITS * 3))  /* Longest wait, ticks */
+
+typedef struct timer_data TIMER_DATA;
+
+struct timer_data {
+    TIMER_DATA      *next;
+    TIMER_DATA     **prev;              /* What points to this one    */
+    guint32          expires;           /* In ticks                   */
+    guint32          period;            /* 0 if only once             */
+    gint             id;
+    CONNECTION_DATA *connection;        /* NULL for a function's      */
+    gchar           *command;
+    GtkFunction      func;
+    gpointer         data;
+};
+
+static TIMER_DATA *timer_wheel[TIMER_RINGS][TIMER_SLOTS];
+static guint32     timer_ticks;         /* The next tick to be run    */
+static GHashTable *timer_table;         /* By id                      */
+static gint        timer_count;
+static gint        timer_last_id;
+static gint        timer_tag;
+static guint32     timer_due;           /* The tick it is set for     */
+static glong       timer_epoch;
+
+/* The time, in ticks */
+static guint32 timer_now (void)
+{
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+
+    if (!timer_epoch)
+        timer_epoch = tv.tv_sec;
+
+    return (tv.tv_sec - timer_epoch) * (1000 / TIMER_TICK)
+        + tv.tv_usec / (TIMER_TICK * 1000);
+}
+
+/* How long until tick begins, in ms */
+static glong timer_ms_until (guint32 tick)
+{
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+
+    return (gint32) (tick - timer_now ()) * TIMER_TICK
+        - tv.tv_usec / 1000 % TIMER_TICK;
+}
+
+static void timer_link (TIMER_DATA **slot, TIMER_DATA *t)
+{
+    t->next = *slot;
+    t->prev = slot;
+
+    if (*slot)
+        (*slot)->prev = &t->next;
+
+    *slot = t;
+}
+
+static void timer_unlink (TIMER_DATA *t)
+{
+    *t->prev = t->next;
+
+    if (t->next)
+        t->next->prev = t->prev;
+
+    t->next = NULL;
+    t->prev = NULL;
+}
+
+/* Put a timer in the slot of the ring that reaches as far as it is due */
+static void timer_insert (TIMER_DATA *t)
+{
+    guint32 due = t->expires - timer_ticks;
+    gint    ring;
+
+    if ((gint32) due < 0) {
+        t->expires = timer_ticks;
+        due = 0;
+    } else if (due > TIMER_MAX) {
+        t->expires = timer_ticks + TIMER_MAX;
+        due = TIMER_MAX;
+    }
+
+    for (ring = 0; ring < TIMER_RINGS - 1; ring++)
+        if (due < 1 << (TIMER_BITS * (ring + 1)))
+            break;
+
+    timer_link (&timer_wheel[ring][(t->expires >> (TIMER_BITS * ring)) & TIMER_MASK], t);
+}
+
+/* Move the timers of the slot due in ring down a ring, returning the
+ * slot, so the caller knows if this ring has gone round too
+ */
+static gint timer_cascade (gint ring)
+{
+    gint        slot = (timer_ticks >> (TIMER_BITS * ring)) & TIMER_MASK;
+    TIMER_DATA *list = timer_wheel[ring][slot];
+    TIMER_DATA *t;
+
+    timer_wheel[ring][slot] = NULL;
+
+    while ((t = list) != NULL) {
+        list = t->next;
+        timer_insert (t);
+    }
+
+    return slot;
+}
+
+static void timer_free (TIMER_DATA *t)
+{
+    g_hash_table_remove (timer_table, &t->id);
+
+    if (t->connection && t->connection->timer_tick == t->id)
+        t->connection->timer_tick = 0;
+
+    g_free (t->command);
+    g_free (t);
+    timer_count--;
+}
+
+/* When the soonest timer is due, or TIMER_SLEEP from now if later.
+ * The soonest of a ring are in the slot it has got to, or the next one
+ * after with timers: those in the slot it has got to may have been put
+ * there since it was moved down, to wait for the ring to go round
+ */
+static guint32 timer_next (void)
+{
+    guint32     next = timer_ticks + TIMER_SLEEP;
+    TIMER_DATA *first, *t;
+    gint        ring, slot, i;
+
+    for (ring = 0; ring < TIMER_RINGS; ring++) {
+        slot = (timer_ticks >> (TIMER_BITS * ring)) & TIMER_MASK;
+
+        for (i = 0; i < TIMER_SLOTS; i++) {
+            first = timer_wheel[ring][(slot + i) & TIMER_MASK];
+
+            for (t = first; t != NULL; t = t->next)
+                if ((gint32) (t->expires - next) < 0)
+                    next = t->expires;
+
+            if (first && i > 0)
+                break;
+        }
+    }
+
+    return next;
+}
+
+static gint timer_run (gpointer data);
+
+/* Set the one timeout for the next tick with something to do */
+static void timer_arm (void)
+{
+    if (timer_tag)
+        gtk_timeout_remove (timer_tag);
+
+    timer_tag = 0;
+
+    if (timer_count == 0)
+        return;
+
+    timer_due = timer_next ();
+    timer_tag = gtk_timeout_add (MAX (timer_ms_until (timer_due), 1),
+                                 timer_run, NULL);
+}
+
+/* Run every tick up to now. The timers of a slot are moved to a list
+ * of their own first, so a command that takes away another timer of
+ * the same slot takes it from there
+ */
+static gint timer_run (gpointer data)
+{
+    guint32     now = timer_now ();
+    TIMER_DATA *running;
+    TIMER_DATA *t;
+
+    /* This timeout is over; timers added while running set another */
+    timer_tag = 0;
+
+    while ((gint32) (now - timer_ticks) >= 0 && timer_count > 0) {
+        gint slot = timer_ticks & TIMER_MASK;
+        gint ring;
+
+        for (ring = 1; ring < TIMER_RINGS && slot == 0; ring++)
+            slot = timer_cascade (ring);
+
+        slot = timer_ticks & TIMER_MASK;
+        timer_ticks++;
+
+        running = NULL;
+
+        if (timer_wheel[0][slot]) {
+            running = timer_wheel[0][slot];
+            running->prev = &running;
+            timer_wheel[0][slot] = NULL;
+        }
+
+        while ((t = running) != NULL) {
+            CONNECTION_DATA *connection = t->connection;
+            GtkFunction      func       = t->func;
+            gpointer         func_data  = t->data;
+            gint             id         = t->id;
+            gchar           *command    = g_strdup (t->command);
+
+            timer_unlink (t);
+
+            if (t->period) {
+                /* From now if it is late, so it doesn't go off over
+                   and over to catch up */
+                t->expires += t->period;
+                if ((gint32) (t->expires - now) < 0)
+                    t->expires = now + t->period;
+                timer_insert (t);
+            } else {
+                timer_free (t);
+            }
+
+            if (func) {
+                if (!(* func) (func_data))
+                    timer_remove (id);
+            } else if (*command) {
+                /* A tick timer may be there just to be realigned */
+                action_send_to_connection (command, connection);
+            }
+
+            g_free (command);
+        }
+    }
+
+    timer_arm ();
+
+    return FALSE;
+}
+
+static TIMER_DATA *timer_new (glong ms, gboolean repeat)
+{
+    TIMER_DATA *t;
+    guint32     ticks;
+
+    if (timer_table == NULL)
+        timer_table = g_hash_table_new (g_int_hash, g_int_equal);
+
+    /* Nothing has moved the wheel on while it was empty */
+    if (timer_count == 0)
+        timer_ticks = timer_now ();
+
+    ticks = (ms + TIMER_TICK / 2) / TIMER_TICK;
+    if (ticks < 1)
+        ticks = 1;
+
+    t = g_new0 (TIMER_DATA, 1);
+    t->id      = ++timer_last_id;
+    t->period  = repeat ? ticks : 0;
+    t->expires = timer_now () + ticks;
+
+    return t;
+}
+
+static gint timer_start (TIMER_DATA *t)
+{
+    timer_insert (t);
+    g_hash_table_insert (timer_table, &t->id, t);
+    timer_count++;
+
+    if (!timer_tag || (gint32) (t->expires - timer_due) < 0)
+        timer_arm ();
+
+    return t->id;
+}
+
+/* Send command to connection in ms milliseconds, and every ms after
+ * that if repeat. Returns the timer's number
+ */
+gint timer_add (CONNECTION_DATA *connection, glong ms, gchar *command,
+                gboolean repeat)
+{
+    TIMER_DATA *t = timer_new (ms, repeat);
+
+    t->connection = connection;
+    t->command    = g_strdup (command);
+
+    return timer_start (t);
+}
+
+/* Call func(data) every ms milliseconds, for as long as it returns
+ * TRUE. Returns the timer's number, for timer_remove()
+ */
+gint timer_add_func (glong ms, GtkFunction func, gpointer data)
+{
+    TIMER_DATA *t = timer_new (ms, TRUE);
+
+    t->func = func;
+    t->data = data;
+
+    return timer_start (t);
+}
+
+gboolean timer_remove (gint id)
+{
+    TIMER_DATA *t;
+
+    if (timer_table == NULL
+        || (t = g_hash_table_lookup (timer_table, &id)) == NULL)
+        return FALSE;
+
+    timer_unlink (t);
+    timer_free (t);
+
+    return TRUE;
+}
+
+static gboolean timer_remove_connection_cb (gpointer key, gpointer value,
+                                            gpointer data)
+{
+    TIMER_DATA *t = value;
+
+    if (t->connection != data)
+        return FALSE;
+
+    timer_unlink (t);
+
+    if (t->connection->timer_tick == t->id)
+        t->connection->timer_tick = 0;
+
+    g_free (t->command);
+    g_free (t);
+    timer_count--;
+
+    return TRUE;
+}
+
+/* Take away the timers of a connection, when it is closed */
+void timer_remove_connection (CONNECTION_DATA *connection)
+{
+    if (timer_table)
+        g_hash_table_foreach_remove (timer_table, timer_remove_connection_cb,
+                                     connection);
+}
+
+/* Start the period of the tick timer of a connection again from now,
+ * to keep it in step with the mud's ticks
+ */
+static gboolean timer_realign (CONNECTION_DATA *connection)
+{
+    TIMER_DATA *t;
+
+    if (!connection->timer_tick
+        || (t = g_hash_table_lookup (timer_table, &connection->timer_tick)) == NULL)
+        return FALSE;
+
+    timer_unlink (t);
+    t->expires = timer_now () + t->period;
+    timer_insert (t);
+
+    return TRUE;
+}
+
+static void timer_list_cb (gpointer key, gpointer value, gpointer data)
+{
+    TIMER_DATA      *t = value;
+    CONNECTION_DATA *connection = data;
+    gchar            every[32] = "";
+    gchar           *line;
+
+    if (t->connection != connection)
+        return;
+
+    if (t->period)
+        g_snprintf (every, 31, ", then every %.2fs",
+                    t->period * TIMER_TICK / 1000.0);
+
+    line = g_strdup_printf ("*** Timer %d%s: in %.2fs%s: %s\n", t->id,
+                            t->id == connection->timer_tick ? " (tick)" : "",
+                            (gint32) (t->expires - timer_now ()) * TIMER_TICK / 1000.0,
+                            every, t->command);
+    textfield_add (connection->window, line, MESSAGE_NORMAL);
+    g_free (line);
+}
+
+/* The commands for timers, taken from what is sent before it goes to
+ * the mud, so they work typed, from aliases, from actions and from
+ * plugins:
+ *
+ *   #after SECONDS COMMAND     send COMMAND once, SECONDS from now
+ *   #every SECONDS COMMAND     send COMMAND every SECONDS
+ *   #tick SECONDS COMMAND      the same, as the connection's tick timer
+ *   #tick                      start the tick timer's period from now
+ *   #untimer NUMBER|all        take away timers
+ *   #timers                    list them
+ *
+ * text is what is left to send, from the start of a command. The
+ * others end at the next of separators, but the COMMAND of a timer is
+ * all the rest of the text, separators and all, so "#after 5 a;b"
+ * sends both later. Returns where what was used ends, or NULL for a
+ * command that isn't one of these, which is sent as it is.
+ */
+gchar *timer_command (CONNECTION_DATA *connection, gchar *text,
+                      gchar *separators, gboolean verbose)
+{
+    gchar   *word, *arg, *end;
+    gchar    buf[256];
+    gdouble  seconds;
+    gint     id, length;
+
+    if (text[0] != '#')
+        return NULL;
+
+    end    = text + strcspn (text, separators);
+    length = MIN (strcspn (text, " \t"), end - text);
+    word   = g_strndup (text, length);
+    arg    = text + length + strspn (text + length, " \t");
+
+    if (!strcmp (word, "#timers")) {
+        if (timer_table)
+            g_hash_table_foreach (timer_table, timer_list_cb, connection);
+    } else if (!strcmp (word, "#untimer")) {
+        if (!strncmp (arg, "all", 3)) {
+            timer_remove_connection (connection);
+        } else if ((id = atoi (arg)) <= 0 || !timer_remove (id)) {
+            g_snprintf (buf, 255, "*** No timer %d.\n", id);
+            textfield_add (connection->window, buf, MESSAGE_ERR);
+        }
+    } else if (!strcmp (word, "#tick") && strchr (separators, *arg) != NULL) {
+        if (!timer_realign (connection))
+            textfield_add (connection->window, "*** There is no tick timer.\n",
+                           MESSAGE_ERR);
+    } else if (!strcmp (word, "#after") || !strcmp (word, "#every")
+               || !strcmp (word, "#tick")) {
+        gchar *after;
+
+        seconds = strtod (arg, &after);
+
+        if (after == arg || seconds <= 0) {
+            g_snprintf (buf, 255, "*** Usage: %s SECONDS COMMAND\n", word);
+            textfield_add (connection->window, buf, MESSAGE_ERR);
+        } else {
+            gchar *command = g_strdup (after + strspn (after, " \t"));
+
+            g_strchomp (command);
+
+            if (word[1] == 't' && connection->timer_tick)
+                timer_remove (connection->timer_tick);
+
+            id = timer_add (connection, seconds * 1000, command, word[1] != 'a');
+
+            if (word[1] == 't')
+                connection->timer_tick = id;
+
+            if (verbose) {
+                g_snprintf (buf, 255, "*** Timer %d set.\n", id);
+                textfield_add (connection->window, buf, MESSAGE_NORMAL);
+            }
+
+            g_free (command);
+            end = text + strlen (text);
+        }
+    } else {
+        g_free (word);
+        return NULL;
+    }
+
+    g_free (word);
+    return end;
+}
@@ -219,6 +219,9 @@ void switch_page_cb (GtkNotebook *widget, gpointer data, guint nb_int, gpointer
     gtk_widget_set_sensitive (menu_main_close, FALSE);
   else
     gtk_widget_set_sensitive (menu_main_close, TRUE);
+
+  if (connections[nb_int])
+    prompt_switch (connections[nb_int]);
 }
 
 void textfield_add (GtkWidget *text_widget, gchar *message, gint colortype)
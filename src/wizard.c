@@ -46,8 +46,20 @@ static GList       *wizard_connection_list2;
 
 void free_connection_data (CONNECTION_DATA *c)
 {
+  /* Timers can be set while not connected, so disconnect() hasn't
+     always taken them away */
+  timer_remove_connection (c);
+
+  if (c->partial_wait)
+    gtk_timeout_remove (c->partial_wait);
+
+  if (c->partial)
+    g_string_free (c->partial, TRUE);
+
   g_free (c->host);
   g_free (c->port);
+  g_free (c->prompt);
+  g_free (c->prompt_status);
   g_free (c);
 }
 